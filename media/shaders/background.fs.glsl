@@ -0,0 +1,45 @@
+#version 330
+
+#define BACKGROUND_MAX_LAYERS 4
+
+// see RENDER_BLEND in render.hpp
+#define RENDER_BLEND_ALPHA 0
+#define RENDER_BLEND_ADDITIVE 1
+
+out vec4 color;
+
+// per layer: scroll velocity in pixels per second in .xy, offset in pixels in .zw
+uniform vec4 layer_scroll[BACKGROUND_MAX_LAYERS];
+// per layer: tile size in pixels in .xy, opacity in .z, RENDER_BLEND in .w
+uniform vec4 layer_tiles[BACKGROUND_MAX_LAYERS];
+uniform sampler2D layer_textures[BACKGROUND_MAX_LAYERS];
+uniform int layer_count;
+uniform float time;
+
+vec3 composite_layer(vec3 below, sampler2D layer_texture, int layer) {
+    if (layer >= layer_count) {
+        return below;
+    }
+
+    // the textures repeat, so scrolling is just an offset into them
+    vec2 pixel = gl_FragCoord.xy - layer_scroll[layer].zw - layer_scroll[layer].xy*time;
+    vec4 texel = texture(layer_texture, pixel/layer_tiles[layer].xy);
+    float opacity = texel.a*layer_tiles[layer].z;
+
+    if (int(layer_tiles[layer].w) == RENDER_BLEND_ADDITIVE) {
+        return below + texel.rgb*opacity;
+    }
+
+    return mix(below, texel.rgb, opacity);
+}
+
+void main() {
+    // sampler arrays only take constant indices in 330, so the layers are unrolled
+    vec3 result = vec3(0.0);
+    result = composite_layer(result, layer_textures[0], 0);
+    result = composite_layer(result, layer_textures[1], 1);
+    result = composite_layer(result, layer_textures[2], 2);
+    result = composite_layer(result, layer_textures[3], 3);
+
+    color = vec4(result, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+// one triangle that covers the screen, no vertex buffer needed
+const vec4 verts[3] = vec4[3](vec4(-1.0, -1.0, 1.0, 1.0),
+                              vec4( 3.0, -1.0, 1.0, 1.0),
+                              vec4(-1.0,  3.0, 1.0, 1.0));
+
+void main(void) {
+    gl_Position = verts[gl_VertexID];
+}
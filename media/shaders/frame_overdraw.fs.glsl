@@ -0,0 +1,15 @@
+#version 330
+
+// see OVERDRAW_STEP in render.hpp, the colours come from OVERDRAW_HEAT_COLORS in main.cpp
+#define OVERDRAW_HEAT_COUNT 8
+
+uniform sampler2D frame_texture;
+uniform vec3 heat_colors[OVERDRAW_HEAT_COUNT];
+in vec2 vs_uv;
+out vec4 color;
+
+void main() {
+    // the red channel counts the fragments shaded at this pixel, the last colour is everything past it
+    int count = int(texture(frame_texture, vs_uv).r*255.0 + 0.5);
+    color = vec4(heat_colors[min(count, OVERDRAW_HEAT_COUNT - 1)], 1.0);
+}
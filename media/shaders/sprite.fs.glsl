@@ -1,12 +1,58 @@
 #version 330
 
+#define SPRITE_FLAG_SDF 1
+#define SPRITE_FLAG_CUTOUT 4
+#define SPRITE_FLAG_PREMULTIPLIED 8
+
+// a cutout texel under this is a hole, anything else is opaque
+#define CUTOUT_ALPHA 0.5
+// blended texels this faint wouldn't change the 8 bit target anyway
+#define MIN_BLENDED_ALPHA (1.0/256.0)
+// see OVERDRAW_STEP in render.hpp
+#define OVERDRAW_STEP (1.0/255.0)
+
 in vec2 vs_uv;
+in vec4 vs_color;
+flat in int vs_flags;
 out vec4 color;
 
 uniform sampler2D sprite_texture;
+// RENDER_DEBUG_OVERDRAW, the target is blended with GL_ONE, GL_ONE
+uniform bool overdraw;
 // uniform sampler2D sprite_normal_texture;
 
 void main() {
 
-    color = texture(sprite_texture, vs_uv);
+    vec4 texel = texture(sprite_texture, vs_uv);
+
+    if ((vs_flags & SPRITE_FLAG_SDF) != 0) {
+        // glyph atlases store distance to the outline, 0.5 is the edge
+        float distance = texel.r;
+        float edge_width = max(fwidth(distance)*0.5, 0.0001);
+        float coverage = smoothstep(0.5 - edge_width, 0.5 + edge_width, distance);
+        color = vec4(vs_color.rgb, vs_color.a*coverage);
+    }
+    else {
+        color = texel*vs_color;
+    }
+
+    if ((vs_flags & SPRITE_FLAG_CUTOUT) != 0) {
+        if (color.a < CUTOUT_ALPHA) {
+            discard;
+        }
+        color.a = 1.0;
+    }
+    else if ((vs_flags & SPRITE_FLAG_PREMULTIPLIED) != 0) {
+        // additive light comes with no alpha, only a texel with nothing in it is empty
+        if (max(max(color.r, color.g), max(color.b, color.a)) < MIN_BLENDED_ALPHA) {
+            discard;
+        }
+    }
+    else if (color.a < MIN_BLENDED_ALPHA) {
+        discard;
+    }
+
+    if (overdraw) {
+        color = vec4(OVERDRAW_STEP, 0.0, 0.0, 0.0);
+    }
 }
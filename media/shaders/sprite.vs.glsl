@@ -14,14 +14,69 @@ const vec2 uvs[6] = vec2[6](vec2( 0.0, 1.0),
                             vec2( 0.0, 0.0),
                             vec2( 1.0, 0.0));
 
+#define SPRITE_FLAG_ANIMATED 2
+
+// loop modes, see ANIMATION_LOOP_MODE in animation.hpp
+#define ANIMATION_ONCE 0
+#define ANIMATION_LOOP 1
+#define ANIMATION_PING_PONG 2
+
+// per instance, see SpriteInstance in render.hpp
+layout(location = 0) in vec4 instance_basis;
+layout(location = 1) in vec4 instance_position;
+layout(location = 2) in vec4 instance_uv_rect;
+layout(location = 3) in vec4 instance_color;
+
 out vec2 vs_uv;
+out vec4 vs_color;
+flat out int vs_flags;
 
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
+
+// clip headers (first frame texel, frame count, fps, loop mode) then frame uv rects
+uniform samplerBuffer animation_clips;
+uniform float time;
+
+vec4 animation_frame_uv_rect(vec4 animation) {
+    vec4 clip = texelFetch(animation_clips, int(animation.x));
+    int frame_count = int(clip.y);
+
+    // a negative speed plays the clip backwards, mod() keeps negative frames in range
+    float frame_time = floor((time - animation.y)*animation.z*clip.z);
+    int frame = 0;
+
+    if (int(clip.w) == ANIMATION_ONCE) {
+        frame = clamp(int(frame_time), 0, frame_count - 1);
+    }
+    else if (int(clip.w) == ANIMATION_PING_PONG && frame_count > 1) {
+        int period = 2*frame_count - 2;
+        frame = int(mod(frame_time, float(period)));
+        if (frame >= frame_count) {
+            frame = period - frame;
+        }
+    }
+    else {
+        frame = int(mod(frame_time, float(frame_count)));
+    }
+
+    return texelFetch(animation_clips, int(clip.x) + frame);
+}
 
 void main(void) {
-    vs_uv = uvs[gl_VertexID];
-    mat4 mvp = projection * view * model;
-    gl_Position = mvp * verts[gl_VertexID];
+    vec4 corner = verts[gl_VertexID];
+    vec2 world = instance_basis.xy*corner.x + instance_basis.zw*corner.y + instance_position.xy;
+
+    int flags = int(instance_position.w);
+
+    vec4 uv_rect = instance_uv_rect;
+    if ((flags & SPRITE_FLAG_ANIMATED) != 0) {
+        uv_rect = animation_frame_uv_rect(instance_uv_rect);
+    }
+
+    vs_uv = uv_rect.xy + uvs[gl_VertexID]*uv_rect.zw;
+    vs_color = instance_color;
+    vs_flags = flags;
+
+    gl_Position = projection * view * vec4(world, instance_position.z, 1.0);
 }
@@ -0,0 +1,260 @@
+#include "animation.hpp"
+
+static const char *find_text(const char *begin, const char *end, const char *needle)
+{
+    size_t length = SDL_strlen(needle);
+    for (const char *c = begin; c + length <= end; ++c) {
+        if (memcmp(c, needle, length) == 0) {
+            return c;
+        }
+    }
+
+    return nullptr;
+}
+
+
+// whole attribute names only, so looking up x never matches the end of "index"
+static bool read_xml_attribute(const char *tag, const char *tag_end, const char *attribute, char *value, int size)
+{
+    size_t length = SDL_strlen(attribute);
+
+    for (const char *c = tag + 1; c + length + 2 <= tag_end; ++c) {
+        if (!SDL_isspace((unsigned char)c[-1]) || memcmp(c, attribute, length) != 0 || c[length] != '=' || c[length + 1] != '"') {
+            continue;
+        }
+
+        const char *start = c + length + 2;
+        const char *quote = start;
+        while (quote < tag_end && *quote != '"') {
+            ++quote;
+        }
+
+        int copied = (int)(quote - start) < size - 1 ? (int)(quote - start) : size - 1;
+        memcpy(value, start, copied);
+        value[copied] = '\0';
+        return true;
+    }
+
+    return false;
+}
+
+
+bool load_texture_atlas(TextureAtlas *atlas, Vfs *vfs, Texture *texture, const char *path)
+{
+    if (atlas == nullptr || texture == nullptr) {
+        LOG_ERROR(LOG_RENDER, "cannot load an atlas without a texture: %s", path);
+        return false;
+    }
+
+    memset(atlas, 0, sizeof(TextureAtlas));
+    atlas->texture = texture;
+
+    FileView file;
+    if (!open_file_view(vfs, path, &file)) {
+        LOG_ERROR(LOG_RENDER, "Could not open texture atlas: %s", path);
+        return false;
+    }
+
+    const char *end = (const char *)file.data + file.size;
+    const char *tag = find_text((const char *)file.data, end, "<SubTexture");
+
+    while (tag) {
+        const char *tag_end = find_text(tag, end, ">");
+        if (tag_end == nullptr) {
+            break;
+        }
+
+        if (atlas->region_count >= ATLAS_MAX_REGIONS) {
+            LOG_WARN(LOG_RENDER, "Texture atlas %s has more than %d regions, the rest are skipped", path, ATLAS_MAX_REGIONS);
+            break;
+        }
+
+        AtlasRegion *region = &atlas->regions[atlas->region_count];
+        char number[16];
+        bool valid = read_xml_attribute(tag, tag_end, "name", region->name, ENTITY_NAME_LENGTH);
+
+        valid = valid && read_xml_attribute(tag, tag_end, "x", number, sizeof(number));
+        region->offset.x = (float)SDL_atoi(number);
+        valid = valid && read_xml_attribute(tag, tag_end, "y", number, sizeof(number));
+        region->offset.y = (float)SDL_atoi(number);
+        valid = valid && read_xml_attribute(tag, tag_end, "width", number, sizeof(number));
+        region->size.x = (float)SDL_atoi(number);
+        valid = valid && read_xml_attribute(tag, tag_end, "height", number, sizeof(number));
+        region->size.y = (float)SDL_atoi(number);
+
+        if (valid) {
+            atlas->region_count += 1;
+        }
+        else {
+            LOG_WARN(LOG_RENDER, "Skipping a malformed region in texture atlas %s", path);
+        }
+
+        tag = find_text(tag_end, end, "<SubTexture");
+    }
+
+    close_file_view(vfs, &file);
+
+    LOG_INFO(LOG_RENDER, "Loaded texture atlas: %s, %d regions", path, atlas->region_count);
+
+    return true;
+}
+
+
+AtlasRegion *find_atlas_region(TextureAtlas *atlas, const char *name)
+{
+    for (int i = 0; i < atlas->region_count; ++i) {
+        if (SDL_strncmp(atlas->regions[i].name, name, ENTITY_NAME_LENGTH) == 0) {
+            return &atlas->regions[i];
+        }
+    }
+
+    return nullptr;
+}
+
+
+glm::vec4 get_atlas_uv_rect(TextureAtlas *atlas, AtlasRegion *region)
+{
+    // rows are uploaded top down, the sprite quad samples bottom up
+    glm::vec2 atlas_size = atlas->texture->image_size;
+    return glm::vec4(region->offset.x/atlas_size.x, (region->offset.y + region->size.y)/atlas_size.y,
+                     region->size.x/atlas_size.x, -region->size.y/atlas_size.y);
+}
+
+
+void init_animation_library(AnimationLibrary *library)
+{
+    if (library == nullptr) {
+        LOG_ERROR(LOG_RENDER, "animation library is null");
+        exit(1);
+    }
+
+    memset(library, 0, sizeof(AnimationLibrary));
+
+    glGenBuffers(1, &library->buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, library->buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(library->texels), nullptr, GL_STATIC_DRAW);
+
+    glGenTextures(1, &library->buffer_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, library->buffer_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, library->buffer);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+
+AnimationClipId add_animation_clip(AnimationLibrary *library, const char *name, TextureAtlas *atlas,
+                                   const char **frame_names, int frame_count, float fps, ANIMATION_LOOP_MODE loop_mode)
+{
+    if (library->clip_count >= ANIMATION_MAX_CLIPS) {
+        LOG_ERROR(LOG_RENDER, "Too many animation clips, cannot add %s", name);
+        return INVALID_ANIMATION_CLIP;
+    }
+
+    if (frame_count <= 0 || fps <= 0.f || library->frame_count + frame_count > ANIMATION_MAX_FRAMES) {
+        LOG_ERROR(LOG_RENDER, "Animation clip %s needs 1 to %d frames and a positive frame rate",
+                  name, ANIMATION_MAX_FRAMES - library->frame_count);
+        return INVALID_ANIMATION_CLIP;
+    }
+
+    AnimationClipId id = library->clip_count;
+    AnimationClip *clip = &library->clips[id];
+    memset(clip, 0, sizeof(AnimationClip));
+
+    SDL_strlcpy(clip->name, name, ENTITY_NAME_LENGTH);
+    clip->texture = atlas->texture;
+    clip->first_frame = ANIMATION_MAX_CLIPS + library->frame_count;
+    clip->frame_count = frame_count;
+    clip->fps = fps;
+    clip->loop_mode = loop_mode;
+
+    for (int i = 0; i < frame_count; ++i) {
+        AtlasRegion *region = find_atlas_region(atlas, frame_names[i]);
+        if (region == nullptr) {
+            LOG_ERROR(LOG_RENDER, "Animation clip %s: no atlas region named %s", name, frame_names[i]);
+            return INVALID_ANIMATION_CLIP;
+        }
+
+        library->texels[clip->first_frame + i] = get_atlas_uv_rect(atlas, region);
+        clip->frame_size = glm::max(clip->frame_size, region->size);
+    }
+
+    library->texels[id] = glm::vec4((float)clip->first_frame, (float)frame_count, fps, (float)loop_mode);
+
+    library->clip_count += 1;
+    library->frame_count += frame_count;
+    library->dirty = true;
+
+    return id;
+}
+
+
+AnimationClipId add_animation_clip_sequence(AnimationLibrary *library, const char *name, TextureAtlas *atlas,
+                                            const char *frame_pattern, int first, int last, float fps, ANIMATION_LOOP_MODE loop_mode)
+{
+    char names[ANIMATION_MAX_CLIP_FRAMES][ENTITY_NAME_LENGTH];
+    const char *frame_names[ANIMATION_MAX_CLIP_FRAMES];
+
+    int frame_count = last - first + 1;
+    if (frame_count <= 0 || frame_count > ANIMATION_MAX_CLIP_FRAMES) {
+        LOG_ERROR(LOG_RENDER, "Animation clip %s has an invalid frame range %d to %d", name, first, last);
+        return INVALID_ANIMATION_CLIP;
+    }
+
+    for (int i = 0; i < frame_count; ++i) {
+        SDL_snprintf(names[i], ENTITY_NAME_LENGTH, frame_pattern, first + i);
+        frame_names[i] = names[i];
+    }
+
+    return add_animation_clip(library, name, atlas, frame_names, frame_count, fps, loop_mode);
+}
+
+
+AnimationClipId find_animation_clip(AnimationLibrary *library, const char *name)
+{
+    for (int i = 0; i < library->clip_count; ++i) {
+        if (SDL_strncmp(library->clips[i].name, name, ENTITY_NAME_LENGTH) == 0) {
+            return i;
+        }
+    }
+
+    return INVALID_ANIMATION_CLIP;
+}
+
+
+AnimationClip *get_animation_clip(AnimationLibrary *library, AnimationClipId clip)
+{
+    if (library == nullptr || clip < 0 || clip >= library->clip_count) {
+        return nullptr;
+    }
+
+    return &library->clips[clip];
+}
+
+
+float get_animation_clip_duration(AnimationLibrary *library, AnimationClipId clip, float speed)
+{
+    AnimationClip *found = get_animation_clip(library, clip);
+    if (found == nullptr || speed == 0.f) {
+        return 0.f;
+    }
+
+    return found->frame_count/(found->fps*fabsf(speed));
+}
+
+
+void bind_animation_clips(AnimationLibrary *library)
+{
+    if (library->dirty) {
+        // clips are defined at load time, after that the table never changes
+        glBindBuffer(GL_TEXTURE_BUFFER, library->buffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, (ANIMATION_MAX_CLIPS + library->frame_count)*sizeof(glm::vec4), library->texels);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        library->dirty = false;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + ANIMATION_CLIP_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, library->buffer_texture);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "types.h"
+#include "render.hpp"
+#include "vfs.hpp"
+
+// Flipbook clips are frame lists over a texture atlas. The whole clip table
+// lives in one texture buffer and the sprite vertex shader picks the frame
+// from the time uniform, so an animated sprite only carries its clip, start
+// time and speed, and the CPU never touches it again after spawning it.
+#define ATLAS_MAX_REGIONS 512
+
+#define ANIMATION_MAX_CLIPS 64
+#define ANIMATION_MAX_FRAMES 1024
+#define ANIMATION_MAX_CLIP_FRAMES 64
+#define ANIMATION_CLIP_TEXTURE_UNIT 1
+
+#define INVALID_ANIMATION_CLIP -1
+
+typedef int AnimationClipId;
+
+// matches the loop modes read by sprite.vs.glsl
+enum ANIMATION_LOOP_MODE {
+    ANIMATION_ONCE,      // holds the last frame
+    ANIMATION_LOOP,
+    ANIMATION_PING_PONG
+};
+
+// in atlas pixels, y down from the top left like the atlas description
+struct AtlasRegion {
+    char name[ENTITY_NAME_LENGTH];
+    glm::vec2 offset;
+    glm::vec2 size;
+};
+
+struct TextureAtlas {
+    Texture *texture;
+
+    int region_count;
+    AtlasRegion regions[ATLAS_MAX_REGIONS];
+};
+
+struct AnimationClip {
+    char name[ENTITY_NAME_LENGTH];
+    Texture *texture;
+
+    int first_frame;
+    int frame_count;
+    float fps;
+    ANIMATION_LOOP_MODE loop_mode;
+
+    // the largest frame, in pixels, a good default size for the sprite
+    glm::vec2 frame_size;
+};
+
+// Texel layout: one header per clip, (first frame texel, frame count, fps,
+// loop mode), then every clip's frame uv rects from ANIMATION_MAX_CLIPS on.
+struct AnimationLibrary {
+    GLuint buffer;
+    GLuint buffer_texture;
+    bool dirty;
+
+    int clip_count;
+    AnimationClip clips[ANIMATION_MAX_CLIPS];
+
+    int frame_count;
+    glm::vec4 texels[ANIMATION_MAX_CLIPS + ANIMATION_MAX_FRAMES];
+};
+
+// reads the <SubTexture name x y width height/> entries of a TextureAtlas xml
+bool load_texture_atlas(TextureAtlas *atlas, Vfs *vfs, Texture *texture, const char *path);
+AtlasRegion *find_atlas_region(TextureAtlas *atlas, const char *name);
+
+// flipped vertically like every uv rect the sprite shader gets, so the region shows upright
+glm::vec4 get_atlas_uv_rect(TextureAtlas *atlas, AtlasRegion *region);
+
+void init_animation_library(AnimationLibrary *library);
+
+AnimationClipId add_animation_clip(AnimationLibrary *library, const char *name, TextureAtlas *atlas,
+                                   const char **frame_names, int frame_count, float fps, ANIMATION_LOOP_MODE loop_mode);
+
+// frames named by a printf pattern, "fire%02d.png" from 1 to 7 is fire01.png ... fire07.png
+AnimationClipId add_animation_clip_sequence(AnimationLibrary *library, const char *name, TextureAtlas *atlas,
+                                            const char *frame_pattern, int first, int last, float fps, ANIMATION_LOOP_MODE loop_mode);
+
+AnimationClipId find_animation_clip(AnimationLibrary *library, const char *name);
+AnimationClip *get_animation_clip(AnimationLibrary *library, AnimationClipId clip);
+
+// seconds until a clip played once reaches its last frame
+float get_animation_clip_duration(AnimationLibrary *library, AnimationClipId clip, float speed = 1.f);
+
+// uploads the table if clips were added since the last call
+void bind_animation_clips(AnimationLibrary *library);
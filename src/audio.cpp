@@ -0,0 +1,791 @@
+#include "audio.hpp"
+
+static bool push_audio_command(AudioSystem *audio, AudioCommand *command)
+{
+    if (audio == nullptr || audio->device == 0) {
+        return false;
+    }
+
+    AudioCommandQueue *queue = &audio->commands;
+    Uint32 write = (Uint32)SDL_AtomicGet(&queue->write_index);
+    Uint32 read = (Uint32)SDL_AtomicGet(&queue->read_index);
+
+    if (write - read >= AUDIO_COMMAND_QUEUE_SIZE) {
+        SDL_AtomicAdd(&audio->stats.commands_dropped, 1);
+        return false;
+    }
+
+    queue->commands[write & (AUDIO_COMMAND_QUEUE_SIZE - 1)] = *command;
+
+    // publishing the index is the release, the callback never sees a half written command
+    SDL_AtomicSet(&queue->write_index, (int)(write + 1));
+    return true;
+}
+
+
+static void fade_music_stream(AudioSystem *audio, MusicStream *stream, AudioCommand *command)
+{
+    // a fade out for a track that is still loading is applied when it starts
+    if (!stream->mixing || stream->generation != command->music_generation) {
+        if (command->gain <= 0.f) {
+            stream->stop_generation = command->music_generation;
+        }
+        return;
+    }
+
+    int fade_frames = (int)(command->fade_s * audio->sample_rate);
+    stream->gain_target = command->gain;
+    stream->gain_step = fade_frames > 0 ? (command->gain - stream->gain)/fade_frames : (command->gain - stream->gain);
+}
+
+
+static void finish_music_stream(MusicStream *stream)
+{
+    stream->mixing = false;
+    SDL_AtomicSet(&stream->state, MUSIC_FINISHED);
+}
+
+
+// Resamples the stream's ring into the mix buffers. Short of data is an
+// underrun, the rest of the buffer stays silent for this stream.
+static void mix_music_stream(AudioSystem *audio, MusicStream *stream, int frames)
+{
+    if (SDL_AtomicGet(&stream->stop_requested)) {
+        finish_music_stream(stream);
+        return;
+    }
+
+    if (!stream->mixing) {
+        if (stream->stop_generation == stream->generation) {
+            finish_music_stream(stream);
+            return;
+        }
+
+        stream->mixing = true;
+        stream->read_position = (double)(Uint32)SDL_AtomicGet(&stream->frames_read);
+        stream->gain = 0.f;
+        stream->gain_target = 1.f;
+        stream->gain_step = stream->fade_in_frames > 0 ? 1.f/stream->fade_in_frames : 1.f;
+    }
+
+    const double step = (double)stream->sample_rate / audio->sample_rate;
+    const Uint32 written = (Uint32)SDL_AtomicGet(&stream->frames_written);
+    const float *ring = stream->ring;
+
+    float *left = audio->mix_left;
+    float *right = audio->mix_right;
+
+    for (int i = 0; i < frames; ++i) {
+        Uint32 base = (Uint32)(Uint64)stream->read_position;
+
+        if ((Sint32)(written - (base + 1)) <= 0) {
+            if (SDL_AtomicGet(&stream->end_of_stream)) {
+                finish_music_stream(stream);
+                return;
+            }
+
+            SDL_AtomicAdd(&stream->underruns, 1);
+            break;
+        }
+
+        float t = (float)(stream->read_position - (double)(Uint64)base);
+        const float *a = ring + (base & (MUSIC_RING_FRAMES - 1))*2;
+        const float *b = ring + ((base + 1) & (MUSIC_RING_FRAMES - 1))*2;
+
+        left[i] += (a[0] + (b[0] - a[0])*t) * stream->gain;
+        right[i] += (a[1] + (b[1] - a[1])*t) * stream->gain;
+
+        if (stream->gain != stream->gain_target) {
+            stream->gain += stream->gain_step;
+            if ((stream->gain_step > 0.f && stream->gain >= stream->gain_target) ||
+                (stream->gain_step < 0.f && stream->gain <= stream->gain_target))
+            {
+                stream->gain = stream->gain_target;
+            }
+        }
+
+        stream->read_position += step;
+    }
+
+    SDL_AtomicSet(&stream->frames_read, (int)(Uint32)(Uint64)stream->read_position);
+
+    if (stream->gain_target <= 0.f && stream->gain <= 0.f) {
+        finish_music_stream(stream);
+    }
+}
+
+
+static void close_music_stream(AudioSystem *audio, MusicStream *stream)
+{
+    // the decoder lives in decoder_memory, there is nothing to close
+    stream->decoder = nullptr;
+    close_file_view(audio->vfs, &stream->file);
+
+    SDL_AtomicSet(&stream->stop_requested, 0);
+    SDL_AtomicSet(&stream->end_of_stream, 0);
+    SDL_AtomicSet(&stream->state, MUSIC_IDLE);
+}
+
+
+// Decodes into the free part of the ring, wrapping to the loop start at the
+// loop end (or end of file). Worker thread only.
+static void fill_music_stream(MusicStream *stream)
+{
+    if (SDL_AtomicGet(&stream->end_of_stream)) {
+        return;
+    }
+
+    for (;;) {
+        Uint32 written = (Uint32)SDL_AtomicGet(&stream->frames_written);
+        Uint32 read = (Uint32)SDL_AtomicGet(&stream->frames_read);
+        Uint32 free_frames = MUSIC_RING_FRAMES - (written - read);
+
+        if (free_frames < MUSIC_DECODE_CHUNK_FRAMES) {
+            return;
+        }
+
+        int wanted = MUSIC_DECODE_CHUNK_FRAMES;
+        if (stream->loop_end > 0 && stream->decode_position + wanted > stream->loop_end) {
+            wanted = (int)(stream->loop_end - stream->decode_position);
+        }
+
+        int decoded = wanted > 0 ? decode_vorbis_frames(stream->decoder, stream->decode_chunk, stream->channels, wanted) : 0;
+
+        if (decoded <= 0) {
+            if (!stream->loop) {
+                SDL_AtomicSet(&stream->end_of_stream, 1);
+                return;
+            }
+
+            if (!seek_vorbis(stream->decoder, stream->loop_start)) {
+                LOG_ERROR(LOG_AUDIO, "Could not seek music to loop start: %s", stream->path);
+                SDL_AtomicSet(&stream->end_of_stream, 1);
+                return;
+            }
+
+            stream->decode_position = stream->loop_start;
+            continue;
+        }
+
+        for (int i = 0; i < decoded; ++i) {
+            float *frame = stream->ring + ((written + i) & (MUSIC_RING_FRAMES - 1))*2;
+            const float *source = stream->decode_chunk + i*stream->channels;
+            frame[0] = source[0];
+            frame[1] = stream->channels > 1 ? source[1] : source[0];
+        }
+
+        stream->decode_position += decoded;
+        SDL_AtomicSet(&stream->frames_written, (int)(written + decoded));
+    }
+}
+
+
+static bool open_music_stream(AudioSystem *audio, MusicStream *stream, MusicRequest *request)
+{
+    if (!open_file_view(audio->vfs, request->path, &stream->file)) {
+        LOG_ERROR(LOG_AUDIO, "Could not find music %s", request->path);
+        return false;
+    }
+
+    // the decoder lives in a fixed buffer, opening a track never touches the heap
+    int error = VORBIS_OK;
+    stream->decoder = open_vorbis(stream->file.data, (int)stream->file.size, stream->decoder_memory, MUSIC_DECODER_MEMORY, &error);
+    if (stream->decoder == nullptr) {
+        LOG_ERROR(LOG_AUDIO, "Could not open music %s (%s)", request->path, get_vorbis_error_name(error));
+        close_file_view(audio->vfs, &stream->file);
+        return false;
+    }
+
+    if (stream->decoder->channels > 2) {
+        LOG_ERROR(LOG_AUDIO, "Only mono and stereo music is supported: %s", request->path);
+        stream->decoder = nullptr;
+        close_file_view(audio->vfs, &stream->file);
+        return false;
+    }
+
+    SDL_strlcpy(stream->path, request->path, MUSIC_PATH_LENGTH);
+    stream->channels = stream->decoder->channels;
+    stream->sample_rate = stream->decoder->sample_rate;
+    stream->loop = request->loop;
+    stream->loop_start = request->loop_start;
+    stream->loop_end = request->loop_end;
+    stream->decode_position = 0;
+    stream->fade_in_frames = (int)(request->fade_in_s * audio->sample_rate);
+    stream->generation = request->generation;
+
+    SDL_AtomicSet(&stream->frames_written, 0);
+    SDL_AtomicSet(&stream->frames_read, 0);
+    SDL_AtomicSet(&stream->end_of_stream, 0);
+    SDL_AtomicSet(&stream->stop_requested, 0);
+
+    fill_music_stream(stream);
+    return true;
+}
+
+
+static int SDLCALL music_thread_main(void *userdata)
+{
+    AudioSystem *audio = (AudioSystem*)userdata;
+    MusicRequestQueue *queue = &audio->music_requests;
+
+    while (!SDL_AtomicGet(&audio->music_thread_quit)) {
+        for (int s = 0; s < MUSIC_STREAMS; ++s) {
+            MusicStream *stream = &audio->music[s];
+            int state = SDL_AtomicGet(&stream->state);
+
+            if (state == MUSIC_PLAYING) {
+                fill_music_stream(stream);
+            }
+            else if (state == MUSIC_FINISHED) {
+                close_music_stream(audio, stream);
+            }
+        }
+
+        Uint32 read = (Uint32)SDL_AtomicGet(&queue->read_index);
+        Uint32 write = (Uint32)SDL_AtomicGet(&queue->write_index);
+
+        if (read != write) {
+            MusicRequest *request = &queue->requests[read & (MUSIC_REQUEST_QUEUE_SIZE - 1)];
+            MusicStream *stream = &audio->music[request->stream];
+            int state = SDL_AtomicGet(&stream->state);
+
+            // the stream is still playing out, ask the callback to let go and retry next pass
+            if (state != MUSIC_IDLE) {
+                if (state == MUSIC_PLAYING) {
+                    SDL_AtomicSet(&stream->stop_requested, 1);
+                }
+                SDL_Delay(1);
+                continue;
+            }
+
+            if (request->path[0] != '\0') {
+                SDL_AtomicSet(&stream->state, MUSIC_LOADING);
+                if (open_music_stream(audio, stream, request)) {
+                    SDL_AtomicSet(&stream->state, MUSIC_PLAYING);
+                }
+                else {
+                    SDL_AtomicSet(&stream->state, MUSIC_IDLE);
+                }
+            }
+
+            SDL_AtomicSet(&queue->read_index, (int)(read + 1));
+            continue;
+        }
+
+        SDL_Delay(MUSIC_WORKER_SLEEP_MS);
+    }
+
+    for (int s = 0; s < MUSIC_STREAMS; ++s) {
+        close_music_stream(audio, &audio->music[s]);
+    }
+
+    return 0;
+}
+
+
+bool play_music(AudioSystem *audio, const char *path, float crossfade_s, bool loop, Uint32 loop_start, Uint32 loop_end)
+{
+    if (audio == nullptr || audio->device == 0) {
+        return false;
+    }
+
+    MusicRequestQueue *queue = &audio->music_requests;
+    Uint32 write = (Uint32)SDL_AtomicGet(&queue->write_index);
+    Uint32 read = (Uint32)SDL_AtomicGet(&queue->read_index);
+
+    if (write - read >= MUSIC_REQUEST_QUEUE_SIZE) {
+        SDL_AtomicAdd(&audio->stats.commands_dropped, 1);
+        return false;
+    }
+
+    // the new track goes into the other stream while the current one fades out
+    stop_music(audio, crossfade_s);
+
+    int stream = (audio->current_music_stream + 1) % MUSIC_STREAMS;
+
+    MusicRequest *request = &queue->requests[write & (MUSIC_REQUEST_QUEUE_SIZE - 1)];
+    SDL_strlcpy(request->path, path, MUSIC_PATH_LENGTH);
+    request->stream = stream;
+    request->loop = loop;
+    request->loop_start = loop_start;
+    request->loop_end = loop_end;
+    request->fade_in_s = crossfade_s;
+    request->generation = ++audio->music_generation;
+
+    SDL_AtomicSet(&queue->write_index, (int)(write + 1));
+
+    audio->current_music_stream = stream;
+    return true;
+}
+
+
+bool stop_music(AudioSystem *audio, float fade_s)
+{
+    if (audio == nullptr || audio->device == 0 || audio->current_music_stream < 0) {
+        return false;
+    }
+
+    AudioCommand command;
+    memset(&command, 0, sizeof(AudioCommand));
+    command.type = AUDIO_COMMAND_MUSIC_FADE;
+    command.music_stream = audio->current_music_stream;
+    command.music_generation = audio->music_generation;
+    command.gain = 0.f;
+    command.fade_s = fade_s;
+
+    return push_audio_command(audio, &command);
+}
+
+static void start_voice(AudioSystem *audio, AudioCommand *command)
+{
+    AudioVoice *voice = nullptr;
+
+    for (int i = 0; i < AUDIO_MAX_VOICES; ++i) {
+        if (!audio->voices[i].active) {
+            voice = &audio->voices[i];
+            break;
+        }
+    }
+
+    // every voice busy: steal the one that has been playing longest
+    if (voice == nullptr) {
+        voice = &audio->voices[0];
+        for (int i = 1; i < AUDIO_MAX_VOICES; ++i) {
+            if ((Sint32)(audio->voices[i].serial - voice->serial) < 0) {
+                voice = &audio->voices[i];
+            }
+        }
+        SDL_AtomicAdd(&audio->stats.voices_stolen, 1);
+    }
+
+    AudioSample *sample = &audio->sounds[command->sound];
+
+    float pan = command->pan < -1.f ? -1.f : (command->pan > 1.f ? 1.f : command->pan);
+    float angle = (pan + 1.f) * 0.25f * (float)M_PI;
+
+    voice->active = true;
+    voice->sound = command->sound;
+    voice->position = 0.0;
+    voice->step = ((double)sample->sample_rate / audio->sample_rate) * command->pitch;
+    voice->gain_left = command->gain * cosf(angle);
+    voice->gain_right = command->gain * sinf(angle);
+    voice->serial = audio->voice_serial++;
+}
+
+
+static void process_audio_commands(AudioSystem *audio)
+{
+    AudioCommandQueue *queue = &audio->commands;
+    Uint32 read = (Uint32)SDL_AtomicGet(&queue->read_index);
+    Uint32 write = (Uint32)SDL_AtomicGet(&queue->write_index);
+
+    while (read != write) {
+        AudioCommand *command = &queue->commands[read & (AUDIO_COMMAND_QUEUE_SIZE - 1)];
+
+        switch(command->type) {
+            case AUDIO_COMMAND_PLAY:
+            {
+                start_voice(audio, command);
+                break;
+            }
+            case AUDIO_COMMAND_STOP_ALL:
+            {
+                for (int i = 0; i < AUDIO_MAX_VOICES; ++i) {
+                    audio->voices[i].active = false;
+                }
+                break;
+            }
+            case AUDIO_COMMAND_MASTER_GAIN:
+            {
+                audio->master_gain = command->gain;
+                break;
+            }
+            case AUDIO_COMMAND_MUSIC_FADE:
+            {
+                fade_music_stream(audio, &audio->music[command->music_stream], command);
+                break;
+            }
+        }
+
+        read += 1;
+    }
+
+    SDL_AtomicSet(&queue->read_index, (int)read);
+}
+
+
+// Resamples one voice with linear interpolation and accumulates it into the
+// planar mix buffers. Returns false once the voice has played out.
+static bool mix_voice(AudioSystem *audio, AudioVoice *voice, int frames)
+{
+    AudioSample *sample = &audio->sounds[voice->sound];
+    const float *source = sample->frames;
+    const int channels = sample->channels;
+    const double end = (double)sample->frame_count;
+    const float step = (float)voice->step;
+
+    float *left = audio->mix_left;
+    float *right = audio->mix_right;
+    int i = 0;
+
+#if AUDIO_SIMD_SSE2
+    const __m128 lanes = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+    const __m128 steps = _mm_mul_ps(lanes, _mm_set1_ps(step));
+    const __m128 gain_left = _mm_set1_ps(voice->gain_left);
+    const __m128 gain_right = _mm_set1_ps(voice->gain_right);
+
+    // four output frames at a time while all four stay inside the sample
+    while (i + 4 <= frames && voice->position + 3.0*voice->step < end) {
+        int base = (int)voice->position;
+        __m128 offsets = _mm_add_ps(_mm_set1_ps((float)(voice->position - base)), steps);
+        __m128i whole = _mm_cvttps_epi32(offsets);
+        __m128 t = _mm_sub_ps(offsets, _mm_cvtepi32_ps(whole));
+
+        int index[4];
+        _mm_storeu_si128((__m128i*)index, whole);
+
+        const float *f0 = source + (base + index[0])*channels;
+        const float *f1 = source + (base + index[1])*channels;
+        const float *f2 = source + (base + index[2])*channels;
+        const float *f3 = source + (base + index[3])*channels;
+
+        __m128 out_left;
+        __m128 out_right;
+
+        if (channels == 1) {
+            __m128 a = _mm_set_ps(f3[0], f2[0], f1[0], f0[0]);
+            __m128 b = _mm_set_ps(f3[1], f2[1], f1[1], f0[1]);
+            __m128 v = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+            out_left = _mm_mul_ps(v, gain_left);
+            out_right = _mm_mul_ps(v, gain_right);
+        }
+        else {
+            __m128 al = _mm_set_ps(f3[0], f2[0], f1[0], f0[0]);
+            __m128 bl = _mm_set_ps(f3[2], f2[2], f1[2], f0[2]);
+            __m128 ar = _mm_set_ps(f3[1], f2[1], f1[1], f0[1]);
+            __m128 br = _mm_set_ps(f3[3], f2[3], f1[3], f0[3]);
+            out_left = _mm_mul_ps(_mm_add_ps(al, _mm_mul_ps(_mm_sub_ps(bl, al), t)), gain_left);
+            out_right = _mm_mul_ps(_mm_add_ps(ar, _mm_mul_ps(_mm_sub_ps(br, ar), t)), gain_right);
+        }
+
+        _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), out_left));
+        _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), out_right));
+
+        voice->position += 4.0*voice->step;
+        i += 4;
+    }
+#endif
+
+    while (i < frames && voice->position < end) {
+        int base = (int)voice->position;
+        float t = (float)(voice->position - base);
+        const float *f = source + base*channels;
+
+        if (channels == 1) {
+            float v = f[0] + (f[1] - f[0])*t;
+            left[i] += v * voice->gain_left;
+            right[i] += v * voice->gain_right;
+        }
+        else {
+            left[i] += (f[0] + (f[2] - f[0])*t) * voice->gain_left;
+            right[i] += (f[1] + (f[3] - f[1])*t) * voice->gain_right;
+        }
+
+        voice->position += voice->step;
+        i += 1;
+    }
+
+    return voice->position < end;
+}
+
+
+// Interleaves the planar mix into the device buffer with master gain and clipping.
+static void write_audio_output(AudioSystem *audio, float *out, int frames)
+{
+    const float *left = audio->mix_left;
+    const float *right = audio->mix_right;
+    int i = 0;
+
+#if AUDIO_SIMD_SSE2
+    const __m128 gain = _mm_set1_ps(audio->master_gain);
+    const __m128 low = _mm_set1_ps(-1.f);
+    const __m128 high = _mm_set1_ps(1.f);
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_max_ps(low, _mm_min_ps(high, _mm_mul_ps(_mm_loadu_ps(left + i), gain)));
+        __m128 r = _mm_max_ps(low, _mm_min_ps(high, _mm_mul_ps(_mm_loadu_ps(right + i), gain)));
+        _mm_storeu_ps(out + i*2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + i*2 + 4, _mm_unpackhi_ps(l, r));
+    }
+#endif
+
+    for (; i < frames; ++i) {
+        float l = left[i] * audio->master_gain;
+        float r = right[i] * audio->master_gain;
+        out[i*2] = l < -1.f ? -1.f : (l > 1.f ? 1.f : l);
+        out[i*2 + 1] = r < -1.f ? -1.f : (r > 1.f ? 1.f : r);
+    }
+}
+
+
+// Runs on SDL's audio thread: no allocation, no locks, no logging.
+static void SDLCALL audio_callback(void *userdata, Uint8 *stream, int length)
+{
+    AudioSystem *audio = (AudioSystem*)userdata;
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    process_audio_commands(audio);
+
+    float *out = (float*)stream;
+    int frames_left = length / (int)(sizeof(float)*2);
+    int voices_active = 0;
+
+    while (frames_left > 0) {
+        int frames = frames_left < audio->buffer_frames ? frames_left : audio->buffer_frames;
+
+        memset(audio->mix_left, 0, frames*sizeof(float));
+        memset(audio->mix_right, 0, frames*sizeof(float));
+
+        voices_active = 0;
+        for (int v = 0; v < AUDIO_MAX_VOICES; ++v) {
+            AudioVoice *voice = &audio->voices[v];
+            if (voice->active) {
+                voice->active = mix_voice(audio, voice, frames);
+                voices_active += 1;
+            }
+        }
+
+        for (int s = 0; s < MUSIC_STREAMS; ++s) {
+            if (SDL_AtomicGet(&audio->music[s].state) == MUSIC_PLAYING) {
+                mix_music_stream(audio, &audio->music[s], frames);
+            }
+        }
+
+        write_audio_output(audio, out, frames);
+
+        out += frames*2;
+        frames_left -= frames;
+    }
+
+    int mix_us = (int)((SDL_GetPerformanceCounter() - start) * 1000000 / SDL_GetPerformanceFrequency());
+
+    SDL_AtomicAdd(&audio->stats.callbacks, 1);
+    SDL_AtomicSet(&audio->stats.mix_us_last, mix_us);
+    SDL_AtomicAdd(&audio->stats.mix_us_total, mix_us);
+    if (mix_us > SDL_AtomicGet(&audio->stats.mix_us_max)) {
+        SDL_AtomicSet(&audio->stats.mix_us_max, mix_us);
+    }
+    SDL_AtomicSet(&audio->stats.voices_active, voices_active);
+}
+
+
+bool init_audio(AudioSystem *audio, Vfs *vfs)
+{
+    if (audio == nullptr) {
+        LOG_ERROR(LOG_AUDIO, "audio system is null");
+        exit(1);
+    }
+
+    memset(audio, 0, sizeof(AudioSystem));
+    audio->vfs = vfs;
+    audio->master_gain = 1.f;
+    audio->current_music_stream = -1;
+
+    SDL_AudioSpec desired;
+    SDL_AudioSpec obtained;
+    memset(&desired, 0, sizeof(SDL_AudioSpec));
+
+    desired.freq = AUDIO_SAMPLE_RATE;
+    desired.format = AUDIO_F32SYS;
+    desired.channels = 2;
+    desired.samples = AUDIO_BUFFER_FRAMES;
+    desired.callback = audio_callback;
+    desired.userdata = audio;
+
+    audio->device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (audio->device == 0) {
+        LOG_WARN(LOG_AUDIO, "Could not open audio device, continuing without sound: %s", SDL_GetError());
+        return false;
+    }
+
+    audio->sample_rate = obtained.freq;
+    audio->buffer_frames = obtained.samples;
+    audio->mix_left = (float*)tracked_malloc(audio->buffer_frames*sizeof(float));
+    audio->mix_right = (float*)tracked_malloc(audio->buffer_frames*sizeof(float));
+    audio->sound_decoder_memory = (char*)tracked_malloc(MUSIC_DECODER_MEMORY);
+
+    for (int s = 0; s < MUSIC_STREAMS; ++s) {
+        MusicStream *stream = &audio->music[s];
+        stream->ring = (float*)tracked_malloc(MUSIC_RING_FRAMES*2*sizeof(float));
+        stream->decoder_memory = (char*)tracked_malloc(MUSIC_DECODER_MEMORY);
+        stream->decode_chunk = (float*)tracked_malloc(MUSIC_DECODE_CHUNK_FRAMES*2*sizeof(float));
+    }
+
+    audio->music_thread = SDL_CreateThread(music_thread_main, "music", audio);
+
+    SDL_PauseAudioDevice(audio->device, 0);
+
+    LOG_INFO(LOG_AUDIO, "Opened audio device @ %dHz, %d frames per buffer", audio->sample_rate, audio->buffer_frames);
+    return true;
+}
+
+
+void shutdown_audio(AudioSystem *audio)
+{
+    if (audio->device == 0) {
+        return;
+    }
+
+    print_audio_stats(audio);
+
+    SDL_AtomicSet(&audio->music_thread_quit, 1);
+    SDL_WaitThread(audio->music_thread, nullptr);
+
+    SDL_CloseAudioDevice(audio->device);
+    audio->device = 0;
+
+    for (int s = 0; s < MUSIC_STREAMS; ++s) {
+        free(audio->music[s].ring);
+        free(audio->music[s].decoder_memory);
+        free(audio->music[s].decode_chunk);
+    }
+
+    for (int i = 0; i < audio->sound_count; ++i) {
+        free(audio->sounds[i].frames);
+    }
+    free(audio->mix_left);
+    free(audio->mix_right);
+    free(audio->sound_decoder_memory);
+}
+
+
+SoundId load_sound(AudioSystem *audio, const char *name, const char *path)
+{
+    if (audio->sound_count >= AUDIO_MAX_SOUNDS) {
+        LOG_ERROR(LOG_AUDIO, "Too many sounds, cannot load %s", path);
+        return INVALID_SOUND;
+    }
+
+    FileView file;
+    if (!open_file_view(audio->vfs, path, &file)) {
+        LOG_ERROR(LOG_AUDIO, "Could not find sound: %s", path);
+        return INVALID_SOUND;
+    }
+
+    int error = VORBIS_OK;
+    VorbisDecoder *decoder = open_vorbis(file.data, (int)file.size, audio->sound_decoder_memory, MUSIC_DECODER_MEMORY, &error);
+    if (decoder == nullptr || decoder->total_frames == 0) {
+        LOG_ERROR(LOG_AUDIO, "Could not decode sound %s (%s)", path, decoder ? "no length" : get_vorbis_error_name(error));
+        close_file_view(audio->vfs, &file);
+        return INVALID_SOUND;
+    }
+
+    int channels = decoder->channels;
+    if (channels > 2) {
+        LOG_ERROR(LOG_AUDIO, "Only mono and stereo sounds are supported: %s", path);
+        close_file_view(audio->vfs, &file);
+        return INVALID_SOUND;
+    }
+
+    SoundId id = audio->sound_count;
+    AudioSample *sample = &audio->sounds[id];
+    memset(sample, 0, sizeof(AudioSample));
+
+    SDL_strlcpy(sample->name, name, ENTITY_NAME_LENGTH);
+    sample->channels = channels;
+    sample->sample_rate = decoder->sample_rate;
+
+    // decoded once here, straight to floats, so the mixer only ever plays from memory.
+    // a stream cut short keeps the frames that were there
+    int value_count = (int)decoder->total_frames*channels;
+    sample->frames = (float*)tracked_malloc((value_count + channels)*sizeof(float));
+    int frame_count = decode_vorbis_frames(decoder, sample->frames, channels, (int)decoder->total_frames);
+    close_file_view(audio->vfs, &file);
+    if (frame_count == 0) {
+        LOG_ERROR(LOG_AUDIO, "Could not decode sound: %s", path);
+        free(sample->frames);
+        sample->frames = nullptr;
+        return INVALID_SOUND;
+    }
+    for (int c = 0; c < channels; ++c) {
+        sample->frames[frame_count*channels + c] = 0.f;
+    }
+    sample->frame_count = frame_count;
+
+    // only publish the slot once the sample data is complete
+    audio->sound_count += 1;
+
+    LOG_INFO(LOG_AUDIO, "Loaded sound %s @ %d frames, %d channels, %dHz", name, frame_count, channels, sample->sample_rate);
+    return id;
+}
+
+
+SoundId find_sound(AudioSystem *audio, const char *name)
+{
+    for (int i = 0; i < audio->sound_count; ++i) {
+        if (SDL_strncmp(audio->sounds[i].name, name, ENTITY_NAME_LENGTH) == 0) {
+            return i;
+        }
+    }
+
+    return INVALID_SOUND;
+}
+
+
+bool play_sound(AudioSystem *audio, SoundId sound, float gain, float pan, float pitch)
+{
+    if (audio == nullptr || sound < 0 || sound >= audio->sound_count || pitch <= 0.f || audio->sounds_muted) {
+        return false;
+    }
+
+    AudioCommand command;
+    command.type = AUDIO_COMMAND_PLAY;
+    command.sound = sound;
+    command.gain = gain;
+    command.pan = pan;
+    command.pitch = pitch;
+
+    return push_audio_command(audio, &command);
+}
+
+
+void mute_sounds(AudioSystem *audio, bool muted)
+{
+    if (audio) {
+        audio->sounds_muted = muted;
+    }
+}
+
+
+bool stop_all_sounds(AudioSystem *audio)
+{
+    AudioCommand command;
+    memset(&command, 0, sizeof(AudioCommand));
+    command.type = AUDIO_COMMAND_STOP_ALL;
+
+    return push_audio_command(audio, &command);
+}
+
+
+bool set_master_gain(AudioSystem *audio, float gain)
+{
+    AudioCommand command;
+    memset(&command, 0, sizeof(AudioCommand));
+    command.type = AUDIO_COMMAND_MASTER_GAIN;
+    command.gain = gain;
+
+    return push_audio_command(audio, &command);
+}
+
+
+void print_audio_stats(AudioSystem *audio)
+{
+    int callbacks = SDL_AtomicGet(&audio->stats.callbacks);
+    double buffer_us = audio->buffer_frames * 1000000.0 / audio->sample_rate;
+    double average_us = callbacks ? (double)SDL_AtomicGet(&audio->stats.mix_us_total) / callbacks : 0.0;
+
+    LOG_INFO(LOG_AUDIO, "Audio: %d buffers, mix avg %.1fus max %dus of %.0fus budget, %d voices stolen, %d commands dropped, %d music underruns",
+             callbacks, average_us, SDL_AtomicGet(&audio->stats.mix_us_max), buffer_us,
+             SDL_AtomicGet(&audio->stats.voices_stolen), SDL_AtomicGet(&audio->stats.commands_dropped),
+             SDL_AtomicGet(&audio->music[0].underruns) + SDL_AtomicGet(&audio->music[1].underruns));
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "types.h"
+#include "vfs.hpp"
+#include "vorbis.hpp"
+
+// SSE2 is baseline on x64, the scalar path covers everything else
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define AUDIO_SIMD_SSE2 0
+#endif
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_BUFFER_FRAMES 512
+#define AUDIO_MAX_VOICES 32
+#define AUDIO_MAX_SOUNDS 64
+#define AUDIO_COMMAND_QUEUE_SIZE 256 // must be a power of two
+
+// Music is decoded a chunk at a time on a worker thread, so a track costs
+// the same fixed ring and decoder memory however long it is.
+#define MUSIC_STREAMS 2
+#define MUSIC_RING_FRAMES 16384 // must be a power of two
+#define MUSIC_DECODE_CHUNK_FRAMES 2048
+#define MUSIC_DECODER_MEMORY KILOBYTES(256)
+#define MUSIC_REQUEST_QUEUE_SIZE 8 // must be a power of two
+#define MUSIC_WORKER_SLEEP_MS 4
+#define MUSIC_PATH_LENGTH 256
+
+#define INVALID_SOUND -1
+
+enum AUDIO_COMMAND_TYPE {
+    AUDIO_COMMAND_PLAY,
+    AUDIO_COMMAND_STOP_ALL,
+    AUDIO_COMMAND_MASTER_GAIN,
+    AUDIO_COMMAND_MUSIC_FADE
+};
+
+struct AudioCommand {
+    AUDIO_COMMAND_TYPE type;
+    SoundId sound;
+    float gain;
+    float pan;
+    float pitch;
+
+    int music_stream;
+    Uint32 music_generation;
+    float fade_s;
+};
+
+// single producer (game thread), single consumer (audio callback)
+struct AudioCommandQueue {
+    AudioCommand commands[AUDIO_COMMAND_QUEUE_SIZE];
+    SDL_atomic_t write_index;
+    SDL_atomic_t read_index;
+};
+
+enum MUSIC_STATE {
+    MUSIC_IDLE,     // free, the worker may claim it
+    MUSIC_LOADING,  // worker is opening and prefilling, the callback ignores it
+    MUSIC_PLAYING,  // callback consumes, worker keeps the ring topped up
+    MUSIC_FINISHED  // callback is done with it, worker closes the decoder
+};
+
+struct MusicRequest {
+    char path[MUSIC_PATH_LENGTH];
+    int stream;
+    bool loop;
+    Uint32 loop_start;
+    Uint32 loop_end;
+    float fade_in_s;
+    Uint32 generation;
+};
+
+struct MusicRequestQueue {
+    MusicRequest requests[MUSIC_REQUEST_QUEUE_SIZE];
+    SDL_atomic_t write_index;
+    SDL_atomic_t read_index;
+};
+
+struct MusicStream {
+    SDL_atomic_t state;
+    SDL_atomic_t stop_requested;
+    SDL_atomic_t end_of_stream;
+    SDL_atomic_t underruns;
+
+    // stereo frames at the track's own rate, both counters only ever grow
+    float *ring;
+    SDL_atomic_t frames_written;
+    SDL_atomic_t frames_read;
+
+    // owned by the worker, the decoder reads straight out of the mapped file
+    FileView file;
+    VorbisDecoder *decoder;
+    char *decoder_memory;
+    float *decode_chunk;
+    char path[MUSIC_PATH_LENGTH];
+    int channels;
+    bool loop;
+    Uint32 loop_start;
+    Uint32 loop_end;
+    Uint32 decode_position;
+
+    // written by the worker before it publishes MUSIC_PLAYING
+    int sample_rate;
+    int fade_in_frames;
+    Uint32 generation;
+
+    // owned by the callback
+    bool mixing;
+    double read_position;
+    float gain;
+    float gain_target;
+    float gain_step;
+    Uint32 stop_generation;
+};
+
+struct AudioSample {
+    char name[ENTITY_NAME_LENGTH];
+
+    // interleaved, with one extra silent frame so interpolation can read past the end
+    float *frames;
+    int frame_count;
+    int channels;
+    int sample_rate;
+};
+
+struct AudioVoice {
+    bool active;
+    SoundId sound;
+
+    double position;
+    double step;
+
+    float gain_left;
+    float gain_right;
+
+    Uint32 serial;
+};
+
+struct AudioStats {
+    SDL_atomic_t callbacks;
+    SDL_atomic_t mix_us_last;
+    SDL_atomic_t mix_us_max;
+    SDL_atomic_t mix_us_total;
+    SDL_atomic_t voices_active;
+    SDL_atomic_t voices_stolen;
+    SDL_atomic_t commands_dropped;
+};
+
+struct AudioSystem {
+    Vfs *vfs;
+    SDL_AudioDeviceID device;
+    int sample_rate;
+    int buffer_frames;
+
+    int sound_count;
+    AudioSample sounds[AUDIO_MAX_SOUNDS];
+
+    AudioVoice voices[AUDIO_MAX_VOICES];
+    Uint32 voice_serial;
+    float master_gain;
+
+    // main thread only. a simulation that will be rolled back plays nothing
+    bool sounds_muted;
+
+    // planar accumulators sized to the device buffer, owned by the callback
+    float *mix_left;
+    float *mix_right;
+
+    // load_sound's decoder, the same size as a music stream's. main thread only
+    char *sound_decoder_memory;
+
+    AudioCommandQueue commands;
+    AudioStats stats;
+
+    MusicStream music[MUSIC_STREAMS];
+    MusicRequestQueue music_requests;
+    int current_music_stream;
+    Uint32 music_generation;
+    SDL_Thread *music_thread;
+    SDL_atomic_t music_thread_quit;
+};
+
+bool init_audio(AudioSystem *audio, Vfs *vfs);
+void shutdown_audio(AudioSystem *audio);
+
+SoundId load_sound(AudioSystem *audio, const char *name, const char *path);
+SoundId find_sound(AudioSystem *audio, const char *name);
+
+bool play_sound(AudioSystem *audio, SoundId sound, float gain = 1.f, float pan = 0.f, float pitch = 1.f);
+void mute_sounds(AudioSystem *audio, bool muted);
+bool stop_all_sounds(AudioSystem *audio);
+bool set_master_gain(AudioSystem *audio, float gain);
+
+bool play_music(AudioSystem *audio, const char *path, float crossfade_s, bool loop = true, Uint32 loop_start = 0, Uint32 loop_end = 0);
+bool stop_music(AudioSystem *audio, float fade_s);
+
+void print_audio_stats(AudioSystem *audio);
@@ -0,0 +1,289 @@
+#include "collision.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// how far a shape's texel steps may be from whole pixels and still count as aligned
+#define COLLISION_ALIGNED_EPSILON 1e-3f
+
+static inline int collision_popcount(Uint64 bits)
+{
+#if defined(_MSC_VER)
+    return (int)__popcnt64(bits);
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+
+static inline Uint64 low_bits(int count)
+{
+    return count >= 64 ? ~0ull : (1ull << count) - 1;
+}
+
+
+CollisionMask *create_collision_mask(const void *pixels, int width, int height, int pitch, int alpha_threshold)
+{
+    if (pixels == nullptr || width <= 0 || height <= 0) {
+        LOG_ERROR(LOG_RENDER, "cannot build a collision mask without pixels");
+        return nullptr;
+    }
+
+    CollisionMask *mask = MALLOC(CollisionMask);
+    mask->width = width;
+    mask->height = height;
+    mask->words_per_row = (width + 63)/64;
+
+    size_t size = (size_t)mask->words_per_row*height*sizeof(Uint64);
+    mask->rows = (Uint64 *)tracked_malloc(size);
+    memset(mask->rows, 0, size);
+
+    for (int y = 0; y < height; ++y) {
+        const Uint8 *pixel = (const Uint8 *)pixels + (size_t)y*pitch;
+        Uint64 *row = mask->rows + (size_t)y*mask->words_per_row;
+
+        for (int x = 0; x < width; ++x, pixel += 4) {
+            if (pixel[3] >= alpha_threshold) {
+                row[x >> 6] |= 1ull << (x & 63);
+            }
+        }
+    }
+
+    return mask;
+}
+
+
+void destroy_collision_mask(CollisionMask *mask)
+{
+    if (mask) {
+        free(mask->rows);
+        free(mask);
+    }
+}
+
+
+bool get_collision_mask_bit(const CollisionMask *mask, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= mask->width || y >= mask->height) {
+        return false;
+    }
+
+    return (mask->rows[(size_t)y*mask->words_per_row + (x >> 6)] >> (x & 63)) & 1;
+}
+
+
+CollisionShape make_collision_shape(const CollisionMask *mask, const SpriteInstance *instance)
+{
+    CollisionShape shape;
+    shape.mask = mask;
+    shape.uv_rect = instance->uv_rect;
+    shape.center = glm::vec2(instance->position);
+    shape.axis_x = glm::vec2(instance->basis.x, instance->basis.y);
+    shape.axis_y = glm::vec2(instance->basis.z, instance->basis.w);
+
+    return shape;
+}
+
+
+void get_collision_shape_bounds(const CollisionShape *shape, glm::vec2 *bounds_min, glm::vec2 *bounds_max)
+{
+    glm::vec2 extent = (glm::abs(shape->axis_x) + glm::abs(shape->axis_y))*0.5f;
+    *bounds_min = shape->center - extent;
+    *bounds_max = shape->center + extent;
+}
+
+
+bool collision_shape_bounds_overlap(const CollisionShape *a, const CollisionShape *b)
+{
+    glm::vec2 a_min, a_max, b_min, b_max;
+    get_collision_shape_bounds(a, &a_min, &a_max);
+    get_collision_shape_bounds(b, &b_min, &b_max);
+
+    return a_min.x < b_max.x && b_min.x < a_max.x && a_min.y < b_max.y && b_min.y < a_max.y;
+}
+
+
+// Where each world pixel lands in a shape's mask. The mapping is affine, the
+// texel under the center of world pixel (x, y) is origin + (x + 0.5)*step_x
+// + (y + 0.5)*step_y, and only texels inside the region count.
+struct MaskMapping {
+    const CollisionMask *mask;
+    glm::vec2 origin;
+    glm::vec2 step_x;
+    glm::vec2 step_y;
+
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    // one texel per pixel, unrotated: a world row is a run of one mask row
+    bool aligned;
+    int offset_x;
+    int offset_y;
+    int sign_y;
+};
+
+
+static bool init_mask_mapping(const CollisionShape *shape, MaskMapping *mapping)
+{
+    float length_x = glm::dot(shape->axis_x, shape->axis_x);
+    float length_y = glm::dot(shape->axis_y, shape->axis_y);
+    if (length_x <= 0.f || length_y <= 0.f) {
+        return false;
+    }
+
+    // without a mask the quad is solid, it maps onto an imaginary one texel per pixel mask
+    glm::vec2 mask_size;
+    glm::vec4 uv_rect;
+    if (shape->mask) {
+        mask_size = glm::vec2(shape->mask->width, shape->mask->height);
+        uv_rect = shape->uv_rect;
+    }
+    else {
+        mask_size = glm::max(glm::vec2(sqrtf(length_x), sqrtf(length_y)), glm::vec2(1.f));
+        uv_rect = glm::vec4(0.f, 0.f, 1.f, 1.f);
+    }
+
+    glm::vec2 unit_x = shape->axis_x/length_x;
+    glm::vec2 unit_y = shape->axis_y/length_y;
+    glm::vec2 region_offset = glm::vec2(uv_rect.x, uv_rect.y)*mask_size;
+    glm::vec2 region_size = glm::vec2(uv_rect.z, uv_rect.w)*mask_size;
+
+    mapping->mask = shape->mask;
+    mapping->step_x = glm::vec2(unit_x.x, unit_y.x)*region_size;
+    mapping->step_y = glm::vec2(unit_x.y, unit_y.y)*region_size;
+    mapping->origin = region_offset + (glm::vec2(0.5f) - glm::vec2(glm::dot(shape->center, unit_x), glm::dot(shape->center, unit_y)))*region_size;
+
+    glm::vec2 region_min = glm::min(region_offset, region_offset + region_size);
+    glm::vec2 region_max = glm::max(region_offset, region_offset + region_size);
+    mapping->left = glm::max((int)floorf(region_min.x + 0.5f), 0);
+    mapping->top = glm::max((int)floorf(region_min.y + 0.5f), 0);
+    mapping->right = glm::min((int)floorf(region_max.x + 0.5f), (int)mask_size.x);
+    mapping->bottom = glm::min((int)floorf(region_max.y + 0.5f), (int)mask_size.y);
+
+    // the rows may run either way up, atlas regions are flipped and so is the player
+    mapping->aligned = fabsf(mapping->step_x.x - 1.f) < COLLISION_ALIGNED_EPSILON &&
+                       fabsf(mapping->step_x.y) < COLLISION_ALIGNED_EPSILON &&
+                       fabsf(mapping->step_y.x) < COLLISION_ALIGNED_EPSILON &&
+                       fabsf(fabsf(mapping->step_y.y) - 1.f) < COLLISION_ALIGNED_EPSILON;
+    mapping->sign_y = mapping->step_y.y > 0.f ? 1 : -1;
+    mapping->offset_x = (int)floorf(mapping->origin.x + 0.5f);
+    mapping->offset_y = (int)floorf(mapping->origin.y + 0.5f*mapping->sign_y);
+
+    return true;
+}
+
+
+// count texels of a mask row from start on, shifted down so start is bit 0
+static inline Uint64 read_mask_bits(const CollisionMask *mask, int row, int start, int count)
+{
+    const Uint64 *words = mask->rows + (size_t)row*mask->words_per_row;
+    int word = start >> 6;
+    int shift = start & 63;
+
+    Uint64 bits = words[word] >> shift;
+    if (shift != 0 && word + 1 < mask->words_per_row) {
+        bits |= words[word + 1] << (64 - shift);
+    }
+
+    return bits & low_bits(count);
+}
+
+
+// count world pixels from (x, y) on, one bit each, set where the shape is solid
+static Uint64 read_world_row(const MaskMapping *mapping, int x, int y, int count)
+{
+    if (mapping->aligned) {
+        int row = mapping->sign_y*y + mapping->offset_y;
+        if (row < mapping->top || row >= mapping->bottom) {
+            return 0;
+        }
+
+        int start = x + mapping->offset_x;
+        int first = glm::max(start, mapping->left);
+        int last = glm::min(start + count, mapping->right);
+        if (first >= last) {
+            return 0;
+        }
+
+        Uint64 bits = mapping->mask ? read_mask_bits(mapping->mask, row, first, last - first) : low_bits(last - first);
+        return bits << (first - start);
+    }
+
+    glm::vec2 texel = mapping->origin + (x + 0.5f)*mapping->step_x + (y + 0.5f)*mapping->step_y;
+    Uint64 bits = 0;
+
+    for (int i = 0; i < count; ++i, texel += mapping->step_x) {
+        int texel_x = (int)floorf(texel.x);
+        int texel_y = (int)floorf(texel.y);
+
+        if (texel_x >= mapping->left && texel_x < mapping->right && texel_y >= mapping->top && texel_y < mapping->bottom &&
+            (mapping->mask == nullptr || get_collision_mask_bit(mapping->mask, texel_x, texel_y)))
+        {
+            bits |= 1ull << i;
+        }
+    }
+
+    return bits;
+}
+
+
+static int test_collision_shapes(const CollisionShape *a, const CollisionShape *b, bool count_all)
+{
+    MaskMapping mapping_a, mapping_b;
+    if (!init_mask_mapping(a, &mapping_a) || !init_mask_mapping(b, &mapping_b)) {
+        return 0;
+    }
+
+    // read the cheap side first, a sampled row is only built where the other is solid
+    if (!mapping_a.aligned && mapping_b.aligned) {
+        MaskMapping swap = mapping_a;
+        mapping_a = mapping_b;
+        mapping_b = swap;
+    }
+
+    glm::vec2 a_min, a_max, b_min, b_max;
+    get_collision_shape_bounds(a, &a_min, &a_max);
+    get_collision_shape_bounds(b, &b_min, &b_max);
+
+    int min_x = (int)floorf(glm::max(a_min.x, b_min.x));
+    int min_y = (int)floorf(glm::max(a_min.y, b_min.y));
+    int max_x = (int)ceilf(glm::min(a_max.x, b_max.x));
+    int max_y = (int)ceilf(glm::min(a_max.y, b_max.y));
+
+    int overlap = 0;
+    for (int y = min_y; y < max_y; ++y) {
+        for (int x = min_x; x < max_x; x += 64) {
+            int count = glm::min(max_x - x, 64);
+
+            Uint64 bits = read_world_row(&mapping_a, x, y, count);
+            if (bits == 0) {
+                continue;
+            }
+
+            bits &= read_world_row(&mapping_b, x, y, count);
+            if (bits != 0) {
+                if (!count_all) {
+                    return 1;
+                }
+                overlap += collision_popcount(bits);
+            }
+        }
+    }
+
+    return overlap;
+}
+
+
+bool collision_shapes_overlap(const CollisionShape *a, const CollisionShape *b)
+{
+    return test_collision_shapes(a, b, false) != 0;
+}
+
+
+int count_collision_shape_overlap(const CollisionShape *a, const CollisionShape *b)
+{
+    return test_collision_shapes(a, b, true);
+}
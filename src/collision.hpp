@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+#include "render.hpp"
+
+// Collision masks keep one bit per texel, set where the image is opaque
+// enough to hit, packed 64 texels to a word with the leftmost texel in the
+// lowest bit. Two unrotated sprites overlap when a pair of rows, shifted
+// into line, ANDs to something nonzero, so the narrowphase costs a few word
+// operations per 64 pixels instead of a texel compare per pixel.
+#define COLLISION_ALPHA_THRESHOLD 128
+
+struct CollisionMask {
+    int width;
+    int height;
+    int words_per_row;
+    Uint64 *rows;       // row 0 is the top of the image, like the surface it came from
+};
+
+// A mask placed in the world the same way a SpriteInstance places its quad:
+// the uv rect picks the region of the mask, flips included, and the axes are
+// the quad's full width and height vectors. A null mask is a solid quad.
+struct CollisionShape {
+    const CollisionMask *mask;
+    glm::vec4 uv_rect;
+    glm::vec2 center;
+    glm::vec2 axis_x;
+    glm::vec2 axis_y;
+};
+
+// pixels are 32 bit RGBA, which is what init_texture converts every image to
+CollisionMask *create_collision_mask(const void *pixels, int width, int height, int pitch,
+                                     int alpha_threshold = COLLISION_ALPHA_THRESHOLD);
+void destroy_collision_mask(CollisionMask *mask);
+
+bool get_collision_mask_bit(const CollisionMask *mask, int x, int y);
+
+// animated instances carry a clip instead of a uv rect, give those the current frame's rect
+CollisionShape make_collision_shape(const CollisionMask *mask, const SpriteInstance *instance);
+
+// the broadphase, world space bounds of the whole quad
+void get_collision_shape_bounds(const CollisionShape *shape, glm::vec2 *bounds_min, glm::vec2 *bounds_max);
+bool collision_shape_bounds_overlap(const CollisionShape *a, const CollisionShape *b);
+
+// The narrowphase, in world pixels. Shapes drawn one texel to a pixel and
+// unrotated read their rows straight out of the mask, rotated or scaled ones
+// are sampled into words first and then go through the same AND.
+bool collision_shapes_overlap(const CollisionShape *a, const CollisionShape *b);
+int count_collision_shape_overlap(const CollisionShape *a, const CollisionShape *b);
@@ -0,0 +1,1075 @@
+#include "compression.hpp"
+
+#include <math.h>
+
+// a level that comes out the same as its source, PSNR is infinite there
+#define COMPRESSION_PSNR_EXACT_DB 99.f
+
+static inline int clamp_channel(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+
+static inline int get_level_size(int size, int level)
+{
+    int level_size = size >> level;
+    return level_size > 0 ? level_size : 1;
+}
+
+
+static inline int quantize_565(const float *rgb)
+{
+    int r = (int)(rgb[0]*31.f/255.f + 0.5f);
+    int g = (int)(rgb[1]*63.f/255.f + 0.5f);
+    int b = (int)(rgb[2]*31.f/255.f + 0.5f);
+
+    r = r < 0 ? 0 : (r > 31 ? 31 : r);
+    g = g < 0 ? 0 : (g > 63 ? 63 : g);
+    b = b < 0 ? 0 : (b > 31 ? 31 : b);
+
+    return (r << 11) | (g << 5) | b;
+}
+
+
+static inline void expand_565(int color, int *rgb)
+{
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+
+// with color0 > color1 the block has four colors, otherwise three and transparent black
+static void build_color_palette(int color0, int color1, bool four_colors, int palette[4][4])
+{
+    expand_565(color0, palette[0]);
+    expand_565(color1, palette[1]);
+    palette[0][3] = 255;
+    palette[1][3] = 255;
+
+    for (int c = 0; c < 3; ++c) {
+        if (four_colors) {
+            palette[2][c] = (2*palette[0][c] + palette[1][c])/3;
+            palette[3][c] = (palette[0][c] + 2*palette[1][c])/3;
+        }
+        else {
+            palette[2][c] = (palette[0][c] + palette[1][c])/2;
+            palette[3][c] = 0;
+        }
+    }
+
+    palette[2][3] = 255;
+    palette[3][3] = four_colors ? 255 : 0;
+}
+
+
+// the nearest palette color for each texel, and the squared error over the counted ones
+static int find_color_indices(const Uint8 *texels, int palette[4][4], Uint32 counted, int *indices)
+{
+    int distances[16];
+
+#if COMPRESSION_SIMD_SSE2
+    // two texels a register as 16 bit channels, alpha masked off, the
+    // squared distances to each palette color summed with madd
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+
+    __m128i low[4];
+    __m128i high[4];
+    for (int row = 0; row < 4; ++row) {
+        __m128i texel_row = _mm_loadu_si128((const __m128i *)(texels + row*16));
+        low[row] = _mm_and_si128(_mm_unpacklo_epi8(texel_row, zero), rgb_mask);
+        high[row] = _mm_and_si128(_mm_unpackhi_epi8(texel_row, zero), rgb_mask);
+    }
+
+    __m128i best[4];
+    __m128i best_index[4];
+
+    for (int p = 0; p < 4; ++p) {
+        const __m128i color = _mm_set_epi16(0, (short)palette[p][2], (short)palette[p][1], (short)palette[p][0],
+                                            0, (short)palette[p][2], (short)palette[p][1], (short)palette[p][0]);
+        const __m128i index = _mm_set1_epi32(p);
+
+        for (int row = 0; row < 4; ++row) {
+            __m128i low_delta = _mm_sub_epi16(low[row], color);
+            __m128i high_delta = _mm_sub_epi16(high[row], color);
+            __m128i low_sum = _mm_madd_epi16(low_delta, low_delta);
+            __m128i high_sum = _mm_madd_epi16(high_delta, high_delta);
+
+            // rg and b0 halves of each texel added, then the four texels gathered
+            low_sum = _mm_add_epi32(low_sum, _mm_shuffle_epi32(low_sum, _MM_SHUFFLE(2, 3, 0, 1)));
+            high_sum = _mm_add_epi32(high_sum, _mm_shuffle_epi32(high_sum, _MM_SHUFFLE(2, 3, 0, 1)));
+            __m128i distance = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(low_sum), _mm_castsi128_ps(high_sum), _MM_SHUFFLE(2, 0, 2, 0)));
+
+            if (p == 0) {
+                best[row] = distance;
+                best_index[row] = index;
+            }
+            else {
+                __m128i closer = _mm_cmplt_epi32(distance, best[row]);
+                best[row] = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best[row]));
+                best_index[row] = _mm_or_si128(_mm_and_si128(closer, index), _mm_andnot_si128(closer, best_index[row]));
+            }
+        }
+    }
+
+    for (int row = 0; row < 4; ++row) {
+        _mm_storeu_si128((__m128i *)(distances + row*4), best[row]);
+        _mm_storeu_si128((__m128i *)(indices + row*4), best_index[row]);
+    }
+#else
+    for (int t = 0; t < 16; ++t) {
+        const Uint8 *texel = texels + t*4;
+        distances[t] = 0x7fffffff;
+
+        for (int p = 0; p < 4; ++p) {
+            int dr = texel[0] - palette[p][0];
+            int dg = texel[1] - palette[p][1];
+            int db = texel[2] - palette[p][2];
+            int distance = dr*dr + dg*dg + db*db;
+
+            if (distance < distances[t]) {
+                distances[t] = distance;
+                indices[t] = p;
+            }
+        }
+    }
+#endif
+
+    int error = 0;
+    for (int t = 0; t < 16; ++t) {
+        if (counted & (1u << t)) {
+            error += distances[t];
+        }
+    }
+
+    return error;
+}
+
+
+// the counted texels furthest apart along their principal axis
+static void fit_color_endpoints(const Uint8 *texels, Uint32 counted, float *end0, float *end1)
+{
+    float mean[3] = {};
+    float low[3] = { 255.f, 255.f, 255.f };
+    float high[3] = {};
+    int count = 0;
+
+    for (int t = 0; t < 16; ++t) {
+        if (counted & (1u << t)) {
+            for (int c = 0; c < 3; ++c) {
+                float value = texels[t*4 + c];
+                mean[c] += value;
+                low[c] = value < low[c] ? value : low[c];
+                high[c] = value > high[c] ? value : high[c];
+            }
+            count += 1;
+        }
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        mean[c] /= (float)count;
+    }
+
+    // rr rg rb gg gb bb
+    float covariance[6] = {};
+    for (int t = 0; t < 16; ++t) {
+        if (counted & (1u << t)) {
+            float r = texels[t*4 + 0] - mean[0];
+            float g = texels[t*4 + 1] - mean[1];
+            float b = texels[t*4 + 2] - mean[2];
+
+            covariance[0] += r*r;
+            covariance[1] += r*g;
+            covariance[2] += r*b;
+            covariance[3] += g*g;
+            covariance[4] += g*b;
+            covariance[5] += b*b;
+        }
+    }
+
+    // a few power iterations from the widest range are plenty for 16 texels
+    float axis[3] = { high[0] - low[0], high[1] - low[1], high[2] - low[2] };
+    for (int iteration = 0; iteration < 4; ++iteration) {
+        float x = axis[0]*covariance[0] + axis[1]*covariance[1] + axis[2]*covariance[2];
+        float y = axis[0]*covariance[1] + axis[1]*covariance[3] + axis[2]*covariance[4];
+        float z = axis[0]*covariance[2] + axis[1]*covariance[4] + axis[2]*covariance[5];
+
+        float length = fabsf(x) > fabsf(y) ? fabsf(x) : fabsf(y);
+        length = fabsf(z) > length ? fabsf(z) : length;
+        if (length < 1e-6f) {
+            break;
+        }
+
+        axis[0] = x/length;
+        axis[1] = y/length;
+        axis[2] = z/length;
+    }
+
+    int lowest = -1;
+    int highest = -1;
+    float lowest_dot = 0.f;
+    float highest_dot = 0.f;
+
+    for (int t = 0; t < 16; ++t) {
+        if (counted & (1u << t)) {
+            float dot = texels[t*4 + 0]*axis[0] + texels[t*4 + 1]*axis[1] + texels[t*4 + 2]*axis[2];
+            if (lowest < 0 || dot < lowest_dot) {
+                lowest = t;
+                lowest_dot = dot;
+            }
+            if (highest < 0 || dot > highest_dot) {
+                highest = t;
+                highest_dot = dot;
+            }
+        }
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        end0[c] = texels[highest*4 + c];
+        end1[c] = texels[lowest*4 + c];
+    }
+}
+
+
+// least squares endpoints for the indices the last fit picked
+static bool refit_color_endpoints(const Uint8 *texels, Uint32 counted, bool four_colors, const int *indices, float *end0, float *end1)
+{
+    static const float four_color_weights[4] = { 1.f, 0.f, 2.f/3.f, 1.f/3.f };
+    static const float three_color_weights[4] = { 1.f, 0.f, 1.f/2.f, 0.f };
+    const float *end0_weights = four_colors ? four_color_weights : three_color_weights;
+
+    float aa = 0.f;
+    float ab = 0.f;
+    float bb = 0.f;
+    float ax[3] = {};
+    float bx[3] = {};
+
+    for (int t = 0; t < 16; ++t) {
+        if (counted & (1u << t)) {
+            float a = end0_weights[indices[t]];
+            float b = 1.f - a;
+
+            aa += a*a;
+            ab += a*b;
+            bb += b*b;
+
+            for (int c = 0; c < 3; ++c) {
+                ax[c] += a*texels[t*4 + c];
+                bx[c] += b*texels[t*4 + c];
+            }
+        }
+    }
+
+    float determinant = aa*bb - ab*ab;
+    if (fabsf(determinant) < 1e-6f) {
+        return false;
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        end0[c] = (float)clamp_channel((int)((bb*ax[c] - ab*bx[c])/determinant + 0.5f));
+        end1[c] = (float)clamp_channel((int)((aa*bx[c] - ab*ax[c])/determinant + 0.5f));
+    }
+
+    return true;
+}
+
+
+// Four colors put the endpoints in four color order, so the same block decodes
+// the same in BC1 and BC3. Three colors are for BC1 blocks with texels cut
+// out, every texel outside counted takes the transparent entry.
+static int evaluate_color_endpoints(const Uint8 *texels, Uint32 counted, bool four_colors, int *color0, int *color1, int *indices)
+{
+    if (four_colors ? *color0 < *color1 : *color0 > *color1) {
+        int swap = *color0;
+        *color0 = *color1;
+        *color1 = swap;
+    }
+
+    int palette[4][4];
+    int error = 0;
+
+    // one color, every texel takes the first entry in either mode
+    if (*color0 == *color1) {
+        build_color_palette(*color0, *color1, false, palette);
+
+        for (int t = 0; t < 16; ++t) {
+            indices[t] = 0;
+            if (counted & (1u << t)) {
+                for (int c = 0; c < 3; ++c) {
+                    int delta = texels[t*4 + c] - palette[0][c];
+                    error += delta*delta;
+                }
+            }
+        }
+    }
+    else if (four_colors) {
+        build_color_palette(*color0, *color1, true, palette);
+        return find_color_indices(texels, palette, counted, indices);
+    }
+    else {
+        // the transparent entry is black, a kept texel must never land on it
+        build_color_palette(*color0, *color1, false, palette);
+        memcpy(palette[3], palette[2], sizeof(palette[2]));
+
+        error = find_color_indices(texels, palette, counted, indices);
+        for (int t = 0; t < 16; ++t) {
+            indices[t] = indices[t] == 3 ? 2 : indices[t];
+        }
+    }
+
+    if (!four_colors) {
+        for (int t = 0; t < 16; ++t) {
+            if (!(counted & (1u << t))) {
+                indices[t] = 3;
+            }
+        }
+    }
+
+    return error;
+}
+
+
+static void encode_color_block(const Uint8 *texels, Uint32 counted, bool four_colors, Uint8 *block)
+{
+    // nothing visible, the colors still have to be something
+    if (counted == 0) {
+        counted = 0xffff;
+    }
+
+    float end0[3];
+    float end1[3];
+    fit_color_endpoints(texels, counted, end0, end1);
+
+    int best_color0 = quantize_565(end0);
+    int best_color1 = quantize_565(end1);
+    int best_indices[16];
+    int best_error = evaluate_color_endpoints(texels, counted, four_colors, &best_color0, &best_color1, best_indices);
+
+    for (int pass = 0; pass < COMPRESSION_REFINE_PASSES && best_error > 0; ++pass) {
+        if (!refit_color_endpoints(texels, counted, four_colors, best_indices, end0, end1)) {
+            break;
+        }
+
+        int color0 = quantize_565(end0);
+        int color1 = quantize_565(end1);
+        int indices[16];
+        int error = evaluate_color_endpoints(texels, counted, four_colors, &color0, &color1, indices);
+        if (error >= best_error) {
+            break;
+        }
+
+        best_color0 = color0;
+        best_color1 = color1;
+        best_error = error;
+        memcpy(best_indices, indices, sizeof(indices));
+    }
+
+    Uint32 bits = 0;
+    for (int t = 0; t < 16; ++t) {
+        bits |= (Uint32)best_indices[t] << (t*2);
+    }
+
+    block[0] = (Uint8)(best_color0 & 0xff);
+    block[1] = (Uint8)(best_color0 >> 8);
+    block[2] = (Uint8)(best_color1 & 0xff);
+    block[3] = (Uint8)(best_color1 >> 8);
+    block[4] = (Uint8)(bits & 0xff);
+    block[5] = (Uint8)((bits >> 8) & 0xff);
+    block[6] = (Uint8)((bits >> 16) & 0xff);
+    block[7] = (Uint8)(bits >> 24);
+}
+
+
+static void decode_color_block(const Uint8 *block, bool always_four_colors, Uint8 *texels)
+{
+    int color0 = block[0] | (block[1] << 8);
+    int color1 = block[2] | (block[3] << 8);
+    Uint32 bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((Uint32)block[7] << 24);
+
+    int palette[4][4];
+    build_color_palette(color0, color1, always_four_colors || color0 > color1, palette);
+
+    for (int t = 0; t < 16; ++t) {
+        int *color = palette[(bits >> (t*2)) & 3];
+        texels[t*4 + 0] = (Uint8)color[0];
+        texels[t*4 + 1] = (Uint8)color[1];
+        texels[t*4 + 2] = (Uint8)color[2];
+        texels[t*4 + 3] = (Uint8)color[3];
+    }
+}
+
+
+// alpha0 > alpha1 is eight steps between them, otherwise six plus exact 0 and 255
+static void build_alpha_palette(int alpha0, int alpha1, int *palette)
+{
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+
+    if (alpha0 > alpha1) {
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1] = ((7 - i)*alpha0 + i*alpha1)/7;
+        }
+    }
+    else {
+        for (int i = 1; i < 5; ++i) {
+            palette[i + 1] = ((5 - i)*alpha0 + i*alpha1)/5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+
+static int find_alpha_indices(const Uint8 *texels, const int *palette, int *indices)
+{
+    int error = 0;
+
+    for (int t = 0; t < 16; ++t) {
+        int alpha = texels[t*4 + 3];
+        int best = 0x7fffffff;
+
+        for (int p = 0; p < 8; ++p) {
+            int delta = alpha - palette[p];
+            if (delta*delta < best) {
+                best = delta*delta;
+                indices[t] = p;
+            }
+        }
+
+        error += best;
+    }
+
+    return error;
+}
+
+
+static void encode_alpha_block(const Uint8 *texels, Uint8 *block)
+{
+    int low = 255;
+    int high = 0;
+    int inner_low = 255;
+    int inner_high = 0;
+
+    for (int t = 0; t < 16; ++t) {
+        int alpha = texels[t*4 + 3];
+        low = alpha < low ? alpha : low;
+        high = alpha > high ? alpha : high;
+
+        if (alpha != 0 && alpha != 255) {
+            inner_low = alpha < inner_low ? alpha : inner_low;
+            inner_high = alpha > inner_high ? alpha : inner_high;
+        }
+    }
+
+    if (inner_low > inner_high) {
+        inner_low = inner_high = 0;
+    }
+
+    int palette[8];
+    int indices[16];
+    build_alpha_palette(high, low, palette);
+    int error = find_alpha_indices(texels, palette, indices);
+    int alpha0 = high;
+    int alpha1 = low;
+
+    // sprite edges go from 0 to 255 with a few steps in between, the exact ends help there
+    if (error > 0) {
+        int edge_palette[8];
+        int edge_indices[16];
+        build_alpha_palette(inner_low, inner_high, edge_palette);
+
+        if (find_alpha_indices(texels, edge_palette, edge_indices) < error) {
+            alpha0 = inner_low;
+            alpha1 = inner_high;
+            memcpy(indices, edge_indices, sizeof(indices));
+        }
+    }
+
+    Uint64 bits = 0;
+    for (int t = 0; t < 16; ++t) {
+        bits |= (Uint64)indices[t] << (t*3);
+    }
+
+    block[0] = (Uint8)alpha0;
+    block[1] = (Uint8)alpha1;
+    for (int i = 0; i < 6; ++i) {
+        block[2 + i] = (Uint8)((bits >> (i*8)) & 0xff);
+    }
+}
+
+
+int get_texture_mip_count(int width, int height)
+{
+    int size = width > height ? width : height;
+    int count = 1;
+
+    while (size > 1 && count < TEXTURE_MAX_MIPS) {
+        size >>= 1;
+        count += 1;
+    }
+
+    return count;
+}
+
+
+int get_texture_level_bytes(int format, int width, int height)
+{
+    int blocks = ((width + 3)/4)*((height + 3)/4);
+
+    switch (format) {
+        case TEXTURE_FORMAT_BC1: return blocks*8;
+        case TEXTURE_FORMAT_BC3: return blocks*16;
+        default: return width*height*4;
+    }
+}
+
+
+bool alloc_texture_image(TextureImage *image, int format, int width, int height, int mip_count)
+{
+    memset(image, 0, sizeof(TextureImage));
+
+    if (width <= 0 || height <= 0 || mip_count < 1 || mip_count > TEXTURE_MAX_MIPS) {
+        LOG_ERROR(LOG_RENDER, "Cannot lay out a %dx%d texture with %d mips", width, height, mip_count);
+        return false;
+    }
+
+    image->format = format;
+    image->width = width;
+    image->height = height;
+    image->mip_count = mip_count;
+
+    for (int level = 0; level < mip_count; ++level) {
+        image->mip_bytes[level] = get_texture_level_bytes(format, get_level_size(width, level), get_level_size(height, level));
+        image->bytes += image->mip_bytes[level];
+    }
+
+    image->memory = tracked_malloc(image->bytes);
+    if (image->memory == nullptr) {
+        LOG_ERROR(LOG_MEMORY, "Could not allocate %d bytes for a %dx%d texture", image->bytes, width, height);
+        memset(image, 0, sizeof(TextureImage));
+        return false;
+    }
+
+    Uint8 *level_memory = (Uint8 *)image->memory;
+    for (int level = 0; level < mip_count; ++level) {
+        image->mips[level] = level_memory;
+        level_memory += image->mip_bytes[level];
+    }
+
+    return true;
+}
+
+
+void free_texture_image(TextureImage *image)
+{
+    free(image->memory);
+    memset(image, 0, sizeof(TextureImage));
+}
+
+
+void encode_bc1_block(const Uint8 *texels, Uint8 *block)
+{
+    // cut where sprite.fs.glsl cuts, a block with anything under that goes three colors and transparent
+    Uint32 kept = 0;
+    for (int t = 0; t < 16; ++t) {
+        if (texels[t*4 + 3] >= COMPRESSION_CUTOUT_ALPHA) {
+            kept |= 1u << t;
+        }
+    }
+
+    // all of it cut, black endpoints and every index transparent
+    if (kept == 0) {
+        memset(block, 0, 4);
+        memset(block + 4, 0xff, 4);
+        return;
+    }
+
+    encode_color_block(texels, kept, kept == 0xffff, block);
+}
+
+
+void encode_bc3_block(const Uint8 *texels, Uint8 *block)
+{
+    // the color of something fully transparent never shows, so it doesn't get a say
+    Uint32 visible = 0;
+    for (int t = 0; t < 16; ++t) {
+        if (texels[t*4 + 3] > 0) {
+            visible |= 1u << t;
+        }
+    }
+
+    encode_alpha_block(texels, block);
+    encode_color_block(texels, visible, true, block + 8);
+}
+
+
+void decode_bc1_block(const Uint8 *block, Uint8 *texels)
+{
+    decode_color_block(block, false, texels);
+}
+
+
+void decode_bc3_block(const Uint8 *block, Uint8 *texels)
+{
+    decode_color_block(block + 8, true, texels);
+
+    int palette[8];
+    build_alpha_palette(block[0], block[1], palette);
+
+    Uint64 bits = 0;
+    for (int i = 0; i < 6; ++i) {
+        bits |= (Uint64)block[2 + i] << (i*8);
+    }
+
+    for (int t = 0; t < 16; ++t) {
+        texels[t*4 + 3] = (Uint8)palette[(bits >> (t*3)) & 7];
+    }
+}
+
+
+void build_texture_mips(TextureImage *image)
+{
+    for (int level = 1; level < image->mip_count; ++level) {
+        const Uint8 *source = image->mips[level - 1];
+        int source_width = get_level_size(image->width, level - 1);
+        int source_height = get_level_size(image->height, level - 1);
+
+        Uint8 *target = image->mips[level];
+        int width = get_level_size(image->width, level);
+        int height = get_level_size(image->height, level);
+
+        for (int y = 0; y < height; ++y) {
+            int y0 = 2*y < source_height ? 2*y : source_height - 1;
+            int y1 = 2*y + 1 < source_height ? 2*y + 1 : source_height - 1;
+
+            for (int x = 0; x < width; ++x) {
+                int x0 = 2*x < source_width ? 2*x : source_width - 1;
+                int x1 = 2*x + 1 < source_width ? 2*x + 1 : source_width - 1;
+
+                const Uint8 *quad[4] = {
+                    source + (y0*source_width + x0)*4,
+                    source + (y0*source_width + x1)*4,
+                    source + (y1*source_width + x0)*4,
+                    source + (y1*source_width + x1)*4,
+                };
+
+                // weighted by alpha, so transparent texels don't darken the edges
+                int alpha_sum = 0;
+                int weighted[3] = {};
+                int plain[3] = {};
+                for (int i = 0; i < 4; ++i) {
+                    alpha_sum += quad[i][3];
+                    for (int c = 0; c < 3; ++c) {
+                        weighted[c] += quad[i][c]*quad[i][3];
+                        plain[c] += quad[i][c];
+                    }
+                }
+
+                Uint8 *texel = target + (y*width + x)*4;
+                for (int c = 0; c < 3; ++c) {
+                    texel[c] = (Uint8)(alpha_sum > 0 ? (weighted[c] + alpha_sum/2)/alpha_sum : (plain[c] + 2)/4);
+                }
+                texel[3] = (Uint8)((alpha_sum + 2)/4);
+            }
+        }
+    }
+}
+
+
+int pick_compressed_format(const TextureImage *rgba)
+{
+    const Uint8 *texels = rgba->mips[0];
+    int count = rgba->width*rgba->height;
+
+    // a solid shape's antialiased edge is a thin band of these, a glow is mostly them
+    int soft = 0;
+    for (int i = 0; i < count; ++i) {
+        if (texels[i*4 + 3] != 0 && texels[i*4 + 3] != 255) {
+            soft += 1;
+        }
+    }
+
+    return soft <= (int)(count*COMPRESSION_CUTOUT_SOFT_SHARE) ? TEXTURE_FORMAT_BC1 : TEXTURE_FORMAT_BC3;
+}
+
+
+struct CompressionWork {
+    const TextureImage *rgba;
+    TextureImage *compressed;
+
+    int row_count;                              // block rows, every level
+    int level_first_row[TEXTURE_MAX_MIPS];
+    SDL_atomic_t next_row;
+};
+
+
+static void compress_block_row(CompressionWork *work, int row)
+{
+    const TextureImage *rgba = work->rgba;
+    TextureImage *compressed = work->compressed;
+
+    int level = rgba->mip_count - 1;
+    while (work->level_first_row[level] > row) {
+        --level;
+    }
+
+    int width = get_level_size(rgba->width, level);
+    int height = get_level_size(rgba->height, level);
+    int blocks_x = (width + 3)/4;
+    int block_y = row - work->level_first_row[level];
+    int block_bytes = compressed->format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+
+    const Uint8 *source = rgba->mips[level];
+    Uint8 *block = compressed->mips[level] + block_y*blocks_x*block_bytes;
+    Uint8 texels[64];
+
+    for (int block_x = 0; block_x < blocks_x; ++block_x) {
+        // a partial block repeats its last row and column
+        for (int j = 0; j < 4; ++j) {
+            int y = block_y*4 + j < height ? block_y*4 + j : height - 1;
+            for (int i = 0; i < 4; ++i) {
+                int x = block_x*4 + i < width ? block_x*4 + i : width - 1;
+                memcpy(texels + (j*4 + i)*4, source + (y*width + x)*4, 4);
+            }
+        }
+
+        if (compressed->format == TEXTURE_FORMAT_BC1) {
+            encode_bc1_block(texels, block);
+        }
+        else {
+            encode_bc3_block(texels, block);
+        }
+        block += block_bytes;
+    }
+}
+
+
+static int SDLCALL compression_worker_main(void *data)
+{
+    CompressionWork *work = (CompressionWork *)data;
+
+    for (;;) {
+        int row = SDL_AtomicAdd(&work->next_row, 1);
+        if (row >= work->row_count) {
+            break;
+        }
+        compress_block_row(work, row);
+    }
+
+    return 0;
+}
+
+
+bool compress_texture_image(const TextureImage *rgba, int format, TextureImage *compressed)
+{
+    if (rgba->format != TEXTURE_FORMAT_RGBA8 || (format != TEXTURE_FORMAT_BC1 && format != TEXTURE_FORMAT_BC3)) {
+        LOG_ERROR(LOG_RENDER, "Can only compress RGBA8 to BC1 or BC3");
+        return false;
+    }
+
+    if (!alloc_texture_image(compressed, format, rgba->width, rgba->height, rgba->mip_count)) {
+        return false;
+    }
+
+    CompressionWork work;
+    memset(&work, 0, sizeof(CompressionWork));
+    work.rgba = rgba;
+    work.compressed = compressed;
+
+    for (int level = 0; level < rgba->mip_count; ++level) {
+        work.level_first_row[level] = work.row_count;
+        work.row_count += (get_level_size(rgba->height, level) + 3)/4;
+    }
+
+    // this thread works too, the others only help when there are rows enough
+    int helpers = SDL_GetCPUCount() - 1;
+    helpers = helpers < COMPRESSION_MAX_WORKERS - 1 ? helpers : COMPRESSION_MAX_WORKERS - 1;
+    helpers = helpers < work.row_count - 1 ? helpers : work.row_count - 1;
+
+    SDL_Thread *threads[COMPRESSION_MAX_WORKERS];
+    int thread_count = 0;
+    for (int i = 0; i < helpers; ++i) {
+        threads[thread_count] = SDL_CreateThread(compression_worker_main, "compress", &work);
+        if (threads[thread_count]) {
+            thread_count += 1;
+        }
+    }
+
+    compression_worker_main(&work);
+
+    for (int i = 0; i < thread_count; ++i) {
+        SDL_WaitThread(threads[i], nullptr);
+    }
+
+    return true;
+}
+
+
+bool decompress_texture_image(const TextureImage *compressed, int mip_count, TextureImage *rgba)
+{
+    if (compressed->format != TEXTURE_FORMAT_BC1 && compressed->format != TEXTURE_FORMAT_BC3) {
+        LOG_ERROR(LOG_RENDER, "Can only decompress BC1 or BC3");
+        return false;
+    }
+
+    mip_count = mip_count < compressed->mip_count ? mip_count : compressed->mip_count;
+    if (!alloc_texture_image(rgba, TEXTURE_FORMAT_RGBA8, compressed->width, compressed->height, mip_count)) {
+        return false;
+    }
+
+    int block_bytes = compressed->format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+    Uint8 texels[64];
+
+    for (int level = 0; level < mip_count; ++level) {
+        int width = get_level_size(compressed->width, level);
+        int height = get_level_size(compressed->height, level);
+        const Uint8 *block = compressed->mips[level];
+        Uint8 *target = rgba->mips[level];
+
+        for (int block_y = 0; block_y*4 < height; ++block_y) {
+            for (int block_x = 0; block_x*4 < width; ++block_x) {
+                if (compressed->format == TEXTURE_FORMAT_BC1) {
+                    decode_bc1_block(block, texels);
+                }
+                else {
+                    decode_bc3_block(block, texels);
+                }
+                block += block_bytes;
+
+                for (int j = 0; j < 4 && block_y*4 + j < height; ++j) {
+                    for (int i = 0; i < 4 && block_x*4 + i < width; ++i) {
+                        memcpy(target + ((block_y*4 + j)*width + block_x*4 + i)*4, texels + (j*4 + i)*4, 4);
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static float get_psnr_db(double squared_error, double samples)
+{
+    if (samples <= 0.0 || squared_error <= 0.0) {
+        return COMPRESSION_PSNR_EXACT_DB;
+    }
+
+    return (float)(10.0*log10(255.0*255.0/(squared_error/samples)));
+}
+
+
+void measure_texture_psnr(const TextureImage *source, const TextureImage *decoded, float *color_db, float *alpha_db)
+{
+    const Uint8 *a = source->mips[0];
+    const Uint8 *b = decoded->mips[0];
+    int count = source->width*source->height;
+
+    double color_error = 0.0;
+    double color_samples = 0.0;
+    double alpha_error = 0.0;
+
+    for (int i = 0; i < count; ++i) {
+        if (a[i*4 + 3] > 0 && b[i*4 + 3] > 0) {
+            for (int c = 0; c < 3; ++c) {
+                double delta = (double)a[i*4 + c] - (double)b[i*4 + c];
+                color_error += delta*delta;
+            }
+            color_samples += 3.0;
+        }
+
+        double delta = (double)a[i*4 + 3] - (double)b[i*4 + 3];
+        alpha_error += delta*delta;
+    }
+
+    *color_db = get_psnr_db(color_error, color_samples);
+    *alpha_db = get_psnr_db(alpha_error, (double)count);
+}
+
+
+bool load_compressed_texture(const void *data, size_t size, TextureImage *image)
+{
+    CompressedTextureHeader header;
+    if (size < sizeof(CompressedTextureHeader)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(CompressedTextureHeader));
+
+    if (header.magic != COMPRESSED_TEXTURE_MAGIC || header.version != COMPRESSED_TEXTURE_VERSION ||
+        (header.format != TEXTURE_FORMAT_BC1 && header.format != TEXTURE_FORMAT_BC3) ||
+        header.width == 0 || header.height == 0 || header.width > 16384 || header.height > 16384 ||
+        header.mip_count == 0 || header.mip_count > TEXTURE_MAX_MIPS)
+    {
+        return false;
+    }
+
+    if (!alloc_texture_image(image, (int)header.format, (int)header.width, (int)header.height, (int)header.mip_count)) {
+        return false;
+    }
+
+    for (int level = 0; level < image->mip_count; ++level) {
+        Uint64 end = (Uint64)header.mip_offsets[level] + header.mip_sizes[level];
+        if (header.mip_sizes[level] != (Uint32)image->mip_bytes[level] || end > size) {
+            free_texture_image(image);
+            return false;
+        }
+
+        memcpy(image->mips[level], (const Uint8 *)data + header.mip_offsets[level], header.mip_sizes[level]);
+    }
+
+    return true;
+}
+
+
+bool write_compressed_texture(const char *path, const TextureImage *image)
+{
+    CompressedTextureHeader header;
+    memset(&header, 0, sizeof(CompressedTextureHeader));
+    header.magic = COMPRESSED_TEXTURE_MAGIC;
+    header.version = COMPRESSED_TEXTURE_VERSION;
+    header.format = (Uint32)image->format;
+    header.width = (Uint32)image->width;
+    header.height = (Uint32)image->height;
+    header.mip_count = (Uint32)image->mip_count;
+
+    Uint32 offset = sizeof(CompressedTextureHeader);
+    for (int level = 0; level < image->mip_count; ++level) {
+        header.mip_offsets[level] = offset;
+        header.mip_sizes[level] = (Uint32)image->mip_bytes[level];
+        offset += header.mip_sizes[level];
+    }
+
+    std::fstream file;
+    file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_ERROR(LOG_RENDER, "Could not create compressed texture: %s", path);
+        return false;
+    }
+
+    file.write((const char *)&header, sizeof(CompressedTextureHeader));
+    file.write((const char *)image->memory, image->bytes);
+
+    if (!file.good()) {
+        LOG_ERROR(LOG_RENDER, "Could not write compressed texture: %s", path);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool get_compressed_texture_path(const char *image_path, char *compressed_path, int size)
+{
+    const char *extension = SDL_strrchr(image_path, '.');
+    const char *separator = SDL_strrchr(image_path, '/');
+    int stem_length = (extension && (!separator || extension > separator)) ? (int)(extension - image_path) : (int)SDL_strlen(image_path);
+
+    int written = SDL_snprintf(compressed_path, size, "%.*s%s", stem_length, image_path, COMPRESSED_TEXTURE_EXTENSION);
+    return written > 0 && written < size;
+}
+
+
+bool compress_texture_directory(const char *directory)
+{
+    std::vector<std::string> files;
+    collect_directory_files(directory, "", files);
+
+    int compressed_count = 0;
+    int failed_count = 0;
+    Sint64 source_bytes = 0;
+    Sint64 compressed_bytes = 0;
+    Uint64 start_counter = SDL_GetPerformanceCounter();
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        const std::string &file = files[i];
+        if (file.size() < 4 || SDL_strcasecmp(file.c_str() + file.size() - 4, ".png") != 0) {
+            continue;
+        }
+
+        std::string path = std::string(directory) + "/" + file;
+        Uint64 file_counter = SDL_GetPerformanceCounter();
+
+        SDL_Surface *surface = IMG_Load(path.c_str());
+        if (surface && surface->format->format != SDL_PIXELFORMAT_RGBA32) {
+            SDL_Surface *rgba_surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+            SDL_FreeSurface(surface);
+            surface = rgba_surface;
+        }
+
+        if (surface == nullptr) {
+            LOG_ERROR(LOG_RENDER, "Could not load image named: %s", path.c_str());
+            failed_count += 1;
+            continue;
+        }
+
+        TextureImage rgba;
+        if (!alloc_texture_image(&rgba, TEXTURE_FORMAT_RGBA8, surface->w, surface->h, get_texture_mip_count(surface->w, surface->h))) {
+            SDL_FreeSurface(surface);
+            failed_count += 1;
+            continue;
+        }
+
+        for (int y = 0; y < surface->h; ++y) {
+            memcpy(rgba.mips[0] + y*surface->w*4, (const Uint8 *)surface->pixels + y*surface->pitch, surface->w*4);
+        }
+        SDL_FreeSurface(surface);
+
+        build_texture_mips(&rgba);
+
+        TextureImage compressed = {};
+        TextureImage decoded = {};
+        char compressed_path[1024];
+        float color_db = 0.f;
+        float alpha_db = 0.f;
+
+        int format = pick_compressed_format(&rgba);
+        bool written = compress_texture_image(&rgba, format, &compressed) &&
+                       decompress_texture_image(&compressed, 1, &decoded);
+
+        if (written) {
+            measure_texture_psnr(&rgba, &decoded, &color_db, &alpha_db);
+            free_texture_image(&decoded);
+
+            written = get_compressed_texture_path(path.c_str(), compressed_path, sizeof(compressed_path)) &&
+                      write_compressed_texture(compressed_path, &compressed);
+        }
+
+        if (written) {
+            // against what the upload took before, one level of RGBA
+            int uncompressed = get_texture_level_bytes(TEXTURE_FORMAT_RGBA8, rgba.width, rgba.height);
+            float ms = (float)((SDL_GetPerformanceCounter() - file_counter)*1000.0/SDL_GetPerformanceFrequency());
+
+            LOG_INFO(LOG_RENDER, "%s: %dx%d %s, %d mips, %d KB -> %d KB, color %.1f dB, alpha %.1f dB, %.1f ms",
+                     file.c_str(), rgba.width, rgba.height, format == TEXTURE_FORMAT_BC1 ? "BC1" : "BC3", compressed.mip_count,
+                     uncompressed >> 10, compressed.bytes >> 10, color_db, alpha_db, ms);
+
+            source_bytes += uncompressed;
+            compressed_bytes += compressed.bytes;
+            compressed_count += 1;
+        }
+        else {
+            failed_count += 1;
+        }
+
+        free_texture_image(&compressed);
+        free_texture_image(&rgba);
+    }
+
+    if (compressed_count == 0 && failed_count == 0) {
+        LOG_ERROR(LOG_RENDER, "No images to compress in %s", directory);
+        return false;
+    }
+
+    float seconds = (float)((SDL_GetPerformanceCounter() - start_counter)/(double)SDL_GetPerformanceFrequency());
+    LOG_INFO(LOG_RENDER, "Compressed %d images in %.2fs, %d failed: %d KB -> %d KB with mips, %.1fx smaller",
+             compressed_count, seconds, failed_count, (int)(source_bytes >> 10), (int)(compressed_bytes >> 10),
+             compressed_bytes > 0 ? (float)source_bytes/(float)compressed_bytes : 0.f);
+
+    return failed_count == 0;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "types.h"
+#include "vfs.hpp"
+
+// SSE2 is baseline on x64, the scalar path covers everything else
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMPRESSION_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define COMPRESSION_SIMD_SSE2 0
+#endif
+
+// Block compressed textures, built when the assets are and loaded instead of
+// the image they came from. Opaque images and solid shapes become BC1, half a
+// byte a texel, with alpha cut where the cutout blend cuts it. Soft ones,
+// glows and the like, become BC3, one byte a texel. Both with the whole mip chain.
+// The .bct sits next to its image and goes into the pack like any other file,
+// so a texture without one just loads the image as before.
+#define COMPRESSED_TEXTURE_MAGIC 0x31544342 // "BCT1"
+#define COMPRESSED_TEXTURE_VERSION 1
+#define COMPRESSED_TEXTURE_EXTENSION ".bct"
+
+#define TEXTURE_MAX_MIPS 16
+#define COMPRESSION_MAX_WORKERS 16
+
+// alpha BC1 keeps opaque, sprite.fs.glsl drops everything under half
+#define COMPRESSION_CUTOUT_ALPHA 128
+
+// the share of level 0 between transparent and opaque an image can have and
+// still go BC1, solid sprites have their edges there, soft ones have more
+#define COMPRESSION_CUTOUT_SOFT_SHARE 0.25f
+
+// refits of the color endpoints to the indices they picked, each one keeps the better result
+#define COMPRESSION_REFINE_PASSES 2
+
+enum TEXTURE_FORMAT {
+    TEXTURE_FORMAT_RGBA8,
+    TEXTURE_FORMAT_BC1,         // 8 bytes a 4x4 block, opaque or cut out
+    TEXTURE_FORMAT_BC3,         // 16 bytes a block, 8 of them alpha
+};
+
+// the file is this, then each level's blocks where its offset says
+struct CompressedTextureHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 format;
+    Uint32 width;
+    Uint32 height;
+    Uint32 mip_count;
+    Uint32 mip_offsets[TEXTURE_MAX_MIPS];
+    Uint32 mip_sizes[TEXTURE_MAX_MIPS];
+};
+
+// decoded and ready to upload, every level in one allocation
+struct TextureImage {
+    int format;
+    int width;
+    int height;
+
+    int mip_count;
+    Uint8 *mips[TEXTURE_MAX_MIPS];
+    int mip_bytes[TEXTURE_MAX_MIPS];
+
+    void *memory;
+    int bytes;                  // all levels
+};
+
+int get_texture_mip_count(int width, int height);
+int get_texture_level_bytes(int format, int width, int height);
+
+// the levels are laid out, their contents are left to the caller
+bool alloc_texture_image(TextureImage *image, int format, int width, int height, int mip_count);
+void free_texture_image(TextureImage *image);
+
+// texels are 16 RGBA8 in rows of four
+void encode_bc1_block(const Uint8 *texels, Uint8 *block);
+void encode_bc3_block(const Uint8 *texels, Uint8 *block);
+void decode_bc1_block(const Uint8 *block, Uint8 *texels);
+void decode_bc3_block(const Uint8 *block, Uint8 *texels);
+
+// level 0 is filled in, the rest are averaged down from it weighted by alpha
+void build_texture_mips(TextureImage *image);
+
+// BC1 unless more of level 0 is partly transparent than COMPRESSION_CUTOUT_SOFT_SHARE
+int pick_compressed_format(const TextureImage *rgba);
+
+// every level, block rows shared out over a few threads
+bool compress_texture_image(const TextureImage *rgba, int format, TextureImage *compressed);
+
+// back to RGBA8, the first mip_count levels
+bool decompress_texture_image(const TextureImage *compressed, int mip_count, TextureImage *rgba);
+
+// over level 0. color only counts where neither side is fully transparent, BC1
+// cutting a texel out shows up in alpha
+void measure_texture_psnr(const TextureImage *source, const TextureImage *decoded, float *color_db, float *alpha_db);
+
+bool load_compressed_texture(const void *data, size_t size, TextureImage *image);
+bool write_compressed_texture(const char *path, const TextureImage *image);
+
+// images/foo.png -> images/foo.bct
+bool get_compressed_texture_path(const char *image_path, char *compressed_path, int size);
+
+// the asset step: a .bct for every .png below the directory, with sizes and PSNR logged
+bool compress_texture_directory(const char *directory);
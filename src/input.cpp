@@ -0,0 +1,361 @@
+#include "input.hpp"
+
+static void set_controller_button(GamePadController *controller, Uint8 button, bool pressed)
+{
+    switch(button) {
+        case BUTTON_UP:    controller->btn_up = pressed; break;
+        case BUTTON_DOWN:  controller->btn_down = pressed; break;
+        case BUTTON_LEFT:  controller->btn_left = pressed; break;
+        case BUTTON_RIGHT: controller->btn_right = pressed; break;
+        case BUTTON_A:     controller->btn_a = pressed; break;
+        case BUTTON_B:     controller->btn_b = pressed; break;
+        case BUTTON_X:     controller->btn_x = pressed; break;
+        case BUTTON_Y:     controller->btn_y = pressed; break;
+    }
+}
+
+
+Uint8 pack_controller(const GamePadController *controller)
+{
+    return (Uint8)((controller->btn_up << BUTTON_UP) | (controller->btn_down << BUTTON_DOWN) |
+                   (controller->btn_left << BUTTON_LEFT) | (controller->btn_right << BUTTON_RIGHT) |
+                   (controller->btn_a << BUTTON_A) | (controller->btn_b << BUTTON_B) |
+                   (controller->btn_x << BUTTON_X) | (controller->btn_y << BUTTON_Y));
+}
+
+
+void unpack_controller(Uint8 bits, GamePadController *controller)
+{
+    for (Uint8 button = 0; button < BUTTON_COUNT; ++button) {
+        set_controller_button(controller, button, (bits >> button) & 1);
+    }
+}
+
+
+void init_input(InputSystem *input, INPUT_MODE mode, const std::string &filename)
+{
+    if (input == nullptr) {
+        LOG_ERROR(LOG_INPUT, "input system is null");
+        exit(1);
+    }
+
+    input->mode = mode;
+    input->filename = filename;
+    input->tick = 0;
+    memset(&input->state, 0, sizeof(GamePadController));
+    input->pending.clear();
+    input->events.clear();
+    input->checksums.clear();
+    input->replay_event_cursor = 0;
+    input->replay_checksum_cursor = 0;
+    input->replay_tick_count = 0;
+    input->desyncs = 0;
+
+    // reserved up front so polling and recording don't allocate mid-session
+    input->pending.reserve(INPUT_PENDING_RESERVE);
+    if (mode == INPUT_RECORD) {
+        input->events.reserve(INPUT_RECORD_RESERVE);
+        input->checksums.reserve(INPUT_RECORD_RESERVE);
+    }
+
+    if (mode == INPUT_REPLAY) {
+        if (!load_input_recording(input, filename)) {
+            LOG_ERROR(LOG_INPUT, "Could not load input recording: %s", filename.c_str());
+            exit(1);
+        }
+    }
+}
+
+
+void shutdown_input(InputSystem *input)
+{
+    if (input->mode == INPUT_RECORD) {
+        if (!save_input_recording(input, input->filename)) {
+            LOG_ERROR(LOG_INPUT, "Could not save input recording: %s", input->filename.c_str());
+        }
+    }
+}
+
+
+INPUT_BUTTON input_button_from_key(SDL_Keycode key)
+{
+    switch(key) {
+        case SDLK_UP:    return BUTTON_UP;
+        case SDLK_DOWN:  return BUTTON_DOWN;
+        case SDLK_LEFT:  return BUTTON_LEFT;
+        case SDLK_RIGHT: return BUTTON_RIGHT;
+        case SDLK_a:     return BUTTON_A;
+        case SDLK_s:     return BUTTON_B;
+    }
+
+    return BUTTON_NONE;
+}
+
+
+void input_handle_key(InputSystem *input, SDL_Keycode key, bool pressed)
+{
+    // a replay owns the controller, live keys would make it diverge
+    if (input->mode == INPUT_REPLAY) {
+        return;
+    }
+
+    INPUT_BUTTON button = input_button_from_key(key);
+    if (button == BUTTON_NONE) {
+        return;
+    }
+
+    InputEvent event;
+    event.tick = input->tick;
+    event.button = (Uint8)button;
+    event.pressed = pressed ? 1 : 0;
+    input->pending.push_back(event);
+}
+
+
+void input_begin_tick(InputSystem *input, GamePadController *controller)
+{
+    if (input->mode == INPUT_REPLAY) {
+        while (input->replay_event_cursor < input->events.size() &&
+               input->events[input->replay_event_cursor].tick <= input->tick)
+        {
+            InputEvent *event = &input->events[input->replay_event_cursor++];
+            set_controller_button(&input->state, event->button, event->pressed != 0);
+        }
+    }
+    else {
+        // events polled between ticks land on the tick that consumes them
+        for (size_t i = 0; i < input->pending.size(); ++i) {
+            InputEvent event = input->pending[i];
+            event.tick = input->tick;
+            set_controller_button(&input->state, event.button, event.pressed != 0);
+
+            if (input->mode == INPUT_RECORD) {
+                input->events.push_back(event);
+            }
+        }
+        input->pending.clear();
+    }
+
+    if (controller) {
+        *controller = input->state;
+    }
+}
+
+
+void input_peek_state(InputSystem *input, GamePadController *controller)
+{
+    *controller = input->state;
+
+    if (input->mode != INPUT_REPLAY) {
+        for (size_t i = 0; i < input->pending.size(); ++i) {
+            set_controller_button(controller, input->pending[i].button, input->pending[i].pressed != 0);
+        }
+    }
+}
+
+
+void input_end_tick(InputSystem *input, Uint32 state_hash)
+{
+    if ((input->tick % INPUT_CHECKSUM_INTERVAL_TICKS) == 0) {
+        if (input->mode == INPUT_RECORD) {
+            InputChecksum checksum;
+            checksum.tick = input->tick;
+            checksum.hash = state_hash;
+            input->checksums.push_back(checksum);
+        }
+        else if (input->mode == INPUT_REPLAY && input->replay_checksum_cursor < input->checksums.size()) {
+            InputChecksum *checksum = &input->checksums[input->replay_checksum_cursor];
+            if (checksum->tick == input->tick) {
+                if (checksum->hash != state_hash) {
+                    if (input->desyncs == 0) {
+                        LOG_ERROR(LOG_INPUT, "Replay desync at tick %u", input->tick);
+                    }
+                    input->desyncs += 1;
+                }
+                input->replay_checksum_cursor += 1;
+            }
+        }
+    }
+
+    input->tick += 1;
+}
+
+
+bool input_replay_finished(InputSystem *input)
+{
+    return input->mode == INPUT_REPLAY && input->tick >= input->replay_tick_count;
+}
+
+
+static void write_varint(std::vector<Uint8> &out, Uint32 value)
+{
+    while (value >= 0x80) {
+        out.push_back((Uint8)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((Uint8)value);
+}
+
+
+static bool read_varint(const Uint8 **cursor, const Uint8 *end, Uint32 *value)
+{
+    Uint32 result = 0;
+    int shift = 0;
+
+    while (*cursor < end && shift < 32) {
+        Uint8 byte = *(*cursor)++;
+        result |= (Uint32)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+        shift += 7;
+    }
+
+    return false;
+}
+
+
+bool save_input_recording(InputSystem *input, const std::string &filename)
+{
+    InputFileHeader header;
+    header.magic = INPUT_FILE_MAGIC;
+    header.version = INPUT_FILE_VERSION;
+    header.ticks_per_second = SIMULATION_TICKS_PER_SECOND;
+    header.tick_count = input->tick;
+    header.event_count = (Uint32)input->events.size();
+    header.checksum_count = (Uint32)input->checksums.size();
+
+    // events and checksums are merged in tick order, each stamped with a
+    // varint delta from the previous record
+    std::vector<Uint8> body;
+    body.reserve(input->events.size()*2 + input->checksums.size()*6 + 1);
+
+    size_t e = 0;
+    size_t c = 0;
+    Uint32 last_tick = 0;
+    while (e < input->events.size() || c < input->checksums.size()) {
+        bool take_checksum = e >= input->events.size() ||
+            (c < input->checksums.size() && input->checksums[c].tick < input->events[e].tick);
+
+        if (take_checksum) {
+            InputChecksum *checksum = &input->checksums[c++];
+            write_varint(body, checksum->tick - last_tick);
+            body.push_back(INPUT_CODE_CHECKSUM);
+            for (int i = 0; i < 4; ++i) {
+                body.push_back((Uint8)(checksum->hash >> (i*8)));
+            }
+            last_tick = checksum->tick;
+        }
+        else {
+            InputEvent *event = &input->events[e++];
+            write_varint(body, event->tick - last_tick);
+            body.push_back((Uint8)((event->pressed ? 0x80 : 0) | event->button));
+            last_tick = event->tick;
+        }
+    }
+    write_varint(body, 0);
+    body.push_back(INPUT_CODE_END);
+
+    std::fstream file;
+    file.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.write((char*)&header, sizeof(InputFileHeader));
+    file.write((char*)body.data(), body.size());
+
+    LOG_INFO(LOG_INPUT, "Saved input recording %s: %u ticks, %u events, %d bytes", filename.c_str(),
+             header.tick_count, header.event_count, (int)(sizeof(InputFileHeader) + body.size()));
+
+    return file.good();
+}
+
+
+bool load_input_recording(InputSystem *input, const std::string &filename)
+{
+    std::fstream file;
+    file.open(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    size_t size = (size_t)file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    if (size < sizeof(InputFileHeader)) {
+        return false;
+    }
+
+    InputFileHeader header;
+    file.read((char*)&header, sizeof(InputFileHeader));
+
+    if (header.magic != INPUT_FILE_MAGIC || header.version != INPUT_FILE_VERSION) {
+        LOG_ERROR(LOG_INPUT, "Bad input recording header: %s", filename.c_str());
+        return false;
+    }
+
+    if (header.ticks_per_second != SIMULATION_TICKS_PER_SECOND) {
+        LOG_ERROR(LOG_INPUT, "Input recording uses %d ticks/s, expected %d", (int)header.ticks_per_second, SIMULATION_TICKS_PER_SECOND);
+        return false;
+    }
+
+    std::vector<Uint8> body(size - sizeof(InputFileHeader));
+    file.read((char*)body.data(), body.size());
+
+    input->events.clear();
+    input->checksums.clear();
+    input->events.reserve(header.event_count);
+    input->checksums.reserve(header.checksum_count);
+
+    const Uint8 *cursor = body.data();
+    const Uint8 *end = body.data() + body.size();
+    Uint32 tick = 0;
+
+    for (;;) {
+        Uint32 delta = 0;
+        if (!read_varint(&cursor, end, &delta) || cursor >= end) {
+            LOG_ERROR(LOG_INPUT, "Truncated input recording: %s", filename.c_str());
+            return false;
+        }
+        tick += delta;
+
+        Uint8 code = *cursor++;
+        if (code == INPUT_CODE_END) {
+            break;
+        }
+
+        if (code == INPUT_CODE_CHECKSUM) {
+            if (end - cursor < 4) {
+                LOG_ERROR(LOG_INPUT, "Truncated input recording: %s", filename.c_str());
+                return false;
+            }
+
+            InputChecksum checksum;
+            checksum.tick = tick;
+            checksum.hash = 0;
+            for (int i = 0; i < 4; ++i) {
+                checksum.hash |= (Uint32)cursor[i] << (i*8);
+            }
+            cursor += 4;
+            input->checksums.push_back(checksum);
+        }
+        else {
+            InputEvent event;
+            event.tick = tick;
+            event.button = code & 0x7f;
+            event.pressed = (code & 0x80) ? 1 : 0;
+            input->events.push_back(event);
+        }
+    }
+
+    input->replay_tick_count = header.tick_count;
+    input->replay_event_cursor = 0;
+    input->replay_checksum_cursor = 0;
+
+    LOG_INFO(LOG_INPUT, "Loaded input recording %s: %u ticks, %d events", filename.c_str(), header.tick_count, (int)input->events.size());
+
+    return true;
+}
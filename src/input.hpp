@@ -0,0 +1,98 @@
+#pragma once
+
+#include "types.h"
+
+// Fixed simulation step. Every input event is stamped with the tick it is
+// applied on so a recorded session replays through exactly the same states.
+#define SIMULATION_TICKS_PER_SECOND 60
+#define SIMULATION_TICK_S (1.f/SIMULATION_TICKS_PER_SECOND)
+
+#define INPUT_CHECKSUM_INTERVAL_TICKS 60
+#define INPUT_PENDING_RESERVE 64
+#define INPUT_RECORD_RESERVE 8192
+
+#define INPUT_FILE_MAGIC 0x3034444c // "LD40"
+#define INPUT_FILE_VERSION 1
+
+enum INPUT_BUTTON {
+    BUTTON_UP,
+    BUTTON_DOWN,
+    BUTTON_LEFT,
+    BUTTON_RIGHT,
+    BUTTON_A,
+    BUTTON_B,
+    BUTTON_X,
+    BUTTON_Y,
+
+    BUTTON_COUNT,
+    BUTTON_NONE = 0xff
+};
+
+enum INPUT_MODE {
+    INPUT_LIVE,
+    INPUT_RECORD,
+    INPUT_REPLAY
+};
+
+// record codes in the file, one byte after the varint tick delta:
+// bit 7 = pressed, bits 0-6 = button, or one of the special codes below
+#define INPUT_CODE_CHECKSUM 0x7e
+#define INPUT_CODE_END 0x7f
+
+struct InputEvent {
+    Uint32 tick;
+    Uint8 button;
+    Uint8 pressed;
+};
+
+struct InputChecksum {
+    Uint32 tick;
+    Uint32 hash;
+};
+
+struct InputFileHeader {
+    Uint32 magic;
+    Uint16 version;
+    Uint16 ticks_per_second;
+    Uint32 tick_count;
+    Uint32 event_count;
+    Uint32 checksum_count;
+};
+
+struct InputSystem {
+    INPUT_MODE mode;
+    std::string filename;
+
+    Uint32 tick;
+    GamePadController state;
+
+    std::vector<InputEvent> pending;
+    std::vector<InputEvent> events;
+    std::vector<InputChecksum> checksums;
+
+    size_t replay_event_cursor;
+    size_t replay_checksum_cursor;
+    Uint32 replay_tick_count;
+
+    int desyncs;
+};
+
+void init_input(InputSystem *input, INPUT_MODE mode, const std::string &filename);
+void shutdown_input(InputSystem *input);
+
+INPUT_BUTTON input_button_from_key(SDL_Keycode key);
+void input_handle_key(InputSystem *input, SDL_Keycode key, bool pressed);
+
+// one bit per INPUT_BUTTON, for anything that sends or stores a controller
+Uint8 pack_controller(const GamePadController *controller);
+void unpack_controller(Uint8 bits, GamePadController *controller);
+
+void input_begin_tick(InputSystem *input, GamePadController *controller);
+
+// the state the next tick will start from, without consuming or recording anything
+void input_peek_state(InputSystem *input, GamePadController *controller);
+void input_end_tick(InputSystem *input, Uint32 state_hash);
+bool input_replay_finished(InputSystem *input);
+
+bool save_input_recording(InputSystem *input, const std::string &filename);
+bool load_input_recording(InputSystem *input, const std::string &filename);
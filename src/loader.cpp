@@ -0,0 +1,106 @@
+#include "loader.hpp"
+
+static int SDLCALL loader_thread_main(void *userdata)
+{
+    Loader *loader = (Loader *)userdata;
+
+    // everything the loader allocates is load time, whichever frame it lands in
+    ALLOC_SCOPE(ALLOC_LOADING);
+
+    for (;;) {
+        SDL_SemWait(loader->pending);
+
+        Uint32 read = (Uint32)SDL_AtomicGet(&loader->read_index);
+        Uint32 write = (Uint32)SDL_AtomicGet(&loader->write_index);
+
+        // the quit post comes after every job queued before it
+        if (read == write) {
+            if (SDL_AtomicGet(&loader->quit)) {
+                break;
+            }
+            continue;
+        }
+
+        LoadJob *job = loader->queue[read % LOADER_QUEUE_SIZE];
+        job->run(job->data);
+
+        SDL_AtomicSet(&loader->read_index, (int)(read + 1));
+        SDL_AtomicAdd(&loader->jobs_done, 1);
+        SDL_AtomicSet(&job->done, 1);
+    }
+
+    return 0;
+}
+
+
+void init_loader(Loader *loader)
+{
+    if (loader == nullptr) {
+        LOG_ERROR(LOG_CORE, "loader is null");
+        exit(1);
+    }
+
+    memset(loader, 0, sizeof(Loader));
+
+    loader->pending = SDL_CreateSemaphore(0);
+    loader->thread = SDL_CreateThread(loader_thread_main, "loader", loader);
+
+    if (loader->pending == nullptr || loader->thread == nullptr) {
+        LOG_ERROR(LOG_CORE, "Could not start the loader thread: %s", SDL_GetError());
+        exit(1);
+    }
+}
+
+
+void shutdown_loader(Loader *loader)
+{
+    if (loader->thread == nullptr) {
+        return;
+    }
+
+    SDL_AtomicSet(&loader->quit, 1);
+    SDL_SemPost(loader->pending);
+    SDL_WaitThread(loader->thread, nullptr);
+    SDL_DestroySemaphore(loader->pending);
+
+    LOG_INFO(LOG_CORE, "Loader: %d jobs done", SDL_AtomicGet(&loader->jobs_done));
+
+    loader->thread = nullptr;
+    loader->pending = nullptr;
+}
+
+
+void queue_load_job(Loader *loader, LoadJob *job, LoadJobFunc run, void *data)
+{
+    job->run = run;
+    job->data = data;
+    SDL_AtomicSet(&job->done, 0);
+
+    Uint32 write = (Uint32)SDL_AtomicGet(&loader->write_index);
+    Uint32 read = (Uint32)SDL_AtomicGet(&loader->read_index);
+
+    if (write - read >= LOADER_QUEUE_SIZE) {
+        LOG_WARN(LOG_CORE, "Loader queue is full, running a job on the main thread");
+        run(data);
+        SDL_AtomicSet(&job->done, 1);
+        return;
+    }
+
+    loader->queue[write % LOADER_QUEUE_SIZE] = job;
+    SDL_AtomicSet(&loader->write_index, (int)(write + 1));
+    SDL_SemPost(loader->pending);
+}
+
+
+bool is_load_job_done(LoadJob *job)
+{
+    return SDL_AtomicGet(&job->done) != 0;
+}
+
+
+void wait_load_job(LoadJob *job)
+{
+    while (!is_load_job_done(job)) {
+        SDL_Delay(1);
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "types.h"
+#include "collision.hpp"
+#include "compression.hpp"
+
+// One background thread for the work that would otherwise stall a frame:
+// decoding images, faulting in fresh arena pages, freeing a finished scene.
+// Jobs are plain function calls done in the order they were queued. The
+// caller owns every job and polls it, nothing calls back into the game.
+#define LOADER_QUEUE_SIZE 64
+
+typedef void (*LoadJobFunc)(void *data);
+
+struct LoadJob {
+    LoadJobFunc run;
+    void *data;
+    SDL_atomic_t done;
+};
+
+struct Loader {
+    SDL_Thread *thread;
+    SDL_sem *pending;           // one count per queued job, the thread sleeps on it
+    SDL_atomic_t quit;
+
+    // single producer, the main thread, and single consumer, the loader thread
+    SDL_atomic_t write_index;
+    SDL_atomic_t read_index;
+    LoadJob *queue[LOADER_QUEUE_SIZE];
+
+    SDL_atomic_t jobs_done;
+};
+
+void init_loader(Loader *loader);
+
+// finishes everything already queued first
+void shutdown_loader(Loader *loader);
+
+// from the main thread only. a full queue runs the job right here instead of dropping it
+void queue_load_job(Loader *loader, LoadJob *job, LoadJobFunc run, void *data);
+bool is_load_job_done(LoadJob *job);
+void wait_load_job(LoadJob *job);
+
+
+// Scene transitions: the next scene's arena and images are prepared on the
+// loader thread while the current scene keeps running, the main thread then
+// uploads a few textures a frame, runs the new scene's startup and switches
+// on the following frame. The scene it replaces is torn down the same way.
+#define SCENE_TRANSITION_UPLOADS_PER_FRAME 2
+
+enum SCENE_TRANSITION_MODE {
+    SCENE_TRANSITION_USE,   // replaces the top of the stack, the old scene is destroyed
+    SCENE_TRANSITION_PUSH   // goes on top, the old scene is kept under it
+};
+
+enum SCENE_TRANSITION_STATE {
+    SCENE_TRANSITION_IDLE,
+    SCENE_TRANSITION_LOADING,   // waiting on the loader thread
+    SCENE_TRANSITION_UPLOADING, // main thread, a slice per frame
+    SCENE_TRANSITION_READY      // started, switches on the next frame
+};
+
+// decoded on the loader thread, uploaded and freed on the main thread
+struct DecodedImage {
+    const SceneTexture *texture;
+    int texture_index;          // in the scene's list, where its handle goes
+    TextureImage image;         // no memory means the decode failed
+    CollisionMask *collision_mask;
+    LoadJob job;
+};
+
+struct SceneTransition {
+    SCENE_TRANSITION_STATE state;
+    SCENE_TRANSITION_MODE mode;
+    Scene *scene;
+
+    LoadJob arena_job;
+
+    int image_count;
+    int images_uploaded;
+    DecodedImage images[SCENE_MAX_TEXTURES];
+
+    // the last scene sent off to be freed, one at a time
+    LoadJob teardown_job;
+};
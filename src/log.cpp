@@ -0,0 +1,293 @@
+#include "log.hpp"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+static Logger LOGGER = { false, LOG_LEVEL_INFO, 0xffffffff };
+static thread_local LogRing *CURRENT_LOG_RING = nullptr;
+static thread_local bool CURRENT_LOG_RING_CLAIMED = false;
+
+
+static const char *log_level_name(int level)
+{
+    switch(level) {
+        case LOG_LEVEL_TRACE: return "TRACE";
+        case LOG_LEVEL_DEBUG: return "DEBUG";
+        case LOG_LEVEL_INFO:  return "INFO ";
+        case LOG_LEVEL_WARN:  return "WARN ";
+        case LOG_LEVEL_ERROR: return "ERROR";
+    }
+
+    return "?????";
+}
+
+
+static const char *log_category_name(int category)
+{
+    switch(category) {
+        case LOG_CORE:   return "core";
+        case LOG_FILE:   return "file";
+        case LOG_RENDER: return "render";
+        case LOG_TEXT:   return "text";
+        case LOG_AUDIO:  return "audio";
+        case LOG_INPUT:  return "input";
+        case LOG_MEMORY: return "memory";
+        case LOG_SCENE:  return "scene";
+        case LOG_NET:    return "net";
+    }
+
+    return "unknown";
+}
+
+
+static void write_log_entry(LogEntry *entry)
+{
+    char line[LOG_MESSAGE_LENGTH + 96];
+    int length = SDL_snprintf(line, sizeof(line), "[%8.3f] %s %s: %s", entry->time_ms/1000.0,
+                              log_level_name(entry->level), log_category_name(entry->category), entry->message);
+
+    if (entry->suppressed > 0 && length < (int)sizeof(line)) {
+        length += SDL_snprintf(line + length, sizeof(line) - length, " (%d similar messages suppressed)", entry->suppressed);
+    }
+
+    fputs(line, stdout);
+    fputc('\n', stdout);
+}
+
+
+static void drain_log_rings()
+{
+    bool written = false;
+
+    int ring_count = SDL_AtomicGet(&LOGGER.ring_count);
+    if (ring_count > LOG_MAX_THREADS) {
+        ring_count = LOG_MAX_THREADS;
+    }
+
+    for (int i = 0; i < ring_count; ++i) {
+        LogRing *ring = &LOGGER.rings[i];
+
+        Uint32 read = (Uint32)SDL_AtomicGet(&ring->read_index);
+        Uint32 write = (Uint32)SDL_AtomicGet(&ring->write_index);
+
+        while (read != write) {
+            write_log_entry(&ring->entries[read & (LOG_RING_SIZE - 1)]);
+            read += 1;
+            SDL_AtomicSet(&ring->read_index, (int)read);
+            written = true;
+        }
+
+        int dropped = SDL_AtomicSet(&ring->dropped, 0);
+        if (dropped > 0) {
+            fprintf(stdout, "[log] thread %lu dropped %d messages, its ring was full\n", (unsigned long)ring->thread, dropped);
+            written = true;
+        }
+    }
+
+    if (written) {
+        fflush(stdout);
+    }
+}
+
+
+static int log_thread_main(void *)
+{
+    while (!SDL_AtomicGet(&LOGGER.quit)) {
+        // errors post the semaphore so they show up right away
+        SDL_SemWaitTimeout(LOGGER.wake, LOG_FLUSH_INTERVAL_MS);
+        drain_log_rings();
+    }
+
+    drain_log_rings();
+    return 0;
+}
+
+
+static LogRing *get_log_ring()
+{
+    if (!CURRENT_LOG_RING_CLAIMED) {
+        CURRENT_LOG_RING_CLAIMED = true;
+
+        int index = SDL_AtomicAdd(&LOGGER.ring_count, 1);
+        if (index < LOG_MAX_THREADS) {
+            CURRENT_LOG_RING = &LOGGER.rings[index];
+            CURRENT_LOG_RING->thread = SDL_ThreadID();
+        }
+    }
+
+    return CURRENT_LOG_RING;
+}
+
+
+// Returns false once a call site has used up its burst for the current
+// window. The first message of the next window carries the skipped count.
+static bool rate_limit_log_site(const char *format, int *suppressed)
+{
+    *suppressed = 0;
+
+    size_t slot = ((size_t)format >> 3) * 2654435761u;
+    for (int probe = 0; probe < LOG_SITE_PROBES; ++probe) {
+        LogSite *site = &LOGGER.sites[(slot + probe) % LOG_MAX_SITES];
+
+        if (site->format != format && !SDL_AtomicCASPtr(&site->format, nullptr, (void *)format)) {
+            if (site->format != format) {
+                continue;
+            }
+        }
+
+        Uint32 now = SDL_GetTicks();
+        int window_start = SDL_AtomicGet(&site->window_start_ms);
+        if (now - (Uint32)window_start >= LOG_RATE_LIMIT_WINDOW_MS &&
+            SDL_AtomicCAS(&site->window_start_ms, window_start, (int)now))
+        {
+            *suppressed = SDL_AtomicSet(&site->suppressed, 0);
+            SDL_AtomicSet(&site->count, 0);
+        }
+
+        if (SDL_AtomicAdd(&site->count, 1) >= LOG_RATE_LIMIT_BURST) {
+            SDL_AtomicAdd(&site->suppressed, 1);
+            return false;
+        }
+        return true;
+    }
+
+    // the site table is full, sites that don't fit are never limited
+    return true;
+}
+
+
+void init_log(int level)
+{
+    LOGGER.level = level;
+    LOGGER.category_mask = 0xffffffff;
+    SDL_AtomicSet(&LOGGER.quit, 0);
+
+    LOGGER.wake = SDL_CreateSemaphore(0);
+    LOGGER.thread = SDL_CreateThread(log_thread_main, "log", nullptr);
+
+    if (LOGGER.thread == nullptr) {
+        fprintf(stdout, "[log] could not start the log thread, logging synchronously: %s\n", SDL_GetError());
+        return;
+    }
+
+    LOGGER.running = true;
+
+    // fatal errors exit() straight away, this still gets their message out
+    atexit(shutdown_log);
+}
+
+
+void shutdown_log()
+{
+    if (!LOGGER.running) {
+        return;
+    }
+
+    SDL_AtomicSet(&LOGGER.quit, 1);
+    SDL_SemPost(LOGGER.wake);
+    SDL_WaitThread(LOGGER.thread, nullptr);
+
+    LOGGER.running = false;
+    LOGGER.thread = nullptr;
+    drain_log_rings();
+
+    for (int i = 0; i < LOG_MAX_SITES; ++i) {
+        LogSite *site = &LOGGER.sites[i];
+        int suppressed = SDL_AtomicGet(&site->suppressed);
+        if (site->format && suppressed > 0) {
+            fprintf(stdout, "[log] %d more messages like \"%s\" were suppressed\n", suppressed, (const char *)site->format);
+        }
+    }
+    fflush(stdout);
+
+    SDL_DestroySemaphore(LOGGER.wake);
+    LOGGER.wake = nullptr;
+}
+
+
+int log_level_from_name(const char *name)
+{
+    static const char *names[] = { "trace", "debug", "info", "warn", "error", "none" };
+
+    for (int i = 0; i < (int)(sizeof(names)/sizeof(names[0])); ++i) {
+        if (SDL_strcasecmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+void set_log_level(int level)
+{
+    LOGGER.level = level;
+}
+
+
+void set_log_category(LOG_CATEGORY category, bool enabled)
+{
+    if (enabled) {
+        LOGGER.category_mask |= (1u << category);
+    }
+    else {
+        LOGGER.category_mask &= ~(1u << category);
+    }
+}
+
+
+bool log_enabled(int level, int category)
+{
+    return level >= LOGGER.level && (LOGGER.category_mask & (1u << category)) != 0;
+}
+
+
+void log_write(int level, int category, const char *format, ...)
+{
+    int suppressed = 0;
+    if (!rate_limit_log_site(format, &suppressed)) {
+        return;
+    }
+
+    LogRing *ring = LOGGER.running ? get_log_ring() : nullptr;
+
+    LogEntry local_entry;
+    LogEntry *entry = &local_entry;
+    Uint32 write = 0;
+
+    if (ring) {
+        write = (Uint32)SDL_AtomicGet(&ring->write_index);
+        Uint32 read = (Uint32)SDL_AtomicGet(&ring->read_index);
+
+        // never wait on the flush thread, a full ring loses the message instead
+        if (write - read >= LOG_RING_SIZE) {
+            SDL_AtomicAdd(&ring->dropped, 1);
+            return;
+        }
+
+        entry = &ring->entries[write & (LOG_RING_SIZE - 1)];
+    }
+
+    entry->time_ms = SDL_GetTicks();
+    entry->level = (Uint8)level;
+    entry->category = (Uint8)category;
+    entry->suppressed = (Uint16)(suppressed > 0xffff ? 0xffff : suppressed);
+
+    va_list args;
+    va_start(args, format);
+    SDL_vsnprintf(entry->message, LOG_MESSAGE_LENGTH, format, args);
+    va_end(args);
+
+    if (ring == nullptr) {
+        // before init_log, after shutdown_log, or more threads than rings
+        write_log_entry(entry);
+        fflush(stdout);
+        return;
+    }
+
+    SDL_AtomicSet(&ring->write_index, (int)(write + 1));
+
+    if (level >= LOG_LEVEL_ERROR) {
+        SDL_SemPost(LOGGER.wake);
+    }
+}
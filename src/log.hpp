@@ -0,0 +1,132 @@
+#pragma once
+
+#include "types.h"
+
+// Messages are formatted straight into a ring owned by the calling thread
+// and written out by a background thread, so logging never blocks a frame
+// on stdout. Anything below LOG_COMPILE_LEVEL is not compiled in at all.
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_NONE 5
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_MESSAGE_LENGTH 240
+#define LOG_RING_SIZE 256 // must be a power of two
+#define LOG_MAX_THREADS 8
+#define LOG_MAX_SITES 512
+#define LOG_SITE_PROBES 8
+#define LOG_FLUSH_INTERVAL_MS 10
+
+// per call site, anything past the burst inside one window is counted, not written
+#define LOG_RATE_LIMIT_WINDOW_MS 1000
+#define LOG_RATE_LIMIT_BURST 20
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LOG_PRINTF_FORMAT(format_index, args_index) __attribute__((format(printf, format_index, args_index)))
+#else
+#define LOG_PRINTF_FORMAT(format_index, args_index)
+#endif
+
+enum LOG_CATEGORY {
+    LOG_CORE,
+    LOG_FILE,
+    LOG_RENDER,
+    LOG_TEXT,
+    LOG_AUDIO,
+    LOG_INPUT,
+    LOG_MEMORY,
+    LOG_SCENE,
+    LOG_NET,
+
+    LOG_CATEGORY_COUNT
+};
+
+struct LogEntry {
+    Uint32 time_ms;
+    Uint8 level;
+    Uint8 category;
+    Uint16 suppressed;
+    char message[LOG_MESSAGE_LENGTH];
+};
+
+// single producer (the owning thread), single consumer (the flush thread)
+struct LogRing {
+    SDL_threadID thread;
+    LogEntry entries[LOG_RING_SIZE];
+    SDL_atomic_t write_index;
+    SDL_atomic_t read_index;
+    SDL_atomic_t dropped;
+};
+
+struct LogSite {
+    void *format;
+    SDL_atomic_t window_start_ms;
+    SDL_atomic_t count;
+    SDL_atomic_t suppressed;
+};
+
+struct Logger {
+    bool running;
+    int level;
+    Uint32 category_mask;
+
+    LogRing rings[LOG_MAX_THREADS];
+    SDL_atomic_t ring_count;
+    SDL_atomic_t dropped;
+
+    LogSite sites[LOG_MAX_SITES];
+
+    SDL_Thread *thread;
+    SDL_sem *wake;
+    SDL_atomic_t quit;
+};
+
+#define LOG_WRITE(level, category, ...) \
+    do { if (log_enabled(level, category)) log_write(level, category, __VA_ARGS__); } while(0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(category, ...) LOG_WRITE(LOG_LEVEL_TRACE, category, __VA_ARGS__)
+#else
+#define LOG_TRACE(category, ...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(category, ...) LOG_WRITE(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#else
+#define LOG_DEBUG(category, ...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(category, ...) LOG_WRITE(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#else
+#define LOG_INFO(category, ...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(category, ...) LOG_WRITE(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#else
+#define LOG_WARN(category, ...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(category, ...) LOG_WRITE(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+#else
+#define LOG_ERROR(category, ...) ((void)0)
+#endif
+
+// safe to log before init_log and after shutdown_log, that just writes synchronously
+void init_log(int level);
+void shutdown_log();
+
+int log_level_from_name(const char *name);
+void set_log_level(int level);
+void set_log_category(LOG_CATEGORY category, bool enabled);
+
+bool log_enabled(int level, int category);
+void log_write(int level, int category, const char *format, ...) LOG_PRINTF_FORMAT(3, 4);
@@ -17,103 +17,521 @@
 
 #include "types.h"
 
+#include "log.hpp"
+#include "log.cpp"
+
+#include "memory.hpp"
+#include "memory.cpp"
+
+#include "resources.hpp"
+
+#include "vfs.hpp"
+#include "vfs.cpp"
+
 #include "objects.hpp"
 #include "objects.cpp"
 
+#include "input.hpp"
+#include "input.cpp"
+
+#include "vorbis.hpp"
+#include "vorbis.cpp"
+
+#include "audio.hpp"
+#include "audio.cpp"
+
+#include "workers.hpp"
+#include "workers.cpp"
+
+#include "stream.hpp"
+#include "stream.cpp"
+
+#include "render.hpp"
+#include "render.cpp"
+
+#include "animation.hpp"
+#include "animation.cpp"
+
+#include "collision.hpp"
+#include "collision.cpp"
+
+#include "compression.hpp"
+#include "compression.cpp"
+
+#include "textures.hpp"
+#include "textures.cpp"
+
+#include "loader.hpp"
+#include "loader.cpp"
+
+#include "projectiles.hpp"
+#include "projectiles.cpp"
+
+#include "snapshot.hpp"
+#include "snapshot.cpp"
+
+#include "runahead.hpp"
+#include "runahead.cpp"
+
+#include "netplay.hpp"
+#include "netplay.cpp"
+
+#include "truetype.hpp"
+#include "truetype.cpp"
+
+#include "text.hpp"
+#include "text.cpp"
+
+#include "renderthread.hpp"
+#include "renderthread.cpp"
+
 /*********************************************************************
  GLOBALS
  *********************************************************************/
 
 static Window *window = nullptr;
-static std::map<std::string, Shader *> SHADERS;
-static std::map<std::string, Texture *> TEXTURES;
+static Vfs *VFS = nullptr;
+static Loader *LOADER = nullptr;
+static AudioSystem *AUDIO = nullptr;
+static RenderThread *RENDER_THREAD = nullptr;
+static AnimationLibrary *ANIMATIONS = nullptr;
+static TextureAtlas *SHEET_ATLAS = nullptr;
+static TextSystem *TEXT = nullptr;
+
+// the render queue key has 8 bits for the shader, its registry index goes there
+#define SHADER_REGISTRY_CAPACITY 64
+typedef ResourceRegistry<Shader, SHADER_REGISTRY_CAPACITY> ShaderRegistry;
+static ShaderRegistry *SHADERS = nullptr;
+static TextureCache *TEXTURES = nullptr;
+
+// the render thread's, see renderthread.hpp. vertex arrays and framebuffers
+// don't carry over from the main context, so it makes these itself
+static SpriteBatch *SPRITE_BATCH = nullptr;
+static WorkerPool *RENDER_WORKERS = nullptr;
+static GLuint RENDER_VAO = 0;
+static Frame RENDER_TARGET;
+static Background RENDER_BACKGROUND;
+static RetainedLayer RETAINED_LAYERS[RENDER_LAYER_COUNT];
+static int GPU_FRAMES_AHEAD = STREAM_DEFAULT_FRAMES_AHEAD;
+static bool PERSISTENT_BUFFERS = true;
+static int RENDER_WORKER_THREADS = -1;
+
+// the game thread's pick, F3 cycles it and every frame carries it over
+static RENDER_DEBUG RENDER_DEBUG_VIEW = RENDER_DEBUG_OFF;
+
+// RENDER_LAYER bits, drawn into a texture of their own and only again when they change
+static Uint32 RETAINED_RENDER_LAYERS = 1u << RENDER_LAYER_OVERLAY;
+
+// RENDER_DEBUG_OVERDRAW by fragments per pixel, the background alone is one
+static const glm::vec3 OVERDRAW_HEAT_COLORS[] = {
+    glm::vec3(0.f, 0.f, 0.f),
+    glm::vec3(0.f, 0.f, 0.4f),
+    glm::vec3(0.f, 0.3f, 1.f),
+    glm::vec3(0.f, 0.8f, 0.2f),
+    glm::vec3(0.9f, 0.9f, 0.f),
+    glm::vec3(1.f, 0.5f, 0.f),
+    glm::vec3(1.f, 0.f, 0.f),
+    glm::vec3(1.f, 1.f, 1.f),
+};
+
+// resolved once when they load, everything after goes by handle
+static ShaderHandle DEFAULT_SHADER;
+static ShaderHandle FRAME_SHADER;
+static ShaderHandle OVERDRAW_FRAME_SHADER;
+static ShaderHandle SPRITE_SHADER;
+static ShaderHandle BACKGROUND_SHADER;
+static TextureHandle SHEET_TEXTURE;
 
 static int SCREEN_WIDTH = 1200;
 static int SCREEN_HEIGHT = 800;
 
 static std::list<Scene *> SCENE_STACK;
+static float SCENE_MUSIC_CROSSFADE_S = 1.5f;
+static SceneTransition SCENE_TRANSITION;
+static SceneSnapshot *QUICK_SAVE = nullptr;
+static RunAhead *RUN_AHEAD = nullptr;
+static Netplay *NETPLAY = nullptr;
+
+// the atlas and animations share the sprite sheet, so main loads that one for every scene.
+// the startup finds each one's handle by its place in the list
+enum MAIN_SCENE_TEXTURE {
+    MAIN_TEXTURE_BLUE_SHIP,
+    MAIN_TEXTURE_RED_SHIP,
+    MAIN_TEXTURE_BLUE_OPTION,
+    MAIN_TEXTURE_BACKGROUND,
+    MAIN_TEXTURE_STARS,
+    MAIN_TEXTURE_SCORE_PANEL,
+    MAIN_TEXTURE_LIFE_BLUE,
+    MAIN_TEXTURE_LIFE_RED,
+    MAIN_TEXTURE_NUMERAL_X,
+    MAIN_TEXTURE_NUMERAL_0,     // the other digits follow in order
+};
+
+static const SceneTexture MAIN_SCENE_TEXTURES[] = {
+    { "blue_ship", "images/PNG/playerShip2_blue.png" },
+    { "red_ship", "images/PNG/playerShip2_red.png" },
+    { "blue_option", "images/PNG/ufoBlue.png" },
+    { "background_dark_purple", "images/Backgrounds/darkPurple.png" },
+    { "background_stars", "images/Backgrounds/black.png" },
+    { "score_panel", "images/PNG/UI/buttonBlue.png" },
+    { "life_blue", "images/PNG/UI/playerLife1_blue.png" },
+    { "life_red", "images/PNG/UI/playerLife1_red.png" },
+    { "numeral_x", "images/PNG/UI/numeralX.png" },
+    { "numeral_0", "images/PNG/UI/numeral0.png" },
+    { "numeral_1", "images/PNG/UI/numeral1.png" },
+    { "numeral_2", "images/PNG/UI/numeral2.png" },
+    { "numeral_3", "images/PNG/UI/numeral3.png" },
+    { "numeral_4", "images/PNG/UI/numeral4.png" },
+    { "numeral_5", "images/PNG/UI/numeral5.png" },
+    { "numeral_6", "images/PNG/UI/numeral6.png" },
+    { "numeral_7", "images/PNG/UI/numeral7.png" },
+    { "numeral_8", "images/PNG/UI/numeral8.png" },
+    { "numeral_9", "images/PNG/UI/numeral9.png" },
+};
+
+// never simulate more than this many ticks to catch up after a long frame
+static int MAX_SIMULATION_TICKS_PER_FRAME = 5;
+
+// the HUD only changes this often, so its text layouts stay cached in between
+static int HUD_REFRESH_MS = 500;
 
 /*********************************************************************
  FUNCTION DEFINITIONS
  *********************************************************************/
 
-std::string read_file(std::string filename);
-void init_scene(Scene *scene, std::string name);
+void log_shader_info_log(const char *shader_name, const char *stage, char *infolog);
+void init_scene(Scene *scene, const std::string &name);
+void load_scene(Scene *scene);
+void destroy_scene(Scene *scene);
+void reserve_scene_render_frames(Scene *scene);
 void push_scene(Scene *scene);
 void use_scene(Scene *scene);
 Scene *pop_scene();
+bool begin_scene_transition(Scene *scene, SCENE_TRANSITION_MODE mode);
+void update_scene_transition();
+void quick_save_scene(Scene *scene);
+void quick_load_scene(Scene *scene);
+void update_scene_music(Scene *previous, Scene *next);
+void init_gl_state();
 void init_frame(Frame *frame);
+void free_frame(Frame *frame);
 void use_frame(Frame *frame);
-void init_shader(Shader *shader, std::string name, std::string vertex_filename, std::string fragment_filename);
-void set_shader_uniform_1i(Shader *shader, std::string uniform_name, int value);
-void set_shader_uniform_1f(Shader *shader, std::string uniform_name, float value);
-void set_shader_uniform_matrix4fv(Shader *shader, std::string uniform_name, int count, bool transpose, glm::mat4 *matrices);
+ShaderHandle load_shader(const char *name, const char *vertex_filename, const char *fragment_filename);
+void set_shader_uniform_1i(Shader *shader, const char *uniform_name, int value);
+void set_shader_uniform_1f(Shader *shader, const char *uniform_name, float value);
+void set_shader_uniform_matrix4fv(Shader *shader, const char *uniform_name, int count, bool transpose, glm::mat4 *matrices);
 
-GLint get_shader_uniform_location(Shader *shader, std::string uniform_name);
+GLint get_shader_uniform_location(Shader *shader, const char *uniform_name);
 void use_shader(Shader *shader);
-void create_window(Window *win, std::string &title, int width, int height);
+Shader *get_shader(ShaderHandle handle);
+void create_window(Window *win, std::string &title, int width, int height, bool visible = true);
 
-void init_texture(Texture *texture, std::string name, std::string image_path);
 void init_entity(Entity *entity, glm::vec3 position, glm::vec3 scale = glm::vec3(1.f, 1.f, 1.f), glm::vec3 rotation = glm::vec3(0.f, 0.f, 0.f));
 void init_sprite(Sprite *sprite, Entity *parent, Texture *texture, glm::vec2 offset = glm::vec2(0.f, 0.f), glm::vec2 frame_size = glm::vec2(0.f, 0.f));
+void set_sprite_animation(Sprite *sprite, AnimationClipId clip, float start_time_s, float speed = 1.f);
+
+Entity *alloc_entity(Scene *scene);
+Sprite *alloc_sprite(Scene *scene);
+void destroy_entity(Scene *scene, Entity *entity);
 
 void add_entity(Entity *entity, Entity *child);
 void add_scene_entity(Scene *scene, Entity *child);
-
-void set_entity_group_tag(Scene *scene, Entity *entity, std::string tag);
-std::list<Entity *> get_entities_by_group_tag(Scene *scene, std::string group_tag);
-
-void set_entity_tag(Scene *scene, Entity *entity, std::string tag);
-Entity *get_entity_by_tag(Scene *scene, std::string tag);
-
-void *MemoryArenaAlloc(MemoryArena *arena, int size);
-
-void draw_entity(Entity *entity);
-void draw_scene(Scene* scene);
-
+void remove_scene_entity(Scene *scene, Entity *entity);
+
+void set_entity_group_tag(Scene *scene, Entity *entity, const char *tag);
+EntityGroup *get_entities_by_group_tag(Scene *scene, const char *group_tag);
+
+void set_entity_tag(Scene *scene, Entity *entity, const char *tag);
+Entity *get_entity_by_tag(Scene *scene, const char *tag);
+
+void use_sprite_shader(Shader *sprite_shader, float time_s);
+void use_scene_shader(int shader_index, void *render_frame);
+glm::mat4 get_entity_model(Entity *entity);
+glm::vec4 get_sprite_uv_rect(Sprite *sprite);
+CollisionShape get_entity_collision_shape(Entity *entity);
+void draw_entity(Entity *entity, RenderQueue *queue, int shader_index);
+void build_render_frame(RenderFrame *frame, Scene *scene, const char *hud_text);
+
+// on the render thread
+void start_rendering(void *user_data);
+void stop_rendering(void *user_data);
+void draw_render_frame(RenderFrame *frame, RenderFrameStats *stats, void *user_data);
+void draw_scene(RenderFrame *frame, RenderFrameStats *stats);
+void update_retained_render_layer(RenderFrame *frame, RENDER_LAYER layer, RenderFrameStats *stats);
+void draw_hud(const char *hud_text);
+void draw_debug_legend(RENDER_DEBUG debug);
+
+Uint32 hash_scene_state(Scene *scene);
+
+Scene *create_main_scene(const char *music_path, bool coop);
 void main_scene_starup(Scene *scene);
 void main_scene_update(Scene *scene, float elapsed_time_s);
 void main_scene_shutdown(Scene *scene);
+void main_scene_draw_overlay(Scene *scene, RenderQueue *queue);
 
 /*********************************************************************
  PROGRAM
  *********************************************************************/
 int main(int argc, char * argv[])
 {
+    INPUT_MODE input_mode = INPUT_LIVE;
+    std::string input_filename;
+    bool headless = false;
+    bool allocation_trace = false;
+    bool allocation_test = false;
+    int allocation_warmup_frames = ALLOCATION_DEFAULT_WARMUP_FRAMES;
+    const char *main_scene_music = nullptr;
+    const char *pack_directory = nullptr;
+    const char *pack_path = nullptr;
+    const char *compress_directory = nullptr;
+    int log_level = LOG_LEVEL_INFO;
+    int run_ahead_ticks = -1;
+    int texture_budget_mb = TEXTURE_DEFAULT_BUDGET_MB;
+    bool render_thread = true;
+    int netplay_player = 0;
+    int netplay_port = 0;
+    char netplay_remote_host[64] = "127.0.0.1";
+    int netplay_remote_port = 0;
+    float netplay_latency_ms = 0.f;
+    float netplay_loss = 0.f;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--record" && i + 1 < argc) {
+            input_mode = INPUT_RECORD;
+            input_filename = argv[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            input_mode = INPUT_REPLAY;
+            input_filename = argv[++i];
+        }
+        else if (arg == "--headless") {
+            headless = true;
+        }
+        else if (arg == "--pack" && i + 2 < argc) {
+            // build a pack from a directory and quit: --pack media media.pak
+            pack_directory = argv[++i];
+            pack_path = argv[++i];
+        }
+        else if (arg == "--compress-textures" && i + 1 < argc) {
+            // build a .bct for every image, run it before --pack so the pack picks them up
+            compress_directory = argv[++i];
+        }
+        else if (arg == "--music" && i + 1 < argc) {
+            main_scene_music = argv[++i];
+        }
+        else if (arg == "--log-level" && i + 1 < argc) {
+            log_level = log_level_from_name(argv[++i]);
+            if (log_level < 0) {
+                LOG_ERROR(LOG_CORE, "Unknown log level %s, expected trace, debug, info, warn, error or none", argv[i]);
+                exit(1);
+            }
+        }
+        else if (arg == "--texture-budget" && i + 1 < argc) {
+            // megabytes of image textures kept on the GPU, held ones count but are never evicted
+            texture_budget_mb = atoi(argv[++i]);
+        }
+        else if (arg == "--gpu-frames-ahead" && i + 1 < argc) {
+            // 0 waits for the GPU every frame, the least latency and the least overlap
+            GPU_FRAMES_AHEAD = atoi(argv[++i]);
+        }
+        else if (arg == "--no-persistent-buffers") {
+            PERSISTENT_BUFFERS = false;
+        }
+        else if (arg == "--render-workers" && i + 1 < argc) {
+            // threads that help fill instance data, 0 fills it all on the render thread
+            RENDER_WORKER_THREADS = atoi(argv[++i]);
+        }
+        else if (arg == "--no-retained-layers") {
+            // every layer drawn sprite by sprite each frame, to compare
+            RETAINED_RENDER_LAYERS = 0;
+        }
+        else if (arg == "--no-render-thread") {
+            // simulation and drawing one after the other, to compare
+            render_thread = false;
+        }
+        else if (arg == "--run-ahead" && i + 1 < argc) {
+            // 1 to 3 ticks, 0 only measures latency for comparison. with --headless
+            // --replay it logs the cost per frame without a display, latency needs one
+            run_ahead_ticks = atoi(argv[++i]);
+            if (run_ahead_ticks < 0 || run_ahead_ticks > RUN_AHEAD_MAX_TICKS) {
+                LOG_ERROR(LOG_CORE, "--run-ahead takes 0 to %d ticks", RUN_AHEAD_MAX_TICKS);
+                exit(1);
+            }
+        }
+        else if (arg == "--netplay" && i + 3 < argc) {
+            // co-op on two machines: --netplay 1 7001 127.0.0.1:7002 and --netplay 2 7002 127.0.0.1:7001
+            netplay_player = atoi(argv[++i]);
+            netplay_port = atoi(argv[++i]);
+
+            const char *remote = argv[++i];
+            const char *colon = SDL_strrchr(remote, ':');
+            if (colon) {
+                SDL_strlcpy(netplay_remote_host, remote, SDL_min((size_t)(colon - remote) + 1, sizeof(netplay_remote_host)));
+                netplay_remote_port = atoi(colon + 1);
+            }
+            else {
+                netplay_remote_port = atoi(remote);
+            }
+
+            if ((netplay_player != 1 && netplay_player != 2) || netplay_port <= 0 || netplay_remote_port <= 0) {
+                LOG_ERROR(LOG_CORE, "--netplay takes the player, 1 or 2, a local port and the other side's address:port");
+                exit(1);
+            }
+        }
+        else if (arg == "--net-latency" && i + 1 < argc) {
+            netplay_latency_ms = (float)atof(argv[++i]);
+        }
+        else if (arg == "--net-loss" && i + 1 < argc) {
+            // percent of outgoing packets
+            netplay_loss = (float)atof(argv[++i])/100.f;
+        }
+        else if (arg == "--alloc-trace") {
+            allocation_trace = true;
+        }
+        else if (arg == "--alloc-test") {
+            // fail the run if any frame after warm-up touches the heap
+            allocation_test = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                allocation_warmup_frames = atoi(argv[++i]);
+            }
+        }
+        else {
+            LOG_WARN(LOG_CORE, "Unknown argument: %s", arg.c_str());
+        }
+    }
+
+    if (headless && input_mode != INPUT_REPLAY) {
+        LOG_ERROR(LOG_CORE, "--headless needs a recording to play: --replay <file>");
+        exit(1);
+    }
+
+    // a recording only has one controller, and run-ahead guesses on top of the rollback's guesses
+    if (netplay_player && (input_mode != INPUT_LIVE || run_ahead_ticks >= 0)) {
+        LOG_ERROR(LOG_CORE, "--netplay can't be combined with --record, --replay or --run-ahead");
+        exit(1);
+    }
+
+    init_allocation_tracker(&ALLOCATION_TRACKER, allocation_trace, allocation_test, allocation_warmup_frames);
+    AllocationScope loading_scope(ALLOC_LOADING);
+
+    // after the tracker, so the log thread's memory is counted as load time
+    init_log(log_level);
+
+    if (compress_directory) {
+        IMG_Init(IMG_INIT_PNG);
+        bool compressed = compress_texture_directory(compress_directory);
+        IMG_Quit();
+        shutdown_log();
+        return compressed ? 0 : 1;
+    }
+
+    if (pack_path) {
+        bool written = write_pack(pack_directory, pack_path);
+        shutdown_log();
+        return written ? 0 : 1;
+    }
+
+    // a pack next to the loose files overrides them, so patches can ship as a pack
+    VFS = MALLOC(Vfs);
+    init_vfs(VFS);
+    mount_directory(VFS, "media");
+    mount_pack(VFS, "media.pak");
+
+    LOADER = MALLOC(Loader);
+    init_loader(LOADER);
+
     SDL_Init(SDL_INIT_EVERYTHING);
     IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF);
 
     window = MALLOC(Window);
 
     std::string window_title = "ludum dare 40";
-    create_window(window, window_title, SCREEN_WIDTH, SCREEN_HEIGHT);
+    create_window(window, window_title, SCREEN_WIDTH, SCREEN_HEIGHT, !headless);
 
-    //TODO(Brett): add memory manager...
-    Shader *default_shader = MALLOC(Shader);
-    Shader *frame_shader = MALLOC(Shader);
-    Shader *sprite_shader = MALLOC(Shader);
+    SHADERS = MALLOC(ShaderRegistry);
+    init_resource_registry(SHADERS, "shader");
 
-    init_shader(default_shader, "default", "media\\shaders\\simple.vs.glsl", "media\\shaders\\simple.fs.glsl");
-    init_shader(frame_shader, "frame", "media\\shaders\\frame.vs.glsl", "media\\shaders\\frame.fs.glsl");
-    init_shader(sprite_shader, "sprite", "media\\shaders\\sprite.vs.glsl", "media\\shaders\\sprite.fs.glsl");
+    DEFAULT_SHADER = load_shader("default", "shaders/simple.vs.glsl", "shaders/simple.fs.glsl");
+    FRAME_SHADER = load_shader("frame", "shaders/frame.vs.glsl", "shaders/frame.fs.glsl");
+    OVERDRAW_FRAME_SHADER = load_shader("frame_overdraw", "shaders/frame.vs.glsl", "shaders/frame_overdraw.fs.glsl");
+    SPRITE_SHADER = load_shader("sprite", "shaders/sprite.vs.glsl", "shaders/sprite.fs.glsl");
+    BACKGROUND_SHADER = load_shader("background", "shaders/background.vs.glsl", "shaders/background.fs.glsl");
 
-    Texture *ship_texture = MALLOC(Texture);
-    init_texture(ship_texture, "blue_ship", "media\\images\\PNG\\playerShip2_blue.png");
+    if (!is_resource_handle_valid(FRAME_SHADER) || !is_resource_handle_valid(SPRITE_SHADER) || !is_resource_handle_valid(BACKGROUND_SHADER)) {
+        LOG_ERROR(LOG_RENDER, "Could not build the frame, sprite and background shaders");
+        exit(1);
+    }
 
-    Texture *option_texture = MALLOC(Texture);
-    init_texture(option_texture, "blue_option", "media\\images\\PNG\\ufoBlue.png");
+    TEXTURES = MALLOC(TextureCache);
+    init_texture_cache(TEXTURES, VFS, texture_budget_mb);
 
-    Texture *bullet_texture = MALLOC(Texture);
-    init_texture(bullet_texture, "blue_bullet", "media\\images\\PNG\\lasers\\laserBlue03.png");
+    // held for the whole run, the atlas and the animations point at it
+    SHEET_TEXTURE = acquire_texture(TEXTURES, "sheet", "images/Spritesheet/sheet.png");
+    Texture *sheet_texture = get_texture(TEXTURES, SHEET_TEXTURE);
 
-    Scene *scene = MALLOC(Scene);
-    init_scene(scene, "main_scene");
+    // effects and projectiles are regions of the sprite sheet
+    SHEET_ATLAS = MALLOC(TextureAtlas);
+    load_texture_atlas(SHEET_ATLAS, VFS, sheet_texture, "images/Spritesheet/sheet.xml");
 
-    scene->startup = &main_scene_starup;
-    scene->update = &main_scene_update;
-    scene->shutdown = &main_scene_shutdown;
+    ANIMATIONS = MALLOC(AnimationLibrary);
+    init_animation_library(ANIMATIONS);
+    add_animation_clip_sequence(ANIMATIONS, "engine_fire", SHEET_ATLAS, "fire%02d.png", 1, 7, 15.f, ANIMATION_LOOP);
+    add_animation_clip_sequence(ANIMATIONS, "shield", SHEET_ATLAS, "shield%d.png", 1, 3, 8.f, ANIMATION_PING_PONG);
+
+    TEXT = MALLOC(TextSystem);
+    init_text(TEXT);
+    load_font(TEXT, VFS, "future", "images/Bonus/kenvector_future.ttf");
+    FontId hud_font = load_font(TEXT, VFS, "future_thin", "images/Bonus/kenvector_future_thin.ttf");
+    preload_glyphs(TEXT, hud_font, " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-");
 
-    use_scene(scene);
+    // decoded up front, the mixer only ever plays from memory
+    AUDIO = MALLOC(AudioSystem);
+    if (headless) {
+        memset(AUDIO, 0, sizeof(AudioSystem));
+    }
+    else if (init_audio(AUDIO, VFS)) {
+        load_sound(AUDIO, "laser", "images/Bonus/sfx_laser1.ogg");
+        load_sound(AUDIO, "laser_alt", "images/Bonus/sfx_laser2.ogg");
+        load_sound(AUDIO, "zap", "images/Bonus/sfx_zap.ogg");
+        load_sound(AUDIO, "shield_up", "images/Bonus/sfx_shieldUp.ogg");
+        load_sound(AUDIO, "shield_down", "images/Bonus/sfx_shieldDown.ogg");
+        load_sound(AUDIO, "two_tone", "images/Bonus/sfx_twoTone.ogg");
+        load_sound(AUDIO, "lose", "images/Bonus/sfx_lose.ogg");
+    }
+
+    QUICK_SAVE = MALLOC(SceneSnapshot);
+    init_scene_snapshot(QUICK_SAVE, DEFAULT_MEMORY_ARENA_SIZE_MB);
+
+    // last, the render thread starts with everything loaded so far visible to it
+    if (!headless) {
+        RENDER_THREAD = MALLOC(RenderThread);
+        init_render_thread(RENDER_THREAD, window, render_thread, RENDER_QUEUE_CAPACITY, PROJECTILE_DRAW_LIST_CAPACITY,
+                           start_rendering, draw_render_frame, stop_rendering, nullptr);
+    }
+
+    // headless nothing is drawn, but a replay still pays for it, to measure the cost
+    if (run_ahead_ticks >= 0) {
+        RUN_AHEAD = MALLOC(RunAhead);
+        init_run_ahead(RUN_AHEAD, run_ahead_ticks);
+    }
+
+    // nothing to keep running yet, so the first scene loads on the spot in the main loop
+    use_scene(create_main_scene(main_scene_music, netplay_player != 0));
+
+    if (netplay_player) {
+        NETPLAY = MALLOC(Netplay);
+        if (!init_netplay(NETPLAY, netplay_player - 1, netplay_port, netplay_remote_host, netplay_remote_port,
+                          SCENE_STACK.back(), &hash_scene_state, AUDIO))
+        {
+            exit(1);
+        }
+        set_netplay_link(NETPLAY, netplay_latency_ms, netplay_loss);
+    }
+
+    InputSystem input;
+    init_input(&input, input_mode, input_filename);
 
     bool running = true;
 
@@ -129,6 +547,17 @@ int main(int argc, char * argv[])
     float frame_interval_s = 0.f;
     float frames = 0.f;
 
+    char hud_text[RENDER_FRAME_TEXT_LENGTH] = "";
+    Uint32 hud_refresh_time = SDL_GetTicks();
+
+    float simulation_accumulator_s = 0.f;
+    Uint64 simulation_counter_total = 0;
+    Uint64 simulation_counter_max = 0;
+    Uint64 replay_start_counter = SDL_GetPerformanceCounter();
+
+    // everything allocated so far is load time, frames report by subsystem
+    end_allocation_frame(&ALLOCATION_TRACKER);
+
     while(running) {
         int last_time = current_time;
         current_time = SDL_GetTicks();
@@ -136,6 +565,8 @@ int main(int argc, char * argv[])
 
         total_time_s += elapsed_time_s;
 
+        ALLOC_SCOPE(ALLOC_PLATFORM);
+
         while(SDL_PollEvent(&event)) {
             switch(event.type) {
                 case SDL_QUIT:
@@ -145,293 +576,701 @@ int main(int argc, char * argv[])
                 }
                 case SDL_KEYDOWN:
                 {
-                    switch(event.key.keysym.sym) {
-                        case SDLK_ESCAPE:
-                        {
-                            running = false;
-                            break;
-                        }
+                    if (event.key.keysym.sym == SDLK_ESCAPE) {
+                        running = false;
+                        break;
+                    }
 
-                        case SDLK_UP:
-                        {
-                            scene->gamepadcontroller.btn_up = true;
-                            break;
+                    // restarts behind the running scene, a replay or the other player can't follow it so only live
+                    if (event.key.keysym.sym == SDLK_F5 && !event.key.repeat && input.mode == INPUT_LIVE && !NETPLAY) {
+                        Scene *restart = create_main_scene(main_scene_music, false);
+                        if (!begin_scene_transition(restart, SCENE_TRANSITION_USE)) {
+                            destroy_scene(restart);
                         }
-                        case SDLK_DOWN:
-                        {
-                            scene->gamepadcontroller.btn_down = true;
-                            break;
-                        }
-                        case SDLK_LEFT:
-                        {
-                            scene->gamepadcontroller.btn_left = true;
-                            break;
+                        break;
+                    }
+
+                    // only changes what is drawn, so replays and netplay can look too
+                    if (event.key.keysym.sym == SDLK_F3 && !event.key.repeat) {
+                        RENDER_DEBUG_VIEW = (RENDER_DEBUG)((RENDER_DEBUG_VIEW + 1) % RENDER_DEBUG_COUNT);
+                        LOG_INFO(LOG_RENDER, "Debug view %d", RENDER_DEBUG_VIEW);
+                        break;
+                    }
+
+                    // quick save and load, live only for the same reason
+                    if ((event.key.keysym.sym == SDLK_F6 || event.key.keysym.sym == SDLK_F9) && !event.key.repeat && input.mode == INPUT_LIVE && !NETPLAY) {
+                        if (event.key.keysym.sym == SDLK_F6) {
+                            quick_save_scene(SCENE_STACK.back());
                         }
-                        case SDLK_RIGHT:
-                        {
-                            scene->gamepadcontroller.btn_right = true;
-                            break;
+                        else {
+                            quick_load_scene(SCENE_STACK.back());
                         }
-                        case SDLK_a:
-                        {
-                            scene->gamepadcontroller.btn_a = true;
-                            break;
+                        break;
+                    }
+
+                    if (!event.key.repeat) {
+                        ALLOC_SCOPE(ALLOC_INPUT);
+                        input_handle_key(&input, event.key.keysym.sym, true);
+
+                        INPUT_BUTTON button = input_button_from_key(event.key.keysym.sym);
+                        if (RUN_AHEAD && button <= BUTTON_RIGHT) {
+                            arm_latency_probe(RUN_AHEAD, SCENE_STACK.back());
                         }
                     }
                     break;
                 }
                 case SDL_KEYUP:
                 {
-                    switch(event.key.keysym.sym) {
-                        case SDLK_UP:
-                        {
-                            scene->gamepadcontroller.btn_up = false;
-                            break;
-                        }
-                        case SDLK_DOWN:
-                        {
-                            scene->gamepadcontroller.btn_down = false;
-                            break;
-                        }
-                        case SDLK_LEFT:
-                        {
-                            scene->gamepadcontroller.btn_left = false;
-                            break;
-                        }
-                        case SDLK_RIGHT:
-                        {
-                            scene->gamepadcontroller.btn_right = false;
-                            break;
-                        }
-                        case SDLK_a:
-                        {
-                            scene->gamepadcontroller.btn_a = false;
-                            break;
-                        }
-                    }
+                    ALLOC_SCOPE(ALLOC_INPUT);
+                    input_handle_key(&input, event.key.keysym.sym, false);
                     break;
                 }
             }
         }
 
+        update_scene_transition();
+
         Scene *current_scene = SCENE_STACK.back();
         if (!current_scene->initialized) {
-            scene->startup(scene);
+            ALLOC_SCOPE(ALLOC_LOADING);
+            if (!current_scene->loaded) {
+                load_scene(current_scene);
+            }
+            current_scene->startup(current_scene);
+            reserve_scene_render_frames(current_scene);
+        }
+
+        if (NETPLAY) {
+            ALLOC_SCOPE(ALLOC_SIMULATION);
+            netplay_poll(NETPLAY);
+        }
+
+        // a headless replay steps one tick per loop as fast as it can go,
+        // otherwise ticks are paid for out of real elapsed time
+        if (headless) {
+            simulation_accumulator_s = SIMULATION_TICK_S;
         }
         else {
-            scene->update(scene, elapsed_time_s);
+            simulation_accumulator_s += elapsed_time_s;
+            if (simulation_accumulator_s > MAX_SIMULATION_TICKS_PER_FRAME*SIMULATION_TICK_S) {
+                simulation_accumulator_s = MAX_SIMULATION_TICKS_PER_FRAME*SIMULATION_TICK_S;
+            }
         }
 
-        if (frame_interval_s > 0.f ) {
-            frame_interval_s -= elapsed_time_s;
-            continue;
+        while (running && simulation_accumulator_s >= SIMULATION_TICK_S) {
+            if (input_replay_finished(&input)) {
+                running = false;
+                break;
+            }
+
+            simulation_accumulator_s -= SIMULATION_TICK_S;
+
+            Uint64 tick_start = SDL_GetPerformanceCounter();
+
+            bool simulated = true;
+            {
+                ALLOC_SCOPE(ALLOC_INPUT);
+                input_begin_tick(&input, NETPLAY ? nullptr : &current_scene->gamepadcontroller);
+            }
+            {
+                ALLOC_SCOPE(ALLOC_SIMULATION);
+                if (NETPLAY) {
+                    // both controllers come from the rollback, it simulates and re-simulates on its own
+                    simulated = netplay_tick(NETPLAY, &input.state);
+                }
+                else {
+                    current_scene->update(current_scene, SIMULATION_TICK_S);
+                    current_scene->time_s += SIMULATION_TICK_S;
+                }
+            }
+            if (!simulated) {
+                break;
+            }
+            {
+                ALLOC_SCOPE(ALLOC_INPUT);
+                input_end_tick(&input, hash_scene_state(current_scene));
+            }
+
+            Uint64 tick_counter = SDL_GetPerformanceCounter() - tick_start;
+            simulation_counter_total += tick_counter;
+            if (tick_counter > simulation_counter_max) {
+                simulation_counter_max = tick_counter;
+            }
         }
 
-        frames += 1;
-        // std::cout << "FPS: " << frames/total_time_s << std::endl;
-        frame_interval_s = target_frame_time_s + frame_interval_s;
+        if (!headless) {
+            if (frame_interval_s > 0.f ) {
+                frame_interval_s -= elapsed_time_s;
+                continue;
+            }
 
-        draw_scene(current_scene);
+            ALLOC_SCOPE(ALLOC_RENDER);
+
+            frames += 1;
+            frame_interval_s = target_frame_time_s + frame_interval_s;
+
+            Uint32 hud_elapsed_ms = SDL_GetTicks() - hud_refresh_time;
+            if (hud_elapsed_ms >= (Uint32)HUD_REFRESH_MS) {
+                // what the render thread drew since the last refresh, which can be fewer frames than were published
+                RenderThreadStats render_stats;
+                take_render_stats(RENDER_THREAD, &render_stats);
+                int drawn = render_stats.drawn > 0 ? render_stats.drawn : 1;
+
+                SDL_snprintf(hud_text, sizeof(hud_text), "FPS %d  SHOTS %d  GPU WAIT %.2f MS\nSPRITES %d  DRAWS %d  STATES %d\nTEXTURES %d  %d KB  EVICTED %d",
+                             (int)(render_stats.drawn*1000.f/hud_elapsed_ms + 0.5f),
+                             current_scene->projectiles ? count_projectiles(current_scene->projectiles) : 0,
+                             get_stream_wait_ms(render_stats.frames.gpu_wait_counter)/drawn,
+                             render_stats.frames.sprites/drawn, render_stats.frames.draw_calls/drawn,
+                             render_stats.frames.state_changes/drawn,
+                             TEXTURES->resident_count, (int)(TEXTURES->resident_bytes >> 10), TEXTURES->total_stats.evictions);
+
+                // how often each retained layer came straight from its texture
+                for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+                    int retained_frames = render_stats.frames.retained_frames[layer];
+                    if (retained_frames > 0) {
+                        int length = (int)SDL_strlen(hud_text);
+                        SDL_snprintf(hud_text + length, sizeof(hud_text) - length, "\nLAYER %d CACHE %d%%", layer,
+                                     (retained_frames - render_stats.frames.retained_redraws[layer])*100/retained_frames);
+                    }
+                }
 
-        use_frame(nullptr);
-        use_shader(frame_shader);
-        set_shader_uniform_1i(frame_shader, "frame_texture", 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, scene->frame.gl_texture_id);
-        // glClearColor(1.f, 0.f, 1.f, 1.f);
-        // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        SDL_GL_SwapWindow(window->sdl_window);
-        
+                hud_refresh_time += hud_elapsed_ms;
+            }
+
+            if (RUN_AHEAD) {
+                begin_run_ahead(RUN_AHEAD, current_scene, &input, AUDIO);
+            }
+
+            // only copying here, the next tick can start as soon as it is published
+            RenderFrame *render_frame = begin_render_frame(RENDER_THREAD);
+            build_render_frame(render_frame, current_scene, hud_text);
+            publish_render_frame(RENDER_THREAD);
+
+            // with the render thread the frame is presented a little after this, the probe doesn't count that
+            if (RUN_AHEAD) {
+                check_latency_probe(RUN_AHEAD, current_scene);
+                end_run_ahead(RUN_AHEAD, current_scene);
+            }
+        }
+        else if (RUN_AHEAD) {
+            // save, the extra ticks and the restore after every replayed tick, the
+            // next tick's checksum also catches a restore that isn't exact
+            begin_run_ahead(RUN_AHEAD, current_scene, &input, AUDIO);
+            end_run_ahead(RUN_AHEAD, current_scene);
+        }
+
+        if (NETPLAY) {
+            end_netplay_frame(NETPLAY);
+        }
+
+        end_texture_frame(TEXTURES);
+
+        end_allocation_frame(&ALLOCATION_TRACKER);
+    }
+
+    if (input.mode == INPUT_REPLAY) {
+        double frequency = (double)SDL_GetPerformanceFrequency();
+        double wall_s = (SDL_GetPerformanceCounter() - replay_start_counter)/frequency;
+        double simulated_ms = simulation_counter_total*1000.0/frequency;
+
+        LOG_INFO(LOG_CORE, "Replay %s: %u ticks in %.3fs, update avg %.4fms, max %.4fms, desyncs %d",
+                 input.filename.c_str(), input.tick, wall_s, (input.tick ? simulated_ms/input.tick : 0.0),
+                 simulation_counter_max*1000.0/frequency, input.desyncs);
+    }
+
+    // first, nothing it still draws can be freed before it stops
+    if (RENDER_THREAD) {
+        shutdown_render_thread(RENDER_THREAD);
+    }
+
+    if (RUN_AHEAD) {
+        shutdown_run_ahead(RUN_AHEAD);
+    }
+
+    if (NETPLAY) {
+        shutdown_netplay(NETPLAY);
+    }
+
+    shutdown_input(&input);
+    shutdown_audio(AUDIO);
+    print_text_stats(TEXT);
+    shutdown_loader(LOADER);
+    free_scene_snapshot(QUICK_SAVE);
+    shutdown_texture_cache(TEXTURES);
+    shutdown_vfs(VFS);
+
+    if (ALLOCATION_TRACKER.steady_state_test) {
+        LOG_INFO(LOG_MEMORY, "Allocation test: %d steady state frames allocated", ALLOCATION_TRACKER.steady_state_failures);
     }
 
-    return 0;
+    shutdown_log();
+
+    if (ALLOCATION_TRACKER.steady_state_test && ALLOCATION_TRACKER.steady_state_failures > 0) {
+        return 2;
+    }
+
+    return input.desyncs > 0 ? 1 : 0;
 }
 
 /*********************************************************************
  FUNCTIONS
  *********************************************************************/
 
-std::string read_file(std::string filename)
+void log_shader_info_log(const char *shader_name, const char *stage, char *infolog)
 {
-    std::fstream file;
-    file.open(filename.c_str(), std::ios::in | std::ios::binary);
-
-    file.seekg(0, std::ios::end);
-    int size = file.tellg();
-
-    std::cout << "Reading file " << filename << " @ " << size << std::endl;
-
-    file.seekg(0, std::ios::beg);
+    // one entry per line, a whole compiler log won't fit in a log message
+    char *line = infolog;
+    while (line && *line) {
+        char *end = SDL_strchr(line, '\n');
+        if (end) {
+            *end = '\0';
+        }
 
-    char *med = (char*)malloc(sizeof(char)*size);
-    memset(med, 0, size);
-    file.read(med, size);
+        if (*line) {
+            LOG_ERROR(LOG_RENDER, "Shader %s %s: %s", shader_name, stage, line);
+        }
 
-    std::string result = std::string(med);
-    result[size] = '\0';
-    return result;
+        line = end ? end + 1 : nullptr;
+    }
 }
 
 
-void init_scene(Scene *scene, std::string name)
+void init_scene(Scene *scene, const std::string &name)
 {
     if (scene == nullptr) {
-        std::cout << "scene is null" << std::endl;
+        LOG_ERROR(LOG_SCENE, "scene is null");
         exit(1);
     }
     static int scene_ids = 0;
 
     memset(scene, 0, sizeof(Scene));
     scene->id = ++scene_ids;
-    scene->entities = new std::list<Entity *>();
-    scene->tagged_entities = new std::map<std::string, Entity *>();
-    scene->tagged_groups = new std::map <std::string, std::list<Entity *>>();
 
+    // the arena and GL objects come later, from load_scene or a scene transition
     scene->memory_arena.memory_size = DEFAULT_MEMORY_ARENA_SIZE_MB;
-    scene->memory_arena.memory = (unsigned char *)malloc(scene->memory_arena.memory_size*sizeof(unsigned char));
-    scene->memory_arena.current_memory_pointer = scene->memory_arena.memory;
-
-    glGenVertexArrays(1, &scene->vao);
-    glBindVertexArray(scene->vao);
-    init_frame(&scene->frame);
 }
 
 
-void init_frame(Frame *frame)
+// a load job, safe on the loader thread
+static void allocate_scene_arena(void *data)
 {
-    if (frame == nullptr) {
-        std::cout << "frame is null" << std::endl;
+    Scene *scene = (Scene *)data;
+
+    scene->memory_arena.memory = (unsigned char *)tracked_malloc(scene->memory_arena.memory_size*sizeof(unsigned char));
+    if (scene->memory_arena.memory == nullptr) {
+        LOG_ERROR(LOG_MEMORY, "Could not allocate a %d byte scene arena", scene->memory_arena.memory_size);
         exit(1);
     }
 
-    static int frame_ids = 0;
+    // faulting every page in here keeps that cost off the frames that first touch them
+    memset(scene->memory_arena.memory, 0, scene->memory_arena.memory_size);
+    scene->memory_arena.current_memory_pointer = scene->memory_arena.memory;
+}
 
-    memset(frame, 0, sizeof(Frame));
-    frame->id = ++frame_ids;
-    glGenFramebuffers(1, &frame->glid);
-    glBindFramebuffer(GL_FRAMEBUFFER, frame->glid);
 
-    glGenTextures(1, &frame->gl_texture_id);
-    glBindTexture(GL_TEXTURE_2D, frame->gl_texture_id);
+// the main thread part, once the arena is there
+static void create_scene_objects(Scene *scene)
+{
+    init_memory_pool(&scene->entity_pool, &scene->memory_arena, sizeof(Entity));
+    init_memory_pool(&scene->sprite_pool, &scene->memory_arena, sizeof(Sprite));
 
-    glTexImage2D(GL_TEXTURE_2D, 0,GL_RGBA, SCREEN_WIDTH, SCREEN_HEIGHT, 0,GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    scene->loaded = true;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
-    frame->gl_depth_buffer_id;
-    glGenRenderbuffers(1, &frame->gl_depth_buffer_id);
-    glBindRenderbuffer(GL_RENDERBUFFER, frame->gl_depth_buffer_id);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCREEN_WIDTH, SCREEN_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, frame->gl_depth_buffer_id);
+// a load job, frees what destroy_scene left for the loader thread
+static void free_scene_memory(void *data)
+{
+    Scene *scene = (Scene *)data;
 
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, frame->gl_texture_id, 0);
-    GLenum draw_buffers[1] = {GL_COLOR_ATTACHMENT0};
-    glDrawBuffers(1, draw_buffers);
+    free(scene->memory_arena.memory);
+    free(scene);
+}
 
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cout << "Error creating framebuffer" << std::endl;
-        exit(1);
-    }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+static void decode_image_job(void *data)
+{
+    DecodedImage *image = (DecodedImage *)data;
+    decode_texture_image(TEXTURES, image->texture->image_path, &image->image, &image->collision_mask);
 }
 
 
-void use_frame(Frame *frame)
+void load_scene(Scene *scene)
 {
-    GLuint id = 0;
-    if (frame == nullptr){
-        id = 0;
+    // all at once on this thread, the hitch a scene transition is there to avoid
+    if (scene->texture_count > SCENE_MAX_TEXTURES) {
+        LOG_ERROR(LOG_SCENE, "Scene %d needs %d textures, a scene holds at most %d", scene->id, scene->texture_count, SCENE_MAX_TEXTURES);
+        exit(1);
     }
-    else {
-        id = frame->glid;
+
+    allocate_scene_arena(scene);
+
+    for (int i = 0; i < scene->texture_count; ++i) {
+        scene->texture_handles[i] = acquire_texture(TEXTURES, scene->textures[i].name, scene->textures[i].image_path);
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, id);
+    create_scene_objects(scene);
 }
 
 
-void push_scene(Scene *scene)
+void destroy_scene(Scene *scene)
 {
-    if (scene==nullptr) {
-        std::cout << "Cannot push null scene" << std::endl;
+    if (scene == nullptr) {
+        LOG_ERROR(LOG_SCENE, "Cannot destroy null scene");
         exit(1);
     }
 
-    SCENE_STACK.push_back(scene);
-}
+    // game code and GL objects stay on the main thread, the big frees go to the loader
+    if (scene->initialized && scene->shutdown) {
+        scene->shutdown(scene);
+    }
 
+    if (scene->loaded) {
+        // frames already published can still draw with its textures, and released ones can be evicted
+        if (RENDER_THREAD) {
+            wait_render_thread(RENDER_THREAD);
+        }
 
-void use_scene(Scene *scene)
-{
-    if (scene==nullptr) {
-        std::cout << "Cannot set null scene" << std::endl;
-        exit(1);
+        for (int i = 0; i < scene->texture_count; ++i) {
+            release_texture(TEXTURES, scene->texture_handles[i]);
+        }
     }
 
-    if (SCENE_STACK.size() > 0) {
-        SCENE_STACK.pop_back();
+    LoadJob *teardown_job = &SCENE_TRANSITION.teardown_job;
+    if (teardown_job->run) {
+        wait_load_job(teardown_job);
     }
-    SCENE_STACK.push_back(scene);
+
+    queue_load_job(LOADER, teardown_job, free_scene_memory, scene);
 }
 
 
-Scene *pop_scene()
+void reserve_scene_render_frames(Scene *scene)
 {
-    Scene *scene = SCENE_STACK.back();
-    SCENE_STACK.pop_back();
-    return scene;
+    // right after the startup made the pools, so building a frame never has to grow the draw lists
+    if (RENDER_THREAD && scene->projectiles) {
+        reserve_render_frame_projectiles(RENDER_THREAD, get_projectile_capacity(scene->projectiles));
+    }
 }
 
 
-void init_shader(Shader *shader, std::string name, std::string vertex_filename, std::string fragment_filename)
+bool begin_scene_transition(Scene *scene, SCENE_TRANSITION_MODE mode)
 {
-    if ( shader == nullptr ) {
-        std::cout << "ERROR: shader object is null" << std::endl;
+    if (scene == nullptr) {
+        LOG_ERROR(LOG_SCENE, "Cannot transition to null scene");
         exit(1);
     }
 
-    static int shader_ids = 0;
+    SceneTransition *transition = &SCENE_TRANSITION;
+    if (transition->state != SCENE_TRANSITION_IDLE) {
+        LOG_WARN(LOG_SCENE, "Scene %d is still loading, scene %d has to wait", transition->scene->id, scene->id);
+        return false;
+    }
 
-    memset((void*)shader, 0, sizeof(Shader));
+    if (scene->texture_count > SCENE_MAX_TEXTURES) {
+        LOG_ERROR(LOG_SCENE, "Scene %d needs %d textures, a scene holds at most %d", scene->id, scene->texture_count, SCENE_MAX_TEXTURES);
+        return false;
+    }
 
-    shader->id = ++shader_ids;
-    shader->vertex_shader_filename = vertex_filename;
-    shader->fragment_shader_filename = fragment_filename;
-    shader->name = name;
-    shader->bound = false;
-    shader->uniform_locations = new std::map<std::string, GLint>();
+    transition->state = SCENE_TRANSITION_LOADING;
+    transition->mode = mode;
+    transition->scene = scene;
+    transition->image_count = 0;
+    transition->images_uploaded = 0;
 
-    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    queue_load_job(LOADER, &transition->arena_job, allocate_scene_arena, scene);
 
-    std::string vertex_shader_code = read_file(shader->vertex_shader_filename);
-    std::string fragment_shader_code = read_file(shader->fragment_shader_filename);
+    // held from here, so nothing the scene needs is evicted while it loads
+    for (int i = 0; i < scene->texture_count; ++i) {
+        if (is_texture_resident(TEXTURES, scene->textures[i].image_path)) {
+            scene->texture_handles[i] = acquire_texture(TEXTURES, scene->textures[i].name, scene->textures[i].image_path);
+            continue;
+        }
 
-    const char *vertex_shader_code_cstr = vertex_shader_code.c_str();
-    const char *fragment_shader_code_cstr = fragment_shader_code.c_str();
+        DecodedImage *image = &transition->images[transition->image_count++];
+        image->texture_index = i;
+        image->texture = &scene->textures[i];
+        memset(&image->image, 0, sizeof(TextureImage));
+        image->collision_mask = nullptr;
+        queue_load_job(LOADER, &image->job, decode_image_job, image);
+    }
 
-    const int vertex_shader_code_size = vertex_shader_code.size();
-    const int fragment_shader_code_size = fragment_shader_code.size();
+    LOG_INFO(LOG_SCENE, "Loading scene %d in the background, %d images to decode", scene->id, transition->image_count);
+    return true;
+}
 
-    glShaderSource(vertex_shader, 1, &vertex_shader_code_cstr, &vertex_shader_code_size);
-    glShaderSource(fragment_shader, 1, &fragment_shader_code_cstr, &fragment_shader_code_size);
 
-    glCompileShader(vertex_shader);
-    glCompileShader(fragment_shader);
+void update_scene_transition()
+{
+    SceneTransition *transition = &SCENE_TRANSITION;
+    Scene *scene = transition->scene;
+
+    // one step a frame at most, so no single frame pays for the whole load
+    switch (transition->state) {
+        case SCENE_TRANSITION_IDLE:
+        {
+            break;
+        }
+        case SCENE_TRANSITION_LOADING:
+        {
+            bool done = is_load_job_done(&transition->arena_job);
+            for (int i = 0; done && i < transition->image_count; ++i) {
+                done = is_load_job_done(&transition->images[i].job);
+            }
 
-    int vertex_compilation_result = 0;
+            if (done) {
+                transition->state = SCENE_TRANSITION_UPLOADING;
+            }
+            break;
+        }
+        case SCENE_TRANSITION_UPLOADING:
+        {
+            ALLOC_SCOPE(ALLOC_LOADING);
+
+            int uploads = 0;
+            while (transition->images_uploaded < transition->image_count && uploads < SCENE_TRANSITION_UPLOADS_PER_FRAME) {
+                DecodedImage *image = &transition->images[transition->images_uploaded++];
+                if (image->image.memory == nullptr) {
+                    LOG_ERROR(LOG_RENDER, "Could not load image named: %s", image->texture->image_path);
+                    exit(1);
+                }
 
-    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &vertex_compilation_result);
+                scene->texture_handles[image->texture_index] =
+                    acquire_decoded_texture(TEXTURES, image->texture->name, image->texture->image_path, &image->image, image->collision_mask);
+                uploads += 1;
+            }
+
+            // the startup gets a frame of its own
+            if (uploads == 0) {
+                create_scene_objects(scene);
+                scene->startup(scene);
+                reserve_scene_render_frames(scene);
+                transition->state = SCENE_TRANSITION_READY;
+            }
+            break;
+        }
+        case SCENE_TRANSITION_READY:
+        {
+            Scene *previous = SCENE_STACK.size() > 0 ? SCENE_STACK.back() : nullptr;
+
+            if (transition->mode == SCENE_TRANSITION_PUSH) {
+                push_scene(scene);
+            }
+            else {
+                use_scene(scene);
+                if (previous) {
+                    destroy_scene(previous);
+                }
+            }
+
+            LOG_INFO(LOG_SCENE, "Switched to scene %d", scene->id);
+
+            transition->scene = nullptr;
+            transition->state = SCENE_TRANSITION_IDLE;
+            break;
+        }
+    }
+}
+
+
+void init_frame(Frame *frame)
+{
+    if (frame == nullptr) {
+        LOG_ERROR(LOG_RENDER, "frame is null");
+        exit(1);
+    }
+
+    static int frame_ids = 0;
+
+    memset(frame, 0, sizeof(Frame));
+    frame->id = ++frame_ids;
+    glGenFramebuffers(1, &frame->glid);
+    glBindFramebuffer(GL_FRAMEBUFFER, frame->glid);
+
+    glGenTextures(1, &frame->gl_texture_id);
+    glBindTexture(GL_TEXTURE_2D, frame->gl_texture_id);
+
+    glTexImage2D(GL_TEXTURE_2D, 0,GL_RGBA, SCREEN_WIDTH, SCREEN_HEIGHT, 0,GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    frame->gl_depth_buffer_id;
+    glGenRenderbuffers(1, &frame->gl_depth_buffer_id);
+    glBindRenderbuffer(GL_RENDERBUFFER, frame->gl_depth_buffer_id);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCREEN_WIDTH, SCREEN_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, frame->gl_depth_buffer_id);
+
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, frame->gl_texture_id, 0);
+    GLenum draw_buffers[1] = {GL_COLOR_ATTACHMENT0};
+    glDrawBuffers(1, draw_buffers);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOG_ERROR(LOG_RENDER, "Error creating framebuffer");
+        exit(1);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+void free_frame(Frame *frame)
+{
+    glDeleteFramebuffers(1, &frame->glid);
+    glDeleteTextures(1, &frame->gl_texture_id);
+    glDeleteRenderbuffers(1, &frame->gl_depth_buffer_id);
+    memset(frame, 0, sizeof(Frame));
+}
+
+
+void use_frame(Frame *frame)
+{
+    GLuint id = 0;
+    if (frame == nullptr){
+        id = 0;
+    }
+    else {
+        id = frame->glid;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, id);
+}
+
+
+void push_scene(Scene *scene)
+{
+    if (scene==nullptr) {
+        LOG_ERROR(LOG_SCENE, "Cannot push null scene");
+        exit(1);
+    }
+
+    Scene *previous = SCENE_STACK.size() > 0 ? SCENE_STACK.back() : nullptr;
+    SCENE_STACK.push_back(scene);
+    update_scene_music(previous, scene);
+}
+
+
+void use_scene(Scene *scene)
+{
+    if (scene==nullptr) {
+        LOG_ERROR(LOG_SCENE, "Cannot set null scene");
+        exit(1);
+    }
+
+    Scene *previous = nullptr;
+    if (SCENE_STACK.size() > 0) {
+        previous = SCENE_STACK.back();
+        SCENE_STACK.pop_back();
+    }
+    SCENE_STACK.push_back(scene);
+    update_scene_music(previous, scene);
+}
+
+
+Scene *pop_scene()
+{
+    Scene *scene = SCENE_STACK.back();
+    SCENE_STACK.pop_back();
+    update_scene_music(scene, SCENE_STACK.size() > 0 ? SCENE_STACK.back() : nullptr);
+    return scene;
+}
+
+
+void update_scene_music(Scene *previous, Scene *next)
+{
+    const char *previous_music = previous ? previous->music_path : nullptr;
+    const char *next_music = next ? next->music_path : nullptr;
+
+    // scenes sharing a track keep it playing through the transition
+    if (previous_music == next_music || (previous_music && next_music && SDL_strcmp(previous_music, next_music) == 0)) {
+        return;
+    }
+
+    if (next_music) {
+        play_music(AUDIO, next_music, SCENE_MUSIC_CROSSFADE_S);
+    }
+    else {
+        stop_music(AUDIO, SCENE_MUSIC_CROSSFADE_S);
+    }
+}
+
+
+void quick_save_scene(Scene *scene)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    if (save_scene_snapshot(QUICK_SAVE, scene)) {
+        double elapsed_ms = (SDL_GetPerformanceCounter() - start)*1000.0/SDL_GetPerformanceFrequency();
+        LOG_INFO(LOG_SCENE, "Quick saved scene %d, %d of %d bytes in %.3fms", scene->id, QUICK_SAVE->copied, QUICK_SAVE->used, elapsed_ms);
+    }
+}
+
+
+void quick_load_scene(Scene *scene)
+{
+    // the background's vao belongs to the scene that saved, it may be gone since
+    if (QUICK_SAVE->used == 0 || QUICK_SAVE->scene_id != scene->id) {
+        LOG_WARN(LOG_SCENE, "No quick save for scene %d", scene->id);
+        return;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    if (load_scene_snapshot(QUICK_SAVE, scene)) {
+        double elapsed_ms = (SDL_GetPerformanceCounter() - start)*1000.0/SDL_GetPerformanceFrequency();
+        LOG_INFO(LOG_SCENE, "Quick loaded scene %d, %d of %d bytes in %.3fms", scene->id, QUICK_SAVE->copied, QUICK_SAVE->used, elapsed_ms);
+    }
+}
+
+
+ShaderHandle load_shader(const char *name, const char *vertex_filename, const char *fragment_filename)
+{
+    ShaderHandle handle = add_resource(SHADERS, name);
+    Shader *shader = get_shader(handle);
+
+    shader->name = name;
+    shader->bound = false;
+    shader->uniform_locations = new std::map<std::string, GLint, std::less<>>();
+
+    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+
+    // GL takes the source with an explicit length, so the mapped files go in as they are
+    FileView vertex_shader_file;
+    FileView fragment_shader_file;
+
+    if (!open_file_view(VFS, vertex_filename, &vertex_shader_file) ||
+        !open_file_view(VFS, fragment_filename, &fragment_shader_file))
+    {
+        LOG_ERROR(LOG_RENDER, "Could not find source for shader %s", name);
+        exit(1);
+    }
+
+    const char *vertex_shader_code = (const char *)vertex_shader_file.data;
+    const char *fragment_shader_code = (const char *)fragment_shader_file.data;
+
+    const int vertex_shader_code_size = (int)vertex_shader_file.size;
+    const int fragment_shader_code_size = (int)fragment_shader_file.size;
+
+    glShaderSource(vertex_shader, 1, &vertex_shader_code, &vertex_shader_code_size);
+    glShaderSource(fragment_shader, 1, &fragment_shader_code, &fragment_shader_code_size);
+
+    glCompileShader(vertex_shader);
+    glCompileShader(fragment_shader);
+
+    close_file_view(VFS, &vertex_shader_file);
+    close_file_view(VFS, &fragment_shader_file);
+
+    int vertex_compilation_result = 0;
+
+    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &vertex_compilation_result);
 
     if(!vertex_compilation_result) {
         int log_length = 0;
         glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &log_length);
-        char *infolog = (char*)malloc(sizeof(char)*log_length);
+        char *infolog = (char*)tracked_malloc(sizeof(char)*log_length);
         glGetShaderInfoLog(vertex_shader, log_length, NULL, &infolog[0]);
-        std::cout << "VERTEX SHADER COMPILATION LOG\n\n" << infolog << std::endl;
+        log_shader_info_log(name, "vertex", infolog);
     }
 
     int fragment_compilation_result = 0;
@@ -441,9 +1280,9 @@ void init_shader(Shader *shader, std::string name, std::string vertex_filename,
     if(!fragment_compilation_result) {
         int log_length = 0;
         glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &log_length);
-        char *infolog = (char*)malloc(sizeof(char)*log_length);
+        char *infolog = (char*)tracked_malloc(sizeof(char)*log_length);
         glGetShaderInfoLog(fragment_shader, log_length, NULL, &infolog[0]);
-        std::cout << "FRAGMENT SHADER COMPILATION LOG\n\n" << infolog << std::endl;
+        log_shader_info_log(name, "fragment", infolog);
         free(infolog);
     }
 
@@ -461,39 +1300,44 @@ void init_shader(Shader *shader, std::string name, std::string vertex_filename,
 	{
 		int log_length = 0;
 		glGetProgramiv(shader->glid, GL_INFO_LOG_LENGTH, &log_length);
-		char *infolog = (char*)malloc(sizeof(char)*log_length);
+		char *infolog = (char*)tracked_malloc(sizeof(char)*log_length);
 		glGetProgramInfoLog(shader->glid, log_length, NULL, &infolog[0]);
-		std::cout << "SHADER COMPILATION ERROR: \n\n" <<  infolog << std::endl;
+		log_shader_info_log(name, "link", infolog);
         free(infolog);
-        return;
+
+        glDeleteProgram(shader->glid);
+        delete shader->uniform_locations;
+        remove_resource(SHADERS, handle);
+        return ShaderHandle{};
     }
     
-    std::cout << "Compiled shader: " << name << std::endl;
+    LOG_INFO(LOG_RENDER, "Compiled shader: %s", name);
 
-    SHADERS[name] = shader;
+    return handle;
 }
 
 
-GLint get_shader_uniform_location(Shader *shader, std::string uniform_name) 
+GLint get_shader_uniform_location(Shader *shader, const char *uniform_name) 
 {
     if (shader == nullptr) {
-        std::cout << "Attempt to read nullptr instead of shader" << std::endl;
+        LOG_ERROR(LOG_RENDER, "Attempt to read nullptr instead of shader");
         exit(1);
     }
 
-    if (shader->uniform_locations->find(uniform_name) == shader->uniform_locations->end()) {
-        GLint location = glGetUniformLocation(shader->glid, uniform_name.c_str());
+    auto found = shader->uniform_locations->find(uniform_name);
+    if (found == shader->uniform_locations->end()) {
+        GLint location = glGetUniformLocation(shader->glid, uniform_name);
 
         if ( location < 0 ) {
-            std::cout << "Uniform location " << uniform_name << " not found!" << std::endl;
+            LOG_WARN(LOG_RENDER, "Uniform location %s not found in shader %s", uniform_name, shader->name);
             // exit(1);
         }
         
         (*shader->uniform_locations)[uniform_name] = location;
-        return (*shader->uniform_locations)[uniform_name];
+        return location;
     }
     else {
-        return (*shader->uniform_locations)[uniform_name];
+        return found->second;
     }
 
     //NOTE(Brett): SHould never be here
@@ -501,10 +1345,10 @@ GLint get_shader_uniform_location(Shader *shader, std::string uniform_name)
 }
 
 
-void set_shader_uniform_1i(Shader *shader, std::string uniform_name, int value) 
+void set_shader_uniform_1i(Shader *shader, const char *uniform_name, int value) 
 {
     if ( shader == nullptr ) {
-        std::cout << "Attempt to read nullptr instead of shader" << std::endl;
+        LOG_ERROR(LOG_RENDER, "Attempt to read nullptr instead of shader");
         exit(1);
     }
 
@@ -513,10 +1357,10 @@ void set_shader_uniform_1i(Shader *shader, std::string uniform_name, int value)
 }
 
 
-void set_shader_uniform_1f(Shader *shader, std::string uniform_name, float value) 
+void set_shader_uniform_1f(Shader *shader, const char *uniform_name, float value) 
 {
     if ( shader == nullptr ) {
-        std::cout << "Attempt to read nullptr instead of shader" << std::endl;
+        LOG_ERROR(LOG_RENDER, "Attempt to read nullptr instead of shader");
         exit(1);
     }
 
@@ -525,10 +1369,10 @@ void set_shader_uniform_1f(Shader *shader, std::string uniform_name, float value
 }
 
 
-void set_shader_uniform_matrix4fv(Shader *shader, std::string uniform_name, int count, bool transpose, glm::mat4 *matrices)
+void set_shader_uniform_matrix4fv(Shader *shader, const char *uniform_name, int count, bool transpose, glm::mat4 *matrices)
 {
     if ( shader == nullptr ) {
-        std::cout << "Attempt to read nullptr instead of shader" << std::endl;
+        LOG_ERROR(LOG_RENDER, "Attempt to read nullptr instead of shader");
         exit(1);
     }
 
@@ -553,17 +1397,25 @@ void use_shader(Shader *shader)
 }
 
 
-void create_window(Window *win, std::string &title, int width, int height) 
+Shader *get_shader(ShaderHandle handle)
+{
+    return get_resource(SHADERS, handle);
+}
+
+
+void create_window(Window *win, std::string &title, int width, int height, bool visible) 
 {
     if (window == nullptr) {
-        std::cout << "NO WINDOW!!!!" << std::endl;
+        LOG_ERROR(LOG_RENDER, "NO WINDOW!!!!");
         exit(1);
     }
 
     win->width = width;
     win->height = height;
 
-    win->sdl_window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, win->width, win->height, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+    // a hidden window still gives us a GL context to load shaders and textures into
+    Uint32 window_flags = SDL_WINDOW_OPENGL | (visible ? SDL_WINDOW_SHOWN : SDL_WINDOW_HIDDEN);
+    win->sdl_window = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, win->width, win->height, window_flags);
 
     win->context = SDL_GL_CreateContext(win->sdl_window);
 
@@ -573,58 +1425,29 @@ void create_window(Window *win, std::string &title, int width, int height)
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    glEnable(GL_DEPTH);
-    glDepthFunc(GL_LEQUAL);
+    init_gl_state();
 
     glewExperimental = GL_TRUE;
     glewInit();
 }
 
 
-void init_texture(Texture *texture, std::string image_name, std::string image_path)
+// per context, the render thread's starts out with none of it
+void init_gl_state()
 {
-    if (texture == nullptr) {
-        std::cout << "cannot initialize texture when it is null" << std::endl;
-        exit(1);
-    }
-
-    static int texture_ids = 0;
-
-    memset(texture, 0, sizeof(Texture));
-    texture->id = ++texture_ids;
-    SDL_Surface *med_surface = IMG_Load(image_path.c_str());
-
-    if ( !med_surface ) {
-        std::cout << "Could not load image named: " << image_path << std::endl;
-        exit(1);
-    }
-
-    texture->image_size = glm::vec2(med_surface->w, med_surface->h);
-
-    glGenTextures(1, &texture->glid);
-    glBindTexture(GL_TEXTURE_2D, texture->glid);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, med_surface->w, med_surface->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)med_surface->pixels);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    SDL_FreeSurface(med_surface);
-
-    TEXTURES[image_name] = texture;
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // only on while the render queue draws, see draw_scene
+    glDisable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
 }
 
 
 void init_entity(Entity *entity, glm::vec3 position, glm::vec3 scale, glm::vec3 rotation)
 {
     if (entity == nullptr) {
-        std::cout << "cannot initialize entity when it is null" << std::endl;
+        LOG_ERROR(LOG_SCENE, "cannot initialize entity when it is null");
         exit(1);
     }
 
@@ -634,8 +1457,6 @@ void init_entity(Entity *entity, glm::vec3 position, glm::vec3 scale, glm::vec3
 
     entity->id = ++entity_ids;
     entity->sprite = nullptr;
-    entity->children = new std::list<Entity *>();
-    entity->tag = std::string();
 
     entity->acceleration = glm::vec3(0.f);
     entity->velocity = glm::vec3(0.f);
@@ -648,17 +1469,17 @@ void init_entity(Entity *entity, glm::vec3 position, glm::vec3 scale, glm::vec3
 void init_sprite(Sprite *sprite, Entity *parent, Texture *texture, glm::vec2 frame_offset, glm::vec2 frame_size) 
 {
     if (sprite == nullptr) { 
-        std::cout << "cannot initialize sprite when it is null" << std::endl;
+        LOG_ERROR(LOG_SCENE, "cannot initialize sprite when it is null");
         exit(1);
     }
 
     if (parent == nullptr) {
-        std::cout << "cannot set sprite parent to null entity" << std::endl;
+        LOG_ERROR(LOG_SCENE, "cannot set sprite parent to null entity");
         exit(1);
     }
 
     if (texture == nullptr) {
-        std::cout << "sprite cannot use null texture" << std::endl;
+        LOG_ERROR(LOG_SCENE, "sprite cannot use null texture");
         exit(1);
     }
 
@@ -677,162 +1498,317 @@ void init_sprite(Sprite *sprite, Entity *parent, Texture *texture, glm::vec2 fra
     else {
         sprite->texture_frame_size = frame_size;
     }
+
+    // most sprites are solid shapes, soft ones like glows set ALPHA or ADDITIVE
+    sprite->layer = RENDER_LAYER_WORLD;
+    sprite->blend = RENDER_BLEND_CUTOUT;
+
+    sprite->animation_clip = INVALID_ANIMATION_CLIP;
+    sprite->animation_speed = 1.f;
+}
+
+
+void set_sprite_animation(Sprite *sprite, AnimationClipId clip, float start_time_s, float speed)
+{
+    sprite->animation_clip = clip;
+    sprite->animation_start_s = start_time_s;
+    sprite->animation_speed = speed;
 }
 
 
-void set_entity_tag(Scene *scene, Entity *entity, std::string tag)
+void set_entity_tag(Scene *scene, Entity *entity, const char *tag)
 {
     if (scene == nullptr) {
-        std::cout << "Cannot tag into null scene" << std::endl;
+        LOG_ERROR(LOG_SCENE, "Cannot tag into null scene");
         exit(1);
     }
 
     if (entity == nullptr) {
-        std::cout << "cannot tag null entity" << std::endl;
+        LOG_ERROR(LOG_SCENE, "cannot tag null entity");
+        exit(1);
+    }
+
+    SDL_strlcpy(entity->tag, tag, ENTITY_NAME_LENGTH);
+
+    // the first entity to take a tag keeps it
+    if (get_entity_by_tag(scene, tag)) {
+        return;
+    }
+
+    if (scene->tag_count >= MAX_TAGGED_ENTITIES) {
+        LOG_ERROR(LOG_SCENE, "Too many tagged entities, cannot add %s", tag);
         exit(1);
     }
 
-    scene->tagged_entities->insert(std::pair<std::string, Entity *>(tag, entity));
+    EntityTag *entity_tag = &scene->tags[scene->tag_count++];
+    SDL_strlcpy(entity_tag->tag, tag, ENTITY_NAME_LENGTH);
+    entity_tag->entity = entity;
 }
 
 
-Entity *get_entity_by_tag(Scene *scene, std::string tag)
+Entity *get_entity_by_tag(Scene *scene, const char *tag)
 {
     if (scene == nullptr) {
-        std::cout << "Cannot tag into null scene" << std::endl;
+        LOG_ERROR(LOG_SCENE, "Cannot tag into null scene");
         exit(1);
     }
 
-    if (scene->tagged_entities->find(tag) == scene->tagged_entities->end()) {
-        return nullptr;
+    for (int i = 0; i < scene->tag_count; ++i) {
+        if (SDL_strncmp(scene->tags[i].tag, tag, ENTITY_NAME_LENGTH) == 0) {
+            return scene->tags[i].entity;
+        }
     }
 
-    return scene->tagged_entities->at(tag);
+    return nullptr;
 }
 
 
-void add_scene_entity(Scene *scene, Entity *entity)
+Entity *alloc_entity(Scene *scene)
 {
-    if (entity == nullptr) { 
-        std::cout << "cannot set entity property when its null" << std::endl;
+    if (scene == nullptr) {
+        LOG_ERROR(LOG_SCENE, "cannot allocate entity from null scene");
         exit(1);
     }
 
+    return (Entity*)MemoryPoolAlloc(&scene->entity_pool);
+}
+
+
+Sprite *alloc_sprite(Scene *scene)
+{
     if (scene == nullptr) {
-        std::cout << "cannot set parent to null scene" << std::endl;
+        LOG_ERROR(LOG_SCENE, "cannot allocate sprite from null scene");
         exit(1);
     }
 
-    scene->entities->push_back(entity);
-    entity->scene = scene;
+    return (Sprite*)MemoryPoolAlloc(&scene->sprite_pool);
 }
 
 
-void set_entity_group_tag(Scene *scene, Entity *entity, std::string group_tag)
+void add_scene_entity(Scene *scene, Entity *entity)
 {
     if (entity == nullptr) { 
-        std::cout << "cannot set entity property when its null" << std::endl;
+        LOG_ERROR(LOG_SCENE, "cannot set entity property when its null");
         exit(1);
     }
 
     if (scene == nullptr) {
-        std::cout << "cannot set parent to null scene" << std::endl;
+        LOG_ERROR(LOG_SCENE, "cannot set parent to null scene");
         exit(1);
     }
 
-    if (scene->tagged_groups->find(group_tag) == scene->tagged_groups->end()) {
-        scene->tagged_groups->insert(std::pair<std::string, std::list<Entity *>>(group_tag, std::list<Entity *>()));
+    entity->prev_sibling = scene->last_entity;
+    entity->next_sibling = nullptr;
+
+    if (scene->last_entity) {
+        scene->last_entity->next_sibling = entity;
+    }
+    else {
+        scene->first_entity = entity;
     }
-    scene->tagged_groups->at(group_tag).push_back(entity);
+    scene->last_entity = entity;
+
+    entity->in_scene = true;
 }
 
 
-std::list<Entity *> get_entities_by_group_tag(Scene *scene, std::string group_tag)
+void remove_scene_entity(Scene *scene, Entity *entity)
 {
-    if (scene == nullptr) {
-        std::cout << "cannot set parent to null scene" << std::endl;
+    if (entity == nullptr) { 
+        LOG_ERROR(LOG_SCENE, "cannot remove null entity");
         exit(1);
     }
 
-    if (scene->tagged_groups->find(group_tag) == scene->tagged_groups->end()) {
-        return std::list<Entity *>();
+    if (scene == nullptr || !entity->in_scene || !arena_contains(&scene->memory_arena, entity)) {
+        LOG_ERROR(LOG_SCENE, "cannot remove entity from a scene it is not in");
+        exit(1);
+    }
+
+    if (entity->prev_sibling) {
+        entity->prev_sibling->next_sibling = entity->next_sibling;
     }
     else {
-        return scene->tagged_groups->at(group_tag);
+        scene->first_entity = entity->next_sibling;
     }
 
-    std::list<Entity *>();
-}
+    if (entity->next_sibling) {
+        entity->next_sibling->prev_sibling = entity->prev_sibling;
+    }
+    else {
+        scene->last_entity = entity->prev_sibling;
+    }
 
+    EntityGroup *group = entity->group_tag[0] ? get_entities_by_group_tag(scene, entity->group_tag) : nullptr;
+    if (group) {
+        if (entity->prev_in_group) {
+            entity->prev_in_group->next_in_group = entity->next_in_group;
+        }
+        else {
+            group->first = entity->next_in_group;
+        }
 
-void add_entity(Entity *entity, Entity *child)
-{
-    if (entity == nullptr) { 
-        std::cout << "cannot set entity property when its null" << std::endl;
-        exit(1);
-    }
+        if (entity->next_in_group) {
+            entity->next_in_group->prev_in_group = entity->prev_in_group;
+        }
+        else {
+            group->last = entity->prev_in_group;
+        }
 
-    if (child == nullptr) {
-        std::cout << "cannot set child as null entity" << std::endl;
-        exit(1);
+        group->count -= 1;
     }
 
-    child->parent = entity;
-    entity->children->push_back(child);
+    entity->prev_sibling = nullptr;
+    entity->next_sibling = nullptr;
+    entity->prev_in_group = nullptr;
+    entity->next_in_group = nullptr;
+    entity->group_tag[0] = '\0';
+    entity->in_scene = false;
 }
 
 
-void *MemoryArenaAlloc(MemoryArena *arena, int size) 
+void destroy_entity(Scene *scene, Entity *entity)
 {
-    void *ret_address = arena->current_memory_pointer;
-
-    if ((arena->current_memory_pointer + size) < (arena->memory + arena->memory_size)) {
-        arena->current_memory_pointer += size;
-        return ret_address;
+    if (entity == nullptr) {
+        LOG_ERROR(LOG_SCENE, "cannot destroy null entity");
+        exit(1);
     }
-    else {
-        std::cout << "Asking for more than the arena can give." << std::endl;
+
+    if (entity->first_child) {
+        LOG_ERROR(LOG_SCENE, "cannot destroy an entity that still has children");
         exit(1);
     }
 
-    return nullptr;
+    if (entity->in_scene) {
+        remove_scene_entity(scene, entity);
+    }
+
+    if (entity->sprite) {
+        MemoryPoolFree(&scene->sprite_pool, entity->sprite);
+    }
+    MemoryPoolFree(&scene->entity_pool, entity);
 }
 
 
-void draw_entity(Entity *entity)
+void set_entity_group_tag(Scene *scene, Entity *entity, const char *group_tag)
 {
-    if (entity == nullptr) {
-        std::cout << "Cannot draw null entity" << std::endl;
+    if (entity == nullptr) { 
+        LOG_ERROR(LOG_SCENE, "cannot set entity property when its null");
         exit(1);
     }
 
-    Shader *sprite_shader = SHADERS["sprite"];
-
-    if (!sprite_shader){
-        std::cout << "Coudl not locate sprite shader... it might not be initialized" << std::endl;
+    if (scene == nullptr) {
+        LOG_ERROR(LOG_SCENE, "cannot set parent to null scene");
         exit(1);
     }
 
-    use_shader(sprite_shader);
-    set_shader_uniform_1i(sprite_shader, "sprite_texture", 0);
+    EntityGroup *group = get_entities_by_group_tag(scene, group_tag);
 
-    // draw children first
+    if (group == nullptr) {
+        if (scene->group_count >= MAX_ENTITY_GROUPS) {
+            LOG_ERROR(LOG_SCENE, "Too many entity groups, cannot add %s", group_tag);
+            exit(1);
+        }
 
-    // std::cout << "Drawing tag: " << entity->id << " @ " << entity->tag << std::endl;
-    for(auto iter = entity->children->begin(); iter != entity->children->end(); iter++) {
-        // std::cout << "draw ID: " << (*iter)->id << std::endl; 
-        draw_entity(*iter);
+        group = &scene->groups[scene->group_count++];
+        memset(group, 0, sizeof(EntityGroup));
+        SDL_strlcpy(group->tag, group_tag, ENTITY_NAME_LENGTH);
     }
 
-    glBindTexture(GL_TEXTURE_2D, entity->sprite->texture->glid);
-    glActiveTexture(GL_TEXTURE0);
-
-    glm::mat4 projection = glm::ortho(0.f, (float)SCREEN_WIDTH, 0.f, (float)SCREEN_HEIGHT, 0.0f, 100.f);
-    glm::mat4 view = glm::mat4(1.f);
-    glm::mat4 model = glm::mat4(1.f);
+    SDL_strlcpy(entity->group_tag, group_tag, ENTITY_NAME_LENGTH);
 
-    glm::vec3 translate_offset = glm::vec3(0.f);
-    if (entity->parent) {
+    entity->prev_in_group = group->last;
+    entity->next_in_group = nullptr;
+    if (group->last) {
+        group->last->next_in_group = entity;
+    }
+    else {
+        group->first = entity;
+    }
+    group->last = entity;
+    group->count += 1;
+}
+
+
+EntityGroup *get_entities_by_group_tag(Scene *scene, const char *group_tag)
+{
+    if (scene == nullptr) {
+        LOG_ERROR(LOG_SCENE, "cannot set parent to null scene");
+        exit(1);
+    }
+
+    for (int i = 0; i < scene->group_count; ++i) {
+        if (SDL_strncmp(scene->groups[i].tag, group_tag, ENTITY_NAME_LENGTH) == 0) {
+            return &scene->groups[i];
+        }
+    }
+
+    return nullptr;
+}
+
+
+void add_entity(Entity *entity, Entity *child)
+{
+    if (entity == nullptr) { 
+        LOG_ERROR(LOG_SCENE, "cannot set entity property when its null");
+        exit(1);
+    }
+
+    if (child == nullptr) {
+        LOG_ERROR(LOG_SCENE, "cannot set child as null entity");
+        exit(1);
+    }
+
+    child->parent = entity;
+    child->prev_sibling = entity->last_child;
+    child->next_sibling = nullptr;
+
+    if (entity->last_child) {
+        entity->last_child->next_sibling = child;
+    }
+    else {
+        entity->first_child = child;
+    }
+    entity->last_child = child;
+}
+
+
+void use_sprite_shader(Shader *sprite_shader, float time_s)
+{
+    // per pass uniforms, everything per sprite comes from the instance buffer
+    glm::mat4 projection = glm::ortho(0.f, (float)SCREEN_WIDTH, 0.f, (float)SCREEN_HEIGHT, 0.0f, 100.f);
+    glm::mat4 view = glm::mat4(1.f);
+
+    use_shader(sprite_shader);
+    set_shader_uniform_1i(sprite_shader, "sprite_texture", 0);
+    set_shader_uniform_matrix4fv(sprite_shader, "projection", 1, false, &projection);
+    set_shader_uniform_matrix4fv(sprite_shader, "view", 1, false, &view);
+
+    set_shader_uniform_1i(sprite_shader, "animation_clips", ANIMATION_CLIP_TEXTURE_UNIT);
+    set_shader_uniform_1f(sprite_shader, "time", time_s);
+    set_shader_uniform_1i(sprite_shader, "overdraw", SPRITE_BATCH->debug == RENDER_DEBUG_OVERDRAW);
+    bind_animation_clips(ANIMATIONS);
+}
+
+
+void use_scene_shader(int shader_index, void *render_frame)
+{
+    // called by the render queue whenever the shader in the sort key changes
+    Shader *shader = get_resource_at(SHADERS, shader_index);
+    if (shader == nullptr) {
+        LOG_ERROR(LOG_RENDER, "Render queue asked for unknown shader %d", shader_index);
+        return;
+    }
+
+    use_sprite_shader(shader, ((RenderFrame *)render_frame)->time_s);
+}
+
+
+glm::mat4 get_entity_model(Entity *entity)
+{
+    glm::mat4 model = glm::mat4(1.f);
+
+    glm::vec3 translate_offset = glm::vec3(0.f);
+    if (entity->parent) {
         translate_offset = entity->parent->position;
     }
 
@@ -843,42 +1819,490 @@ void draw_entity(Entity *entity)
     model = glm::rotate(model, glm::radians(entity->rotation.y), glm::vec3(0.f, 1.f, 0.f));
     model = glm::rotate(model, glm::radians(entity->rotation.z), glm::vec3(0.f, 0.f, 1.f));
 
-    set_shader_uniform_matrix4fv(sprite_shader, "projection", 1, false, &projection);
-    set_shader_uniform_matrix4fv(sprite_shader, "view", 1, false, &view);
-    set_shader_uniform_matrix4fv(sprite_shader, "model", 1, false, &model);
+    return model;
+}
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindTexture(GL_TEXTURE_2D, 0);
 
+glm::vec4 get_sprite_uv_rect(Sprite *sprite)
+{
+    glm::vec2 image_size = sprite->texture->image_size;
+    return glm::vec4(sprite->texture_frame_offset/image_size, sprite->texture_frame_size/image_size);
+}
+
+
+CollisionShape get_entity_collision_shape(Entity *entity)
+{
+    // built like the sprite instance, so the mask lines up with what is on screen
+    glm::mat4 model = get_entity_model(entity);
+    SpriteInstance instance = make_sprite_instance(&model, get_sprite_uv_rect(entity->sprite));
+
+    return make_collision_shape(entity->sprite->texture->collision_mask, &instance);
+}
+
+
+void draw_entity(Entity *entity, RenderQueue *queue, int shader_index)
+{
+    if (entity == nullptr) {
+        LOG_ERROR(LOG_RENDER, "Cannot draw null entity");
+        exit(1);
+    }
+
+    // the tree order doesn't matter, the queue sorts by layer and depth
+
+    LOG_TRACE(LOG_RENDER, "Drawing entity %d @ %s", entity->id, entity->tag);
+    for(Entity *child = entity->first_child; child; child = child->next_sibling) {
+        draw_entity(child, queue, shader_index);
+    }
+
+    glm::mat4 model = get_entity_model(entity);
+
+    Sprite *sprite = entity->sprite;
+    SpriteInstance instance;
+    int flags = sprite->blend == RENDER_BLEND_CUTOUT ? SPRITE_FLAG_CUTOUT : 0;
+
+    if (sprite->animation_clip != INVALID_ANIMATION_CLIP) {
+        glm::vec4 animation = glm::vec4((float)sprite->animation_clip, sprite->animation_start_s, sprite->animation_speed, 0.f);
+        instance = make_sprite_instance(&model, animation, glm::vec4(1.f), flags | SPRITE_FLAG_ANIMATED);
+    }
+    else {
+        instance = make_sprite_instance(&model, get_sprite_uv_rect(sprite), glm::vec4(1.f), flags);
+    }
+
+    Uint64 key = make_render_key((RENDER_LAYER)sprite->layer, instance.position.z, (RENDER_BLEND)sprite->blend, shader_index, sprite->texture->glid);
+    submit_sprite(queue, key, &instance);
 }
 
 
-void draw_scene(Scene *scene)
+void build_render_frame(RenderFrame *frame, Scene *scene, const char *hud_text)
 {
     if (scene == nullptr) {
-        std::cout << "Current scene is null... there is nothing to draw" << std::endl;
+        LOG_ERROR(LOG_RENDER, "Current scene is null... there is nothing to draw");
         exit(1);
     }
 
-    use_shader(SHADERS["default"]);
-    use_frame(&scene->frame);
+    frame->time_s = scene->time_s;
+    frame->debug = RENDER_DEBUG_VIEW;
+
+    // before anything is submitted, the retained layers are hashed as they fill
+    frame->queue.retained_layers = RETAINED_RENDER_LAYERS;
+
+    if (scene->background) {
+        frame->background_layer_count = scene->background->layer_count;
+        memcpy(frame->background_layers, scene->background->layers, scene->background->layer_count*sizeof(BackgroundLayer));
+    }
+
+    // projectiles skip the queue, there are too many and they never need sorting
+    if (scene->projectiles) {
+        copy_projectile_draw_list(scene->projectiles, &frame->projectiles);
+    }
+
+    for(Entity *entity = scene->first_entity; entity; entity = entity->next_sibling) {
+        draw_entity(entity, &frame->queue, get_resource_index(SPRITE_SHADER));
+    }
+
+    if (scene->draw_overlay) {
+        scene->draw_overlay(scene, &frame->queue);
+    }
+
+    SDL_strlcpy(frame->hud_text, hud_text, sizeof(frame->hud_text));
+}
+
+
+void start_rendering(void *user_data)
+{
+    init_gl_state();
+
+    // the background and the final blit make their triangles from gl_VertexID
+    glGenVertexArrays(1, &RENDER_VAO);
+    init_frame(&RENDER_TARGET);
+    init_background(&RENDER_BACKGROUND);
+
+    SPRITE_BATCH = MALLOC(SpriteBatch);
+    init_sprite_batch(SPRITE_BATCH, RENDER_QUEUE_CAPACITY + PROJECTILE_DRAW_LIST_CAPACITY + SPRITE_BATCH_RESERVE,
+                      GPU_FRAMES_AHEAD, PERSISTENT_BUFFERS);
+
+    RENDER_WORKERS = MALLOC(WorkerPool);
+    init_worker_pool(RENDER_WORKERS, RENDER_WORKER_THREADS);
+}
+
+
+void stop_rendering(void *user_data)
+{
+    shutdown_worker_pool(RENDER_WORKERS);
+    shutdown_sprite_batch(SPRITE_BATCH);
+    shutdown_background(&RENDER_BACKGROUND);
+
+    for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+        RetainedLayer *retained = &RETAINED_LAYERS[layer];
+        if (retained->frame.glid == 0) {
+            continue;
+        }
+
+        LOG_INFO(LOG_RENDER, "Retained layer %d: %d frames, drawn again in %d, %.1f%% from the cache", layer,
+                 retained->frames, retained->redraws,
+                 retained->frames > 0 ? (retained->frames - retained->redraws)*100.0/retained->frames : 0.0);
+
+        free_frame(&retained->frame);
+        memset(retained, 0, sizeof(RetainedLayer));
+    }
+
+    free_frame(&RENDER_TARGET);
+    glDeleteVertexArrays(1, &RENDER_VAO);
+}
+
+
+void draw_render_frame(RenderFrame *frame, RenderFrameStats *stats, void *user_data)
+{
+    // a full queue and every projectile pool still leave room for the HUD
+    grow_sprite_batch(SPRITE_BATCH, frame->queue.capacity + frame->projectiles.capacity + SPRITE_BATCH_RESERVE);
+
+    Uint64 gpu_wait_counter = SPRITE_BATCH->stream.stats.wait_counter;
+    SPRITE_BATCH->sprites = 0;
+    SPRITE_BATCH->draw_calls = 0;
+    SPRITE_BATCH->debug = frame->debug;
+    SPRITE_BATCH->break_count = 0;
+    frame->queue.state_changes = 0;
+
+    // waits here if the GPU is still GPU_FRAMES_AHEAD frames behind
+    begin_sprite_frame(SPRITE_BATCH);
+
+    draw_scene(frame, stats);
+
+    // the HUD goes over the blit, so the debug views leave it out
+    SPRITE_BATCH->debug = RENDER_DEBUG_OFF;
+
+    // the overdraw count is only readable through the heatmap
+    bool heatmap = frame->debug == RENDER_DEBUG_OVERDRAW && is_resource_handle_valid(OVERDRAW_FRAME_SHADER);
+    Shader *frame_shader = get_shader(heatmap ? OVERDRAW_FRAME_SHADER : FRAME_SHADER);
+
+    use_frame(nullptr);
+    use_shader(frame_shader);
+    set_shader_uniform_1i(frame_shader, "frame_texture", 0);
+    if (heatmap) {
+        glUniform3fv(get_shader_uniform_location(frame_shader, "heat_colors"), SDL_arraysize(OVERDRAW_HEAT_COLORS), &OVERDRAW_HEAT_COLORS[0].x);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, RENDER_TARGET.gl_texture_id);
+    glBindVertexArray(RENDER_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    draw_hud(frame->hud_text);
+
+    stats->sprites = SPRITE_BATCH->sprites;
+    stats->draw_calls = SPRITE_BATCH->draw_calls;
+    stats->state_changes = frame->queue.state_changes;
+
+    draw_debug_legend((RENDER_DEBUG)frame->debug);
+    end_sprite_frame(SPRITE_BATCH);
+
+    stats->gpu_wait_counter = SPRITE_BATCH->stream.stats.wait_counter - gpu_wait_counter;
+}
+
+
+void draw_scene(RenderFrame *frame, RenderFrameStats *stats)
+{
+    Shader *sprite_shader = get_shader(SPRITE_SHADER);
+    Shader *background_shader = get_shader(BACKGROUND_SHADER);
+
+    if (!sprite_shader || !background_shader){
+        LOG_ERROR(LOG_RENDER, "Coudl not locate sprite shader... it might not be initialized");
+        exit(1);
+    }
+
+    RenderQueue *queue = &frame->queue;
+    Uint32 retained_layers = queue->retained_layers;
+    bool overdraw = frame->debug == RENDER_DEBUG_OVERDRAW;
+
+    sort_render_queue(queue);
+    if (overdraw) {
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+
+    // the retained layers that changed are drawn again first, each into its own target
+    glEnable(GL_DEPTH_TEST);
+    for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+        if (retained_layers & (1u << layer)) {
+            update_retained_render_layer(frame, (RENDER_LAYER)layer, stats);
+        }
+    }
+    glDisable(GL_DEPTH_TEST);
 
-    glClearColor(0.f, 0.f, 0.5f, 0.f);
+    use_frame(&RENDER_TARGET);
+
+    // the overdraw count starts at the one fragment the background shades everywhere
+    if (overdraw) {
+        glClearColor(OVERDRAW_STEP, 0.f, 0.f, 0.f);
+    }
+    else {
+        glClearColor(0.f, 0.f, 0.5f, 0.f);
+    }
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    for(std::list<Entity *>::iterator iter = scene->entities->begin();
-        iter != scene->entities->end();
-        iter++)
-    {
-        draw_entity(*iter);
+    // every parallax layer in one fullscreen pass, instead of tiling it with sprites.
+    // the render side keeps its own background, only the layers come with the frame
+    if (frame->background_layer_count > 0 && !overdraw) {
+        RENDER_BACKGROUND.layer_count = frame->background_layer_count;
+        memcpy(RENDER_BACKGROUND.layers, frame->background_layers, frame->background_layer_count*sizeof(BackgroundLayer));
+
+        use_shader(background_shader);
+        glBindVertexArray(RENDER_VAO);
+        draw_background(&RENDER_BACKGROUND, background_shader->glid, frame->time_s);
+    }
+
+    // the background wrote no depth, the solid sprites go in front to back and
+    // hide whatever is drawn behind them afterwards
+    glEnable(GL_DEPTH_TEST);
+    draw_render_queue(queue, RENDER_PASS_CUTOUT, SPRITE_BATCH, use_scene_shader, frame, RENDER_ALL_LAYERS & ~retained_layers);
+
+    // blended, so they go between the passes, tested against the cutouts of their layer
+    use_sprite_shader(sprite_shader, frame->time_s);
+    use_render_layer_depth(RENDER_LAYER_WORLD);
+    glDepthMask(GL_FALSE);
+    begin_sprite_batch(SPRITE_BATCH);
+    draw_projectiles(&frame->projectiles, SPRITE_BATCH, RENDER_WORKERS);
+    end_sprite_batch(SPRITE_BATCH);
+    glDepthMask(GL_TRUE);
+    glDepthRange(0.0, 1.0);
+
+    // a retained layer goes in as one quad, where its blended sprites would have
+    for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+        if (!(retained_layers & (1u << layer))) {
+            draw_render_queue(queue, RENDER_PASS_BLENDED, SPRITE_BATCH, use_scene_shader, frame, 1u << layer);
+        }
+        else if (queue->layer_counts[layer] > 0) {
+            use_sprite_shader(sprite_shader, frame->time_s);
+            draw_retained_layer(&RETAINED_LAYERS[layer], SPRITE_BATCH, (RENDER_LAYER)layer, glm::vec2((float)SCREEN_WIDTH, (float)SCREEN_HEIGHT));
+        }
+    }
+    glDisable(GL_DEPTH_TEST);
+
+    if (overdraw) {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     }
 }
 
 
+void update_retained_render_layer(RenderFrame *frame, RENDER_LAYER layer, RenderFrameStats *stats)
+{
+    RetainedLayer *retained = &RETAINED_LAYERS[layer];
+    if (retained->frame.glid == 0) {
+        init_frame(&retained->frame);
+    }
+
+    stats->retained_frames[layer] += 1;
+    if (update_retained_layer(retained, &frame->queue, layer, frame->debug)) {
+        return;
+    }
+    stats->retained_redraws[layer] += 1;
+
+    // transparent where the layer has nothing, the composite shows through there
+    use_frame(&retained->frame);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    draw_render_queue(&frame->queue, RENDER_PASS_CUTOUT, SPRITE_BATCH, use_scene_shader, frame, 1u << layer);
+    draw_render_queue(&frame->queue, RENDER_PASS_BLENDED, SPRITE_BATCH, use_scene_shader, frame, 1u << layer);
+}
+
+
+void draw_hud(const char *hud_text)
+{
+    static FontId hud_font = INVALID_FONT;
+    if (hud_font == INVALID_FONT) {
+        hud_font = find_font(TEXT, "future_thin");
+    }
+
+    Shader *sprite_shader = get_shader(SPRITE_SHADER);
+
+    // all HUD text shares the glyph atlas, so this pass is a single draw call
+    use_sprite_shader(sprite_shader, 0.f);
+    begin_sprite_batch(SPRITE_BATCH);
+
+    draw_text(TEXT, SPRITE_BATCH, hud_font, hud_text, glm::vec2(16.f, SCREEN_HEIGHT - 32.f), 20.f, glm::vec4(1.f, 1.f, 1.f, 0.9f));
+
+    end_sprite_batch(SPRITE_BATCH);
+}
+
+
+void draw_debug_legend(RENDER_DEBUG debug)
+{
+    if (debug == RENDER_DEBUG_OFF) {
+        return;
+    }
+
+    static FontId legend_font = INVALID_FONT;
+    if (legend_font == INVALID_FONT) {
+        legend_font = find_font(TEXT, "future_thin");
+    }
+
+    Shader *sprite_shader = get_shader(SPRITE_SHADER);
+    use_sprite_shader(sprite_shader, 0.f);
+    begin_sprite_batch(SPRITE_BATCH);
+
+    char line[RENDER_FRAME_TEXT_LENGTH];
+    glm::vec2 position = glm::vec2(SCREEN_WIDTH - 320.f, SCREEN_HEIGHT - 32.f);
+
+    if (debug == RENDER_DEBUG_OVERDRAW) {
+        draw_text(TEXT, SPRITE_BATCH, legend_font, "OVERDRAW", position, 16.f);
+
+        // one swatch per count, in the colour the heatmap uses for it
+        for (int i = 1; i < (int)SDL_arraysize(OVERDRAW_HEAT_COLORS); ++i) {
+            SDL_snprintf(line, sizeof(line), i + 1 < (int)SDL_arraysize(OVERDRAW_HEAT_COLORS) ? "%d" : "%d+", i);
+            glm::vec2 swatch = position + glm::vec2(100.f + (i - 1)*26.f, 0.f);
+            draw_text(TEXT, SPRITE_BATCH, legend_font, line, swatch, 16.f, glm::vec4(OVERDRAW_HEAT_COLORS[i], 1.f));
+        }
+    }
+    else if (debug == RENDER_DEBUG_BATCHES) {
+        // the draw calls in the order they went out, each in its tint with what ended it
+        SDL_snprintf(line, sizeof(line), "BATCHES %d", SPRITE_BATCH->break_count);
+        draw_text(TEXT, SPRITE_BATCH, legend_font, line, position, 16.f);
+
+        for (int i = 0; i < SPRITE_BATCH->break_count; ++i) {
+            SpriteBatchBreak *batch_break = &SPRITE_BATCH->breaks[i];
+            position.y -= 18.f;
+            if (position.y < 0.f) {
+                break;
+            }
+
+            SDL_snprintf(line, sizeof(line), "%2d  %5d SPRITES  TEX %u  %s", i + 1, batch_break->sprites,
+                         batch_break->texture, get_sprite_break_name(batch_break->reason));
+            draw_text(TEXT, SPRITE_BATCH, legend_font, line, position, 16.f, batch_break->tint);
+        }
+    }
+
+    end_sprite_batch(SPRITE_BATCH);
+}
+
+
+Uint32 hash_scene_state(Scene *scene)
+{
+    // FNV-1a over the simulated state, used to check a replay stays in sync
+    Uint32 hash = 2166136261u;
+
+    for(Entity *entity = scene->first_entity; entity; entity = entity->next_sibling) {
+        const unsigned char *bytes[2] = { (const unsigned char *)&entity->position, (const unsigned char *)&entity->velocity };
+
+        for (int b = 0; b < 2; ++b) {
+            for (int i = 0; i < (int)sizeof(glm::vec3); ++i) {
+                hash ^= bytes[b][i];
+                hash *= 16777619u;
+            }
+        }
+    }
+
+    if (scene->projectiles) {
+        hash = hash_projectiles(scene->projectiles, hash);
+    }
+
+    return hash;
+}
+
+
+Scene *create_main_scene(const char *music_path, bool coop)
+{
+    Scene *scene = MALLOC(Scene);
+    init_scene(scene, "main_scene");
+    scene->coop = coop;
+
+    scene->startup = &main_scene_starup;
+    scene->update = &main_scene_update;
+    scene->shutdown = &main_scene_shutdown;
+    scene->draw_overlay = &main_scene_draw_overlay;
+    scene->textures = MAIN_SCENE_TEXTURES;
+    scene->texture_count = SDL_arraysize(MAIN_SCENE_TEXTURES);
+    scene->music_path = music_path;
+
+    return scene;
+}
+
+
 void main_scene_starup(Scene *scene)
 {
     // void *MemoryArenaMalloc(MemoryArena *arena, int size);
-    scene->player = (Entity*)MemoryArenaAlloc(&scene->memory_arena, sizeof(Entity));
+    MainSceneData *data = (MainSceneData*)MemoryArenaAlloc(&scene->memory_arena, sizeof(MainSceneData));
+    data->option_angle = 0.f;
+    data->shoot_interval_s = 0.1f;
+    data->shoot_timer_s = data->shoot_interval_s;
+    data->pattern_interval_s = 0.05f;
+    data->pattern_timer_s = data->pattern_interval_s;
+    data->pattern_angle = 0.f;
+    scene->data = data;
+
+    scene->projectiles = (ProjectileSystem *)MemoryArenaAlloc(&scene->memory_arena, sizeof(ProjectileSystem));
+    init_projectile_system(scene->projectiles, glm::vec2(0.f), glm::vec2(SCREEN_WIDTH, SCREEN_HEIGHT));
+
+    Texture *sheet_texture = get_texture(TEXTURES, SHEET_TEXTURE);
+
+    ProjectileTypeInfo laser = {};
+    AtlasRegion *laser_region = find_atlas_region(SHEET_ATLAS, "laserBlue03.png");
+    laser.capacity = 1024;
+    laser.texture = sheet_texture->glid;
+    laser.uv_rect = get_atlas_uv_rect(SHEET_ATLAS, laser_region);
+    laser.size = laser_region->size;
+    laser.depth = -10.f;
+    laser.oriented = true;
+    laser.mask = sheet_texture->collision_mask;
+    laser.lifetime_s = 2.f;
+    laser.damage = 10.f;
+    add_projectile_type(scene->projectiles, LASER, &laser, &scene->memory_arena);
+
+    // sized for bullet hell, a full screen of orbs is still one pool
+    ProjectileTypeInfo orb = {};
+    AtlasRegion *orb_region = find_atlas_region(SHEET_ATLAS, "laserBlue10.png");
+    orb.capacity = 131072;
+    orb.texture = sheet_texture->glid;
+    orb.uv_rect = get_atlas_uv_rect(SHEET_ATLAS, orb_region);
+    orb.size = glm::vec2(18.f, 18.f);
+    orb.depth = -10.f;
+    orb.mask = sheet_texture->collision_mask;
+    orb.lifetime_s = 8.f;
+    orb.damage = 1.f;
+    add_projectile_type(scene->projectiles, ORB, &orb, &scene->memory_arena);
+
+    // a slow nebula with two star fields over it, the nearer one bigger and faster
+    scene->background = (Background *)MemoryArenaAlloc(&scene->memory_arena, sizeof(Background));
+    init_background(scene->background);
+
+    Texture *background_texture = get_texture(TEXTURES, scene->texture_handles[MAIN_TEXTURE_BACKGROUND]);
+    Texture *stars_texture = get_texture(TEXTURES, scene->texture_handles[MAIN_TEXTURE_STARS]);
+    add_background_layer(scene->background, background_texture->glid, background_texture->image_size, glm::vec2(0.f, -12.f));
+    add_background_layer(scene->background, stars_texture->glid, stars_texture->image_size*1.5f, glm::vec2(0.f, -40.f), 0.6f, RENDER_BLEND_ADDITIVE);
+    add_background_layer(scene->background, stars_texture->glid, stars_texture->image_size*3.f, glm::vec2(0.f, -110.f), 0.8f, RENDER_BLEND_ADDITIVE);
+
+    // rocks drift down and tumble, so the lasers go through the rotated mask path too
+    const char *meteor_regions[MAIN_SCENE_METEOR_COUNT] = {
+        "meteorBrown_big1.png", "meteorGrey_med1.png", "meteorGrey_big3.png", "meteorBrown_med3.png"
+    };
+
+    for (int i = 0; i < MAIN_SCENE_METEOR_COUNT; ++i) {
+        AtlasRegion *region = find_atlas_region(SHEET_ATLAS, meteor_regions[i]);
+        if (region == nullptr) {
+            LOG_ERROR(LOG_SCENE, "No atlas region named %s", meteor_regions[i]);
+            exit(1);
+        }
+
+        Entity *meteor = alloc_entity(scene);
+        init_entity(meteor,
+                    glm::vec3(SCREEN_WIDTH*(i + 0.5f)/MAIN_SCENE_METEOR_COUNT, SCREEN_HEIGHT + 60.f + 140.f*i, -5.f),
+                    glm::vec3(region->size.x, region->size.y, 1.f),
+                    glm::vec3(180.f, 0.f, 0.f));
+        meteor->velocity = glm::vec3(0.f, -40.f - 15.f*i, 0.f);
+
+        meteor->sprite = alloc_sprite(scene);
+        init_sprite(meteor->sprite, meteor, sheet_texture, region->offset, region->size);
+
+        set_entity_group_tag(scene, meteor, "meteors");
+        add_scene_entity(scene, meteor);
+
+        // bigger rocks take more hits
+        data->meteors[i] = meteor;
+        data->meteor_max_health[i] = region->size.x*region->size.y/100.f;
+        data->meteor_health[i] = data->meteor_max_health[i];
+        data->meteor_spin[i] = (i & 1) ? -30.f : 45.f;
+    }
+    data->meteors_destroyed = 0;
+
+    scene->player = alloc_entity(scene);
     init_entity(scene->player,
                 glm::vec3(SCREEN_WIDTH/2.f, SCREEN_HEIGHT/2.f, 0.f),
                 glm::vec3(1.f, 1.f, 1.f),
@@ -886,102 +2310,244 @@ void main_scene_starup(Scene *scene)
     
     set_entity_tag(scene, scene->player, "player1");
 
-    scene->player->sprite = (Sprite*)MemoryArenaAlloc(&scene->memory_arena, sizeof(Sprite));
-    init_sprite(scene->player->sprite, scene->player, TEXTURES["blue_ship"]);
+    scene->player->sprite = alloc_sprite(scene);
+    init_sprite(scene->player->sprite, scene->player, get_texture(TEXTURES, scene->texture_handles[MAIN_TEXTURE_BLUE_SHIP]));
     
     glm::vec2 image_size = scene->player->sprite->texture->image_size;
     scene->player->scale = glm::vec3(image_size.x, image_size.y, 0.f);
     scene->player->rotation = glm::vec3(180.f, 0.f, 0.f);
 
-    Entity *option = (Entity*)MemoryArenaAlloc(&scene->memory_arena, sizeof(Entity));
+    Entity *option = alloc_entity(scene);
     init_entity(option,
                 glm::vec3(80.f, 0.f, -1.f),
                 glm::vec3(30.f, 30.f, 30.f),
                 glm::vec3(0.f, 0.f, 0.f));
     
     set_entity_tag(scene, option, "option1");
-    option->sprite = (Sprite*)MemoryArenaAlloc(&scene->memory_arena, sizeof(Sprite));
-    init_sprite(option->sprite, option, TEXTURES["blue_option"]);
+    option->sprite = alloc_sprite(scene);
+    init_sprite(option->sprite, option, get_texture(TEXTURES, scene->texture_handles[MAIN_TEXTURE_BLUE_OPTION]));
 
     add_entity(scene->player, option);
+
+    // the flame animates on the GPU, the update never has to touch it
+    AnimationClipId engine_fire = find_animation_clip(ANIMATIONS, "engine_fire");
+    AnimationClip *engine_fire_clip = get_animation_clip(ANIMATIONS, engine_fire);
+
+    if (engine_fire_clip) {
+        glm::vec2 flame_size = engine_fire_clip->frame_size;
+
+        Entity *engine_flame = alloc_entity(scene);
+        init_entity(engine_flame,
+                    glm::vec3(0.f, -(image_size.y + flame_size.y)/2.f + 4.f, -2.f),
+                    glm::vec3(flame_size.x, flame_size.y, 1.f),
+                    glm::vec3(0.f, 0.f, 0.f));
+
+        engine_flame->sprite = alloc_sprite(scene);
+        init_sprite(engine_flame->sprite, engine_flame, engine_fire_clip->texture);
+        set_sprite_animation(engine_flame->sprite, engine_fire, scene->time_s);
+        engine_flame->sprite->blend = RENDER_BLEND_ADDITIVE;
+
+        add_entity(scene->player, engine_flame);
+    }
     add_scene_entity(scene, scene->player);
 
+    // off to the right of player one, added after everything else so a
+    // single player scene is laid out exactly as before
+    data->player_two = nullptr;
+    data->player_two_shoot_timer_s = data->shoot_interval_s;
+
+    if (scene->coop) {
+        Entity *player_two = alloc_entity(scene);
+        init_entity(player_two,
+                    glm::vec3(SCREEN_WIDTH/2.f + 160.f, SCREEN_HEIGHT/2.f, 0.f),
+                    glm::vec3(1.f, 1.f, 1.f),
+                    glm::vec3(180.f, 0.f, 0.f));
+
+        set_entity_tag(scene, player_two, "player2");
+
+        player_two->sprite = alloc_sprite(scene);
+        init_sprite(player_two->sprite, player_two, get_texture(TEXTURES, scene->texture_handles[MAIN_TEXTURE_RED_SHIP]));
+
+        glm::vec2 player_two_size = player_two->sprite->texture->image_size;
+        player_two->scale = glm::vec3(player_two_size.x, player_two_size.y, 0.f);
+
+        add_scene_entity(scene, player_two);
+        data->player_two = player_two;
+    }
+
+    // resolved once here so the update never does a name lookup
+    data->option = option;
+    data->shoot_sound = find_sound(AUDIO, "laser");
+
     scene->initialized = true;
 }
 
 
-void main_scene_update(Scene *scene, float elapsed_time_s) 
+static void steer_player_ship(Entity *ship, const GamePadController *controller)
 {
-    static float main_shoot_interval_s = 0.1f;
-    static float shoot_timer = main_shoot_interval_s;
+    ship->acceleration = glm::vec3(0.f);
 
-    static float angle = 0.f;
-    angle += (90.f * elapsed_time_s);
-    float option_radius = 80.f;
+    if (controller->btn_up) {
+        ship->acceleration.y += 1.0f;
+    }
+    else if (controller->btn_down) {
+        ship->acceleration.y -= 1.0f;
+    }
+    if (controller->btn_left) {
+        ship->acceleration.x -= 1.f;
+    }
+    else if (controller->btn_right) {
+        ship->acceleration.x += 1.f;
+    }
+}
 
-    Entity *option = get_entity_by_tag(scene, "option1");
 
-    option->position = glm::vec3(option_radius * cosf(glm::radians(angle)), option_radius * sinf(glm::radians(angle)), -1.f);
+static void fire_player_laser(Scene *scene, Entity *ship, const GamePadController *controller, float *shoot_timer_s, float elapsed_time_s)
+{
+    MainSceneData *data = (MainSceneData*)scene->data;
 
-    float player_velocity_per_second = 100.f;
+    *shoot_timer_s += elapsed_time_s;
+    if (controller->btn_a && *shoot_timer_s >= data->shoot_interval_s) {
+        Projectile laser;
+        laser.position = glm::vec2(ship->position);
+        laser.velocity = glm::vec2(0.f, 800.f);
+        laser.damage = 10.f;
+        spawn_projectiles(scene->projectiles, LASER, ship->id, &laser, 1);
 
-    scene->player->acceleration = glm::vec3(0.f);
+        float pan = (ship->position.x / SCREEN_WIDTH)*2.f - 1.f;
+        play_sound(AUDIO, data->shoot_sound, 0.5f, pan);
 
-    if (scene->gamepadcontroller.btn_up) {
-        scene->player->acceleration.y += 1.0f;
+        *shoot_timer_s = 0.0f;
     }
-    else if (scene->gamepadcontroller.btn_down) {
-        scene->player->acceleration.y -= 1.0f;
+}
+
+
+static void move_player_ship(Entity *ship, float elapsed_time_s)
+{
+    float player_velocity_per_second = 100.f;
+
+    if (glm::length(ship->acceleration) > 0.f) {
+        ship->acceleration = glm::normalize(ship->acceleration);
+        ship->velocity += ship->acceleration * (player_velocity_per_second*elapsed_time_s);
     }
-    if (scene->gamepadcontroller.btn_left) {
-        scene->player->acceleration.x -= 1.f;
+
+    ship->velocity += ship->velocity * -1.f * 0.15f;
+    ship->position += ship->velocity;
+}
+
+
+void main_scene_update(Scene *scene, float elapsed_time_s) 
+{
+    MainSceneData *data = (MainSceneData*)scene->data;
+
+    data->option_angle += (90.f * elapsed_time_s);
+    float option_radius = 80.f;
+
+    Entity *option = data->option;
+
+    option->position = glm::vec3(option_radius * cosf(glm::radians(data->option_angle)), option_radius * sinf(glm::radians(data->option_angle)), -1.f);
+
+    steer_player_ship(scene->player, &scene->gamepadcontroller);
+    fire_player_laser(scene, scene->player, &scene->gamepadcontroller, &data->shoot_timer_s, elapsed_time_s);
+
+    data->pattern_timer_s += elapsed_time_s;
+    if (scene->gamepadcontroller.btn_b && data->pattern_timer_s >= data->pattern_interval_s) {
+        glm::vec2 origin = glm::vec2(scene->player->position + option->position);
+        spawn_projectile_ring(scene->projectiles, ORB, option->id, origin, 36, 180.f, data->pattern_angle);
+
+        data->pattern_angle += 7.f;
+        data->pattern_timer_s = 0.f;
     }
-    else if (scene->gamepadcontroller.btn_right) {
-        scene->player->acceleration.x += 1.f;
+
+    move_player_ship(scene->player, elapsed_time_s);
+
+    Entity *player_two = data->player_two;
+    if (player_two) {
+        steer_player_ship(player_two, &scene->gamepadcontroller_two);
+        fire_player_laser(scene, player_two, &scene->gamepadcontroller_two, &data->player_two_shoot_timer_s, elapsed_time_s);
+        move_player_ship(player_two, elapsed_time_s);
     }
 
-    shoot_timer += elapsed_time_s;
-    if (scene->gamepadcontroller.btn_a && shoot_timer >= main_shoot_interval_s) {
-        Entity *bullet = (Entity*)MemoryArenaAlloc(&scene->memory_arena, sizeof(Entity));
-        init_entity(bullet,
-                glm::vec3(scene->player->position.x, scene->player->position.y, -10.f),
-                glm::vec3(10.f, 38.f, 1.f),
-                glm::vec3(0.f, 0.f, 0.f));
+    update_projectiles(scene->projectiles, elapsed_time_s);
 
-        bullet->name = std::string("bullet");
-        set_entity_group_tag(scene, bullet, "bullets");
-        bullet->sprite = (Sprite*)MemoryArenaAlloc(&scene->memory_arena, sizeof(Sprite));
-        init_sprite(bullet->sprite, bullet, TEXTURES["blue_bullet"]);
+    for (int i = 0; i < MAIN_SCENE_METEOR_COUNT; ++i) {
+        Entity *meteor = data->meteors[i];
+        meteor->position += meteor->velocity*elapsed_time_s;
+        meteor->rotation.z += data->meteor_spin[i]*elapsed_time_s;
 
-        bullet->velocity = glm::vec3(0.f, 800.f, 0.f);
-        add_scene_entity(scene, bullet);
+        // bounds first, masks only for the shots that get close
+        float damage = 0.f;
+        CollisionShape shape = get_entity_collision_shape(meteor);
+        collide_projectiles(scene->projectiles, LASER, &shape, 0, &damage);
+        data->meteor_health[i] -= damage;
 
-        shoot_timer = 0.0f;
+        bool destroyed = data->meteor_health[i] <= 0.f;
+        if (destroyed) {
+            data->meteors_destroyed += 1;
+        }
+
+        // no random numbers, the replay has to land every rock in the same place
+        if (destroyed || meteor->position.y < -meteor->scale.y) {
+            float column = (float)((data->meteors_destroyed*7 + i*3) % 10);
+            meteor->position = glm::vec3(SCREEN_WIDTH*(column + 0.5f)/10.f, SCREEN_HEIGHT + meteor->scale.y, meteor->position.z);
+            data->meteor_health[i] = data->meteor_max_health[i];
+        }
     }
+}
+
 
-    if (glm::length(scene->player->acceleration) > 0.f) {
-        scene->player->acceleration = glm::normalize(scene->player->acceleration);
-        scene->player->velocity += scene->player->acceleration * (player_velocity_per_second*elapsed_time_s);
+static void submit_overlay_sprite(Scene *scene, RenderQueue *queue, int texture_index, glm::vec2 center, float depth)
+{
+    Texture *texture = get_texture(TEXTURES, scene->texture_handles[texture_index]);
+    if (texture == nullptr || texture->glid == 0) {
+        return;
     }
 
-    scene->player->velocity += scene->player->velocity * -1.f * 0.15f;
-    scene->player->position += scene->player->velocity;
+    // the negative y stands the image upright, like the ships' half turn
+    glm::mat4 model = glm::translate(glm::mat4(1.f), glm::vec3(center, depth));
+    model = glm::scale(model, glm::vec3(texture->image_size.x, -texture->image_size.y, 1.f));
+
+    SpriteInstance instance = make_sprite_instance(&model, glm::vec4(0.f, 0.f, 1.f, 1.f), glm::vec4(1.f), SPRITE_FLAG_CUTOUT);
+    Uint64 key = make_render_key(RENDER_LAYER_OVERLAY, depth, RENDER_BLEND_CUTOUT, get_resource_index(SPRITE_SHADER), texture->glid);
+    submit_sprite(queue, key, &instance);
+}
+
 
+void main_scene_draw_overlay(Scene *scene, RenderQueue *queue)
+{
+    MainSceneData *data = (MainSceneData*)scene->data;
+    if (data == nullptr) {
+        return;
+    }
 
-    std::list<Entity *> bullets = get_entities_by_group_tag(scene, "bullets");
+    // a score frame in the corner, a ship per player, an x and the meteors
+    // destroyed. it only changes with the score, the overlay is retained
+    glm::vec2 panel_center = glm::vec2(SCREEN_WIDTH - 131.f, SCREEN_HEIGHT - 30.f);
+    submit_overlay_sprite(scene, queue, MAIN_TEXTURE_SCORE_PANEL, panel_center, -3.f);
 
-    for(std::list<Entity *>::iterator iter = bullets.begin(); iter != bullets.end(); iter++) {
-        Entity *bullet = (*iter);
-        bullet->position += bullet->velocity * elapsed_time_s;
+    glm::vec2 cursor = panel_center + glm::vec2(-83.f, 0.f);
+    submit_overlay_sprite(scene, queue, MAIN_TEXTURE_LIFE_BLUE, cursor, -2.f);
+    if (data->player_two) {
+        cursor.x += 38.f;
+        submit_overlay_sprite(scene, queue, MAIN_TEXTURE_LIFE_RED, cursor, -2.f);
+    }
 
-        if (bullet->position.y < 0 || bullet->position.y > SCREEN_HEIGHT) {
-            bullet->deshould_free = true;
-        }
+    cursor.x += 30.f;
+    submit_overlay_sprite(scene, queue, MAIN_TEXTURE_NUMERAL_X, cursor, -2.f);
+
+    char score[16];
+    SDL_snprintf(score, sizeof(score), "%d", data->meteors_destroyed);
+    for (const char *digit = score; *digit; ++digit) {
+        cursor.x += 22.f;
+        submit_overlay_sprite(scene, queue, MAIN_TEXTURE_NUMERAL_0 + (*digit - '0'), cursor, -2.f);
     }
 }
 
 
 void main_scene_shutdown(Scene *scene)
 {
-
+    // the projectile pools go with the arena
+    if (scene->background) {
+        shutdown_background(scene->background);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,345 @@
+#include "memory.hpp"
+
+#include <new>
+
+static AllocationTracker ALLOCATION_TRACKER;
+static thread_local int CURRENT_ALLOC_SUBSYSTEM = ALLOC_OTHER;
+
+
+AllocationScope::AllocationScope(ALLOC_SUBSYSTEM subsystem)
+{
+    previous = CURRENT_ALLOC_SUBSYSTEM;
+    CURRENT_ALLOC_SUBSYSTEM = subsystem;
+}
+
+
+AllocationScope::~AllocationScope()
+{
+    CURRENT_ALLOC_SUBSYSTEM = previous;
+}
+
+
+const char *allocation_subsystem_name(int subsystem)
+{
+    switch(subsystem) {
+        case ALLOC_OTHER:      return "other";
+        case ALLOC_LOADING:    return "loading";
+        case ALLOC_PLATFORM:   return "platform";
+        case ALLOC_INPUT:      return "input";
+        case ALLOC_SIMULATION: return "simulation";
+        case ALLOC_RENDER:     return "render";
+        case ALLOC_DEBUG:      return "debug";
+    }
+
+    return "unknown";
+}
+
+
+// Must not allocate: this runs inside operator new and SDL's malloc, from any thread.
+void count_allocation(size_t size, void *call_site)
+{
+#if ALLOCATION_TRACKING
+    AllocationTracker *tracker = &ALLOCATION_TRACKER;
+    int subsystem = CURRENT_ALLOC_SUBSYSTEM;
+
+    SDL_AtomicAdd(&tracker->frame_count[subsystem], 1);
+    SDL_AtomicAdd(&tracker->frame_bytes[subsystem], (int)size);
+    SDL_AtomicAdd(&tracker->total_count[subsystem], 1);
+
+    size_t slot = ((size_t)call_site >> 4) * 2654435761u;
+    for (int probe = 0; probe < ALLOCATION_SITE_PROBES; ++probe) {
+        AllocationSite *site = &tracker->sites[(slot + probe) % ALLOCATION_MAX_SITES];
+
+        if (site->address != call_site && !SDL_AtomicCASPtr(&site->address, nullptr, call_site)) {
+            if (site->address != call_site) {
+                continue;
+            }
+        }
+
+        SDL_AtomicSet(&site->subsystem, subsystem);
+        SDL_AtomicAdd(&site->count, 1);
+        SDL_AtomicAdd(&site->bytes, (int)size);
+        return;
+    }
+
+    SDL_AtomicAdd(&tracker->dropped_sites, 1);
+#endif
+}
+
+
+ALLOCATION_NOINLINE void *tracked_malloc(size_t size)
+{
+    count_allocation(size, ALLOCATION_CALL_SITE());
+    return malloc(size);
+}
+
+
+ALLOCATION_NOINLINE void *tracked_realloc(void *memory, size_t size)
+{
+    count_allocation(size, ALLOCATION_CALL_SITE());
+    return realloc(memory, size);
+}
+
+
+#if ALLOCATION_TRACKING
+ALLOCATION_NOINLINE void *operator new(size_t size)
+{
+    count_allocation(size, ALLOCATION_CALL_SITE());
+
+    void *result = malloc(size ? size : 1);
+    if (!result) {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+
+ALLOCATION_NOINLINE void *operator new[](size_t size)
+{
+    count_allocation(size, ALLOCATION_CALL_SITE());
+
+    void *result = malloc(size ? size : 1);
+    if (!result) {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+
+static void * SDLCALL sdl_tracked_malloc(size_t size)
+{
+    count_allocation(size, ALLOCATION_CALL_SITE());
+    return malloc(size);
+}
+
+
+static void * SDLCALL sdl_tracked_calloc(size_t count, size_t size)
+{
+    count_allocation(count*size, ALLOCATION_CALL_SITE());
+    return calloc(count, size);
+}
+
+
+static void * SDLCALL sdl_tracked_realloc(void *memory, size_t size)
+{
+    count_allocation(size, ALLOCATION_CALL_SITE());
+    return realloc(memory, size);
+}
+
+
+static void SDLCALL sdl_tracked_free(void *memory)
+{
+    free(memory);
+}
+#endif
+
+
+void init_allocation_tracker(AllocationTracker *tracker, bool trace, bool steady_state_test, int warmup_frames)
+{
+    tracker->frame = 0;
+    tracker->trace = trace;
+    tracker->steady_state_test = steady_state_test;
+    tracker->warmup_frames = warmup_frames;
+    tracker->steady_state_failures = 0;
+
+#if ALLOCATION_TRACKING
+    // only safe before SDL has handed out any memory, so call this ahead of SDL_Init
+    SDL_SetMemoryFunctions(sdl_tracked_malloc, sdl_tracked_calloc, sdl_tracked_realloc, sdl_tracked_free);
+#else
+    if (steady_state_test) {
+        LOG_WARN(LOG_MEMORY, "Allocation test requested but ALLOCATION_TRACKING is compiled out");
+    }
+#endif
+}
+
+
+void print_allocation_report(AllocationTracker *tracker)
+{
+    ALLOC_SCOPE(ALLOC_DEBUG);
+
+    char summary[LOG_MESSAGE_LENGTH];
+    int length = 0;
+    for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT && length < (int)sizeof(summary); ++i) {
+        int count = SDL_AtomicGet(&tracker->frame_count[i]);
+        if (count > 0 && i != ALLOC_DEBUG) {
+            length += SDL_snprintf(summary + length, sizeof(summary) - length, " %s %d (%d bytes)",
+                                   allocation_subsystem_name(i), count, SDL_AtomicGet(&tracker->frame_bytes[i]));
+        }
+    }
+    summary[length < (int)sizeof(summary) ? length : (int)sizeof(summary) - 1] = '\0';
+    LOG_INFO(LOG_MEMORY, "Allocations in frame %d:%s", tracker->frame, summary);
+
+    // print the busiest call sites, resolve them with the debugger or addr2line
+    AllocationSite *reported[ALLOCATION_REPORT_SITES] = {};
+    for (int r = 0; r < ALLOCATION_REPORT_SITES; ++r) {
+        AllocationSite *best = nullptr;
+
+        for (int i = 0; i < ALLOCATION_MAX_SITES; ++i) {
+            AllocationSite *site = &tracker->sites[i];
+            int count = SDL_AtomicGet(&site->count);
+            if (count == 0 || SDL_AtomicGet(&site->subsystem) == ALLOC_DEBUG) {
+                continue;
+            }
+
+            bool already_reported = false;
+            for (int j = 0; j < r; ++j) {
+                already_reported |= (reported[j] == site);
+            }
+
+            if (!already_reported && (best == nullptr || count > SDL_AtomicGet(&best->count))) {
+                best = site;
+            }
+        }
+
+        if (best == nullptr) {
+            break;
+        }
+
+        reported[r] = best;
+        LOG_INFO(LOG_MEMORY, "    %p %s x%d (%d bytes)", best->address, allocation_subsystem_name(SDL_AtomicGet(&best->subsystem)),
+                 SDL_AtomicGet(&best->count), SDL_AtomicGet(&best->bytes));
+    }
+
+    int dropped = SDL_AtomicGet(&tracker->dropped_sites);
+    if (dropped > 0) {
+        LOG_INFO(LOG_MEMORY, "    %d allocations from untracked sites", dropped);
+    }
+}
+
+
+void end_allocation_frame(AllocationTracker *tracker)
+{
+    int frame_allocations = 0;
+    for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; ++i) {
+        if (i != ALLOC_DEBUG) {
+            frame_allocations += SDL_AtomicGet(&tracker->frame_count[i]);
+        }
+    }
+
+    if (frame_allocations > 0) {
+        bool steady_state = tracker->frame >= tracker->warmup_frames;
+
+        if (tracker->steady_state_test && steady_state) {
+            LOG_ERROR(LOG_MEMORY, "FAIL: heap allocation during steady state frame %d", tracker->frame);
+            tracker->steady_state_failures += 1;
+            print_allocation_report(tracker);
+        }
+        else if (tracker->trace) {
+            print_allocation_report(tracker);
+        }
+    }
+
+    for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; ++i) {
+        SDL_AtomicSet(&tracker->frame_count[i], 0);
+        SDL_AtomicSet(&tracker->frame_bytes[i], 0);
+    }
+
+    for (int i = 0; i < ALLOCATION_MAX_SITES; ++i) {
+        SDL_AtomicSet(&tracker->sites[i].count, 0);
+        SDL_AtomicSet(&tracker->sites[i].bytes, 0);
+    }
+    SDL_AtomicSet(&tracker->dropped_sites, 0);
+
+    tracker->frame += 1;
+}
+
+
+void *MemoryArenaAlloc(MemoryArena *arena, int size) 
+{
+    void *ret_address = arena->current_memory_pointer;
+
+    if ((arena->current_memory_pointer + size) < (arena->memory + arena->memory_size)) {
+        arena->current_memory_pointer += size;
+        return ret_address;
+    }
+    else {
+        LOG_ERROR(LOG_MEMORY, "Asking for more than the arena can give.");
+        exit(1);
+    }
+
+    return nullptr;
+}
+
+
+int get_arena_used(MemoryArena *arena)
+{
+    return (int)(arena->current_memory_pointer - arena->memory);
+}
+
+
+bool arena_contains(MemoryArena *arena, const void *pointer)
+{
+    const unsigned char *address = (const unsigned char *)pointer;
+    return address >= arena->memory && address < arena->memory + arena->memory_size;
+}
+
+
+Uint32 get_arena_offset(MemoryArena *arena, const void *pointer)
+{
+    if (pointer == nullptr) {
+        return ARENA_NULL_OFFSET;
+    }
+
+    return (Uint32)((const unsigned char *)pointer - arena->memory);
+}
+
+
+void *get_arena_pointer(MemoryArena *arena, Uint32 offset)
+{
+    if (offset == ARENA_NULL_OFFSET) {
+        return nullptr;
+    }
+
+    return arena->memory + offset;
+}
+
+
+void init_memory_pool(MemoryPool *pool, MemoryArena *arena, int element_size)
+{
+    pool->arena = arena;
+    pool->element_size = element_size < (int)sizeof(Uint32) ? (int)sizeof(Uint32) : element_size;
+    pool->free_list = ARENA_NULL_OFFSET;
+}
+
+
+void *MemoryPoolAlloc(MemoryPool *pool)
+{
+    if (pool->free_list != ARENA_NULL_OFFSET) {
+        void *element = get_arena_pointer(pool->arena, pool->free_list);
+        memcpy(&pool->free_list, element, sizeof(Uint32));
+        return element;
+    }
+
+    return MemoryArenaAlloc(pool->arena, pool->element_size);
+}
+
+
+void MemoryPoolFree(MemoryPool *pool, void *element)
+{
+    memcpy(element, &pool->free_list, sizeof(Uint32));
+    pool->free_list = get_arena_offset(pool->arena, element);
+}
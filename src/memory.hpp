@@ -0,0 +1,94 @@
+#pragma once
+
+#include "types.h"
+
+// Counts every heap allocation (operator new, MALLOC and SDL's allocator)
+// against the subsystem that is active on the allocating thread. Build with
+// ALLOCATION_TRACKING=0 to compile the hooks out.
+//
+// Plain malloc and realloc aren't hooked, outside this file everything goes
+// through tracked_malloc and tracked_realloc, freed with free as usual.
+#ifndef ALLOCATION_TRACKING
+#define ALLOCATION_TRACKING 1
+#endif
+
+#define ALLOCATION_MAX_SITES 256
+#define ALLOCATION_SITE_PROBES 8
+#define ALLOCATION_REPORT_SITES 8
+#define ALLOCATION_DEFAULT_WARMUP_FRAMES 120
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ALLOCATION_CALL_SITE() _ReturnAddress()
+#define ALLOCATION_NOINLINE __declspec(noinline)
+#else
+#define ALLOCATION_CALL_SITE() __builtin_return_address(0)
+#define ALLOCATION_NOINLINE __attribute__((noinline))
+#endif
+
+enum ALLOC_SUBSYSTEM {
+    ALLOC_OTHER,
+    ALLOC_LOADING,
+    ALLOC_PLATFORM,
+    ALLOC_INPUT,
+    ALLOC_SIMULATION,
+    ALLOC_RENDER,
+    ALLOC_DEBUG,
+
+    ALLOC_SUBSYSTEM_COUNT
+};
+
+struct AllocationSite {
+    void *address;
+    SDL_atomic_t subsystem;
+    SDL_atomic_t count;
+    SDL_atomic_t bytes;
+};
+
+struct AllocationTracker {
+    SDL_atomic_t frame_count[ALLOC_SUBSYSTEM_COUNT];
+    SDL_atomic_t frame_bytes[ALLOC_SUBSYSTEM_COUNT];
+    SDL_atomic_t total_count[ALLOC_SUBSYSTEM_COUNT];
+    SDL_atomic_t dropped_sites;
+
+    AllocationSite sites[ALLOCATION_MAX_SITES];
+
+    int frame;
+    int warmup_frames;
+
+    bool trace;
+    bool steady_state_test;
+    int steady_state_failures;
+};
+
+struct AllocationScope {
+    int previous;
+
+    AllocationScope(ALLOC_SUBSYSTEM subsystem);
+    ~AllocationScope();
+};
+
+#define ALLOC_SCOPE_NAME_(line) alloc_scope_##line
+#define ALLOC_SCOPE_NAME(line) ALLOC_SCOPE_NAME_(line)
+#define ALLOC_SCOPE(subsystem) AllocationScope ALLOC_SCOPE_NAME(__LINE__)(subsystem)
+
+void init_allocation_tracker(AllocationTracker *tracker, bool trace, bool steady_state_test, int warmup_frames);
+void end_allocation_frame(AllocationTracker *tracker);
+void print_allocation_report(AllocationTracker *tracker);
+
+const char *allocation_subsystem_name(int subsystem);
+void count_allocation(size_t size, void *call_site);
+
+// Scene arenas. Everything in one is laid out by offset from its start, so
+// the used range can be copied out and back in, even to another arena.
+void *MemoryArenaAlloc(MemoryArena *arena, int size);
+int get_arena_used(MemoryArena *arena);
+bool arena_contains(MemoryArena *arena, const void *pointer);
+
+// null is ARENA_NULL_OFFSET
+Uint32 get_arena_offset(MemoryArena *arena, const void *pointer);
+void *get_arena_pointer(MemoryArena *arena, Uint32 offset);
+
+void init_memory_pool(MemoryPool *pool, MemoryArena *arena, int element_size);
+void *MemoryPoolAlloc(MemoryPool *pool);
+void MemoryPoolFree(MemoryPool *pool, void *element);
@@ -0,0 +1,516 @@
+#include "netplay.hpp"
+
+#ifdef _WIN32
+#pragma comment(lib, "ws2_32.lib")
+#define close_net_socket closesocket
+#else
+#define close_net_socket close
+#endif
+
+static NetplayTick *get_netplay_tick(Netplay *net, Uint32 tick)
+{
+    NetplayTick *slot = &net->ticks[tick % NETPLAY_INPUT_RING];
+    if (slot->tick != tick) {
+        memset(slot, 0, sizeof(NetplayTick));
+        slot->tick = tick;
+    }
+
+    return slot;
+}
+
+
+static Uint32 next_netplay_random(Netplay *net)
+{
+    Uint32 x = net->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    net->random_state = x;
+    return x;
+}
+
+
+static void write_u32(Uint8 *buffer, int *size, Uint32 value)
+{
+    value = SDL_SwapLE32(value);
+    memcpy(buffer + *size, &value, sizeof(Uint32));
+    *size += sizeof(Uint32);
+}
+
+
+static bool read_u32(const Uint8 *buffer, int size, int *cursor, Uint32 *value)
+{
+    if (*cursor + (int)sizeof(Uint32) > size) {
+        return false;
+    }
+
+    memcpy(value, buffer + *cursor, sizeof(Uint32));
+    *value = SDL_SwapLE32(*value);
+    *cursor += sizeof(Uint32);
+    return true;
+}
+
+
+static void send_datagram(Netplay *net, const Uint8 *data, int size)
+{
+    sendto(net->socket, (const char *)data, size, 0, (const sockaddr *)&net->remote_address, sizeof(sockaddr_in));
+}
+
+
+static void send_netplay_packet(Netplay *net, const Uint8 *data, int size)
+{
+    net->stats.packets_sent += 1;
+    net->stats.bytes_sent += size;
+
+    if (net->loss > 0.f && (next_netplay_random(net) & 0xffff) < (Uint32)(net->loss*65536.f)) {
+        net->stats.packets_dropped += 1;
+        return;
+    }
+
+    if (net->latency_ms <= 0.f || net->delayed_count == NETPLAY_DELAY_QUEUE) {
+        send_datagram(net, data, size);
+        return;
+    }
+
+    // the latency never changes, so the queue stays in send order
+    NetplayDelayedPacket *packet = &net->delayed[(net->delayed_first + net->delayed_count) % NETPLAY_DELAY_QUEUE];
+    packet->send_counter = SDL_GetPerformanceCounter() + (Uint64)(net->latency_ms/1000.0*SDL_GetPerformanceFrequency());
+    packet->size = size;
+    memcpy(packet->data, data, size);
+    net->delayed_count += 1;
+}
+
+
+static void flush_delayed_packets(Netplay *net)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    while (net->delayed_count > 0) {
+        NetplayDelayedPacket *packet = &net->delayed[net->delayed_first];
+        if (packet->send_counter > now) {
+            break;
+        }
+
+        send_datagram(net, packet->data, packet->size);
+        net->delayed_first = (net->delayed_first + 1) % NETPLAY_DELAY_QUEUE;
+        net->delayed_count -= 1;
+    }
+}
+
+
+// magic, tick, ack, advantage, checksum tick and hash, first input tick, input tick count, then runs
+static void send_netplay_inputs(Netplay *net)
+{
+    Uint8 buffer[NETPLAY_MAX_PACKET];
+    int size = 0;
+
+    // everything they haven't acknowledged, as much as the ring still holds
+    Uint32 first = net->remote_acked;
+    if (net->tick - first > NETPLAY_INPUT_RING) {
+        first = net->tick - NETPLAY_INPUT_RING;
+    }
+
+    write_u32(buffer, &size, NETPLAY_MAGIC);
+    write_u32(buffer, &size, net->tick);
+    write_u32(buffer, &size, net->remote_tick);
+    write_u32(buffer, &size, (Uint32)(Sint32)(net->tick - net->remote_latest));
+    write_u32(buffer, &size, net->checksum_tick);
+    write_u32(buffer, &size, net->checksum_hash);
+    write_u32(buffer, &size, first);
+    write_u32(buffer, &size, net->tick - first);
+
+    // the buttons hardly ever change from one tick to the next
+    Uint32 tick = first;
+    while (tick < net->tick && size + 2 <= NETPLAY_MAX_PACKET) {
+        Uint8 input = net->ticks[tick % NETPLAY_INPUT_RING].input[net->local_player];
+        Uint8 run = 0;
+
+        while (tick < net->tick && run < 255 && net->ticks[tick % NETPLAY_INPUT_RING].input[net->local_player] == input) {
+            ++tick;
+            ++run;
+        }
+
+        buffer[size++] = input;
+        buffer[size++] = run;
+    }
+
+    send_netplay_packet(net, buffer, size);
+}
+
+
+static void receive_netplay_packet(Netplay *net, const Uint8 *buffer, int size)
+{
+    int cursor = 0;
+    Uint32 magic, tick, ack, advantage, checksum_tick, checksum_hash, first, count;
+
+    if (!read_u32(buffer, size, &cursor, &magic) || magic != NETPLAY_MAGIC ||
+        !read_u32(buffer, size, &cursor, &tick) ||
+        !read_u32(buffer, size, &cursor, &ack) ||
+        !read_u32(buffer, size, &cursor, &advantage) ||
+        !read_u32(buffer, size, &cursor, &checksum_tick) ||
+        !read_u32(buffer, size, &cursor, &checksum_hash) ||
+        !read_u32(buffer, size, &cursor, &first) ||
+        !read_u32(buffer, size, &cursor, &count))
+    {
+        LOG_WARN(LOG_NET, "Dropping a malformed packet of %d bytes", size);
+        return;
+    }
+
+    net->stats.packets_received += 1;
+
+    // packets can arrive out of order, older news changes nothing
+    if (tick >= net->remote_latest) {
+        net->remote_latest = tick;
+        net->remote_advantage = (int)(Sint32)advantage;
+    }
+    if (ack > net->remote_acked && ack <= net->tick) {
+        net->remote_acked = ack;
+    }
+    if (checksum_tick != NETPLAY_NO_TICK && checksum_tick != net->remote_checksum_checked) {
+        net->remote_checksum_tick = checksum_tick;
+        net->remote_checksum_hash = checksum_hash;
+    }
+
+    Uint32 remote = 1 - net->local_player;
+    Uint32 input_tick = first;
+    Uint32 end = first + count;
+
+    while (input_tick < end && cursor + 2 <= size) {
+        Uint8 input = buffer[cursor++];
+        Uint8 run = buffer[cursor++];
+
+        for (Uint8 i = 0; i < run && input_tick < end; ++i, ++input_tick) {
+            // anything already confirmed is old, anything too far out would clobber the ring
+            if (input_tick < net->remote_tick || input_tick - net->remote_tick >= NETPLAY_INPUT_RING/2) {
+                continue;
+            }
+
+            NetplayTick *slot = get_netplay_tick(net, input_tick);
+            slot->remote_input = input;
+            slot->confirmed = true;
+        }
+    }
+
+    Uint32 previous_remote_tick = net->remote_tick;
+    for (;;) {
+        NetplayTick *slot = &net->ticks[net->remote_tick % NETPLAY_INPUT_RING];
+        if (slot->tick != net->remote_tick || !slot->confirmed) {
+            break;
+        }
+
+        net->last_remote_input = slot->remote_input;
+        net->remote_tick += 1;
+    }
+
+    // the first simulated tick that used something other than what is known now
+    for (Uint32 t = previous_remote_tick; t < net->tick; ++t) {
+        NetplayTick *slot = get_netplay_tick(net, t);
+        Uint8 expected = slot->confirmed ? slot->remote_input : net->last_remote_input;
+
+        if (slot->input[remote] != expected) {
+            if (net->rollback_tick == NETPLAY_NO_TICK || t < net->rollback_tick) {
+                net->rollback_tick = t;
+            }
+            break;
+        }
+    }
+}
+
+
+static void simulate_netplay_tick(Netplay *net, Uint32 tick)
+{
+    NetplayTick *slot = get_netplay_tick(net, tick);
+    Uint32 remote = 1 - net->local_player;
+    slot->input[remote] = slot->confirmed ? slot->remote_input : net->last_remote_input;
+
+    Scene *scene = net->scene;
+    unpack_controller(slot->input[0], &scene->gamepadcontroller);
+    unpack_controller(slot->input[1], &scene->gamepadcontroller_two);
+
+    scene->update(scene, SIMULATION_TICK_S);
+    scene->time_s += SIMULATION_TICK_S;
+
+    slot->hash = net->hash(scene);
+}
+
+
+static void rollback_netplay(Netplay *net)
+{
+    Uint32 first = net->rollback_tick;
+    net->rollback_tick = NETPLAY_NO_TICK;
+
+    if (first == NETPLAY_NO_TICK || first >= net->tick) {
+        return;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    // the snapshot before the first wrong tick is still right, the later ones get retaken
+    load_scene_snapshot(&net->snapshots[first % NETPLAY_SNAPSHOT_RING], net->scene);
+
+    mute_sounds(net->audio, true);
+    for (Uint32 tick = first; tick < net->tick; ++tick) {
+        if (tick != first) {
+            save_scene_snapshot(&net->snapshots[tick % NETPLAY_SNAPSHOT_RING], net->scene);
+        }
+        simulate_netplay_tick(net, tick);
+    }
+    mute_sounds(net->audio, false);
+
+    int depth = (int)(net->tick - first);
+    net->frame_rollback_ticks += depth;
+    net->frame_resimulate_counter += SDL_GetPerformanceCounter() - start;
+
+    NetplayStats *all[] = { &net->stats, &net->report };
+    for (int i = 0; i < 2; ++i) {
+        all[i]->rollbacks += 1;
+        all[i]->rollback_ticks += depth;
+        if (depth > all[i]->max_rollback_ticks) {
+            all[i]->max_rollback_ticks = depth;
+        }
+    }
+}
+
+
+// only ticks with both inputs confirmed are final, those are the ones compared
+static void check_netplay_checksums(Netplay *net)
+{
+    Uint32 final_tick = net->remote_tick < net->tick ? net->remote_tick : net->tick;
+    if (final_tick == 0) {
+        return;
+    }
+
+    Uint32 checksum_tick = ((final_tick - 1)/NETPLAY_CHECKSUM_INTERVAL_TICKS)*NETPLAY_CHECKSUM_INTERVAL_TICKS;
+    NetplayTick *slot = &net->ticks[checksum_tick % NETPLAY_INPUT_RING];
+    if (checksum_tick != net->checksum_tick && slot->tick == checksum_tick) {
+        net->checksum_tick = checksum_tick;
+        net->checksum_hash = slot->hash;
+    }
+
+    Uint32 remote_tick = net->remote_checksum_tick;
+    if (remote_tick == NETPLAY_NO_TICK || remote_tick >= final_tick) {
+        return;
+    }
+
+    slot = &net->ticks[remote_tick % NETPLAY_INPUT_RING];
+    if (slot->tick == remote_tick && slot->hash != net->remote_checksum_hash) {
+        if (net->stats.desyncs == 0) {
+            LOG_ERROR(LOG_NET, "Desync at tick %u: %08x here, %08x on the other side", remote_tick, slot->hash, net->remote_checksum_hash);
+        }
+        net->stats.desyncs += 1;
+    }
+    net->remote_checksum_checked = remote_tick;
+    net->remote_checksum_tick = NETPLAY_NO_TICK;
+}
+
+
+bool init_netplay(Netplay *net, int local_player, int local_port, const char *remote_host, int remote_port,
+                  Scene *scene, NetplayHashFunc hash, AudioSystem *audio)
+{
+    if (net == nullptr) {
+        LOG_ERROR(LOG_NET, "netplay is null");
+        exit(1);
+    }
+
+    memset(net, 0, sizeof(Netplay));
+    net->socket = NET_INVALID_SOCKET;
+    net->local_player = local_player;
+    net->scene = scene;
+    net->hash = hash;
+    net->audio = audio;
+    net->rollback_tick = NETPLAY_NO_TICK;
+    net->checksum_tick = NETPLAY_NO_TICK;
+    net->remote_checksum_tick = NETPLAY_NO_TICK;
+    net->remote_checksum_checked = NETPLAY_NO_TICK;
+
+    // only decides which packets the link simulation drops, never the game
+    net->random_state = (Uint32)SDL_GetPerformanceCounter() | 1;
+
+    for (int i = 0; i < NETPLAY_INPUT_RING; ++i) {
+        net->ticks[i].tick = NETPLAY_NO_TICK;
+    }
+    for (int i = 0; i < NETPLAY_SNAPSHOT_RING; ++i) {
+        init_scene_snapshot(&net->snapshots[i], DEFAULT_MEMORY_ARENA_SIZE_MB);
+    }
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        LOG_ERROR(LOG_NET, "Could not start winsock");
+        return false;
+    }
+#endif
+
+    net->remote_address.sin_family = AF_INET;
+    net->remote_address.sin_port = htons((Uint16)remote_port);
+    if (inet_pton(AF_INET, remote_host, &net->remote_address.sin_addr) != 1) {
+        LOG_ERROR(LOG_NET, "Not an IPv4 address: %s", remote_host);
+        return false;
+    }
+
+    net->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (net->socket == NET_INVALID_SOCKET) {
+        LOG_ERROR(LOG_NET, "Could not create a UDP socket");
+        return false;
+    }
+
+    sockaddr_in local_address;
+    memset(&local_address, 0, sizeof(sockaddr_in));
+    local_address.sin_family = AF_INET;
+    local_address.sin_port = htons((Uint16)local_port);
+    local_address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(net->socket, (const sockaddr *)&local_address, sizeof(sockaddr_in)) != 0) {
+        LOG_ERROR(LOG_NET, "Could not bind UDP port %d", local_port);
+        return false;
+    }
+
+    // polled once a loop, never waited on
+#ifdef _WIN32
+    u_long non_blocking = 1;
+    ioctlsocket(net->socket, FIONBIO, &non_blocking);
+#else
+    fcntl(net->socket, F_SETFL, fcntl(net->socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+    LOG_INFO(LOG_NET, "Player %d on port %d, the other player at %s:%d", local_player + 1, local_port, remote_host, remote_port);
+    return true;
+}
+
+
+void shutdown_netplay(Netplay *net)
+{
+    NetplayStats *stats = &net->stats;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    LOG_INFO(LOG_NET, "Netplay: %u ticks, %d rollbacks, avg depth %.2f, max %d, resimulation avg %.4fms a frame, max %.4fms, %d stalls, %d sync waits, desyncs %d",
+             net->tick, stats->rollbacks, stats->rollbacks ? (double)stats->rollback_ticks/stats->rollbacks : 0.0,
+             stats->max_rollback_ticks, stats->frames ? stats->resimulate_counter_total*1000.0/frequency/stats->frames : 0.0,
+             stats->resimulate_counter_max*1000.0/frequency, stats->stalls, stats->sync_waits, stats->desyncs);
+    LOG_INFO(LOG_NET, "Netplay: %d packets sent, %.1f bytes each, %d dropped by the link simulation, %d received",
+             stats->packets_sent, stats->packets_sent ? (double)stats->bytes_sent/stats->packets_sent : 0.0,
+             stats->packets_dropped, stats->packets_received);
+
+    if (net->socket != NET_INVALID_SOCKET) {
+        close_net_socket(net->socket);
+        net->socket = NET_INVALID_SOCKET;
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    for (int i = 0; i < NETPLAY_SNAPSHOT_RING; ++i) {
+        free_scene_snapshot(&net->snapshots[i]);
+    }
+}
+
+
+void set_netplay_link(Netplay *net, float latency_ms, float loss)
+{
+    net->latency_ms = latency_ms > 0.f ? latency_ms : 0.f;
+    net->loss = loss < 0.f ? 0.f : (loss > 1.f ? 1.f : loss);
+
+    if (net->latency_ms > 0.f || net->loss > 0.f) {
+        LOG_INFO(LOG_NET, "Simulating %.0fms of latency and %.0f%% packet loss on the way out", net->latency_ms, net->loss*100.f);
+    }
+}
+
+
+void netplay_poll(Netplay *net)
+{
+    flush_delayed_packets(net);
+
+    Uint8 buffer[NETPLAY_MAX_PACKET];
+    sockaddr_in from;
+
+    for (;;) {
+        socklen_t from_size = sizeof(sockaddr_in);
+        int size = (int)recvfrom(net->socket, (char *)buffer, sizeof(buffer), 0, (sockaddr *)&from, &from_size);
+        if (size <= 0) {
+            break;
+        }
+
+        if (from.sin_addr.s_addr != net->remote_address.sin_addr.s_addr || from.sin_port != net->remote_address.sin_port) {
+            continue;
+        }
+
+        receive_netplay_packet(net, buffer, size);
+    }
+
+    // a wrong guess is fixed right away, even on a loop that runs no tick
+    if (net->scene->initialized) {
+        rollback_netplay(net);
+        check_netplay_checksums(net);
+    }
+}
+
+
+bool netplay_tick(Netplay *net, const GamePadController *local)
+{
+    netplay_poll(net);
+
+    // past the snapshots, nothing more can be guessed until they catch up.
+    // their input can already be ahead of ours when they started first
+    if ((Sint32)(net->tick - net->remote_tick) >= NETPLAY_MAX_ROLLBACK_TICKS) {
+        net->stats.stalls += 1;
+        net->report.stalls += 1;
+        send_netplay_inputs(net);
+        return false;
+    }
+
+    // both sides work out the same gap from their own ends, the one ahead gives a tick back now and then
+    int advantage = (int)(net->tick - net->remote_latest);
+    if (advantage - net->remote_advantage >= 2 && (net->tick % NETPLAY_SYNC_INTERVAL_TICKS) == 0) {
+        net->remote_advantage += 1;
+        net->stats.sync_waits += 1;
+        net->report.sync_waits += 1;
+        send_netplay_inputs(net);
+        return false;
+    }
+
+    save_scene_snapshot(&net->snapshots[net->tick % NETPLAY_SNAPSHOT_RING], net->scene);
+
+    NetplayTick *slot = get_netplay_tick(net, net->tick);
+    slot->input[net->local_player] = pack_controller(local);
+
+    simulate_netplay_tick(net, net->tick);
+    net->tick += 1;
+
+    send_netplay_inputs(net);
+    return true;
+}
+
+
+void end_netplay_frame(Netplay *net)
+{
+    Uint64 counter = net->frame_resimulate_counter;
+
+    NetplayStats *all[] = { &net->stats, &net->report };
+    for (int i = 0; i < 2; ++i) {
+        all[i]->frames += 1;
+        all[i]->resimulate_counter_total += counter;
+        if (counter > all[i]->resimulate_counter_max) {
+            all[i]->resimulate_counter_max = counter;
+        }
+    }
+
+    if (net->frame_rollback_ticks > 0) {
+        LOG_TRACE(LOG_NET, "Frame rolled back %d ticks in %.4fms", net->frame_rollback_ticks,
+                  counter*1000.0/SDL_GetPerformanceFrequency());
+    }
+
+    net->frame_rollback_ticks = 0;
+    net->frame_resimulate_counter = 0;
+
+    NetplayStats *report = &net->report;
+    if (report->frames >= NETPLAY_REPORT_INTERVAL_FRAMES) {
+        double frequency = (double)SDL_GetPerformanceFrequency();
+        LOG_DEBUG(LOG_NET, "Tick %u, %d ahead: %d rollbacks, avg depth %.2f, max %d, resimulation avg %.4fms a frame, max %.4fms, %d stalls",
+                  net->tick, (int)(net->tick - net->remote_tick), report->rollbacks,
+                  report->rollbacks ? (double)report->rollback_ticks/report->rollbacks : 0.0, report->max_rollback_ticks,
+                  report->resimulate_counter_total*1000.0/frequency/report->frames,
+                  report->resimulate_counter_max*1000.0/frequency, report->stalls);
+        memset(report, 0, sizeof(NetplayStats));
+    }
+}
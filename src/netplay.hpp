@@ -0,0 +1,142 @@
+#pragma once
+
+#include "types.h"
+#include "input.hpp"
+#include "audio.hpp"
+#include "snapshot.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET NetSocket;
+#define NET_INVALID_SOCKET INVALID_SOCKET
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+typedef int NetSocket;
+#define NET_INVALID_SOCKET (-1)
+#endif
+
+// Two player co-op over UDP with rollback. Both sides run the whole scene.
+// Local input goes in on the tick it is read, the other player's is guessed
+// to be whatever it last was. When their real input turns up and differs,
+// the scene goes back to the snapshot taken before that tick and simulates
+// forward again with what is known now. Every packet repeats all the input
+// the other side hasn't acknowledged, as runs of unchanged buttons, so a
+// lost packet only costs the wait for the next one.
+#define NETPLAY_PLAYERS 2
+
+// further ahead of the other side than this and the local side waits for it
+#define NETPLAY_MAX_ROLLBACK_TICKS 8
+
+// snapshots cover every tick that can still be rolled back, the input ring
+// also keeps what the other side hasn't acknowledged yet
+#define NETPLAY_SNAPSHOT_RING 16
+#define NETPLAY_INPUT_RING 64
+
+#define NETPLAY_MAGIC 0x504e444c // "LDNP"
+#define NETPLAY_MAX_PACKET 512
+#define NETPLAY_DELAY_QUEUE 256
+#define NETPLAY_NO_TICK 0xffffffffu
+
+// the side further ahead skips a tick this often until the two are level
+#define NETPLAY_SYNC_INTERVAL_TICKS 10
+
+// both sides hash the confirmed state this often and compare
+#define NETPLAY_CHECKSUM_INTERVAL_TICKS 60
+#define NETPLAY_REPORT_INTERVAL_FRAMES 120
+
+typedef Uint32 (*NetplayHashFunc)(Scene *scene);
+
+struct NetplayTick {
+    Uint32 tick;                        // which tick the slot holds right now
+    Uint8 input[NETPLAY_PLAYERS];       // what the simulation used, the remote one may be a guess
+    Uint8 remote_input;                 // the real one, once confirmed
+    bool confirmed;
+    Uint32 hash;                        // state after the tick
+};
+
+// held back to fake a slow or lossy link
+struct NetplayDelayedPacket {
+    Uint64 send_counter;
+    int size;
+    Uint8 data[NETPLAY_MAX_PACKET];
+};
+
+struct NetplayStats {
+    int frames;
+    int rollbacks;
+    int rollback_ticks;                 // re-simulated, summed over every rollback
+    int max_rollback_ticks;
+    Uint64 resimulate_counter_total;
+    Uint64 resimulate_counter_max;      // worst single frame
+    int stalls;
+    int sync_waits;
+
+    int packets_sent;
+    int packets_received;
+    int packets_dropped;                // by the loss simulation
+    int bytes_sent;
+    int desyncs;
+};
+
+struct Netplay {
+    int local_player;                   // 0 or 1, player one is the scene's own controller
+    NetSocket socket;
+    sockaddr_in remote_address;
+
+    Scene *scene;
+    NetplayHashFunc hash;
+    AudioSystem *audio;
+
+    Uint32 tick;                        // the next tick to simulate
+    Uint32 remote_tick;                 // their input is confirmed below this
+    Uint32 remote_acked;                // they have ours below this
+    Uint32 remote_latest;               // the newest tick they said they were on
+    int remote_advantage;               // how far they think they are ahead of us
+    Uint32 rollback_tick;               // earliest tick simulated with a wrong guess
+    Uint8 last_remote_input;
+
+    NetplayTick ticks[NETPLAY_INPUT_RING];
+    SceneSnapshot snapshots[NETPLAY_SNAPSHOT_RING];  // the state before each tick
+
+    // ours goes out with every packet, theirs waits here until ours is final
+    Uint32 checksum_tick;
+    Uint32 checksum_hash;
+    Uint32 remote_checksum_tick;
+    Uint32 remote_checksum_hash;
+    Uint32 remote_checksum_checked;     // every packet repeats theirs, each one is compared once
+
+    // link simulation, outgoing only, each side fakes its own half
+    float latency_ms;
+    float loss;
+    Uint32 random_state;
+    int delayed_first;
+    int delayed_count;
+    NetplayDelayedPacket delayed[NETPLAY_DELAY_QUEUE];
+
+    // this frame, folded into the stats by end_netplay_frame
+    int frame_rollback_ticks;
+    Uint64 frame_resimulate_counter;
+
+    NetplayStats stats;
+    NetplayStats report;                // since the last periodic report
+};
+
+// player is 0 or 1, the two sides must pick different ones
+bool init_netplay(Netplay *net, int local_player, int local_port, const char *remote_host, int remote_port,
+                  Scene *scene, NetplayHashFunc hash, AudioSystem *audio);
+void shutdown_netplay(Netplay *net);
+
+void set_netplay_link(Netplay *net, float latency_ms, float loss);
+
+// one simulation tick with the local controller. false means the other side
+// is too far behind and nothing was simulated, the caller tries again later
+bool netplay_tick(Netplay *net, const GamePadController *local);
+
+// once per loop, sends and receives even when no tick ran
+void netplay_poll(Netplay *net);
+void end_netplay_frame(Netplay *net);
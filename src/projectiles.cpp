@@ -0,0 +1,409 @@
+#include "projectiles.hpp"
+
+void init_projectile_system(ProjectileSystem *system, glm::vec2 bounds_min, glm::vec2 bounds_max)
+{
+    if (system == nullptr) {
+        LOG_ERROR(LOG_SCENE, "projectile system is null");
+        exit(1);
+    }
+
+    memset(system, 0, sizeof(ProjectileSystem));
+    system->bounds_min = bounds_min;
+    system->bounds_max = bounds_max;
+}
+
+
+void add_projectile_type(ProjectileSystem *system, PROJECTILE_TYPE type, ProjectileTypeInfo *info, MemoryArena *arena)
+{
+    if (type <= NONE || type >= PROJECTILE_TYPE_COUNT || info->capacity <= 0) {
+        LOG_ERROR(LOG_SCENE, "Invalid projectile type %d", type);
+        return;
+    }
+
+    ProjectilePool *pool = &system->pools[type];
+    if (pool->info.capacity > 0) {
+        LOG_ERROR(LOG_SCENE, "Projectile type %d is already set up", type);
+        return;
+    }
+
+    int capacity = info->capacity;
+    pool->info = *info;
+    pool->count = 0;
+
+    pool->position_x = (float *)MemoryArenaAlloc(arena, capacity*sizeof(float));
+    pool->position_y = (float *)MemoryArenaAlloc(arena, capacity*sizeof(float));
+    pool->velocity_x = (float *)MemoryArenaAlloc(arena, capacity*sizeof(float));
+    pool->velocity_y = (float *)MemoryArenaAlloc(arena, capacity*sizeof(float));
+    pool->time_left_s = (float *)MemoryArenaAlloc(arena, capacity*sizeof(float));
+    pool->damage = (float *)MemoryArenaAlloc(arena, capacity*sizeof(float));
+    pool->owner = (int *)MemoryArenaAlloc(arena, capacity*sizeof(int));
+}
+
+
+int spawn_projectiles(ProjectileSystem *system, PROJECTILE_TYPE type, int owner, const Projectile *projectiles, int count)
+{
+    ProjectilePool *pool = &system->pools[type];
+
+    int available = pool->info.capacity - pool->count;
+    int spawned = count < available ? count : available;
+
+    if (spawned < count) {
+        system->dropped += count - spawned;
+        LOG_WARN(LOG_SCENE, "Projectile pool %d is full, dropping %d shots", type, count - spawned);
+    }
+
+    float lifetime_s = pool->info.lifetime_s;
+    int first = pool->count;
+
+    for (int i = 0; i < spawned; ++i) {
+        int index = first + i;
+        pool->position_x[index] = projectiles[i].position.x;
+        pool->position_y[index] = projectiles[i].position.y;
+        pool->velocity_x[index] = projectiles[i].velocity.x;
+        pool->velocity_y[index] = projectiles[i].velocity.y;
+        pool->time_left_s[index] = lifetime_s;
+        pool->damage[index] = projectiles[i].damage;
+        pool->owner[index] = owner;
+    }
+
+    pool->count += spawned;
+    return spawned;
+}
+
+
+int spawn_projectile_ring(ProjectileSystem *system, PROJECTILE_TYPE type, int owner, glm::vec2 origin,
+                          int count, float speed, float angle_offset)
+{
+    if (count <= 0) {
+        return 0;
+    }
+
+    return spawn_projectile_spread(system, type, owner, origin, angle_offset, 360.f*(count - 1)/count, count, speed);
+}
+
+
+int spawn_projectile_spread(ProjectileSystem *system, PROJECTILE_TYPE type, int owner, glm::vec2 origin,
+                            float direction, float spread, int count, float speed)
+{
+    Projectile projectiles[PROJECTILE_SPAWN_CHUNK];
+
+    float damage = system->pools[type].info.damage;
+    float first_angle = direction - spread*0.5f;
+    float step = count > 1 ? spread/(count - 1) : 0.f;
+
+    int spawned = 0;
+    for (int start = 0; start < count; start += PROJECTILE_SPAWN_CHUNK) {
+        int chunk = count - start < PROJECTILE_SPAWN_CHUNK ? count - start : PROJECTILE_SPAWN_CHUNK;
+
+        for (int i = 0; i < chunk; ++i) {
+            float angle = glm::radians(first_angle + step*(start + i));
+            projectiles[i].position = origin;
+            projectiles[i].velocity = glm::vec2(cosf(angle), sinf(angle))*speed;
+            projectiles[i].damage = damage;
+        }
+
+        spawned += spawn_projectiles(system, type, owner, projectiles, chunk);
+    }
+
+    return spawned;
+}
+
+
+static void remove_projectile(ProjectilePool *pool, int index)
+{
+    int last = --pool->count;
+
+    pool->position_x[index] = pool->position_x[last];
+    pool->position_y[index] = pool->position_y[last];
+    pool->velocity_x[index] = pool->velocity_x[last];
+    pool->velocity_y[index] = pool->velocity_y[last];
+    pool->time_left_s[index] = pool->time_left_s[last];
+    pool->damage[index] = pool->damage[last];
+    pool->owner[index] = pool->owner[last];
+}
+
+
+void update_projectiles(ProjectileSystem *system, float elapsed_time_s)
+{
+    for (int type = 0; type < PROJECTILE_TYPE_COUNT; ++type) {
+        ProjectilePool *pool = &system->pools[type];
+        int count = pool->count;
+        if (count == 0) {
+            continue;
+        }
+
+        // the whole sprite has to be off screen before it counts as gone
+        float margin = glm::max(pool->info.size.x, pool->info.size.y);
+        float min_x = system->bounds_min.x - margin;
+        float min_y = system->bounds_min.y - margin;
+        float max_x = system->bounds_max.x + margin;
+        float max_y = system->bounds_max.y + margin;
+
+        float *position_x = pool->position_x;
+        float *position_y = pool->position_y;
+        float *velocity_x = pool->velocity_x;
+        float *velocity_y = pool->velocity_y;
+        float *time_left_s = pool->time_left_s;
+
+        // one field at a time, no branches, so these loops vectorize
+        glm::vec2 acceleration = pool->info.acceleration*elapsed_time_s;
+        if (acceleration != glm::vec2(0.f)) {
+            for (int i = 0; i < count; ++i) {
+                velocity_x[i] += acceleration.x;
+                velocity_y[i] += acceleration.y;
+            }
+        }
+
+        for (int i = 0; i < count; ++i) {
+            position_x[i] += velocity_x[i]*elapsed_time_s;
+            position_y[i] += velocity_y[i]*elapsed_time_s;
+            time_left_s[i] -= elapsed_time_s;
+        }
+
+        // the last one moves into the hole and gets checked on the next pass
+        int i = 0;
+        while (i < pool->count) {
+            if (time_left_s[i] <= 0.f ||
+                position_x[i] < min_x || position_x[i] > max_x ||
+                position_y[i] < min_y || position_y[i] > max_y)
+            {
+                remove_projectile(pool, i);
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+}
+
+
+static glm::vec4 get_projectile_basis(glm::vec2 size, bool oriented, float velocity_x, float velocity_y)
+{
+    if (!oriented) {
+        return glm::vec4(size.x, 0.f, 0.f, size.y);
+    }
+
+    // the sprite's y axis follows the velocity
+    glm::vec2 direction = glm::vec2(velocity_x, velocity_y);
+    float length = glm::length(direction);
+    direction = length > 0.f ? direction/length : glm::vec2(0.f, 1.f);
+
+    return glm::vec4(direction.y*size.x, -direction.x*size.x,
+                     direction.x*size.y, direction.y*size.y);
+}
+
+
+void init_projectile_draw_list(ProjectileDrawList *list, int capacity)
+{
+    if (list == nullptr) {
+        LOG_ERROR(LOG_RENDER, "projectile draw list is null");
+        exit(1);
+    }
+
+    memset(list, 0, sizeof(ProjectileDrawList));
+    list->capacity = capacity;
+
+    // four arrays of capacity floats, each pool takes the same span of all four
+    list->memory = (float *)tracked_malloc(4*capacity*sizeof(float));
+    if (list->memory == nullptr) {
+        LOG_ERROR(LOG_MEMORY, "Could not allocate a projectile draw list for %d shots", capacity);
+        exit(1);
+    }
+
+    // unoriented pools don't copy their velocities, the basis still reads them, unused
+    memset(list->memory, 0, 4*capacity*sizeof(float));
+}
+
+
+void free_projectile_draw_list(ProjectileDrawList *list)
+{
+    free(list->memory);
+    memset(list, 0, sizeof(ProjectileDrawList));
+}
+
+
+void copy_projectile_draw_list(ProjectileSystem *system, ProjectileDrawList *list)
+{
+    int capacity = list->capacity;
+    int used = 0;
+    list->dropped = 0;
+
+    for (int type = 0; type < PROJECTILE_TYPE_COUNT; ++type) {
+        ProjectilePool *pool = &system->pools[type];
+        ProjectileTypeInfo *info = &pool->info;
+        ProjectileDrawPool *draw_pool = &list->pools[type];
+
+        int count = pool->count < capacity - used ? pool->count : capacity - used;
+        list->dropped += pool->count - count;
+
+        draw_pool->texture = info->texture;
+        draw_pool->uv_rect = info->uv_rect;
+        draw_pool->size = info->size;
+        draw_pool->depth = info->depth;
+        draw_pool->oriented = info->oriented;
+        draw_pool->count = count;
+
+        draw_pool->position_x = list->memory + used;
+        draw_pool->position_y = list->memory + capacity + used;
+        draw_pool->velocity_x = list->memory + 2*capacity + used;
+        draw_pool->velocity_y = list->memory + 3*capacity + used;
+
+        memcpy(draw_pool->position_x, pool->position_x, count*sizeof(float));
+        memcpy(draw_pool->position_y, pool->position_y, count*sizeof(float));
+        if (info->oriented) {
+            memcpy(draw_pool->velocity_x, pool->velocity_x, count*sizeof(float));
+            memcpy(draw_pool->velocity_y, pool->velocity_y, count*sizeof(float));
+        }
+
+        used += count;
+    }
+
+    if (list->dropped > 0) {
+        LOG_WARN(LOG_RENDER, "Projectile draw list is full, %d shots not drawn", list->dropped);
+    }
+}
+
+
+struct ProjectileDrawJob {
+    ProjectileDrawPool *pool;
+    SpriteInstance *instances;
+    int first;              // the pool index of instances[0]
+};
+
+
+static void write_projectile_instances(void *data, int first, int count)
+{
+    ProjectileDrawJob *job = (ProjectileDrawJob *)data;
+    ProjectileDrawPool *pool = job->pool;
+
+    for (int i = first; i < first + count; ++i) {
+        int index = job->first + i;
+        SpriteInstance *instance = &job->instances[i];
+
+        instance->basis = get_projectile_basis(pool->size, pool->oriented, pool->velocity_x[index], pool->velocity_y[index]);
+        instance->position = glm::vec4(pool->position_x[index], pool->position_y[index], pool->depth, 0.f);
+        instance->uv_rect = pool->uv_rect;
+        instance->color = glm::vec4(1.f);
+    }
+}
+
+
+void draw_projectiles(ProjectileDrawList *list, SpriteBatch *batch, WorkerPool *workers)
+{
+    for (int type = 0; type < PROJECTILE_TYPE_COUNT; ++type) {
+        ProjectileDrawPool *pool = &list->pools[type];
+
+        int drawn = 0;
+        while (drawn < pool->count) {
+            int reserved = 0;
+            SpriteInstance *instances = reserve_sprites(batch, pool->texture, pool->count - drawn, &reserved);
+            if (reserved == 0) {
+                break;
+            }
+
+            ProjectileDrawJob job;
+            job.pool = pool;
+            job.instances = instances;
+            job.first = drawn;
+
+            if (workers) {
+                run_parallel(workers, reserved, PROJECTILE_DRAW_CHUNK, write_projectile_instances, &job);
+            }
+            else {
+                write_projectile_instances(&job, 0, reserved);
+            }
+
+            drawn += reserved;
+        }
+    }
+}
+
+
+int collide_projectiles(ProjectileSystem *system, PROJECTILE_TYPE type, const CollisionShape *target,
+                        int ignore_owner, float *damage)
+{
+    ProjectilePool *pool = &system->pools[type];
+    ProjectileTypeInfo *info = &pool->info;
+
+    // grown by the shot's half diagonal, so a turned shot can't slip past
+    glm::vec2 target_min, target_max;
+    get_collision_shape_bounds(target, &target_min, &target_max);
+    float reach = glm::length(info->size)*0.5f;
+    target_min -= glm::vec2(reach);
+    target_max += glm::vec2(reach);
+
+    int hits = 0;
+    int i = 0;
+    while (i < pool->count) {
+        float x = pool->position_x[i];
+        float y = pool->position_y[i];
+
+        if (x < target_min.x || x > target_max.x || y < target_min.y || y > target_max.y || pool->owner[i] == ignore_owner) {
+            ++i;
+            continue;
+        }
+
+        glm::vec4 basis = get_projectile_basis(info->size, info->oriented, pool->velocity_x[i], pool->velocity_y[i]);
+
+        CollisionShape shot;
+        shot.mask = info->mask;
+        shot.uv_rect = info->uv_rect;
+        shot.center = glm::vec2(x, y);
+        shot.axis_x = glm::vec2(basis.x, basis.y);
+        shot.axis_y = glm::vec2(basis.z, basis.w);
+
+        if (collision_shapes_overlap(&shot, target)) {
+            if (damage) {
+                *damage += pool->damage[i];
+            }
+
+            hits += 1;
+            remove_projectile(pool, i);
+        }
+        else {
+            ++i;
+        }
+    }
+
+    return hits;
+}
+
+
+int count_projectiles(ProjectileSystem *system)
+{
+    int count = 0;
+    for (int type = 0; type < PROJECTILE_TYPE_COUNT; ++type) {
+        count += system->pools[type].count;
+    }
+    return count;
+}
+
+
+int get_projectile_capacity(ProjectileSystem *system)
+{
+    int capacity = 0;
+    for (int type = 0; type < PROJECTILE_TYPE_COUNT; ++type) {
+        capacity += system->pools[type].info.capacity;
+    }
+    return capacity;
+}
+
+
+Uint32 hash_projectiles(ProjectileSystem *system, Uint32 hash)
+{
+    // FNV-1a over whole words, positions are all a replay can diverge on
+    for (int type = 0; type < PROJECTILE_TYPE_COUNT; ++type) {
+        ProjectilePool *pool = &system->pools[type];
+
+        for (int i = 0; i < pool->count; ++i) {
+            Uint32 words[2];
+            memcpy(&words[0], &pool->position_x[i], sizeof(Uint32));
+            memcpy(&words[1], &pool->position_y[i], sizeof(Uint32));
+
+            hash = (hash ^ words[0])*16777619u;
+            hash = (hash ^ words[1])*16777619u;
+        }
+    }
+
+    return hash;
+}
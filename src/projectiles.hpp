@@ -0,0 +1,126 @@
+#pragma once
+
+#include "types.h"
+#include "render.hpp"
+#include "collision.hpp"
+#include "workers.hpp"
+
+// Projectiles are not entities. Every PROJECTILE_TYPE has a pool with one
+// array per field, so the update is a few straight loops over floats. For
+// drawing the positions and velocities are copied out into a draw list,
+// which the render thread turns into instances straight in the sprite batch.
+// Dead projectiles are swapped out, the live ones always stay packed at the front.
+#define PROJECTILE_SPAWN_CHUNK 256
+
+// shots a draw list starts with, reserved up to a scene's pools once it has made them
+#define PROJECTILE_DRAW_LIST_CAPACITY 4096
+
+// instances written by one worker at a time, see draw_projectiles
+#define PROJECTILE_DRAW_CHUNK 4096
+
+// the per field arrays in a pool, position and velocity count as two each
+#define PROJECTILE_ARRAY_COUNT 7
+
+struct ProjectileTypeInfo {
+    int capacity;
+
+    GLuint texture;
+    glm::vec4 uv_rect;
+    glm::vec2 size;
+    float depth;
+    bool oriented;          // turns to face where it is going
+
+    // the texture's mask, null hits with the whole quad
+    const CollisionMask *mask;
+
+    float lifetime_s;
+    float damage;           // used when a pattern spawns it
+    glm::vec2 acceleration; // pixels per second squared, missiles speed up, orbs can fall
+};
+
+// the arrays come out of the same arena as the system
+struct ProjectilePool {
+    ProjectileTypeInfo info;
+    int count;
+
+    ArenaPtr<float> position_x;
+    ArenaPtr<float> position_y;
+    ArenaPtr<float> velocity_x;
+    ArenaPtr<float> velocity_y;
+    ArenaPtr<float> time_left_s;
+    ArenaPtr<float> damage;
+    ArenaPtr<int> owner;      // entity id of whoever fired it
+};
+
+struct ProjectileSystem {
+    // anything outside, by more than its own size, is gone for good
+    glm::vec2 bounds_min;
+    glm::vec2 bounds_max;
+
+    ProjectilePool pools[PROJECTILE_TYPE_COUNT];
+
+    // spawns that found their pool full, the caller reads and clears it
+    int dropped;
+};
+
+void init_projectile_system(ProjectileSystem *system, glm::vec2 bounds_min, glm::vec2 bounds_max);
+
+// allocates the type's pool from the arena the system is in, do it while loading
+void add_projectile_type(ProjectileSystem *system, PROJECTILE_TYPE type, ProjectileTypeInfo *info, MemoryArena *arena);
+
+int spawn_projectiles(ProjectileSystem *system, PROJECTILE_TYPE type, int owner, const Projectile *projectiles, int count);
+
+// bullet patterns, angles in degrees counterclockwise from +x
+int spawn_projectile_ring(ProjectileSystem *system, PROJECTILE_TYPE type, int owner, glm::vec2 origin,
+                          int count, float speed, float angle_offset);
+int spawn_projectile_spread(ProjectileSystem *system, PROJECTILE_TYPE type, int owner, glm::vec2 origin,
+                            float direction, float spread, int count, float speed);
+
+// what drawing needs of one pool, the arrays point into the draw list
+struct ProjectileDrawPool {
+    GLuint texture;
+    glm::vec4 uv_rect;
+    glm::vec2 size;
+    float depth;
+    bool oriented;
+
+    int count;
+    float *position_x;
+    float *position_y;
+    float *velocity_x;          // only filled in when oriented
+    float *velocity_y;
+};
+
+struct ProjectileDrawList {
+    int capacity;               // every type together
+    int dropped;                // shots the last copy had no room for
+    float *memory;
+    ProjectileDrawPool pools[PROJECTILE_TYPE_COUNT];
+};
+
+void update_projectiles(ProjectileSystem *system, float elapsed_time_s);
+
+void init_projectile_draw_list(ProjectileDrawList *list, int capacity);
+void free_projectile_draw_list(ProjectileDrawList *list);
+
+// never allocates, shots past the list's capacity are dropped and counted
+void copy_projectile_draw_list(ProjectileSystem *system, ProjectileDrawList *list);
+
+// Each pool's instances are reserved in the batch in one go, then filled in
+// chunks spread over the workers, each straight into its own slice of the
+// stream. Every instance only depends on its own index, so the result is the
+// same bytes whichever thread wrote it. workers can be null.
+void draw_projectiles(ProjectileDrawList *list, SpriteBatch *batch, WorkerPool *workers);
+
+// Shots of one type hitting a target, a point against the target's bounds
+// first and the masks only for what is left. Shots fired by ignore_owner go
+// through, entity ids start at 1 so 0 lets every shot hit. Hit shots are
+// removed. Returns the hits and adds up their damage.
+int collide_projectiles(ProjectileSystem *system, PROJECTILE_TYPE type, const CollisionShape *target,
+                        int ignore_owner, float *damage);
+
+int count_projectiles(ProjectileSystem *system);
+
+// every pool's capacity together, what a draw list needs to never drop a shot
+int get_projectile_capacity(ProjectileSystem *system);
+Uint32 hash_projectiles(ProjectileSystem *system, Uint32 hash);
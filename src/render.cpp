@@ -0,0 +1,667 @@
+#include "render.hpp"
+
+// far enough apart to tell neighbouring draw calls apart
+static const glm::vec4 SPRITE_BATCH_TINTS[] = {
+    glm::vec4(1.f, 0.3f, 0.3f, 1.f),
+    glm::vec4(0.3f, 1.f, 0.3f, 1.f),
+    glm::vec4(0.3f, 0.5f, 1.f, 1.f),
+    glm::vec4(1.f, 1.f, 0.3f, 1.f),
+    glm::vec4(1.f, 0.3f, 1.f, 1.f),
+    glm::vec4(0.3f, 1.f, 1.f, 1.f),
+    glm::vec4(1.f, 0.6f, 0.2f, 1.f),
+    glm::vec4(0.7f, 0.4f, 1.f, 1.f),
+};
+
+// the instance attributes point at the run's offset in the stream, set again for every draw
+static void point_sprite_instances(SpriteBatch *batch, int offset)
+{
+    for (int i = 0; i < 4; ++i) {
+        glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void *)(size_t)(offset + i*sizeof(glm::vec4)));
+    }
+}
+
+
+// the next run starts wherever the last one was committed
+static void start_sprite_run(SpriteBatch *batch)
+{
+    int available = 0;
+    batch->instances = (SpriteInstance *)get_stream_cursor(&batch->stream, &available);
+    batch->capacity = available/(int)sizeof(SpriteInstance);
+    batch->count = 0;
+}
+
+
+static void drop_sprites(SpriteBatch *batch, int count)
+{
+    LOG_WARN(LOG_RENDER, "Sprite batch is out of room for this frame, dropping %d sprites", count);
+    batch->stream.stats.overflows += 1;
+}
+
+
+void init_sprite_batch(SpriteBatch *batch, int capacity, int frames_ahead, bool allow_persistent)
+{
+    if (batch == nullptr) {
+        LOG_ERROR(LOG_RENDER, "sprite batch is null");
+        exit(1);
+    }
+
+    memset(batch, 0, sizeof(SpriteBatch));
+
+    glGenVertexArrays(1, &batch->vao);
+    glBindVertexArray(batch->vao);
+
+    init_stream_buffer(&batch->stream, GL_ARRAY_BUFFER, capacity*(int)sizeof(SpriteInstance), frames_ahead, allow_persistent);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->stream.buffer);
+
+    // the quad corners come from gl_VertexID, only the instance data is fetched
+    for (int i = 0; i < 4; ++i) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    point_sprite_instances(batch, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+void shutdown_sprite_batch(SpriteBatch *batch)
+{
+    shutdown_stream_buffer(&batch->stream);
+    glDeleteVertexArrays(1, &batch->vao);
+    batch->vao = 0;
+}
+
+
+void grow_sprite_batch(SpriteBatch *batch, int capacity)
+{
+    StreamBuffer *stream = &batch->stream;
+    if (capacity*(int)sizeof(SpriteInstance) <= stream->region_size) {
+        return;
+    }
+
+    LOG_INFO(LOG_RENDER, "Sprite batch grows from %d to %d sprites a frame",
+             stream->region_size/(int)sizeof(SpriteInstance), capacity);
+
+    // the GL keeps the old buffer alive until the frames still drawing from it are done
+    int frames_ahead = stream->region_count - 1;
+    bool persistent = stream->persistent;
+    StreamStats stats = stream->stats;
+    shutdown_sprite_batch(batch);
+    init_sprite_batch(batch, capacity, frames_ahead, persistent);
+    batch->stream.stats = stats;
+}
+
+
+void begin_sprite_frame(SpriteBatch *batch)
+{
+    begin_stream_frame(&batch->stream);
+    start_sprite_run(batch);
+}
+
+
+void end_sprite_frame(SpriteBatch *batch)
+{
+    end_stream_frame(&batch->stream);
+}
+
+
+void begin_sprite_batch(SpriteBatch *batch)
+{
+    start_sprite_run(batch);
+    batch->texture = 0;
+}
+
+
+void push_sprite(SpriteBatch *batch, GLuint texture, SpriteInstance *instance)
+{
+    if (batch->count > 0 && (texture != batch->texture || batch->count == batch->capacity)) {
+        flush_sprite_batch(batch, texture != batch->texture ? SPRITE_BREAK_TEXTURE : SPRITE_BREAK_FULL);
+    }
+
+    if (batch->count == batch->capacity) {
+        drop_sprites(batch, 1);
+        return;
+    }
+
+    batch->texture = texture;
+    batch->instances[batch->count++] = *instance;
+}
+
+
+SpriteInstance *reserve_sprites(SpriteBatch *batch, GLuint texture, int count, int *reserved)
+{
+    if (batch->count > 0 && (texture != batch->texture || batch->count == batch->capacity)) {
+        flush_sprite_batch(batch, texture != batch->texture ? SPRITE_BREAK_TEXTURE : SPRITE_BREAK_FULL);
+    }
+
+    int available = batch->capacity - batch->count;
+    *reserved = count < available ? count : available;
+    if (*reserved == 0) {
+        drop_sprites(batch, count);
+    }
+
+    SpriteInstance *instances = &batch->instances[batch->count];
+    batch->texture = texture;
+    batch->count += *reserved;
+
+    return instances;
+}
+
+
+SpriteInstance make_sprite_instance(glm::mat4 *model, glm::vec4 uv_rect, glm::vec4 color, int flags)
+{
+    // sprites are flat quads, so the 2x2 part of the model and its
+    // translation are all the vertex shader needs
+    SpriteInstance instance;
+    instance.basis = glm::vec4((*model)[0].x, (*model)[0].y, (*model)[1].x, (*model)[1].y);
+    instance.position = glm::vec4((*model)[3].x, (*model)[3].y, (*model)[3].z, (float)flags);
+    instance.uv_rect = uv_rect;
+    instance.color = color;
+
+    return instance;
+}
+
+
+void push_sprite(SpriteBatch *batch, GLuint texture, glm::mat4 *model, glm::vec4 uv_rect, glm::vec4 color, int flags)
+{
+    SpriteInstance instance = make_sprite_instance(model, uv_rect, color, flags);
+    push_sprite(batch, texture, &instance);
+}
+
+
+void push_sprite_quad(SpriteBatch *batch, GLuint texture, glm::vec3 center, glm::vec2 size, glm::vec4 uv_rect, glm::vec4 color, int flags)
+{
+    SpriteInstance instance;
+    instance.basis = glm::vec4(size.x, 0.f, 0.f, size.y);
+    instance.position = glm::vec4(center, (float)flags);
+    instance.uv_rect = uv_rect;
+    instance.color = color;
+
+    push_sprite(batch, texture, &instance);
+}
+
+
+void push_animated_sprite(SpriteBatch *batch, GLuint texture, glm::mat4 *model, int clip, float start_time_s, float speed, glm::vec4 color)
+{
+    glm::vec4 animation = glm::vec4((float)clip, start_time_s, speed, 0.f);
+    push_sprite(batch, texture, model, animation, color, SPRITE_FLAG_ANIMATED);
+}
+
+
+// the run is still writable, its sprites take the tint in place of their colour
+static void tint_sprite_run(SpriteBatch *batch, SPRITE_BATCH_BREAK reason)
+{
+    glm::vec4 tint = SPRITE_BATCH_TINTS[batch->draw_calls % SDL_arraysize(SPRITE_BATCH_TINTS)];
+    for (int i = 0; i < batch->count; ++i) {
+        batch->instances[i].color = tint;
+    }
+
+    if (batch->break_count < SPRITE_BATCH_MAX_BREAKS) {
+        SpriteBatchBreak *batch_break = &batch->breaks[batch->break_count++];
+        batch_break->reason = reason;
+        batch_break->sprites = batch->count;
+        batch_break->texture = batch->texture;
+        batch_break->tint = tint;
+    }
+}
+
+
+void flush_sprite_batch(SpriteBatch *batch, SPRITE_BATCH_BREAK reason)
+{
+    if (batch->count == 0) {
+        return;
+    }
+
+    if (batch->debug == RENDER_DEBUG_BATCHES) {
+        tint_sprite_run(batch, reason);
+    }
+
+    int drawn = batch->count;
+
+    glBindVertexArray(batch->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->stream.buffer);
+
+    // already in place, the stream only has to say where
+    int offset = commit_stream(&batch->stream, drawn*(int)sizeof(SpriteInstance));
+    point_sprite_instances(batch, offset);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, batch->texture);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, drawn);
+
+    batch->draw_calls += 1;
+    batch->sprites += drawn;
+    start_sprite_run(batch);
+}
+
+
+void end_sprite_batch(SpriteBatch *batch)
+{
+    flush_sprite_batch(batch, SPRITE_BREAK_END);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+const char *get_sprite_break_name(SPRITE_BATCH_BREAK reason)
+{
+    switch(reason) {
+        case SPRITE_BREAK_END:     return "END";
+        case SPRITE_BREAK_TEXTURE: return "TEXTURE";
+        case SPRITE_BREAK_FULL:    return "FULL";
+        case SPRITE_BREAK_LAYER:   return "LAYER";
+        case SPRITE_BREAK_SHADER:  return "SHADER";
+        case SPRITE_BREAK_BLEND:   return "BLEND";
+    }
+
+    return "?";
+}
+
+
+Uint64 make_render_key(RENDER_LAYER layer, float depth, RENDER_BLEND blend, int shader, GLuint texture)
+{
+    // flipping the float's bits makes them sort like the float, the top 24 bits keep the order
+    Uint32 depth_bits;
+    memcpy(&depth_bits, &depth, sizeof(depth_bits));
+    depth_bits = (depth_bits & 0x80000000u) ? ~depth_bits : (depth_bits | 0x80000000u);
+
+    Uint32 pass = RENDER_PASS_BLENDED;
+    Uint32 layer_bits = layer & 0xf;
+
+    // cutouts go front to back, nearest layer first
+    if (blend == RENDER_BLEND_CUTOUT) {
+        pass = RENDER_PASS_CUTOUT;
+        layer_bits = ~layer_bits & 0xf;
+        depth_bits = ~depth_bits;
+    }
+
+    return ((Uint64)pass << RENDER_KEY_PASS_SHIFT) |
+           ((Uint64)layer_bits << RENDER_KEY_LAYER_SHIFT) |
+           ((Uint64)(depth_bits >> 8) << RENDER_KEY_DEPTH_SHIFT) |
+           ((Uint64)(blend & 0x7) << RENDER_KEY_BLEND_SHIFT) |
+           ((Uint64)(shader & 0xff) << RENDER_KEY_SHADER_SHIFT) |
+           (Uint64)(texture & 0xffffff);
+}
+
+
+void init_render_queue(RenderQueue *queue, int capacity)
+{
+    if (queue == nullptr) {
+        LOG_ERROR(LOG_RENDER, "render queue is null");
+        exit(1);
+    }
+
+    memset(queue, 0, sizeof(RenderQueue));
+    queue->capacity = capacity;
+    queue->commands = (SpriteInstance *)tracked_malloc(capacity*sizeof(SpriteInstance));
+    queue->entries = (RenderSortEntry *)tracked_malloc(capacity*sizeof(RenderSortEntry));
+    queue->scratch = (RenderSortEntry *)tracked_malloc(capacity*sizeof(RenderSortEntry));
+}
+
+
+void free_render_queue(RenderQueue *queue)
+{
+    free(queue->commands);
+    free(queue->entries);
+    free(queue->scratch);
+    memset(queue, 0, sizeof(RenderQueue));
+}
+
+
+void begin_render_queue(RenderQueue *queue)
+{
+    queue->count = 0;
+    queue->animated_layers = 0;
+
+    for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+        queue->layer_counts[layer] = 0;
+        queue->layer_hashes[layer] = 2166136261u;
+    }
+}
+
+
+void submit_sprite(RenderQueue *queue, Uint64 key, SpriteInstance *instance)
+{
+    // the queue can't be flushed early without breaking the ordering
+    if (queue->count == queue->capacity) {
+        LOG_WARN(LOG_RENDER, "Render queue is full, dropping sprites past %d", queue->capacity);
+        return;
+    }
+
+    int index = queue->count++;
+    queue->commands[index] = *instance;
+    queue->entries[index].key = key;
+    queue->entries[index].command = (Uint32)index;
+
+    // the key and the instance are everything that ends up on screen
+    int layer = (int)((key >> RENDER_KEY_LAYER_SHIFT) & 0xf);
+    if ((key >> RENDER_KEY_PASS_SHIFT) == RENDER_PASS_CUTOUT) {
+        layer = ~layer & 0xf;
+    }
+
+    if (layer < RENDER_LAYER_COUNT && (queue->retained_layers & (1u << layer))) {
+        Uint32 hash = queue->layer_hashes[layer];
+        const unsigned char *bytes[2] = { (const unsigned char *)&key, (const unsigned char *)instance };
+        int sizes[2] = { (int)sizeof(key), (int)sizeof(SpriteInstance) };
+
+        // FNV-1a, like hash_scene_state
+        for (int b = 0; b < 2; ++b) {
+            for (int i = 0; i < sizes[b]; ++i) {
+                hash ^= bytes[b][i];
+                hash *= 16777619u;
+            }
+        }
+
+        queue->layer_hashes[layer] = hash;
+        queue->layer_counts[layer] += 1;
+        if ((int)instance->position.w & SPRITE_FLAG_ANIMATED) {
+            queue->animated_layers |= 1u << layer;
+        }
+    }
+}
+
+
+// Stable, so sprites with equal keys keep their submission order
+void sort_render_queue(RenderQueue *queue)
+{
+    RenderSortEntry *source = queue->entries;
+    RenderSortEntry *target = queue->scratch;
+    int count = queue->count;
+
+    // all eight byte histograms come out of a single pass over the keys
+    Uint32 histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+
+    for (int i = 0; i < count; ++i) {
+        Uint64 key = source[i].key;
+        for (int digit = 0; digit < 8; ++digit) {
+            histograms[digit][(key >> (digit*8)) & 0xff] += 1;
+        }
+    }
+
+    for (int digit = 0; digit < 8; ++digit) {
+        Uint32 *histogram = histograms[digit];
+        int shift = digit*8;
+
+        // every key has the same byte here, this pass wouldn't move anything
+        if (count == 0 || histogram[(source[0].key >> shift) & 0xff] == (Uint32)count) {
+            continue;
+        }
+
+        Uint32 offset = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            Uint32 bucket_count = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucket_count;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            target[histogram[(source[i].key >> shift) & 0xff]++] = source[i];
+        }
+
+        RenderSortEntry *sorted = target;
+        target = source;
+        source = sorted;
+    }
+
+    queue->sorted = source;
+    memset(queue->pass_layer_counts, 0, sizeof(queue->pass_layer_counts));
+
+    for (int i = 0; i < count; ++i) {
+        int pass = (int)(source[i].key >> RENDER_KEY_PASS_SHIFT);
+        int layer = (int)((source[i].key >> RENDER_KEY_LAYER_SHIFT) & 0xf);
+        if (pass == RENDER_PASS_CUTOUT) {
+            layer = ~layer & 0xf;
+        }
+        queue->pass_layer_counts[pass][layer % RENDER_LAYER_COUNT] += 1;
+    }
+}
+
+
+// alpha blends on its own so a retained layer's texture comes out
+// premultiplied, the screen's target never reads it
+static void use_render_blend(RENDER_BLEND blend)
+{
+    switch(blend) {
+        case RENDER_BLEND_ALPHA:         glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA); break;
+        case RENDER_BLEND_ADDITIVE:      glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ZERO, GL_ONE); break;
+        case RENDER_BLEND_CUTOUT:        break;
+        case RENDER_BLEND_PREMULTIPLIED: glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); break;
+    }
+}
+
+
+void use_render_layer_depth(RENDER_LAYER layer)
+{
+    double slice = 1.0/RENDER_LAYER_COUNT;
+    double far_depth = 1.0 - (int)layer*slice;
+    glDepthRange(far_depth - slice, far_depth);
+}
+
+
+void draw_render_queue(RenderQueue *queue, RENDER_PASS pass, SpriteBatch *batch, RenderUseShaderFunc use_shader, void *user_data,
+                       Uint32 layers)
+{
+    RenderSortEntry *sorted = queue->sorted;
+    int (*layer_counts)[RENDER_LAYER_COUNT] = queue->pass_layer_counts;
+
+    // the blended runs come after all of the cutout ones
+    int first = 0;
+    int drawn = 0;
+    for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+        if (pass == RENDER_PASS_BLENDED) {
+            first += layer_counts[RENDER_PASS_CUTOUT][layer];
+        }
+        if (layers & (1u << layer)) {
+            drawn += layer_counts[pass][layer];
+        }
+    }
+
+    if (drawn == 0) {
+        return;
+    }
+
+    // the overdraw count keeps blending, whatever the pass
+    bool overdraw = batch->debug == RENDER_DEBUG_OVERDRAW;
+
+    // opaque texels only, nothing to blend and the depth they leave is exact
+    if (pass == RENDER_PASS_CUTOUT) {
+        if (!overdraw) {
+            glDisable(GL_BLEND);
+        }
+        glDepthMask(GL_TRUE);
+    }
+    else {
+        glDepthMask(GL_FALSE);
+    }
+
+    int shader = -1;
+    int blend = -1;
+
+    begin_sprite_batch(batch);
+
+    // cutout runs go nearest layer first, blended ones furthest first
+    for (int step = 0; step < RENDER_LAYER_COUNT; ++step) {
+        int layer = pass == RENDER_PASS_CUTOUT ? RENDER_LAYER_COUNT - 1 - step : step;
+        int count = layer_counts[pass][layer];
+
+        if (count == 0 || !(layers & (1u << layer))) {
+            first += count;
+            continue;
+        }
+
+        // the batch already breaks on texture changes, anything else has to flush here
+        flush_sprite_batch(batch, SPRITE_BREAK_LAYER);
+        use_render_layer_depth((RENDER_LAYER)layer);
+        queue->state_changes += 1;
+
+        for (int i = first; i < first + count; ++i) {
+            Uint64 key = sorted[i].key;
+            int key_shader = (int)((key >> RENDER_KEY_SHADER_SHIFT) & 0xff);
+            int key_blend = (int)((key >> RENDER_KEY_BLEND_SHIFT) & 0x7);
+
+            if (key_shader != shader) {
+                flush_sprite_batch(batch, SPRITE_BREAK_SHADER);
+                use_shader(key_shader, user_data);
+                shader = key_shader;
+                queue->state_changes += 1;
+            }
+
+            if (key_blend != blend && !overdraw) {
+                flush_sprite_batch(batch, SPRITE_BREAK_BLEND);
+                use_render_blend((RENDER_BLEND)key_blend);
+                blend = key_blend;
+                queue->state_changes += 1;
+            }
+
+            push_sprite(batch, (GLuint)(key & 0xffffff), &queue->commands[sorted[i].command]);
+        }
+
+        first += count;
+    }
+
+    end_sprite_batch(batch);
+
+    // everything else in the frame expects the default blend, and a clear needs depth writes
+    glEnable(GL_BLEND);
+    if (blend != RENDER_BLEND_ALPHA && blend != -1) {
+        use_render_blend(RENDER_BLEND_ALPHA);
+    }
+    glDepthMask(GL_TRUE);
+    glDepthRange(0.0, 1.0);
+}
+
+
+bool update_retained_layer(RetainedLayer *retained, RenderQueue *queue, RENDER_LAYER layer, int debug)
+{
+    Uint32 hash = queue->layer_hashes[layer];
+    bool animated = (queue->animated_layers & (1u << layer)) != 0;
+
+    retained->frames += 1;
+    if (retained->valid && retained->hash == hash && retained->debug == debug && !animated) {
+        return true;
+    }
+
+    retained->valid = true;
+    retained->hash = hash;
+    retained->debug = debug;
+    retained->redraws += 1;
+
+    return false;
+}
+
+
+void draw_retained_layer(RetainedLayer *retained, SpriteBatch *batch, RENDER_LAYER layer, glm::vec2 screen_size)
+{
+    // at the back of its slice, whatever higher layers left in the depth buffer stays in front
+    glm::vec3 center = glm::vec3(screen_size*0.5f, -99.f);
+
+    use_render_layer_depth(layer);
+    glDepthMask(GL_FALSE);
+    if (batch->debug != RENDER_DEBUG_OVERDRAW) {
+        use_render_blend(RENDER_BLEND_PREMULTIPLIED);
+    }
+
+    begin_sprite_batch(batch);
+    push_sprite_quad(batch, retained->frame.gl_texture_id, center, screen_size, glm::vec4(0.f, 0.f, 1.f, 1.f), glm::vec4(1.f), SPRITE_FLAG_PREMULTIPLIED);
+    end_sprite_batch(batch);
+
+    if (batch->debug != RENDER_DEBUG_OVERDRAW) {
+        use_render_blend(RENDER_BLEND_ALPHA);
+    }
+    glDepthMask(GL_TRUE);
+    glDepthRange(0.0, 1.0);
+}
+
+
+void init_background(Background *background)
+{
+    if (background == nullptr) {
+        LOG_ERROR(LOG_RENDER, "background is null");
+        exit(1);
+    }
+
+    memset(background, 0, sizeof(Background));
+}
+
+
+void shutdown_background(Background *background)
+{
+    // the layer textures belong to whoever loaded them
+    background->layer_count = 0;
+}
+
+
+bool add_background_layer(Background *background, GLuint texture, glm::vec2 tile_size, glm::vec2 velocity, float opacity, RENDER_BLEND blend)
+{
+    if (background->layer_count >= BACKGROUND_MAX_LAYERS) {
+        LOG_ERROR(LOG_RENDER, "Backgrounds have at most %d layers", BACKGROUND_MAX_LAYERS);
+        return false;
+    }
+
+    BackgroundLayer *layer = &background->layers[background->layer_count++];
+    layer->texture = texture;
+    layer->tile_size = tile_size;
+    layer->velocity = velocity;
+    layer->offset = glm::vec2(0.f);
+    layer->opacity = opacity;
+    layer->blend = blend;
+
+    // textures are created with the default GL_REPEAT wrap, set it anyway in case that changes
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return true;
+}
+
+
+void draw_background(Background *background, GLuint program, float time_s)
+{
+    if (background->layer_count == 0) {
+        return;
+    }
+
+    if (background->program != program) {
+        background->program = program;
+        background->scroll_location = glGetUniformLocation(program, "layer_scroll");
+        background->tiles_location = glGetUniformLocation(program, "layer_tiles");
+        background->textures_location = glGetUniformLocation(program, "layer_textures");
+        background->layer_count_location = glGetUniformLocation(program, "layer_count");
+        background->time_location = glGetUniformLocation(program, "time");
+    }
+
+    glm::vec4 scroll[BACKGROUND_MAX_LAYERS];
+    glm::vec4 tiles[BACKGROUND_MAX_LAYERS];
+    GLint texture_units[BACKGROUND_MAX_LAYERS];
+
+    for (int i = 0; i < BACKGROUND_MAX_LAYERS; ++i) {
+        texture_units[i] = i;
+
+        if (i < background->layer_count) {
+            BackgroundLayer *layer = &background->layers[i];
+            scroll[i] = glm::vec4(layer->velocity, layer->offset);
+            tiles[i] = glm::vec4(layer->tile_size, layer->opacity, (float)layer->blend);
+
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, layer->texture);
+        }
+        else {
+            scroll[i] = glm::vec4(0.f);
+            tiles[i] = glm::vec4(1.f, 1.f, 0.f, 0.f);
+        }
+    }
+
+    glUniform4fv(background->scroll_location, BACKGROUND_MAX_LAYERS, (GLfloat *)scroll);
+    glUniform4fv(background->tiles_location, BACKGROUND_MAX_LAYERS, (GLfloat *)tiles);
+    glUniform1iv(background->textures_location, BACKGROUND_MAX_LAYERS, texture_units);
+    glUniform1i(background->layer_count_location, background->layer_count);
+    glUniform1f(background->time_location, time_s);
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    for (int i = background->layer_count - 1; i >= 0; --i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
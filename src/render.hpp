@@ -0,0 +1,267 @@
+#pragma once
+
+#include "types.h"
+#include "stream.hpp"
+
+// Every sprite in a pass goes into one instance buffer and is drawn with
+// glDrawArraysInstanced, the batch only breaks when the texture changes.
+// Instances are written straight into a stream buffer, so its capacity is how
+// many a whole frame can draw, every pass together. The caller sizes it for
+// everything a frame can hold, past that sprites are dropped with a warning.
+// RESERVE is the room past the queue and the projectiles, for what is drawn
+// outside them: the HUD, the debug legend and retained layers' quads.
+#define SPRITE_BATCH_RESERVE 4096
+
+// matches the flag bits read by sprite.fs.glsl
+#define SPRITE_FLAG_SDF 0x1
+#define SPRITE_FLAG_ANIMATED 0x2
+#define SPRITE_FLAG_CUTOUT 0x4
+#define SPRITE_FLAG_PREMULTIPLIED 0x8
+
+struct SpriteInstance {
+    glm::vec4 basis;     // model x axis in .xy, model y axis in .zw
+    glm::vec4 position;  // translation in .xyz, SPRITE_FLAG bits in .w
+    glm::vec4 uv_rect;   // uv offset in .xy, uv size in .zw, or with SPRITE_FLAG_ANIMATED
+                         // the clip in .x, start time in .y and speed in .z
+    glm::vec4 color;
+};
+
+// Key layout, most significant first, so sorting the keys sorts by pass,
+// then layer, then depth, then groups draws that share state:
+//   63 pass | 62..59 layer | 58..35 depth | 34..32 blend | 31..24 shader | 23..0 texture
+//
+// The cutout pass comes first and writes depth. Its layer and depth bits are
+// flipped so it runs front to back, nearest layer first, and whatever ends
+// up behind is rejected by the depth test before it is shaded. The blended
+// pass goes back to front over it, testing depth without writing it. Every
+// layer draws into a slice of the depth range of its own, a higher layer is
+// always nearer, so the depth test keeps the layers in order.
+#define RENDER_QUEUE_CAPACITY 16384
+#define RENDER_KEY_PASS_SHIFT 63
+#define RENDER_KEY_LAYER_SHIFT 59
+#define RENDER_KEY_DEPTH_SHIFT 35
+#define RENDER_KEY_BLEND_SHIFT 32
+#define RENDER_KEY_SHADER_SHIFT 24
+#define RENDER_LAYER_COUNT 4
+#define RENDER_ALL_LAYERS 0xf
+
+enum RENDER_LAYER {
+    RENDER_LAYER_BACKGROUND,
+    RENDER_LAYER_WORLD,
+    RENDER_LAYER_EFFECTS,
+    RENDER_LAYER_OVERLAY
+};
+
+// CUTOUT doesn't blend, sprite.fs.glsl drops texels under half alpha and
+// keeps the rest opaque. PREMULTIPLIED is for textures drawn by the blends
+// above, retained layers. Background layers only take ALPHA or ADDITIVE.
+enum RENDER_BLEND {
+    RENDER_BLEND_ALPHA,
+    RENDER_BLEND_ADDITIVE,
+    RENDER_BLEND_CUTOUT,
+    RENDER_BLEND_PREMULTIPLIED
+};
+
+enum RENDER_PASS {
+    RENDER_PASS_CUTOUT,
+    RENDER_PASS_BLENDED
+};
+
+// Debug views, drawn instead of the normal picture. OVERDRAW counts the
+// fragments that were shaded per pixel, the frame blit colours the count in.
+// BATCHES tints every draw call's sprites a colour of its own and records
+// why each one ended, so the caller can label them.
+enum RENDER_DEBUG {
+    RENDER_DEBUG_OFF,
+    RENDER_DEBUG_OVERDRAW,
+    RENDER_DEBUG_BATCHES,
+    RENDER_DEBUG_COUNT
+};
+
+// what ended a draw call, END is the end of the pass
+enum SPRITE_BATCH_BREAK {
+    SPRITE_BREAK_END,
+    SPRITE_BREAK_TEXTURE,
+    SPRITE_BREAK_FULL,
+    SPRITE_BREAK_LAYER,
+    SPRITE_BREAK_SHADER,
+    SPRITE_BREAK_BLEND
+};
+
+// BATCHES records this many draw calls a frame, later ones are only tinted
+#define SPRITE_BATCH_MAX_BREAKS 64
+
+// with OVERDRAW every shaded fragment adds one to the red channel
+#define OVERDRAW_STEP (1.f/255.f)
+
+struct SpriteBatchBreak {
+    SPRITE_BATCH_BREAK reason;
+    int sprites;
+    GLuint texture;
+    glm::vec4 tint;
+};
+
+// A layer that rarely changes, HUD panels, score frames, decorations, can be
+// retained: drawn into a Frame of its own and composited with a single
+// quad, in its place among the blended sprites. It is drawn again when the
+// hash of what was submitted to it differs from the one it was drawn with,
+// every frame while it has animated sprites.
+//
+// The texture comes out premultiplied, so additive sprites in the layer
+// still only add light once composited.
+struct RetainedLayer {
+    Frame frame;                // made by the caller, the size of the screen
+    bool valid;
+    Uint32 hash;
+    int debug;                  // RENDER_DEBUG it was drawn with
+
+    // since the start
+    int frames;
+    int redraws;
+};
+
+// Parallax backgrounds: every layer is a repeating texture scrolled in the
+// fragment shader, and all of them composite in one fullscreen triangle
+// ahead of the sprites, whatever the screen size.
+#define BACKGROUND_MAX_LAYERS 4
+
+struct SpriteBatch {
+    GLuint vao;
+    StreamBuffer stream;
+
+    // the run being built, at the stream's cursor. capacity is whatever
+    // is left of the frame's region, past it sprites are dropped
+    SpriteInstance *instances;
+    int count;
+    int capacity;
+    GLuint texture;
+
+    // running totals, the caller reads and clears them
+    int draw_calls;
+    int sprites;
+
+    // RENDER_DEBUG, set by the caller for the frame. the breaks pile up
+    // with BATCHES on until the caller clears break_count
+    int debug;
+    int break_count;
+    SpriteBatchBreak breaks[SPRITE_BATCH_MAX_BREAKS];
+};
+
+struct RenderSortEntry {
+    Uint64 key;
+    Uint32 command;
+};
+
+// shader ids come from the key, the caller binds the shader and its pass uniforms
+typedef void (*RenderUseShaderFunc)(int shader, void *user_data);
+
+struct RenderQueue {
+    int count;
+    int capacity;
+    SpriteInstance *commands;
+
+    // sorted by an LSD radix sort that ping-pongs between the two arrays
+    RenderSortEntry *entries;
+    RenderSortEntry *scratch;
+
+    // set by sort_render_queue, every pass and layer is a run in the sorted entries
+    RenderSortEntry *sorted;
+    int pass_layer_counts[2][RENDER_LAYER_COUNT];
+
+    // RENDER_LAYER bits, set by whoever fills the queue and kept by begin_render_queue.
+    // what is submitted to these is hashed, so a RetainedLayer can tell when it changed
+    Uint32 retained_layers;
+    Uint32 animated_layers;     // retained ones with an animated sprite, they change every frame
+    int layer_counts[RENDER_LAYER_COUNT];
+    Uint32 layer_hashes[RENDER_LAYER_COUNT];
+
+    // running total, the caller reads and clears it
+    int state_changes;
+};
+
+SpriteInstance make_sprite_instance(glm::mat4 *model, glm::vec4 uv_rect, glm::vec4 color = glm::vec4(1.f), int flags = 0);
+
+void init_sprite_batch(SpriteBatch *batch, int capacity, int frames_ahead = STREAM_DEFAULT_FRAMES_AHEAD, bool allow_persistent = true);
+void shutdown_sprite_batch(SpriteBatch *batch);
+// between frames, a new stream buffer when capacity doesn't fit the current one
+void grow_sprite_batch(SpriteBatch *batch, int capacity);
+
+// around everything a frame draws, the start waits when the GPU is too far behind
+void begin_sprite_frame(SpriteBatch *batch);
+void end_sprite_frame(SpriteBatch *batch);
+
+void begin_sprite_batch(SpriteBatch *batch);
+void push_sprite(SpriteBatch *batch, GLuint texture, SpriteInstance *instance);
+void push_sprite(SpriteBatch *batch, GLuint texture, glm::mat4 *model, glm::vec4 uv_rect, glm::vec4 color = glm::vec4(1.f), int flags = 0);
+// room for up to count instances in a row, fewer when the batch fills up and
+// none once the frame's region is full, the caller writes them
+SpriteInstance *reserve_sprites(SpriteBatch *batch, GLuint texture, int count, int *reserved);
+void push_sprite_quad(SpriteBatch *batch, GLuint texture, glm::vec3 center, glm::vec2 size, glm::vec4 uv_rect, glm::vec4 color = glm::vec4(1.f), int flags = 0);
+// the vertex shader picks the clip's frame, see animation.hpp
+void push_animated_sprite(SpriteBatch *batch, GLuint texture, glm::mat4 *model, int clip, float start_time_s, float speed = 1.f, glm::vec4 color = glm::vec4(1.f));
+// the reason only matters to RENDER_DEBUG_BATCHES
+void flush_sprite_batch(SpriteBatch *batch, SPRITE_BATCH_BREAK reason = SPRITE_BREAK_END);
+void end_sprite_batch(SpriteBatch *batch);
+
+const char *get_sprite_break_name(SPRITE_BATCH_BREAK reason);
+
+struct BackgroundLayer {
+    GLuint texture;
+    glm::vec2 tile_size;  // screen pixels one repeat of the texture covers
+    glm::vec2 velocity;   // pixels per second, slower layers read as further away
+    glm::vec2 offset;
+    float opacity;
+    RENDER_BLEND blend;
+};
+
+struct Background {
+    int layer_count;
+    BackgroundLayer layers[BACKGROUND_MAX_LAYERS];
+
+    // looked up again whenever a different program draws the background
+    GLuint program;
+    GLint scroll_location;
+    GLint tiles_location;
+    GLint textures_location;
+    GLint layer_count_location;
+    GLint time_location;
+};
+
+Uint64 make_render_key(RENDER_LAYER layer, float depth, RENDER_BLEND blend, int shader, GLuint texture);
+
+void init_render_queue(RenderQueue *queue, int capacity);
+void free_render_queue(RenderQueue *queue);
+void begin_render_queue(RenderQueue *queue);
+void submit_sprite(RenderQueue *queue, Uint64 key, SpriteInstance *instance);
+
+// once a frame, before drawing either pass
+void sort_render_queue(RenderQueue *queue);
+
+// Draws one pass through the batch, only breaking it when the state changes,
+// only the layers with their bit in layers. The depth test has to be on, the
+// cutout pass before the blended one. Leaves blending on, depth writes on
+// and the whole depth range. With the batch's RENDER_DEBUG_OVERDRAW both
+// passes blend with whatever the caller set.
+void draw_render_queue(RenderQueue *queue, RENDER_PASS pass, SpriteBatch *batch, RenderUseShaderFunc use_shader, void *user_data,
+                       Uint32 layers = RENDER_ALL_LAYERS);
+
+// Counts a frame for the layer. True when its texture still holds what the
+// queue has for it, otherwise the caller draws the layer into the frame,
+// cleared to transparent, and it counts as current from then on.
+bool update_retained_layer(RetainedLayer *retained, RenderQueue *queue, RENDER_LAYER layer, int debug);
+
+// the layer's texture over the whole screen, the sprite shader has to be bound
+void draw_retained_layer(RetainedLayer *retained, SpriteBatch *batch, RENDER_LAYER layer, glm::vec2 screen_size);
+
+// the slice of the depth range a layer draws into, for anything drawn outside the queue
+void use_render_layer_depth(RENDER_LAYER layer);
+
+// layers composite in the order they are added, the first one is furthest back
+void init_background(Background *background);
+void shutdown_background(Background *background);
+bool add_background_layer(Background *background, GLuint texture, glm::vec2 tile_size, glm::vec2 velocity,
+                          float opacity = 1.f, RENDER_BLEND blend = RENDER_BLEND_ALPHA);
+
+// The program and a vertex array have to be bound already, the background
+// only sets its uniforms. The triangle comes from gl_VertexID, any vao does.
+void draw_background(Background *background, GLuint program, float time_s);
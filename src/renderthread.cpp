@@ -0,0 +1,314 @@
+#include "renderthread.hpp"
+
+static void add_render_stats(RenderThreadStats *stats, RenderFrameStats *frame_stats, Uint64 draw_counter)
+{
+    stats->drawn += 1;
+    stats->draw_counter += draw_counter;
+    if (draw_counter > stats->max_draw_counter) {
+        stats->max_draw_counter = draw_counter;
+    }
+
+    stats->frames.sprites += frame_stats->sprites;
+    stats->frames.draw_calls += frame_stats->draw_calls;
+    stats->frames.state_changes += frame_stats->state_changes;
+    stats->frames.gpu_wait_counter += frame_stats->gpu_wait_counter;
+
+    for (int layer = 0; layer < RENDER_LAYER_COUNT; ++layer) {
+        stats->frames.retained_frames[layer] += frame_stats->retained_frames[layer];
+        stats->frames.retained_redraws[layer] += frame_stats->retained_redraws[layer];
+    }
+}
+
+
+static void draw_and_present(RenderThread *thread, RenderFrame *frame)
+{
+    Uint64 start_counter = SDL_GetPerformanceCounter();
+
+    RenderFrameStats frame_stats = {};
+    thread->draw(frame, &frame_stats, thread->user_data);
+    SDL_GL_SwapWindow(thread->window->sdl_window);
+
+    Uint64 draw_counter = SDL_GetPerformanceCounter() - start_counter;
+
+    SDL_LockMutex(thread->lock);
+    add_render_stats(&thread->recent, &frame_stats, draw_counter);
+    add_render_stats(&thread->total, &frame_stats, draw_counter);
+    SDL_UnlockMutex(thread->lock);
+}
+
+
+static int SDLCALL render_thread_main(void *userdata)
+{
+    RenderThread *thread = (RenderThread *)userdata;
+
+    ALLOC_SCOPE(ALLOC_RENDER);
+
+    if (SDL_GL_MakeCurrent(thread->window->sdl_window, thread->context) != 0) {
+        LOG_ERROR(LOG_RENDER, "Could not make the render context current: %s", SDL_GetError());
+        exit(1);
+    }
+
+    thread->start(thread->user_data);
+    SDL_SemPost(thread->started);
+
+    for (;;) {
+        SDL_SemWait(thread->published);
+
+        if (SDL_AtomicGet(&thread->quit)) {
+            break;
+        }
+
+        SDL_LockMutex(thread->lock);
+        int index = thread->ready;
+        if (index >= 0) {
+            thread->drawing = index;
+            thread->ready = -1;
+        }
+        SDL_UnlockMutex(thread->lock);
+
+        // the posts of frames that were replaced find nothing
+        if (index < 0) {
+            continue;
+        }
+
+        RenderFrame *frame = &thread->frames[index];
+
+        // on the GPU, the CPU goes straight on to submitting
+        glWaitSync(frame->uploads, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(frame->uploads);
+        frame->uploads = nullptr;
+
+        draw_and_present(thread, frame);
+
+        SDL_LockMutex(thread->lock);
+        thread->drawing = -1;
+        SDL_UnlockMutex(thread->lock);
+    }
+
+    thread->stop(thread->user_data);
+    SDL_GL_MakeCurrent(thread->window->sdl_window, nullptr);
+
+    return 0;
+}
+
+
+void init_render_thread(RenderThread *thread, Window *window, bool threaded, int queue_capacity, int projectile_capacity,
+                        RenderThreadFunc start, RenderFrameFunc draw, RenderThreadFunc stop, void *user_data)
+{
+    if (thread == nullptr) {
+        LOG_ERROR(LOG_RENDER, "render thread is null");
+        exit(1);
+    }
+
+    memset(thread, 0, sizeof(RenderThread));
+    thread->window = window;
+    thread->start = start;
+    thread->draw = draw;
+    thread->stop = stop;
+    thread->user_data = user_data;
+
+    thread->lock = SDL_CreateMutex();
+    thread->published = SDL_CreateSemaphore(0);
+    thread->started = SDL_CreateSemaphore(0);
+
+    if (thread->lock == nullptr || thread->published == nullptr || thread->started == nullptr) {
+        LOG_ERROR(LOG_RENDER, "Could not create the render thread's locks: %s", SDL_GetError());
+        exit(1);
+    }
+
+    for (int i = 0; i < RENDER_THREAD_FRAMES; ++i) {
+        init_render_queue(&thread->frames[i].queue, queue_capacity);
+        init_projectile_draw_list(&thread->frames[i].projectiles, projectile_capacity);
+    }
+
+    thread->writing = 0;
+    thread->ready = -1;
+    thread->drawing = -1;
+
+    if (threaded) {
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+        thread->context = SDL_GL_CreateContext(window->sdl_window);
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+        // creating it made it current here, the render thread takes it over
+        SDL_GL_MakeCurrent(window->sdl_window, window->context);
+
+        if (thread->context == nullptr) {
+            LOG_WARN(LOG_RENDER, "Could not create a shared GL context, drawing on the main thread: %s", SDL_GetError());
+        }
+        else {
+            thread->thread = SDL_CreateThread(render_thread_main, "render", thread);
+
+            if (thread->thread == nullptr) {
+                LOG_WARN(LOG_RENDER, "Could not start the render thread, drawing on the main thread: %s", SDL_GetError());
+                SDL_GL_DeleteContext(thread->context);
+                thread->context = nullptr;
+            }
+            else {
+                SDL_SemWait(thread->started);
+            }
+        }
+    }
+
+    if (thread->thread == nullptr) {
+        thread->start(user_data);
+    }
+
+    LOG_INFO(LOG_RENDER, "Drawing on %s, %d frames in turn", thread->thread ? "a render thread" : "the main thread",
+             thread->thread ? RENDER_THREAD_FRAMES : 1);
+}
+
+
+void shutdown_render_thread(RenderThread *thread)
+{
+    if (thread->thread) {
+        SDL_AtomicSet(&thread->quit, 1);
+        SDL_SemPost(thread->published);
+        SDL_WaitThread(thread->thread, nullptr);
+        SDL_GL_DeleteContext(thread->context);
+    }
+    else {
+        thread->stop(thread->user_data);
+    }
+
+    RenderThreadStats *stats = &thread->total;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    LOG_INFO(LOG_RENDER, "Render thread: %d frames published, %d drawn, %d replaced first, %.3fms avg to draw and present, %.3fms max",
+             stats->published, stats->drawn, stats->replaced,
+             stats->drawn > 0 ? stats->draw_counter*1000.0/frequency/stats->drawn : 0.0,
+             stats->max_draw_counter*1000.0/frequency);
+
+    // syncs are shared, the main context can delete the ones nobody waited on
+    for (int i = 0; i < RENDER_THREAD_FRAMES; ++i) {
+        RenderFrame *frame = &thread->frames[i];
+        if (frame->uploads) {
+            glDeleteSync(frame->uploads);
+        }
+
+        free_render_queue(&frame->queue);
+        free_projectile_draw_list(&frame->projectiles);
+    }
+
+    SDL_DestroySemaphore(thread->started);
+    SDL_DestroySemaphore(thread->published);
+    SDL_DestroyMutex(thread->lock);
+
+    memset(thread, 0, sizeof(RenderThread));
+}
+
+
+RenderFrame *begin_render_frame(RenderThread *thread)
+{
+    RenderFrame *frame = &thread->frames[thread->writing];
+
+    // a replaced frame was never waited on
+    if (frame->uploads) {
+        glDeleteSync(frame->uploads);
+        frame->uploads = nullptr;
+    }
+
+    frame->time_s = 0.f;
+    frame->debug = RENDER_DEBUG_OFF;
+    frame->background_layer_count = 0;
+    frame->hud_text[0] = '\0';
+
+    begin_render_queue(&frame->queue);
+    for (int type = 0; type < PROJECTILE_TYPE_COUNT; ++type) {
+        frame->projectiles.pools[type].count = 0;
+    }
+
+    return frame;
+}
+
+
+void publish_render_frame(RenderThread *thread)
+{
+    RenderFrame *frame = &thread->frames[thread->writing];
+
+    if (thread->thread == nullptr) {
+        SDL_LockMutex(thread->lock);
+        thread->recent.published += 1;
+        thread->total.published += 1;
+        SDL_UnlockMutex(thread->lock);
+
+        draw_and_present(thread, frame);
+        return;
+    }
+
+    // another context can only wait on a fence that has been flushed
+    frame->uploads = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    SDL_LockMutex(thread->lock);
+
+    if (thread->ready >= 0) {
+        thread->recent.replaced += 1;
+        thread->total.replaced += 1;
+    }
+
+    thread->ready = thread->writing;
+    for (int i = 0; i < RENDER_THREAD_FRAMES; ++i) {
+        if (i != thread->ready && i != thread->drawing) {
+            thread->writing = i;
+            break;
+        }
+    }
+
+    thread->recent.published += 1;
+    thread->total.published += 1;
+
+    SDL_UnlockMutex(thread->lock);
+    SDL_SemPost(thread->published);
+}
+
+
+void wait_render_thread(RenderThread *thread)
+{
+    if (thread->thread == nullptr) {
+        return;
+    }
+
+    for (;;) {
+        SDL_LockMutex(thread->lock);
+        bool idle = thread->ready < 0 && thread->drawing < 0;
+        SDL_UnlockMutex(thread->lock);
+
+        if (idle) {
+            return;
+        }
+        SDL_Delay(1);
+    }
+}
+
+
+void reserve_render_frame_projectiles(RenderThread *thread, int capacity)
+{
+    bool grow = false;
+    for (int i = 0; i < RENDER_THREAD_FRAMES; ++i) {
+        grow = grow || thread->frames[i].projectiles.capacity < capacity;
+    }
+    if (!grow) {
+        return;
+    }
+
+    // published frames still read their lists
+    wait_render_thread(thread);
+
+    LOG_INFO(LOG_RENDER, "Projectile draw lists grow from %d to %d shots", thread->frames[0].projectiles.capacity, capacity);
+    for (int i = 0; i < RENDER_THREAD_FRAMES; ++i) {
+        ProjectileDrawList *list = &thread->frames[i].projectiles;
+        if (list->capacity < capacity) {
+            free_projectile_draw_list(list);
+            init_projectile_draw_list(list, capacity);
+        }
+    }
+}
+
+
+void take_render_stats(RenderThread *thread, RenderThreadStats *stats)
+{
+    SDL_LockMutex(thread->lock);
+    *stats = thread->recent;
+    memset(&thread->recent, 0, sizeof(RenderThreadStats));
+    SDL_UnlockMutex(thread->lock);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "types.h"
+#include "render.hpp"
+#include "projectiles.hpp"
+
+// GL on a thread of its own. Once a frame the game thread copies what
+// drawing needs into a RenderFrame: the sprites already keyed for the render
+// queue, the live projectiles, the background layers and the HUD text. The
+// render thread sorts, batches, submits and presents it while the game
+// thread goes on with the next ticks, so a frame costs the slower of the two
+// instead of both added up.
+//
+// Three frames take turns: the game thread fills one, the newest published
+// one waits, and the render thread draws the one it took. Neither side waits
+// for the other, a frame the render thread didn't get to is replaced by the
+// next one.
+//
+// The render thread has a context of its own, sharing textures, buffers and
+// programs with the main one, where loading still happens. Vertex arrays and
+// framebuffers don't carry over between contexts, so the render side makes
+// its own in the start callback. Every frame carries a fence from the main
+// context, the render thread waits on it before drawing, so an upload is
+// always complete by the time a frame can use it.
+//
+// Without the thread the same callbacks run in line on the main thread.
+#define RENDER_THREAD_FRAMES 3
+#define RENDER_FRAME_TEXT_LENGTH 192
+
+struct RenderFrame {
+    float time_s;               // the scene's clock, animations and the background scroll on it
+    int debug;                  // RENDER_DEBUG to draw the frame with
+
+    int background_layer_count;
+    BackgroundLayer background_layers[BACKGROUND_MAX_LAYERS];
+
+    RenderQueue queue;          // submitted in any order, sorted on the render thread
+    ProjectileDrawList projectiles;
+
+    char hud_text[RENDER_FRAME_TEXT_LENGTH];
+
+    GLsync uploads;             // after everything the main context did before publishing
+};
+
+// filled in by the draw callback
+struct RenderFrameStats {
+    int sprites;
+    int draw_calls;
+    int state_changes;
+    Uint64 gpu_wait_counter;
+
+    // per RENDER_LAYER, frames it was retained in and how many of them drew it again
+    int retained_frames[RENDER_LAYER_COUNT];
+    int retained_redraws[RENDER_LAYER_COUNT];
+};
+
+struct RenderThreadStats {
+    int published;
+    int drawn;
+    int replaced;               // published, then replaced before it was drawn
+    Uint64 draw_counter;        // from taking a frame to presenting it
+    Uint64 max_draw_counter;
+    RenderFrameStats frames;    // added up over the drawn ones
+};
+
+typedef void (*RenderThreadFunc)(void *user_data);
+typedef void (*RenderFrameFunc)(RenderFrame *frame, RenderFrameStats *stats, void *user_data);
+
+struct RenderThread {
+    Window *window;
+    SDL_GLContext context;      // the render thread's, null when drawing in line
+    SDL_Thread *thread;
+
+    RenderThreadFunc start;
+    RenderFrameFunc draw;
+    RenderThreadFunc stop;
+    void *user_data;
+
+    SDL_mutex *lock;
+    SDL_sem *published;         // a post per published frame, the thread sleeps on it
+    SDL_sem *started;
+    SDL_atomic_t quit;
+
+    RenderFrame frames[RENDER_THREAD_FRAMES];
+
+    // which frame is whose, changed under the lock
+    int writing;                // the game thread's
+    int ready;                  // the newest published, -1 once taken
+    int drawing;                // the render thread's, -1 while it waits
+
+    // under the lock, since the last take and since the start
+    RenderThreadStats recent;
+    RenderThreadStats total;
+};
+
+// The window's context has to be current. The start callback has run on
+// the render thread, with its context current, by the time this returns.
+// threaded false, or a context that can't be shared, draws in line.
+void init_render_thread(RenderThread *thread, Window *window, bool threaded, int queue_capacity, int projectile_capacity,
+                        RenderThreadFunc start, RenderFrameFunc draw, RenderThreadFunc stop, void *user_data);
+
+// drops whatever wasn't drawn yet, runs the stop callback and logs the totals
+void shutdown_render_thread(RenderThread *thread);
+
+// the game thread's frame to fill, cleared
+RenderFrame *begin_render_frame(RenderThread *thread);
+
+// hands it over, without the thread it is drawn and presented right here
+void publish_render_frame(RenderThread *thread);
+
+// until nothing published so far is waiting or being drawn, before deleting what those frames use
+void wait_render_thread(RenderThread *thread);
+
+// Every frame's projectile draw list room for capacity shots, on the game
+// thread once a scene has made its pools. Waits for the thread first when a
+// list has to grow, the lists are never reallocated while a frame is built.
+void reserve_render_frame_projectiles(RenderThread *thread, int capacity);
+
+// what happened since the last call
+void take_render_stats(RenderThread *thread, RenderThreadStats *stats);
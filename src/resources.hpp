@@ -0,0 +1,182 @@
+#pragma once
+
+#include "types.h"
+#include "log.hpp"
+
+// Shaders and textures live in dense arrays and are named by handles, which
+// are looked up once when something loads and then only ever indexed. A
+// handle carries its slot's generation, bumped whenever the slot is freed,
+// so one kept past its resource is caught instead of reading whatever took
+// the slot next. Names, lookups by name and the checks are debug only, build
+// with RESOURCE_DEBUG=0 and a handle is just an index.
+#ifndef RESOURCE_DEBUG
+#define RESOURCE_DEBUG 1
+#endif
+
+#define RESOURCE_INDEX_BITS 16
+#define RESOURCE_INDEX_MASK 0xffffu
+#define RESOURCE_NAME_LENGTH 64
+
+template <typename T, int CAPACITY>
+struct ResourceRegistry {
+    const char *kind;       // for messages
+
+    int count;              // slots ever used, freed ones go on the free list
+    int free_count;
+    Uint16 free_slots[CAPACITY];
+    Uint16 generations[CAPACITY];   // of the current or the next occupant, never 0
+    bool live[CAPACITY];
+
+    T items[CAPACITY];
+
+#if RESOURCE_DEBUG
+    char names[CAPACITY][RESOURCE_NAME_LENGTH];
+#endif
+};
+
+template <typename T>
+inline int get_resource_index(ResourceHandle<T> handle)
+{
+    return (int)(handle.value & RESOURCE_INDEX_MASK);
+}
+
+template <typename T>
+inline bool is_resource_handle_valid(ResourceHandle<T> handle)
+{
+    return handle.value != 0;
+}
+
+template <typename T, int CAPACITY>
+void init_resource_registry(ResourceRegistry<T, CAPACITY> *registry, const char *kind)
+{
+    static_assert(CAPACITY <= RESOURCE_INDEX_MASK + 1, "a registry indexes with 16 bits");
+
+    if (registry == nullptr) {
+        LOG_ERROR(LOG_CORE, "%s registry is null", kind);
+        exit(1);
+    }
+
+    memset((void *)registry, 0, sizeof(ResourceRegistry<T, CAPACITY>));
+    registry->kind = kind;
+}
+
+// the item comes back zeroed, the caller fills it in
+template <typename T, int CAPACITY>
+ResourceHandle<T> add_resource(ResourceRegistry<T, CAPACITY> *registry, const char *name)
+{
+    int index;
+    if (registry->free_count > 0) {
+        index = registry->free_slots[--registry->free_count];
+    }
+    else if (registry->count < CAPACITY) {
+        index = registry->count++;
+        registry->generations[index] = 1;
+    }
+    else {
+        LOG_ERROR(LOG_CORE, "%s registry is full, cannot add %s", registry->kind, name);
+        exit(1);
+    }
+
+    registry->live[index] = true;
+    memset((void *)&registry->items[index], 0, sizeof(T));
+
+#if RESOURCE_DEBUG
+    SDL_strlcpy(registry->names[index], name, RESOURCE_NAME_LENGTH);
+#else
+    (void)name;
+#endif
+
+    ResourceHandle<T> handle;
+    handle.value = ((Uint32)registry->generations[index] << RESOURCE_INDEX_BITS) | (Uint32)index;
+    return handle;
+}
+
+template <typename T, int CAPACITY>
+bool is_resource_live(ResourceRegistry<T, CAPACITY> *registry, ResourceHandle<T> handle)
+{
+    int index = get_resource_index(handle);
+    return handle.value != 0 && index < registry->count && registry->live[index] &&
+           registry->generations[index] == (Uint16)(handle.value >> RESOURCE_INDEX_BITS);
+}
+
+// handles to the slot go stale, the caller has already let go of what the item held
+template <typename T, int CAPACITY>
+void remove_resource(ResourceRegistry<T, CAPACITY> *registry, ResourceHandle<T> handle)
+{
+    if (!is_resource_live(registry, handle)) {
+        LOG_ERROR(LOG_CORE, "Removing a stale %s handle %08x", registry->kind, handle.value);
+        return;
+    }
+
+    int index = get_resource_index(handle);
+    registry->live[index] = false;
+
+    // 0 is never a generation, so no handle is ever 0
+    registry->generations[index] += 1;
+    if (registry->generations[index] == 0) {
+        registry->generations[index] = 1;
+    }
+
+    registry->free_slots[registry->free_count++] = (Uint16)index;
+}
+
+// one index in release builds. the pointer stays good until the handle is removed
+template <typename T, int CAPACITY>
+inline T *get_resource(ResourceRegistry<T, CAPACITY> *registry, ResourceHandle<T> handle)
+{
+#if RESOURCE_DEBUG
+    if (!is_resource_live(registry, handle)) {
+        LOG_ERROR(LOG_CORE, "Stale %s handle %08x", registry->kind, handle.value);
+        return nullptr;
+    }
+#endif
+
+    return &registry->items[get_resource_index(handle)];
+}
+
+// for keys that only have room for the index, the render queue's for one
+template <typename T, int CAPACITY>
+inline T *get_resource_at(ResourceRegistry<T, CAPACITY> *registry, int index)
+{
+#if RESOURCE_DEBUG
+    if (index < 0 || index >= registry->count || !registry->live[index]) {
+        LOG_ERROR(LOG_CORE, "No %s in slot %d", registry->kind, index);
+        return nullptr;
+    }
+#endif
+
+    return &registry->items[index];
+}
+
+#if RESOURCE_DEBUG
+// a linear search, for tools and messages, never for the game itself
+template <typename T, int CAPACITY>
+ResourceHandle<T> find_resource(ResourceRegistry<T, CAPACITY> *registry, const char *name)
+{
+    ResourceHandle<T> handle = {};
+
+    for (int i = 0; i < registry->count; ++i) {
+        if (registry->live[i] && SDL_strcmp(registry->names[i], name) == 0) {
+            handle.value = ((Uint32)registry->generations[i] << RESOURCE_INDEX_BITS) | (Uint32)i;
+            break;
+        }
+    }
+
+    return handle;
+}
+#endif
+
+template <typename T, int CAPACITY>
+const char *get_resource_name(ResourceRegistry<T, CAPACITY> *registry, ResourceHandle<T> handle)
+{
+#if RESOURCE_DEBUG
+    if (is_resource_live(registry, handle)) {
+        return registry->names[get_resource_index(handle)];
+    }
+#else
+    (void)registry;
+    (void)handle;
+#endif
+
+    return "?";
+}
@@ -0,0 +1,121 @@
+#include "runahead.hpp"
+
+void init_run_ahead(RunAhead *run_ahead, int ticks)
+{
+    if (run_ahead == nullptr) {
+        LOG_ERROR(LOG_CORE, "run ahead is null");
+        exit(1);
+    }
+
+    memset(run_ahead, 0, sizeof(RunAhead));
+
+    run_ahead->ticks = ticks < 0 ? 0 : (ticks > RUN_AHEAD_MAX_TICKS ? RUN_AHEAD_MAX_TICKS : ticks);
+    init_scene_snapshot(&run_ahead->snapshot, DEFAULT_MEMORY_ARENA_SIZE_MB);
+}
+
+
+void shutdown_run_ahead(RunAhead *run_ahead)
+{
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    int frames = run_ahead->frames;
+
+    LOG_INFO(LOG_CORE, "Run-ahead %d ticks: %d frames, avg %.4fms, max %.4fms, %.1f KB copied a frame",
+             run_ahead->ticks, frames,
+             frames ? run_ahead->counter_total*1000.0/frequency/frames : 0.0,
+             run_ahead->counter_max*1000.0/frequency,
+             frames ? run_ahead->copied_total/1024.0/frames : 0.0);
+
+    int samples = run_ahead->probe_samples;
+    LOG_INFO(LOG_CORE, "Run-ahead %d ticks: press to screen avg %.2fms, max %.2fms over %d presses, %.2fms ahead of the simulation",
+             run_ahead->ticks, samples ? run_ahead->probe_total_ms/samples : 0.0, run_ahead->probe_max_ms, samples,
+             run_ahead->ticks*SIMULATION_TICK_S*1000.f);
+
+    free_scene_snapshot(&run_ahead->snapshot);
+}
+
+
+void begin_run_ahead(RunAhead *run_ahead, Scene *scene, InputSystem *input, AudioSystem *audio)
+{
+    if (run_ahead->ticks == 0 || !scene->loaded || !scene->initialized) {
+        return;
+    }
+
+    run_ahead->frame_start = SDL_GetPerformanceCounter();
+
+    if (!save_scene_snapshot(&run_ahead->snapshot, scene)) {
+        return;
+    }
+
+    run_ahead->active = true;
+    run_ahead->controller = scene->gamepadcontroller;
+
+    // whatever was pressed since the last tick is what the next real tick will see
+    input_peek_state(input, &scene->gamepadcontroller);
+
+    ALLOC_SCOPE(ALLOC_SIMULATION);
+    mute_sounds(audio, true);
+    for (int i = 0; i < run_ahead->ticks; ++i) {
+        scene->update(scene, SIMULATION_TICK_S);
+        scene->time_s += SIMULATION_TICK_S;
+    }
+    mute_sounds(audio, false);
+}
+
+
+void end_run_ahead(RunAhead *run_ahead, Scene *scene)
+{
+    if (!run_ahead->active) {
+        return;
+    }
+
+    load_scene_snapshot(&run_ahead->snapshot, scene);
+    scene->gamepadcontroller = run_ahead->controller;
+    run_ahead->active = false;
+
+    Uint64 counter = SDL_GetPerformanceCounter() - run_ahead->frame_start;
+    run_ahead->frames += 1;
+    run_ahead->counter_total += counter;
+    if (counter > run_ahead->counter_max) {
+        run_ahead->counter_max = counter;
+    }
+    run_ahead->copied_total += 2.0*run_ahead->snapshot.copied;
+}
+
+
+void arm_latency_probe(RunAhead *run_ahead, Scene *scene)
+{
+    if (run_ahead->probe_armed || scene->player == nullptr || !scene->initialized) {
+        return;
+    }
+
+    // a ship already moving shows nothing new
+    if (glm::length(scene->player->velocity) > 0.01f) {
+        return;
+    }
+
+    run_ahead->probe_armed = true;
+    run_ahead->probe_start = SDL_GetPerformanceCounter();
+    run_ahead->probe_position = scene->player->position;
+}
+
+
+void check_latency_probe(RunAhead *run_ahead, Scene *scene)
+{
+    if (!run_ahead->probe_armed || scene->player == nullptr) {
+        return;
+    }
+
+    double elapsed_ms = (SDL_GetPerformanceCounter() - run_ahead->probe_start)*1000.0/SDL_GetPerformanceFrequency();
+
+    if (glm::length(scene->player->position - run_ahead->probe_position) >= RUN_AHEAD_PROBE_DISTANCE) {
+        run_ahead->probe_samples += 1;
+        run_ahead->probe_total_ms += elapsed_ms;
+        if (elapsed_ms > run_ahead->probe_max_ms) {
+            run_ahead->probe_max_ms = elapsed_ms;
+        }
+        run_ahead->probe_armed = false;
+    }
+    else if (elapsed_ms > RUN_AHEAD_PROBE_TIMEOUT_MS) {
+        run_ahead->probe_armed = false;
+    }
+}
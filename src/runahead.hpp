@@ -0,0 +1,53 @@
+#pragma once
+
+#include "types.h"
+#include "input.hpp"
+#include "audio.hpp"
+#include "snapshot.hpp"
+
+// Run-ahead: before a frame is drawn the scene is saved, stepped a few ticks
+// further with the input held right now, drawn, and put back. The screen is
+// then that many ticks ahead of the real simulation, which hides as many
+// ticks of input latency. Only drawing ever sees the predicted state, real
+// ticks, recordings and checksums don't, and sounds stay muted while it runs.
+#define RUN_AHEAD_MAX_TICKS 3
+
+// how far the player has to move on screen before a press counts as shown
+#define RUN_AHEAD_PROBE_DISTANCE 1.f
+#define RUN_AHEAD_PROBE_TIMEOUT_MS 1000.0
+
+struct RunAhead {
+    int ticks;                  // 0 only measures, for a baseline
+    SceneSnapshot snapshot;
+
+    bool active;                // the scene holds predicted state until the end call
+    GamePadController controller;
+    Uint64 frame_start;
+
+    // cost per drawn frame: save, the extra ticks and the restore
+    int frames;
+    Uint64 counter_total;
+    Uint64 counter_max;
+    double copied_total;
+
+    // a press from rest, timed to the first presented frame that moves the player
+    bool probe_armed;
+    Uint64 probe_start;
+    glm::vec3 probe_position;
+    int probe_samples;
+    double probe_total_ms;
+    double probe_max_ms;
+};
+
+void init_run_ahead(RunAhead *run_ahead, int ticks);
+
+// logs what it measured
+void shutdown_run_ahead(RunAhead *run_ahead);
+
+// around everything that draws the scene, the scene can't be ticked in between
+void begin_run_ahead(RunAhead *run_ahead, Scene *scene, InputSystem *input, AudioSystem *audio);
+void end_run_ahead(RunAhead *run_ahead, Scene *scene);
+
+// arm on a direction press, check after the frame is presented and before the end call
+void arm_latency_probe(RunAhead *run_ahead, Scene *scene);
+void check_latency_probe(RunAhead *run_ahead, Scene *scene);
@@ -0,0 +1,192 @@
+#include "snapshot.hpp"
+
+static void add_snapshot_hole(SnapshotSpan *holes, int *hole_count, MemoryArena *arena, const void *array, int element_size, int count, int capacity)
+{
+    if (array == nullptr || count >= capacity) {
+        return;
+    }
+
+    SnapshotSpan *hole = &holes[(*hole_count)++];
+    hole->offset = get_arena_offset(arena, array) + count*element_size;
+    hole->size = (capacity - count)*element_size;
+}
+
+
+// the used range minus the dead tails of the projectile arrays, in arena order
+static void build_snapshot_spans(SceneSnapshot *snapshot, Scene *scene)
+{
+    MemoryArena *arena = &scene->memory_arena;
+
+    SnapshotSpan holes[SNAPSHOT_MAX_SPANS];
+    int hole_count = 0;
+
+    if (scene->projectiles) {
+        for (int type = 0; type < PROJECTILE_TYPE_COUNT; ++type) {
+            ProjectilePool *pool = &scene->projectiles->pools[type];
+            int count = pool->count;
+            int capacity = pool->info.capacity;
+
+            add_snapshot_hole(holes, &hole_count, arena, pool->position_x, sizeof(float), count, capacity);
+            add_snapshot_hole(holes, &hole_count, arena, pool->position_y, sizeof(float), count, capacity);
+            add_snapshot_hole(holes, &hole_count, arena, pool->velocity_x, sizeof(float), count, capacity);
+            add_snapshot_hole(holes, &hole_count, arena, pool->velocity_y, sizeof(float), count, capacity);
+            add_snapshot_hole(holes, &hole_count, arena, pool->time_left_s, sizeof(float), count, capacity);
+            add_snapshot_hole(holes, &hole_count, arena, pool->damage, sizeof(float), count, capacity);
+            add_snapshot_hole(holes, &hole_count, arena, pool->owner, sizeof(int), count, capacity);
+        }
+    }
+
+    // a handful of holes, allocated in order already, an insertion sort just makes sure
+    for (int i = 1; i < hole_count; ++i) {
+        SnapshotSpan hole = holes[i];
+        int j = i - 1;
+        while (j >= 0 && holes[j].offset > hole.offset) {
+            holes[j + 1] = holes[j];
+            --j;
+        }
+        holes[j + 1] = hole;
+    }
+
+    Uint32 used = (Uint32)snapshot->used;
+    Uint32 cursor = 0;
+    snapshot->span_count = 0;
+    snapshot->copied = 0;
+
+    for (int i = 0; i <= hole_count; ++i) {
+        Uint32 end = i < hole_count ? holes[i].offset : used;
+        if (end > cursor) {
+            SnapshotSpan *span = &snapshot->spans[snapshot->span_count++];
+            span->offset = cursor;
+            span->size = end - cursor;
+            snapshot->copied += span->size;
+        }
+
+        if (i < hole_count) {
+            cursor = holes[i].offset + holes[i].size;
+        }
+    }
+}
+
+void init_scene_snapshot(SceneSnapshot *snapshot, int capacity)
+{
+    if (snapshot == nullptr) {
+        LOG_ERROR(LOG_SCENE, "scene snapshot is null");
+        exit(1);
+    }
+
+    memset(snapshot, 0, sizeof(SceneSnapshot));
+
+    snapshot->memory = (unsigned char *)tracked_malloc(capacity);
+    if (snapshot->memory == nullptr) {
+        LOG_ERROR(LOG_MEMORY, "Could not allocate a %d byte scene snapshot", capacity);
+        exit(1);
+    }
+    snapshot->capacity = capacity;
+}
+
+
+void free_scene_snapshot(SceneSnapshot *snapshot)
+{
+    free(snapshot->memory);
+    memset(snapshot, 0, sizeof(SceneSnapshot));
+}
+
+
+bool save_scene_snapshot(SceneSnapshot *snapshot, Scene *scene)
+{
+    if (!scene->loaded) {
+        LOG_ERROR(LOG_SCENE, "Scene %d has no arena to snapshot", scene->id);
+        return false;
+    }
+
+    MemoryArena *arena = &scene->memory_arena;
+    int used = get_arena_used(arena);
+
+    if (used > snapshot->capacity) {
+        LOG_ERROR(LOG_SCENE, "Scene %d uses %d bytes, more than the %d byte snapshot holds", scene->id, used, snapshot->capacity);
+        return false;
+    }
+
+    snapshot->used = used;
+    snapshot->scene_id = scene->id;
+
+    build_snapshot_spans(snapshot, scene);
+    for (int i = 0; i < snapshot->span_count; ++i) {
+        SnapshotSpan *span = &snapshot->spans[i];
+        memcpy(snapshot->memory + span->offset, arena->memory + span->offset, span->size);
+    }
+
+    snapshot->time_s = scene->time_s;
+    snapshot->entity_free_list = scene->entity_pool.free_list;
+    snapshot->sprite_free_list = scene->sprite_pool.free_list;
+
+    snapshot->first_entity = get_arena_offset(arena, scene->first_entity);
+    snapshot->last_entity = get_arena_offset(arena, scene->last_entity);
+    snapshot->player = get_arena_offset(arena, scene->player);
+    snapshot->data = get_arena_offset(arena, scene->data);
+    snapshot->background = get_arena_offset(arena, scene->background);
+    snapshot->projectiles = get_arena_offset(arena, scene->projectiles);
+
+    snapshot->tag_count = scene->tag_count;
+    for (int i = 0; i < scene->tag_count; ++i) {
+        SDL_strlcpy(snapshot->tags[i].tag, scene->tags[i].tag, ENTITY_NAME_LENGTH);
+        snapshot->tags[i].entity = get_arena_offset(arena, scene->tags[i].entity);
+    }
+
+    snapshot->group_count = scene->group_count;
+    for (int i = 0; i < scene->group_count; ++i) {
+        EntityGroup *group = &scene->groups[i];
+        SDL_strlcpy(snapshot->groups[i].tag, group->tag, ENTITY_NAME_LENGTH);
+        snapshot->groups[i].count = group->count;
+        snapshot->groups[i].first = get_arena_offset(arena, group->first);
+        snapshot->groups[i].last = get_arena_offset(arena, group->last);
+    }
+
+    return true;
+}
+
+
+bool load_scene_snapshot(SceneSnapshot *snapshot, Scene *scene)
+{
+    MemoryArena *arena = &scene->memory_arena;
+
+    if (!scene->loaded || snapshot->used > arena->memory_size) {
+        LOG_ERROR(LOG_SCENE, "Scene %d cannot hold a %d byte snapshot", scene->id, snapshot->used);
+        return false;
+    }
+
+    // what the spans skip is past a pool's count, dead in the scene either way
+    for (int i = 0; i < snapshot->span_count; ++i) {
+        SnapshotSpan *span = &snapshot->spans[i];
+        memcpy(arena->memory + span->offset, snapshot->memory + span->offset, span->size);
+    }
+    arena->current_memory_pointer = arena->memory + snapshot->used;
+
+    scene->time_s = snapshot->time_s;
+    scene->entity_pool.free_list = snapshot->entity_free_list;
+    scene->sprite_pool.free_list = snapshot->sprite_free_list;
+
+    scene->first_entity = (Entity *)get_arena_pointer(arena, snapshot->first_entity);
+    scene->last_entity = (Entity *)get_arena_pointer(arena, snapshot->last_entity);
+    scene->player = (Entity *)get_arena_pointer(arena, snapshot->player);
+    scene->data = get_arena_pointer(arena, snapshot->data);
+    scene->background = (Background *)get_arena_pointer(arena, snapshot->background);
+    scene->projectiles = (ProjectileSystem *)get_arena_pointer(arena, snapshot->projectiles);
+
+    scene->tag_count = snapshot->tag_count;
+    for (int i = 0; i < snapshot->tag_count; ++i) {
+        SDL_strlcpy(scene->tags[i].tag, snapshot->tags[i].tag, ENTITY_NAME_LENGTH);
+        scene->tags[i].entity = (Entity *)get_arena_pointer(arena, snapshot->tags[i].entity);
+    }
+
+    scene->group_count = snapshot->group_count;
+    for (int i = 0; i < snapshot->group_count; ++i) {
+        EntityGroup *group = &scene->groups[i];
+        SDL_strlcpy(group->tag, snapshot->groups[i].tag, ENTITY_NAME_LENGTH);
+        group->count = snapshot->groups[i].count;
+        group->first = (Entity *)get_arena_pointer(arena, snapshot->groups[i].first);
+        group->last = (Entity *)get_arena_pointer(arena, snapshot->groups[i].last);
+    }
+
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "types.h"
+#include "memory.hpp"
+#include "projectiles.hpp"
+
+// A copy of a scene's simulation state: the used range of its arena taken
+// as it is, plus the scene's own fields with their pointers turned into
+// arena offsets. Links inside the arena are ArenaPtrs, so a restore is one
+// memcpy and a handful of offsets, into the same scene or another loaded
+// one. Textures, masks and GL names are only borrowed, a snapshot is good
+// for as long as the process that took it.
+//
+// The projectile pools are most of the arena and mostly empty, so the dead
+// tail of each array is left out and only the spans in between are copied.
+#define SNAPSHOT_MAX_SPANS (PROJECTILE_TYPE_COUNT*PROJECTILE_ARRAY_COUNT + 1)
+
+struct SnapshotSpan {
+    Uint32 offset;
+    Uint32 size;
+};
+
+struct SnapshotEntityGroup {
+    char tag[ENTITY_NAME_LENGTH];
+    int count;
+    Uint32 first;
+    Uint32 last;
+};
+
+struct SnapshotEntityTag {
+    char tag[ENTITY_NAME_LENGTH];
+    Uint32 entity;
+};
+
+struct SceneSnapshot {
+    int scene_id;           // where it came from, it can be loaded into any scene
+
+    unsigned char *memory;  // laid out like the arena, spans at their own offsets
+    int capacity;           // fixed at init, a save never allocates
+    int used;
+    int copied;             // bytes actually in the spans
+
+    int span_count;
+    SnapshotSpan spans[SNAPSHOT_MAX_SPANS];
+
+    float time_s;
+    Uint32 entity_free_list;
+    Uint32 sprite_free_list;
+
+    Uint32 first_entity;
+    Uint32 last_entity;
+    Uint32 player;
+    Uint32 data;
+    Uint32 background;
+    Uint32 projectiles;
+
+    int tag_count;
+    SnapshotEntityTag tags[MAX_TAGGED_ENTITIES];
+
+    int group_count;
+    SnapshotEntityGroup groups[MAX_ENTITY_GROUPS];
+};
+
+// capacity is the arena size of the scenes it will hold, pages the spans never
+// reach are never touched
+void init_scene_snapshot(SceneSnapshot *snapshot, int capacity);
+void free_scene_snapshot(SceneSnapshot *snapshot);
+
+bool save_scene_snapshot(SceneSnapshot *snapshot, Scene *scene);
+
+// the scene has to be loaded, with an arena big enough for what was saved
+bool load_scene_snapshot(SceneSnapshot *snapshot, Scene *scene);
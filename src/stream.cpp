@@ -0,0 +1,178 @@
+#include "stream.hpp"
+
+// a fence that hasn't passed in this long is a hung GPU, not a slow frame
+#define STREAM_FENCE_TIMEOUT_NS 1000000000ull
+
+void init_stream_buffer(StreamBuffer *stream, GLenum target, int region_size, int frames_ahead, bool allow_persistent)
+{
+    if (stream == nullptr) {
+        LOG_ERROR(LOG_RENDER, "stream buffer is null");
+        exit(1);
+    }
+
+    if (frames_ahead < 0 || frames_ahead > STREAM_MAX_FRAMES_AHEAD) {
+        LOG_WARN(LOG_RENDER, "%d frames ahead is out of range, using %d", frames_ahead, STREAM_DEFAULT_FRAMES_AHEAD);
+        frames_ahead = STREAM_DEFAULT_FRAMES_AHEAD;
+    }
+
+    memset(stream, 0, sizeof(StreamBuffer));
+    stream->target = target;
+    stream->region_size = (region_size + STREAM_ALIGNMENT - 1) & ~(STREAM_ALIGNMENT - 1);
+    stream->region_count = frames_ahead + 1;
+
+    // begin_stream_frame moves on to the first region
+    stream->region = stream->region_count - 1;
+
+    GLsizeiptr size = (GLsizeiptr)stream->region_size*stream->region_count;
+
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(target, stream->buffer);
+
+    stream->persistent = allow_persistent && GLEW_ARB_buffer_storage && glBufferStorage != nullptr;
+    if (stream->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, size, nullptr, flags);
+        stream->mapped = (unsigned char *)glMapBufferRange(target, 0, size, flags);
+
+        if (stream->mapped == nullptr) {
+            LOG_WARN(LOG_RENDER, "Could not map a %d KB stream buffer, orphaning instead", (int)(size >> 10));
+            glDeleteBuffers(1, &stream->buffer);
+            glGenBuffers(1, &stream->buffer);
+            glBindBuffer(target, stream->buffer);
+            stream->persistent = false;
+        }
+    }
+
+    if (!stream->persistent) {
+        glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+        stream->staging = (unsigned char *)tracked_malloc(stream->region_size);
+    }
+
+    glBindBuffer(target, 0);
+
+    LOG_INFO(LOG_RENDER, "Stream buffer: %d regions of %d KB, %s, CPU up to %d frames ahead",
+             stream->region_count, stream->region_size >> 10, stream->persistent ? "persistent mapped" : "orphaned", frames_ahead);
+}
+
+
+void shutdown_stream_buffer(StreamBuffer *stream)
+{
+    StreamStats *stats = &stream->stats;
+    LOG_INFO(LOG_RENDER, "Stream buffer: %d frames, waited on the GPU in %d, %.3fms avg, %.3fms max, %d overflows, %d KB a frame",
+             stats->frames, stats->fence_waits,
+             stats->fence_waits > 0 ? get_stream_wait_ms(stats->wait_counter)/stats->fence_waits : 0.f,
+             get_stream_wait_ms(stats->max_wait_counter), stats->overflows,
+             stats->frames > 0 ? (int)((stats->bytes_committed/stats->frames) >> 10) : 0);
+
+    for (int i = 0; i < stream->region_count; ++i) {
+        if (stream->fences[i]) {
+            glDeleteSync(stream->fences[i]);
+        }
+    }
+
+    if (stream->persistent) {
+        glBindBuffer(stream->target, stream->buffer);
+        glUnmapBuffer(stream->target);
+        glBindBuffer(stream->target, 0);
+    }
+
+    glDeleteBuffers(1, &stream->buffer);
+    free(stream->staging);
+    memset(stream, 0, sizeof(StreamBuffer));
+}
+
+
+void begin_stream_frame(StreamBuffer *stream)
+{
+    stream->region = (stream->region + 1) % stream->region_count;
+    stream->cursor = 0;
+    stream->overflowed = false;
+    stream->stats.frames += 1;
+
+    GLsync fence = stream->fences[stream->region];
+    if (fence) {
+        // a quick look first, only a frame that has to wait pays for the flush
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            Uint64 start_counter = SDL_GetPerformanceCounter();
+
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_FENCE_TIMEOUT_NS);
+            } while (status == GL_TIMEOUT_EXPIRED);
+
+            Uint64 wait_counter = SDL_GetPerformanceCounter() - start_counter;
+            stream->stats.fence_waits += 1;
+            stream->stats.wait_counter += wait_counter;
+            if (wait_counter > stream->stats.max_wait_counter) {
+                stream->stats.max_wait_counter = wait_counter;
+            }
+        }
+
+        if (status == GL_WAIT_FAILED) {
+            LOG_ERROR(LOG_RENDER, "Waiting on a stream fence failed");
+        }
+
+        glDeleteSync(fence);
+        stream->fences[stream->region] = nullptr;
+    }
+
+    // the old storage stays with the draws that still read it
+    if (!stream->persistent) {
+        glBindBuffer(stream->target, stream->buffer);
+        glBufferData(stream->target, (GLsizeiptr)stream->region_size*stream->region_count, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(stream->target, 0);
+    }
+}
+
+
+void end_stream_frame(StreamBuffer *stream)
+{
+    stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+
+unsigned char *get_stream_cursor(StreamBuffer *stream, int *available)
+{
+    *available = stream->region_size - stream->cursor;
+
+    if (stream->persistent) {
+        return stream->mapped + stream->region*stream->region_size + stream->cursor;
+    }
+
+    return stream->staging + stream->cursor;
+}
+
+
+int commit_stream(StreamBuffer *stream, int bytes)
+{
+    if (bytes > stream->region_size - stream->cursor) {
+        if (!stream->overflowed) {
+            LOG_WARN(LOG_RENDER, "Stream region is full, %d KB a frame isn't enough", stream->region_size >> 10);
+            stream->overflowed = true;
+        }
+        stream->stats.overflows += 1;
+        bytes = stream->region_size - stream->cursor;
+    }
+
+    int offset = stream->region*stream->region_size + stream->cursor;
+
+    // coherent memory is already visible, the fallback has to hand it over
+    if (!stream->persistent && bytes > 0) {
+        glBindBuffer(stream->target, stream->buffer);
+        glBufferSubData(stream->target, offset, bytes, stream->staging + stream->cursor);
+    }
+
+    stream->cursor += (bytes + STREAM_ALIGNMENT - 1) & ~(STREAM_ALIGNMENT - 1);
+    if (stream->cursor > stream->region_size) {
+        stream->cursor = stream->region_size;
+    }
+    stream->stats.bytes_committed += bytes;
+
+    return offset;
+}
+
+
+float get_stream_wait_ms(Uint64 counter)
+{
+    return (float)(counter*1000.0/SDL_GetPerformanceFrequency());
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "types.h"
+
+// Per frame data on its way to the GPU. The buffer is a ring of regions, one
+// per frame in flight, and each frame only writes into its own region while
+// the GPU reads the ones before it. A fence goes in after each frame's draws
+// and the region is only written again once that fence has passed, so the
+// driver never has to sync or copy behind our back.
+//
+// With ARB_buffer_storage the whole buffer is mapped once, persistent and
+// coherent, and written in place. Plain GL 3.3 writes to a staging copy of
+// the region instead, orphans the buffer at the start of every frame and
+// uploads each range with glBufferSubData when it is committed.
+//
+// The fences also pace the frames: with frames_ahead at N the CPU waits
+// before starting a frame while the GPU is still N frames behind. Fewer is
+// less latency, more keeps the GPU fed when a frame runs long.
+#define STREAM_MAX_FRAMES_AHEAD 3
+#define STREAM_DEFAULT_FRAMES_AHEAD 2
+#define STREAM_ALIGNMENT 256
+
+struct StreamStats {
+    int frames;
+    int fence_waits;            // frames that found the GPU still behind
+    Uint64 wait_counter;        // spent in those waits
+    Uint64 max_wait_counter;
+    int overflows;              // reservations that didn't fit in the region
+    Sint64 bytes_committed;
+};
+
+struct StreamBuffer {
+    GLenum target;
+    GLuint buffer;
+
+    bool persistent;
+    unsigned char *mapped;      // the whole ring when persistent
+    unsigned char *staging;     // one region otherwise
+
+    int region_size;
+    int region_count;           // frames_ahead + 1
+    int region;                 // the one this frame writes
+    int cursor;                 // into the region
+    bool overflowed;            // warned once a frame
+
+    GLsync fences[STREAM_MAX_FRAMES_AHEAD + 1];
+
+    StreamStats stats;
+};
+
+// allow_persistent false forces the orphaning path, to compare the two
+void init_stream_buffer(StreamBuffer *stream, GLenum target, int region_size, int frames_ahead, bool allow_persistent = true);
+void shutdown_stream_buffer(StreamBuffer *stream);
+
+// waits for the region's last frame to clear the GPU
+void begin_stream_frame(StreamBuffer *stream);
+
+// fences what this frame drew from its region
+void end_stream_frame(StreamBuffer *stream);
+
+// Where the next write goes and how many bytes are left in the frame's
+// region. Nothing is reserved until it is committed, so a writer can fill
+// as much as it likes and commit only what it used.
+unsigned char *get_stream_cursor(StreamBuffer *stream, int *available);
+
+// hands what was written at the cursor to the GPU, returns its offset in the buffer
+int commit_stream(StreamBuffer *stream, int bytes);
+
+float get_stream_wait_ms(Uint64 counter);
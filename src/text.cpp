@@ -0,0 +1,348 @@
+#include "text.hpp"
+
+// what a cleared atlas is uploaded from, GL 3.3 has no way to clear a texture in place.
+// zero initialized, so it sits in bss and costs nothing until the first clear reads it
+static Uint8 TEXT_ATLAS_ZEROS[TEXT_ATLAS_SIZE*TEXT_ATLAS_SIZE];
+
+static void clear_text_atlas(TextSystem *text)
+{
+    glBindTexture(GL_TEXTURE_2D, text->atlas_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, TEXT_ATLAS_ZEROS);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    text->shelf_x = 0;
+    text->shelf_y = 0;
+    text->shelf_height = 0;
+}
+
+
+// Starts the atlas over once it is full. Cached layouts remember the
+// generation they were built against and are rebuilt on their next use.
+static void reset_text_atlas(TextSystem *text)
+{
+    LOG_WARN(LOG_TEXT, "Text atlas is full, rasterizing glyphs again");
+
+    clear_text_atlas(text);
+    text->atlas_generation += 1;
+    text->stats.atlas_resets += 1;
+
+    for (int f = 0; f < text->font_count; ++f) {
+        for (int c = 0; c < TEXT_MAX_CODEPOINTS; ++c) {
+            text->fonts[f].glyphs[c].loaded = false;
+        }
+    }
+}
+
+
+static TextGlyph *get_glyph(TextSystem *text, Font *font, int codepoint)
+{
+    TextGlyph *glyph = &font->glyphs[codepoint];
+    if (glyph->loaded) {
+        return glyph;
+    }
+
+    memset(glyph, 0, sizeof(TextGlyph));
+
+    int index = find_truetype_glyph(&font->truetype, codepoint);
+    int advance = 0;
+    int left_side_bearing = 0;
+    get_truetype_hmetrics(&font->truetype, index, &advance, &left_side_bearing);
+    glyph->advance = advance*font->scale;
+
+    int width = 0;
+    int height = 0;
+    int x_offset = 0;
+    int y_offset = 0;
+    unsigned char *bitmap = text->sdf_bitmap;
+    bool rasterized = render_truetype_sdf(&font->truetype, &text->outline, index, font->scale,
+                                          TEXT_SDF_PADDING, TEXT_SDF_ONEDGE, TEXT_SDF_PIXEL_DIST_SCALE,
+                                          bitmap, sizeof(text->sdf_bitmap), &width, &height, &x_offset, &y_offset);
+
+    // whitespace has no outline, it only moves the pen
+    if (!rasterized) {
+        glyph->empty = true;
+        glyph->loaded = true;
+        return glyph;
+    }
+
+    // shelf packing, one texel of gutter keeps linear filtering inside the glyph
+    if (text->shelf_x + width > TEXT_ATLAS_SIZE) {
+        text->shelf_x = 0;
+        text->shelf_y += text->shelf_height + 1;
+        text->shelf_height = 0;
+    }
+
+    if (text->shelf_y + height > TEXT_ATLAS_SIZE) {
+        reset_text_atlas(text);
+    }
+
+    int x = text->shelf_x;
+    int y = text->shelf_y;
+    text->shelf_x += width + 1;
+    if (height > text->shelf_height) {
+        text->shelf_height = height;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, text->atlas_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RED, GL_UNSIGNED_BYTE, bitmap);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glyph->size = glm::vec2(width, height);
+    glyph->offset = glm::vec2(x_offset, y_offset);
+
+    // rows are uploaded top down, the sprite quad samples bottom up
+    float atlas_size = (float)TEXT_ATLAS_SIZE;
+    glyph->uv_rect = glm::vec4(x/atlas_size, (y + height)/atlas_size, width/atlas_size, -height/atlas_size);
+
+    glyph->loaded = true;
+    text->stats.glyphs_rasterized += 1;
+
+    return glyph;
+}
+
+
+static Uint32 hash_text(const char *string, int length)
+{
+    // FNV-1a
+    Uint32 hash = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        hash ^= (unsigned char)string[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+static void build_text_layout(TextSystem *text, TextLayout *layout)
+{
+    Font *font = &text->fonts[layout->font];
+
+    // a glyph that doesn't fit resets the atlas and invalidates the ones
+    // already placed, one more pass is always enough for a single string
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        Uint32 generation = text->atlas_generation;
+
+        float pen_x = 0.f;
+        float pen_y = 0.f;
+        int previous = 0;
+
+        layout->width = 0.f;
+        layout->glyph_count = 0;
+
+        for (int i = 0; i < layout->length; ++i) {
+            int codepoint = (unsigned char)layout->text[i];
+
+            if (codepoint == '\n') {
+                pen_x = 0.f;
+                pen_y -= font->line_height;
+                previous = 0;
+                continue;
+            }
+
+            if (previous) {
+                TrueTypeFont *truetype = &font->truetype;
+                pen_x += get_truetype_kerning(truetype, find_truetype_glyph(truetype, previous), find_truetype_glyph(truetype, codepoint))*font->scale;
+            }
+
+            TextGlyph *glyph = get_glyph(text, font, codepoint);
+
+            if (!glyph->empty) {
+                TextLayoutGlyph *placed = &layout->glyphs[layout->glyph_count++];
+                placed->center = glm::vec2(pen_x + glyph->offset.x + glyph->size.x*0.5f,
+                                           pen_y - (glyph->offset.y + glyph->size.y*0.5f));
+                placed->size = glyph->size;
+                placed->uv_rect = glyph->uv_rect;
+            }
+
+            pen_x += glyph->advance;
+            if (pen_x > layout->width) {
+                layout->width = pen_x;
+            }
+            previous = codepoint;
+        }
+
+        layout->atlas_generation = generation;
+        if (generation == text->atlas_generation) {
+            break;
+        }
+    }
+
+    text->stats.layouts_built += 1;
+}
+
+
+static TextLayout *get_text_layout(TextSystem *text, FontId font, const char *string)
+{
+    int length = (int)SDL_strlen(string);
+    if (length > TEXT_MAX_LAYOUT_LENGTH) {
+        length = TEXT_MAX_LAYOUT_LENGTH;
+    }
+
+    Uint32 hash = hash_text(string, length);
+    text->use_counter += 1;
+
+    TextLayout *oldest = &text->layouts[0];
+    for (int i = 0; i < TEXT_LAYOUT_CACHE_SIZE; ++i) {
+        TextLayout *layout = &text->layouts[i];
+
+        if (layout->hash == hash && layout->font == font && layout->length == length &&
+            memcmp(layout->text, string, length) == 0)
+        {
+            if (layout->atlas_generation != text->atlas_generation) {
+                build_text_layout(text, layout);
+            }
+            else {
+                text->stats.layout_hits += 1;
+            }
+
+            layout->last_used = text->use_counter;
+            return layout;
+        }
+
+        if (layout->last_used < oldest->last_used) {
+            oldest = layout;
+        }
+    }
+
+    TextLayout *layout = oldest;
+    layout->hash = hash;
+    layout->font = font;
+    layout->length = length;
+    memcpy(layout->text, string, length);
+    layout->text[length] = '\0';
+    layout->last_used = text->use_counter;
+
+    build_text_layout(text, layout);
+
+    return layout;
+}
+
+
+void init_text(TextSystem *text)
+{
+    if (text == nullptr) {
+        LOG_ERROR(LOG_TEXT, "text system is null");
+        exit(1);
+    }
+
+    memset(text, 0, sizeof(TextSystem));
+
+    for (int i = 0; i < TEXT_LAYOUT_CACHE_SIZE; ++i) {
+        text->layouts[i].font = INVALID_FONT;
+    }
+
+    glGenTextures(1, &text->atlas_texture);
+    glBindTexture(GL_TEXTURE_2D, text->atlas_texture);
+
+    // distance fields want filtering, it is what keeps scaled edges smooth
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    clear_text_atlas(text);
+}
+
+
+FontId load_font(TextSystem *text, Vfs *vfs, const char *name, const char *path)
+{
+    if (text->font_count >= TEXT_MAX_FONTS) {
+        LOG_ERROR(LOG_TEXT, "Too many fonts, cannot load %s", path);
+        return INVALID_FONT;
+    }
+
+    FontId id = text->font_count;
+    Font *font = &text->fonts[id];
+    memset(font, 0, sizeof(Font));
+
+    // outlines are read straight out of the mapping, it stays open as long as the font
+    if (!open_file_view(vfs, path, &font->file)) {
+        LOG_ERROR(LOG_TEXT, "Could not open font: %s", path);
+        return INVALID_FONT;
+    }
+
+    if (!open_truetype(&font->truetype, font->file.data, (int)font->file.size)) {
+        LOG_ERROR(LOG_TEXT, "Could not read font: %s", path);
+        close_file_view(vfs, &font->file);
+        return INVALID_FONT;
+    }
+
+    SDL_strlcpy(font->name, name, ENTITY_NAME_LENGTH);
+    font->scale = get_truetype_scale(&font->truetype, TEXT_SDF_PIXEL_HEIGHT);
+
+    TrueTypeFont *truetype = &font->truetype;
+    font->line_height = (truetype->ascent - truetype->descent + truetype->line_gap)*font->scale;
+
+    text->font_count += 1;
+
+    LOG_INFO(LOG_TEXT, "Loaded font: %s", path);
+
+    return id;
+}
+
+
+FontId find_font(TextSystem *text, const char *name)
+{
+    for (int i = 0; i < text->font_count; ++i) {
+        if (SDL_strncmp(text->fonts[i].name, name, ENTITY_NAME_LENGTH) == 0) {
+            return i;
+        }
+    }
+
+    return INVALID_FONT;
+}
+
+
+void preload_glyphs(TextSystem *text, FontId font, const char *characters)
+{
+    if (text == nullptr || font < 0 || font >= text->font_count) {
+        return;
+    }
+
+    for (const char *c = characters; *c; ++c) {
+        get_glyph(text, &text->fonts[font], (unsigned char)*c);
+    }
+}
+
+
+float draw_text(TextSystem *text, SpriteBatch *batch, FontId font, const char *string, glm::vec2 position, float size, glm::vec4 color)
+{
+    if (text == nullptr || font < 0 || font >= text->font_count) {
+        return 0.f;
+    }
+
+    TextLayout *layout = get_text_layout(text, font, string);
+    float scale = size/TEXT_SDF_PIXEL_HEIGHT;
+
+    for (int i = 0; i < layout->glyph_count; ++i) {
+        TextLayoutGlyph *glyph = &layout->glyphs[i];
+        glm::vec2 center = position + glyph->center*scale;
+
+        push_sprite_quad(batch, text->atlas_texture, glm::vec3(center, 0.f), glyph->size*scale, glyph->uv_rect, color, SPRITE_FLAG_SDF);
+    }
+
+    return layout->width*scale;
+}
+
+
+float measure_text(TextSystem *text, FontId font, const char *string, float size)
+{
+    if (text == nullptr || font < 0 || font >= text->font_count) {
+        return 0.f;
+    }
+
+    return get_text_layout(text, font, string)->width*(size/TEXT_SDF_PIXEL_HEIGHT);
+}
+
+
+void print_text_stats(TextSystem *text)
+{
+    LOG_INFO(LOG_TEXT, "Text: %d layouts built, %d cache hits, %d glyphs rasterized, %d atlas resets",
+             text->stats.layouts_built, text->stats.layout_hits, text->stats.glyphs_rasterized, text->stats.atlas_resets);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "types.h"
+#include "render.hpp"
+#include "vfs.hpp"
+#include "truetype.hpp"
+
+// Glyphs are rasterized once, on first use, as signed distance fields so a
+// single atlas serves every text size. All fonts share the atlas, so any
+// amount of text in a pass is one draw call.
+#define TEXT_ATLAS_SIZE 512
+#define TEXT_SDF_PIXEL_HEIGHT 32.f
+#define TEXT_SDF_PADDING 4
+#define TEXT_SDF_ONEDGE 128
+#define TEXT_SDF_PIXEL_DIST_SCALE (TEXT_SDF_ONEDGE/(float)TEXT_SDF_PADDING)
+#define TEXT_SDF_MAX_SIZE 128 // pixels on a side, padding included
+
+#define TEXT_MAX_FONTS 4
+#define TEXT_MAX_CODEPOINTS 256
+
+// laid out strings are cached by content, an unchanged string is never laid out twice.
+// longer ones are cut off, this has to hold the whole HUD, RENDER_FRAME_TEXT_LENGTH
+#define TEXT_LAYOUT_CACHE_SIZE 64
+#define TEXT_MAX_LAYOUT_LENGTH 255
+
+#define INVALID_FONT -1
+
+typedef int FontId;
+
+struct TextGlyph {
+    bool loaded;
+    bool empty;
+
+    // in atlas pixels, offset is from the pen to the bitmap's top left, y down
+    glm::vec2 size;
+    glm::vec2 offset;
+    glm::vec4 uv_rect;
+    float advance;
+};
+
+struct Font {
+    char name[ENTITY_NAME_LENGTH];
+    FileView file;
+    TrueTypeFont truetype;
+
+    float scale;
+    float line_height;
+    TextGlyph glyphs[TEXT_MAX_CODEPOINTS];
+};
+
+struct TextLayoutGlyph {
+    glm::vec2 center;  // from the origin on the first baseline, y up
+    glm::vec2 size;
+    glm::vec4 uv_rect;
+};
+
+struct TextLayout {
+    Uint32 hash;
+    FontId font;
+    Uint32 atlas_generation;
+    Uint32 last_used;
+
+    int length;
+    char text[TEXT_MAX_LAYOUT_LENGTH + 1];
+
+    float width;
+    int glyph_count;
+    TextLayoutGlyph glyphs[TEXT_MAX_LAYOUT_LENGTH];
+};
+
+struct TextStats {
+    int layouts_built;
+    int layout_hits;
+    int glyphs_rasterized;
+    int atlas_resets;
+};
+
+struct TextSystem {
+    GLuint atlas_texture;
+    Uint32 atlas_generation;
+    int shelf_x;
+    int shelf_y;
+    int shelf_height;
+
+    int font_count;
+    Font fonts[TEXT_MAX_FONTS];
+
+    Uint32 use_counter;
+    TextLayout layouts[TEXT_LAYOUT_CACHE_SIZE];
+
+    TextStats stats;
+
+    // glyphs are rasterized here before they go up to the atlas
+    TrueTypeOutline outline;
+    Uint8 sdf_bitmap[TEXT_SDF_MAX_SIZE*TEXT_SDF_MAX_SIZE];
+};
+
+void init_text(TextSystem *text);
+
+FontId load_font(TextSystem *text, Vfs *vfs, const char *name, const char *path);
+FontId find_font(TextSystem *text, const char *name);
+
+// rasterizes ahead of time, so text that appears mid-game doesn't hit the allocator
+void preload_glyphs(TextSystem *text, FontId font, const char *characters);
+
+// size is the pixel height of a line, position is the left end of the first baseline
+float draw_text(TextSystem *text, SpriteBatch *batch, FontId font, const char *string, glm::vec2 position, float size, glm::vec4 color = glm::vec4(1.f));
+float measure_text(TextSystem *text, FontId font, const char *string, float size);
+
+void print_text_stats(TextSystem *text);
@@ -0,0 +1,370 @@
+#include "textures.hpp"
+
+// only when something is acquired, from then on the handle indexes
+static TextureHandle find_texture(TextureCache *cache, const char *image_path)
+{
+    ResourceRegistry<Texture, TEXTURE_CACHE_CAPACITY> *textures = &cache->textures;
+    TextureHandle handle = {};
+
+    for (int i = 0; i < textures->count; ++i) {
+        if (textures->live[i] && SDL_strcmp(textures->items[i].image_path, image_path) == 0) {
+            handle.value = ((Uint32)textures->generations[i] << RESOURCE_INDEX_BITS) | (Uint32)i;
+            break;
+        }
+    }
+
+    return handle;
+}
+
+
+static void count_texture_stats(TextureCache *cache, int loads, int reloads, int evictions, Sint64 bytes_loaded, Sint64 bytes_evicted)
+{
+    TextureCacheStats *all[] = { &cache->frame_stats, &cache->total_stats };
+    for (int i = 0; i < 2; ++i) {
+        all[i]->loads += loads;
+        all[i]->reloads += reloads;
+        all[i]->evictions += evictions;
+        all[i]->bytes_loaded += bytes_loaded;
+        all[i]->bytes_evicted += bytes_evicted;
+    }
+}
+
+
+static void evict_texture(TextureCache *cache, Texture *texture)
+{
+    glDeleteTextures(1, &texture->glid);
+    texture->glid = 0;
+
+    destroy_collision_mask(texture->collision_mask);
+    texture->collision_mask = nullptr;
+
+    cache->resident_bytes -= texture->bytes;
+    cache->resident_count -= 1;
+    count_texture_stats(cache, 0, 0, 1, 0, texture->bytes);
+
+    LOG_DEBUG(LOG_RENDER, "Evicted texture %s, %d KB", texture->image_path, texture->bytes/1024);
+}
+
+
+// frees room for the incoming bytes, oldest release first, held ones never
+static void evict_textures(TextureCache *cache, Sint64 incoming_bytes)
+{
+    while (cache->resident_bytes + incoming_bytes > cache->budget_bytes) {
+        Texture *oldest = nullptr;
+
+        for (int i = 0; i < cache->textures.count; ++i) {
+            Texture *texture = &cache->textures.items[i];
+            if (cache->textures.live[i] && texture->glid != 0 && texture->references == 0 &&
+                (oldest == nullptr || texture->released_frame < oldest->released_frame))
+            {
+                oldest = texture;
+            }
+        }
+
+        if (oldest == nullptr) {
+            if (!cache->over_budget) {
+                LOG_WARN(LOG_RENDER, "Textures in use need %d MB, over the %d MB budget",
+                         (int)((cache->resident_bytes + incoming_bytes) >> 20), (int)(cache->budget_bytes >> 20));
+                cache->over_budget = true;
+            }
+            return;
+        }
+
+        evict_texture(cache, oldest);
+    }
+
+    cache->over_budget = false;
+}
+
+
+// takes the image and the mask, frees the image once it is on the GPU
+static void upload_texture(TextureCache *cache, Texture *texture, TextureImage *image, CollisionMask *collision_mask)
+{
+    bool reload = texture->bytes > 0;
+    int bytes = image->bytes;
+
+    evict_textures(cache, bytes);
+
+    texture->image_size = glm::vec2(image->width, image->height);
+    texture->collision_mask = collision_mask;
+    texture->bytes = bytes;
+
+    glGenTextures(1, &texture->glid);
+    glBindTexture(GL_TEXTURE_2D, texture->glid);
+
+    for (int level = 0; level < image->mip_count; ++level) {
+        int width = image->width >> level > 0 ? image->width >> level : 1;
+        int height = image->height >> level > 0 ? image->height >> level : 1;
+
+        if (image->format == TEXTURE_FORMAT_RGBA8) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->mips[level]);
+        }
+        else {
+            GLenum format = image->format == TEXTURE_FORMAT_BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, image->mip_bytes[level], image->mips[level]);
+        }
+    }
+
+    // magnified or drawn 1:1 the sprites stay crisp, the mips only come in when they shrink
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image->mip_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image->mip_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    free_texture_image(image);
+
+    cache->resident_bytes += bytes;
+    cache->resident_count += 1;
+    if (cache->resident_bytes > cache->peak_resident_bytes) {
+        cache->peak_resident_bytes = cache->resident_bytes;
+    }
+    count_texture_stats(cache, 1, reload ? 1 : 0, 0, bytes, 0);
+}
+
+
+// two names for one image share the texture
+static TextureHandle register_texture(TextureCache *cache, const char *name, const char *image_path)
+{
+    TextureHandle handle = find_texture(cache, image_path);
+    if (is_resource_handle_valid(handle)) {
+        return handle;
+    }
+
+    handle = add_resource(&cache->textures, name);
+
+    Texture *texture = &cache->textures.items[get_resource_index(handle)];
+    SDL_strlcpy(texture->image_path, image_path, TEXTURE_PATH_LENGTH);
+
+    return handle;
+}
+
+
+static bool load_texture(TextureCache *cache, Texture *texture)
+{
+    TextureImage image;
+    CollisionMask *collision_mask = nullptr;
+
+    if (!decode_texture_image(cache, texture->image_path, &image, &collision_mask)) {
+        LOG_ERROR(LOG_RENDER, "Could not load image named: %s", texture->image_path);
+        return false;
+    }
+
+    upload_texture(cache, texture, &image, collision_mask);
+    return true;
+}
+
+
+void init_texture_cache(TextureCache *cache, Vfs *vfs, int budget_mb)
+{
+    if (cache == nullptr) {
+        LOG_ERROR(LOG_RENDER, "texture cache is null");
+        exit(1);
+    }
+
+    memset((void *)cache, 0, sizeof(TextureCache));
+    init_resource_registry(&cache->textures, "texture");
+    cache->vfs = vfs;
+    cache->budget_bytes = (Sint64)budget_mb << 20;
+
+    cache->compressed_upload = GLEW_EXT_texture_compression_s3tc != 0;
+    if (!cache->compressed_upload) {
+        LOG_WARN(LOG_RENDER, "No S3TC support, compressed textures are decoded when they load");
+    }
+}
+
+
+void shutdown_texture_cache(TextureCache *cache)
+{
+    TextureCacheStats *stats = &cache->total_stats;
+    LOG_INFO(LOG_RENDER, "Textures: %d known, peak %d KB resident of a %d KB budget, %d loads (%d reloads, %d KB), %d evictions (%d KB)",
+             cache->textures.count, (int)(cache->peak_resident_bytes >> 10), (int)(cache->budget_bytes >> 10),
+             stats->loads, stats->reloads, (int)(stats->bytes_loaded >> 10), stats->evictions, (int)(stats->bytes_evicted >> 10));
+
+    for (int i = 0; i < cache->textures.count; ++i) {
+        Texture *texture = &cache->textures.items[i];
+        if (cache->textures.live[i] && texture->glid != 0) {
+            glDeleteTextures(1, &texture->glid);
+            destroy_collision_mask(texture->collision_mask);
+        }
+    }
+
+    init_resource_registry(&cache->textures, "texture");
+    cache->resident_bytes = 0;
+    cache->resident_count = 0;
+}
+
+
+// the .bct next to the image, blocks as they are or decoded for a driver without S3TC
+static bool decode_compressed_texture(TextureCache *cache, const char *image_path, TextureImage *image, CollisionMask **collision_mask)
+{
+    char compressed_path[TEXTURE_PATH_LENGTH];
+    FileView compressed_file;
+
+    if (!get_compressed_texture_path(image_path, compressed_path, TEXTURE_PATH_LENGTH) ||
+        !open_file_view(cache->vfs, compressed_path, &compressed_file))
+    {
+        return false;
+    }
+
+    bool loaded = load_compressed_texture(compressed_file.data, compressed_file.size, image);
+    close_file_view(cache->vfs, &compressed_file);
+
+    if (!loaded) {
+        LOG_WARN(LOG_RENDER, "Compressed texture %s is damaged, loading the image instead", compressed_path);
+        return false;
+    }
+
+    // the mask needs the texels either way, the fallback needs every level of them
+    TextureImage decoded;
+    if (!decompress_texture_image(image, cache->compressed_upload ? 1 : image->mip_count, &decoded)) {
+        free_texture_image(image);
+        return false;
+    }
+
+    *collision_mask = create_collision_mask(decoded.mips[0], decoded.width, decoded.height, decoded.width*4);
+
+    if (cache->compressed_upload) {
+        free_texture_image(&decoded);
+    }
+    else {
+        free_texture_image(image);
+        *image = decoded;
+    }
+
+    return true;
+}
+
+
+bool decode_texture_image(TextureCache *cache, const char *image_path, TextureImage *image, CollisionMask **collision_mask)
+{
+    FileView image_file;
+    SDL_Surface *med_surface = nullptr;
+
+    memset(image, 0, sizeof(TextureImage));
+    *collision_mask = nullptr;
+
+    if (decode_compressed_texture(cache, image_path, image, collision_mask)) {
+        return true;
+    }
+
+    // decoded straight out of the mapped file
+    if (open_file_view(cache->vfs, image_path, &image_file)) {
+        med_surface = IMG_Load_RW(SDL_RWFromConstMem(image_file.data, (int)image_file.size), 1);
+        close_file_view(cache->vfs, &image_file);
+    }
+
+    if ( !med_surface ) {
+        return false;
+    }
+
+    // the upload and the collision mask both expect RGBA bytes, the backgrounds come in without alpha
+    if (med_surface->format->format != SDL_PIXELFORMAT_RGBA32) {
+        SDL_Surface *rgba_surface = SDL_ConvertSurfaceFormat(med_surface, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(med_surface);
+        med_surface = rgba_surface;
+
+        if ( !med_surface ) {
+            LOG_ERROR(LOG_RENDER, "Could not convert image to RGBA: %s", image_path);
+            return false;
+        }
+    }
+
+    // one level as before, only a compressed build brings mips
+    if (!alloc_texture_image(image, TEXTURE_FORMAT_RGBA8, med_surface->w, med_surface->h, 1)) {
+        SDL_FreeSurface(med_surface);
+        return false;
+    }
+
+    for (int y = 0; y < med_surface->h; ++y) {
+        memcpy(image->mips[0] + y*med_surface->w*4, (const Uint8 *)med_surface->pixels + y*med_surface->pitch, med_surface->w*4);
+    }
+
+    *collision_mask = create_collision_mask(image->mips[0], image->width, image->height, image->width*4);
+    SDL_FreeSurface(med_surface);
+    return true;
+}
+
+
+TextureHandle acquire_texture(TextureCache *cache, const char *name, const char *image_path)
+{
+    TextureHandle handle = register_texture(cache, name, image_path);
+    Texture *texture = &cache->textures.items[get_resource_index(handle)];
+
+    if (texture->glid == 0 && !load_texture(cache, texture)) {
+        exit(1);
+    }
+
+    texture->references += 1;
+    return handle;
+}
+
+
+TextureHandle acquire_decoded_texture(TextureCache *cache, const char *name, const char *image_path, TextureImage *image, CollisionMask *collision_mask)
+{
+    TextureHandle handle = register_texture(cache, name, image_path);
+    Texture *texture = &cache->textures.items[get_resource_index(handle)];
+
+    // someone got there first, the decoded copy isn't needed
+    if (texture->glid != 0) {
+        free_texture_image(image);
+        destroy_collision_mask(collision_mask);
+    }
+    else {
+        upload_texture(cache, texture, image, collision_mask);
+    }
+
+    texture->references += 1;
+    return handle;
+}
+
+
+void release_texture(TextureCache *cache, TextureHandle handle)
+{
+    Texture *texture = get_resource(&cache->textures, handle);
+    if (texture == nullptr || texture->references <= 0) {
+        LOG_WARN(LOG_RENDER, "Releasing texture %s, which isn't held", get_resource_name(&cache->textures, handle));
+        return;
+    }
+
+    texture->references -= 1;
+    if (texture->references == 0) {
+        texture->released_frame = cache->frame;
+    }
+}
+
+
+Texture *get_texture(TextureCache *cache, TextureHandle handle)
+{
+    Texture *texture = get_resource(&cache->textures, handle);
+
+    if (texture && texture->glid == 0 && !load_texture(cache, texture)) {
+        return nullptr;
+    }
+
+    return texture;
+}
+
+
+bool is_texture_resident(TextureCache *cache, const char *image_path)
+{
+    TextureHandle handle = find_texture(cache, image_path);
+    return is_resource_handle_valid(handle) && cache->textures.items[get_resource_index(handle)].glid != 0;
+}
+
+
+void end_texture_frame(TextureCache *cache)
+{
+    evict_textures(cache, 0);
+
+    TextureCacheStats *stats = &cache->frame_stats;
+    if (stats->loads > 0 || stats->evictions > 0) {
+        LOG_DEBUG(LOG_RENDER, "Frame %u textures: %d loaded (%d reloads, %d KB), %d evicted (%d KB), %d resident, %d of %d KB",
+                  cache->frame, stats->loads, stats->reloads, (int)(stats->bytes_loaded >> 10),
+                  stats->evictions, (int)(stats->bytes_evicted >> 10), cache->resident_count,
+                  (int)(cache->resident_bytes >> 10), (int)(cache->budget_bytes >> 10));
+    }
+
+    memset(stats, 0, sizeof(TextureCacheStats));
+    cache->frame += 1;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "types.h"
+#include "vfs.hpp"
+#include "collision.hpp"
+#include "resources.hpp"
+#include "compression.hpp"
+
+// Every texture the game loads from an image goes through here. Whoever
+// needs one acquires it and releases it when done, scenes do it for their
+// whole texture list. Textures nobody holds stay resident until the budget
+// runs out, then the ones released longest ago are deleted first. Acquiring
+// an evicted texture loads it again, from the pack when there is one.
+//
+// A texture is found by its image path when it is acquired, after that the
+// handle reaches it by index. Evicting keeps the slot, so handles held
+// across an eviction stay good and the next get_texture loads it again.
+//
+// An image with a compressed build next to it (see compression.hpp) loads
+// that instead, blocks and mips as they are, or decoded back to RGBA when
+// the driver has no S3TC.
+#define TEXTURE_CACHE_CAPACITY 256
+#define TEXTURE_DEFAULT_BUDGET_MB 256
+
+struct TextureCacheStats {
+    int loads;
+    int reloads;            // loads of something evicted before
+    int evictions;
+    Sint64 bytes_loaded;
+    Sint64 bytes_evicted;
+};
+
+struct TextureCache {
+    Vfs *vfs;
+    Sint64 budget_bytes;
+    Sint64 resident_bytes;
+    Sint64 peak_resident_bytes;
+    int resident_count;
+    bool over_budget;       // everything left is held, warned once until it goes back under
+    bool compressed_upload; // the driver takes BC1 and BC3 blocks as they are
+
+    Uint32 frame;
+    TextureCacheStats frame_stats;
+    TextureCacheStats total_stats;
+
+    ResourceRegistry<Texture, TEXTURE_CACHE_CAPACITY> textures;  // a glid of 0 is evicted
+};
+
+void init_texture_cache(TextureCache *cache, Vfs *vfs, int budget_mb);
+
+// deletes everything, held or not, and logs the totals
+void shutdown_texture_cache(TextureCache *cache);
+
+// no GL in here, the loader thread decodes with it
+bool decode_texture_image(TextureCache *cache, const char *image_path, TextureImage *image, CollisionMask **collision_mask);
+
+// registers the image the first time, loads it if it isn't resident, and
+// holds it. the name is only kept in debug builds, for messages
+TextureHandle acquire_texture(TextureCache *cache, const char *name, const char *image_path);
+
+// the same with an image the loader thread already decoded, the cache takes the image and mask
+TextureHandle acquire_decoded_texture(TextureCache *cache, const char *name, const char *image_path, TextureImage *image, CollisionMask *collision_mask);
+
+void release_texture(TextureCache *cache, TextureHandle handle);
+
+// without a reference, only safe to use until the cache runs out of budget.
+// an evicted texture comes back here too
+Texture *get_texture(TextureCache *cache, TextureHandle handle);
+bool is_texture_resident(TextureCache *cache, const char *image_path);
+
+// evicts down to the budget and starts the next frame's counts
+void end_texture_frame(TextureCache *cache);
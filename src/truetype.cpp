@@ -0,0 +1,657 @@
+#include "truetype.hpp"
+
+#include <math.h>
+
+// big endian fields, 0 for anything outside the file so a damaged font reads as empty
+static Uint32 read_truetype_u8(TrueTypeFont *font, int offset)
+{
+    if (offset < 0 || offset + 1 > font->size) {
+        return 0;
+    }
+    return font->data[offset];
+}
+
+
+static Uint32 read_truetype_u16(TrueTypeFont *font, int offset)
+{
+    if (offset < 0 || offset + 2 > font->size) {
+        return 0;
+    }
+    const Uint8 *data = font->data + offset;
+    return (data[0] << 8) | data[1];
+}
+
+
+static int read_truetype_s16(TrueTypeFont *font, int offset)
+{
+    return (Sint16)read_truetype_u16(font, offset);
+}
+
+
+static Uint32 read_truetype_u32(TrueTypeFont *font, int offset)
+{
+    return (read_truetype_u16(font, offset) << 16) | read_truetype_u16(font, offset + 2);
+}
+
+
+static int find_truetype_table(TrueTypeFont *font, int base, const char *tag)
+{
+    int table_count = read_truetype_u16(font, base + 4);
+    for (int i = 0; i < table_count; ++i) {
+        int record = base + 12 + i*16;
+        if (record + 16 <= font->size && memcmp(font->data + record, tag, 4) == 0) {
+            Uint32 offset = read_truetype_u32(font, record + 8);
+            return offset < (Uint32)font->size ? (int)offset : 0;
+        }
+    }
+    return 0;
+}
+
+
+bool open_truetype(TrueTypeFont *font, const Uint8 *data, int size)
+{
+    memset(font, 0, sizeof(TrueTypeFont));
+    font->data = data;
+    font->size = size;
+
+    // a collection is read as its first font
+    int base = 0;
+    if (size >= 16 && memcmp(data, "ttcf", 4) == 0) {
+        base = (int)read_truetype_u32(font, 12);
+    }
+
+    Uint32 version = read_truetype_u32(font, base);
+    if (version != 0x00010000 && version != 0x74727565) {
+        return false;
+    }
+
+    int head = find_truetype_table(font, base, "head");
+    int hhea = find_truetype_table(font, base, "hhea");
+    int maxp = find_truetype_table(font, base, "maxp");
+    int cmap = find_truetype_table(font, base, "cmap");
+    font->glyf = find_truetype_table(font, base, "glyf");
+    font->loca = find_truetype_table(font, base, "loca");
+    font->hmtx = find_truetype_table(font, base, "hmtx");
+    if (!head || !hhea || !maxp || !cmap || !font->glyf || !font->loca || !font->hmtx) {
+        return false;
+    }
+
+    font->units_per_em = read_truetype_u16(font, head + 18);
+    font->long_loca = read_truetype_s16(font, head + 50) != 0;
+    font->glyph_count = read_truetype_u16(font, maxp + 4);
+    font->ascent = read_truetype_s16(font, hhea + 4);
+    font->descent = read_truetype_s16(font, hhea + 6);
+    font->line_gap = read_truetype_s16(font, hhea + 8);
+    font->long_hmetrics = read_truetype_u16(font, hhea + 34);
+    if (font->glyph_count == 0 || font->long_hmetrics == 0 || font->ascent == font->descent) {
+        return false;
+    }
+
+    // full Unicode beats the basic plane, either beats the old Unicode platform
+    int best = 0;
+    int subtable_count = read_truetype_u16(font, cmap + 2);
+    for (int i = 0; i < subtable_count; ++i) {
+        int record = cmap + 4 + i*8;
+        int platform = read_truetype_u16(font, record);
+        int encoding = read_truetype_u16(font, record + 2);
+        int subtable = cmap + (int)read_truetype_u32(font, record + 4);
+        int format = read_truetype_u16(font, subtable);
+        if (format != 0 && format != 4 && format != 6 && format != 12) {
+            continue;
+        }
+
+        int rank = 0;
+        if (platform == 3 && encoding == 10) {
+            rank = 3;
+        }
+        else if (platform == 3 && encoding == 1) {
+            rank = 2;
+        }
+        else if (platform == 0) {
+            rank = 1;
+        }
+        if (rank > best) {
+            best = rank;
+            font->cmap = subtable;
+            font->cmap_format = format;
+        }
+    }
+    if (!font->cmap) {
+        return false;
+    }
+
+    // only the plain horizontal pair list, the first subtable is the one used
+    int kern = find_truetype_table(font, base, "kern");
+    if (kern && read_truetype_u16(font, kern) == 0 && read_truetype_u16(font, kern + 2) >= 1 &&
+        read_truetype_u16(font, kern + 8) == 1)
+    {
+        font->kern = kern + 4;
+    }
+
+    return true;
+}
+
+
+int find_truetype_glyph(TrueTypeFont *font, int codepoint)
+{
+    int cmap = font->cmap;
+    int glyph = 0;
+
+    if (codepoint < 0) {
+        return 0;
+    }
+
+    if (font->cmap_format == 0) {
+        if (codepoint < 256) {
+            glyph = read_truetype_u8(font, cmap + 6 + codepoint);
+        }
+    }
+    else if (font->cmap_format == 6) {
+        int first = read_truetype_u16(font, cmap + 6);
+        int count = read_truetype_u16(font, cmap + 8);
+        if (codepoint >= first && codepoint < first + count) {
+            glyph = read_truetype_u16(font, cmap + 10 + (codepoint - first)*2);
+        }
+    }
+    else if (font->cmap_format == 4) {
+        if (codepoint > 0xffff) {
+            return 0;
+        }
+
+        // segments are sorted by their last codepoint
+        int segment_count = read_truetype_u16(font, cmap + 6)/2;
+        int ends = cmap + 14;
+        int starts = ends + segment_count*2 + 2;
+        int deltas = starts + segment_count*2;
+        int range_offsets = deltas + segment_count*2;
+        for (int s = 0; s < segment_count; ++s) {
+            if ((int)read_truetype_u16(font, ends + s*2) < codepoint) {
+                continue;
+            }
+
+            int start = read_truetype_u16(font, starts + s*2);
+            if (codepoint < start) {
+                break;
+            }
+
+            int delta = read_truetype_u16(font, deltas + s*2);
+            int range_offset = read_truetype_u16(font, range_offsets + s*2);
+            if (range_offset == 0) {
+                glyph = (codepoint + delta) & 0xffff;
+            }
+            else {
+                glyph = read_truetype_u16(font, range_offsets + s*2 + range_offset + (codepoint - start)*2);
+                if (glyph) {
+                    glyph = (glyph + delta) & 0xffff;
+                }
+            }
+            break;
+        }
+    }
+    else if (font->cmap_format == 12) {
+        int low = 0;
+        int high = (int)read_truetype_u32(font, cmap + 12);
+        while (low < high) {
+            int middle = (low + high)/2;
+            int group = cmap + 16 + middle*12;
+            Uint32 first = read_truetype_u32(font, group);
+            Uint32 last = read_truetype_u32(font, group + 4);
+            if ((Uint32)codepoint < first) {
+                high = middle;
+            }
+            else if ((Uint32)codepoint > last) {
+                low = middle + 1;
+            }
+            else {
+                glyph = (int)(read_truetype_u32(font, group + 8) + (codepoint - first));
+                break;
+            }
+        }
+    }
+
+    return glyph < font->glyph_count ? glyph : 0;
+}
+
+
+void get_truetype_hmetrics(TrueTypeFont *font, int glyph, int *advance, int *left_side_bearing)
+{
+    int long_hmetrics = font->long_hmetrics;
+    if (glyph < long_hmetrics) {
+        *advance = read_truetype_u16(font, font->hmtx + glyph*4);
+        *left_side_bearing = read_truetype_s16(font, font->hmtx + glyph*4 + 2);
+    }
+    else {
+        *advance = read_truetype_u16(font, font->hmtx + (long_hmetrics - 1)*4);
+        *left_side_bearing = read_truetype_s16(font, font->hmtx + long_hmetrics*4 + (glyph - long_hmetrics)*2);
+    }
+}
+
+
+int get_truetype_kerning(TrueTypeFont *font, int first, int second)
+{
+    if (!font->kern) {
+        return 0;
+    }
+
+    // pairs are sorted by left and right glyph together
+    Uint32 key = ((Uint32)first << 16) | (Uint32)second;
+    int low = 0;
+    int high = read_truetype_u16(font, font->kern + 6);
+    while (low < high) {
+        int middle = (low + high)/2;
+        int pair = font->kern + 14 + middle*6;
+        Uint32 pair_key = read_truetype_u32(font, pair);
+        if (key < pair_key) {
+            high = middle;
+        }
+        else if (key > pair_key) {
+            low = middle + 1;
+        }
+        else {
+            return read_truetype_s16(font, pair + 4);
+        }
+    }
+    return 0;
+}
+
+
+float get_truetype_scale(TrueTypeFont *font, float pixel_height)
+{
+    return pixel_height/(float)(font->ascent - font->descent);
+}
+
+
+/*********************************************************************
+ OUTLINES
+ *********************************************************************/
+// where the glyph's data starts, 0 when it has none
+static int find_truetype_glyph_data(TrueTypeFont *font, int glyph)
+{
+    if (glyph < 0 || glyph >= font->glyph_count) {
+        return 0;
+    }
+
+    Uint32 start;
+    Uint32 end;
+    if (font->long_loca) {
+        start = read_truetype_u32(font, font->loca + glyph*4);
+        end = read_truetype_u32(font, font->loca + glyph*4 + 4);
+    }
+    else {
+        start = read_truetype_u16(font, font->loca + glyph*2)*2;
+        end = read_truetype_u16(font, font->loca + glyph*2 + 2)*2;
+    }
+
+    if (end <= start || font->glyf + end > (Uint32)font->size) {
+        return 0;
+    }
+    return font->glyf + (int)start;
+}
+
+
+static void add_outline_line(TrueTypeOutline *outline, float x0, float y0, float x1, float y1)
+{
+    if (x0 == x1 && y0 == y1) {
+        return;
+    }
+    if (outline->count >= TRUETYPE_MAX_SEGMENTS) {
+        outline->overflow = true;
+        return;
+    }
+
+    TrueTypeSegment *segment = &outline->segments[outline->count++];
+    segment->x0 = x0;
+    segment->y0 = y0;
+    segment->x1 = x1;
+    segment->y1 = y1;
+}
+
+
+static void add_outline_curve(TrueTypeOutline *outline, float x0, float y0, float cx, float cy, float x1, float y1)
+{
+    // a quadratic strays a quarter of its second difference from the chord, split
+    // into n lines it strays n squared times less
+    float dx = x0 - 2.f*cx + x1;
+    float dy = y0 - 2.f*cy + y1;
+    int steps = (int)ceilf(sqrtf(sqrtf(dx*dx + dy*dy)/(8.f*TRUETYPE_FLATNESS)));
+    if (steps < 1) {
+        steps = 1;
+    }
+    if (steps > 32) {
+        steps = 32;
+    }
+
+    float px = x0;
+    float py = y0;
+    for (int i = 1; i <= steps; ++i) {
+        float t = i/(float)steps;
+        float u = 1.f - t;
+        float x = u*u*x0 + 2.f*u*t*cx + t*t*x1;
+        float y = u*u*y0 + 2.f*u*t*cy + t*t*y1;
+        add_outline_line(outline, px, py, x, y);
+        px = x;
+        py = y;
+    }
+}
+
+
+// font units to bitmap pixels, x' = m0 x + m2 y + m4, y' = m1 x + m3 y + m5
+static void add_glyph_outline(TrueTypeFont *font, TrueTypeOutline *outline, int glyph, const float *m, int depth);
+
+static void add_simple_glyph_outline(TrueTypeFont *font, TrueTypeOutline *outline, int data, int contour_count, const float *m)
+{
+    int ends = data + 10;
+    int point_count = read_truetype_u16(font, ends + (contour_count - 1)*2) + 1;
+    int instruction_length = read_truetype_u16(font, ends + contour_count*2);
+    int flags = ends + contour_count*2 + 2 + instruction_length;
+
+    // the flags run until every point has one, the x deltas follow, then the y
+    int xs = flags;
+    int x_bytes = 0;
+    for (int point = 0; point < point_count && xs < font->size;) {
+        Uint32 flag = read_truetype_u8(font, xs++);
+        int repeat = 1;
+        if (flag & 0x08) {
+            repeat += read_truetype_u8(font, xs++);
+        }
+        int size = (flag & 0x02) ? 1 : ((flag & 0x10) ? 0 : 2);
+        x_bytes += size*repeat;
+        point += repeat;
+    }
+    int ys = xs + x_bytes;
+
+    int flag_at = flags;
+    Uint32 flag = 0;
+    int repeat = 0;
+    int x = 0;
+    int y = 0;
+    int first = 0;
+    for (int c = 0; c < contour_count; ++c) {
+        int last = read_truetype_u16(font, ends + c*2);
+        if (last < first || last >= point_count) {
+            return;
+        }
+
+        // the whole contour is read first, where it starts depends on its last point
+        int count = last - first + 1;
+        float px[TRUETYPE_MAX_CONTOUR_POINTS];
+        float py[TRUETYPE_MAX_CONTOUR_POINTS];
+        bool on[TRUETYPE_MAX_CONTOUR_POINTS];
+        if (count > TRUETYPE_MAX_CONTOUR_POINTS) {
+            outline->overflow = true;
+            return;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (repeat > 0) {
+                repeat -= 1;
+            }
+            else {
+                flag = read_truetype_u8(font, flag_at++);
+                if (flag & 0x08) {
+                    repeat = read_truetype_u8(font, flag_at++);
+                }
+            }
+
+            if (flag & 0x02) {
+                int delta = read_truetype_u8(font, xs++);
+                x += (flag & 0x10) ? delta : -delta;
+            }
+            else if (!(flag & 0x10)) {
+                x += read_truetype_s16(font, xs);
+                xs += 2;
+            }
+            if (flag & 0x04) {
+                int delta = read_truetype_u8(font, ys++);
+                y += (flag & 0x20) ? delta : -delta;
+            }
+            else if (!(flag & 0x20)) {
+                y += read_truetype_s16(font, ys);
+                ys += 2;
+            }
+
+            px[i] = m[0]*x + m[2]*y + m[4];
+            py[i] = m[1]*x + m[3]*y + m[5];
+            on[i] = (flag & 0x01) != 0;
+        }
+        first = last + 1;
+
+        // off curve neighbours imply an on curve point halfway between them
+        float start_x;
+        float start_y;
+        int begin = 0;
+        int end = count;
+        if (on[0]) {
+            start_x = px[0];
+            start_y = py[0];
+            begin = 1;
+        }
+        else if (on[count - 1]) {
+            start_x = px[count - 1];
+            start_y = py[count - 1];
+            end = count - 1;
+        }
+        else {
+            start_x = (px[0] + px[count - 1])*0.5f;
+            start_y = (py[0] + py[count - 1])*0.5f;
+        }
+
+        float current_x = start_x;
+        float current_y = start_y;
+        bool control = false;
+        float control_x = 0.f;
+        float control_y = 0.f;
+        for (int i = begin; i < end; ++i) {
+            if (on[i]) {
+                if (control) {
+                    add_outline_curve(outline, current_x, current_y, control_x, control_y, px[i], py[i]);
+                }
+                else {
+                    add_outline_line(outline, current_x, current_y, px[i], py[i]);
+                }
+                current_x = px[i];
+                current_y = py[i];
+                control = false;
+            }
+            else {
+                if (control) {
+                    float middle_x = (control_x + px[i])*0.5f;
+                    float middle_y = (control_y + py[i])*0.5f;
+                    add_outline_curve(outline, current_x, current_y, control_x, control_y, middle_x, middle_y);
+                    current_x = middle_x;
+                    current_y = middle_y;
+                }
+                control_x = px[i];
+                control_y = py[i];
+                control = true;
+            }
+        }
+
+        if (control) {
+            add_outline_curve(outline, current_x, current_y, control_x, control_y, start_x, start_y);
+        }
+        else {
+            add_outline_line(outline, current_x, current_y, start_x, start_y);
+        }
+    }
+}
+
+
+static void add_composite_glyph_outline(TrueTypeFont *font, TrueTypeOutline *outline, int data, const float *m, int depth)
+{
+    int at = data + 10;
+    Uint32 flags;
+    do {
+        flags = read_truetype_u16(font, at);
+        int glyph = read_truetype_u16(font, at + 2);
+        at += 4;
+
+        int arg1;
+        int arg2;
+        if (flags & 0x0001) {
+            arg1 = read_truetype_s16(font, at);
+            arg2 = read_truetype_s16(font, at + 2);
+            at += 4;
+        }
+        else {
+            arg1 = (Sint8)read_truetype_u8(font, at);
+            arg2 = (Sint8)read_truetype_u8(font, at + 1);
+            at += 2;
+        }
+
+        // components placed by matching points are drawn unmoved
+        float e = 0.f;
+        float f = 0.f;
+        if (flags & 0x0002) {
+            e = (float)arg1;
+            f = (float)arg2;
+        }
+
+        float a = 1.f;
+        float b = 0.f;
+        float c = 0.f;
+        float d = 1.f;
+        if (flags & 0x0008) {
+            a = d = read_truetype_s16(font, at)/16384.f;
+            at += 2;
+        }
+        else if (flags & 0x0040) {
+            a = read_truetype_s16(font, at)/16384.f;
+            d = read_truetype_s16(font, at + 2)/16384.f;
+            at += 4;
+        }
+        else if (flags & 0x0080) {
+            a = read_truetype_s16(font, at)/16384.f;
+            b = read_truetype_s16(font, at + 2)/16384.f;
+            c = read_truetype_s16(font, at + 4)/16384.f;
+            d = read_truetype_s16(font, at + 6)/16384.f;
+            at += 8;
+        }
+
+        // the component's transform, then the parent's
+        float child[6];
+        child[0] = m[0]*a + m[2]*b;
+        child[1] = m[1]*a + m[3]*b;
+        child[2] = m[0]*c + m[2]*d;
+        child[3] = m[1]*c + m[3]*d;
+        child[4] = m[0]*e + m[2]*f + m[4];
+        child[5] = m[1]*e + m[3]*f + m[5];
+        add_glyph_outline(font, outline, glyph, child, depth + 1);
+    } while ((flags & 0x0020) && at < font->size && !outline->overflow);
+}
+
+
+static void add_glyph_outline(TrueTypeFont *font, TrueTypeOutline *outline, int glyph, const float *m, int depth)
+{
+    int data = find_truetype_glyph_data(font, glyph);
+    if (!data || depth > TRUETYPE_MAX_COMPOSITE_DEPTH) {
+        return;
+    }
+
+    int contour_count = read_truetype_s16(font, data);
+    if (contour_count > 0) {
+        add_simple_glyph_outline(font, outline, data, contour_count, m);
+    }
+    else if (contour_count < 0) {
+        add_composite_glyph_outline(font, outline, data, m, depth);
+    }
+}
+
+
+static float get_segment_distance_squared(const TrueTypeSegment *segment, float x, float y)
+{
+    float dx = segment->x1 - segment->x0;
+    float dy = segment->y1 - segment->y0;
+    float t = ((x - segment->x0)*dx + (y - segment->y0)*dy)/(dx*dx + dy*dy);
+    if (t < 0.f) {
+        t = 0.f;
+    }
+    if (t > 1.f) {
+        t = 1.f;
+    }
+    float ex = segment->x0 + dx*t - x;
+    float ey = segment->y0 + dy*t - y;
+    return ex*ex + ey*ey;
+}
+
+
+bool render_truetype_sdf(TrueTypeFont *font, TrueTypeOutline *outline, int glyph, float scale, int padding,
+                         Uint8 onedge, float pixel_dist_scale, Uint8 *bitmap, int capacity,
+                         int *width, int *height, int *x_offset, int *y_offset)
+{
+    *width = 0;
+    *height = 0;
+    *x_offset = 0;
+    *y_offset = 0;
+
+    int data = find_truetype_glyph_data(font, glyph);
+    if (!data || scale <= 0.f) {
+        return false;
+    }
+
+    // the box from the glyph's header, in whole pixels, y down
+    int x0 = (int)floorf(read_truetype_s16(font, data + 2)*scale);
+    int y0 = (int)floorf(-read_truetype_s16(font, data + 8)*scale);
+    int x1 = (int)ceilf(read_truetype_s16(font, data + 6)*scale);
+    int y1 = (int)ceilf(-read_truetype_s16(font, data + 4)*scale);
+    if (x0 >= x1 || y0 >= y1) {
+        return false;
+    }
+
+    x0 -= padding;
+    y0 -= padding;
+    int w = x1 - x0 + padding;
+    int h = y1 - y0 + padding;
+    if (w*h > capacity) {
+        return false;
+    }
+
+    float m[6] = { scale, 0.f, 0.f, -scale, (float)-x0, (float)-y0 };
+    outline->count = 0;
+    outline->overflow = false;
+    add_glyph_outline(font, outline, glyph, m, 0);
+    if (outline->overflow || outline->count == 0) {
+        return false;
+    }
+
+    for (int row = 0; row < h; ++row) {
+        float y = row + 0.5f;
+        for (int column = 0; column < w; ++column) {
+            float x = column + 0.5f;
+
+            // nonzero winding along a ray to the right says inside or out
+            float nearest = 1e30f;
+            int winding = 0;
+            for (int s = 0; s < outline->count; ++s) {
+                const TrueTypeSegment *segment = &outline->segments[s];
+                float distance = get_segment_distance_squared(segment, x, y);
+                if (distance < nearest) {
+                    nearest = distance;
+                }
+
+                if ((segment->y0 <= y) != (segment->y1 <= y)) {
+                    float t = (y - segment->y0)/(segment->y1 - segment->y0);
+                    if (segment->x0 + (segment->x1 - segment->x0)*t > x) {
+                        winding += segment->y1 > segment->y0 ? 1 : -1;
+                    }
+                }
+            }
+
+            float distance = sqrtf(nearest);
+            float value = onedge + pixel_dist_scale*(winding ? distance : -distance);
+            if (value < 0.f) {
+                value = 0.f;
+            }
+            if (value > 255.f) {
+                value = 255.f;
+            }
+            bitmap[row*w + column] = (Uint8)value;
+        }
+    }
+
+    *width = w;
+    *height = h;
+    *x_offset = x0;
+    *y_offset = y0;
+    return true;
+}
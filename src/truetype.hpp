@@ -0,0 +1,71 @@
+#pragma once
+
+#include "types.h"
+
+// TrueType fonts read straight out of memory, usually a FileView of the pack.
+// Only what the text system draws with: the Unicode cmap, glyf outlines,
+// composites included, horizontal metrics and the kern table. CFF outlines,
+// hinting and GPOS kerning aren't supported.
+#define TRUETYPE_MAX_SEGMENTS 4096
+#define TRUETYPE_MAX_CONTOUR_POINTS 512
+#define TRUETYPE_MAX_COMPOSITE_DEPTH 4
+
+// how far a flattened curve may stray from the real one, in pixels
+#define TRUETYPE_FLATNESS 0.05f
+
+struct TrueTypeFont {
+    const Uint8 *data;
+    int size;
+
+    int glyph_count;
+    int units_per_em;
+    int long_loca;              // loca holds 32 bit offsets rather than halved 16 bit ones
+    int long_hmetrics;          // glyphs past these share the last advance
+    int ascent;
+    int descent;
+    int line_gap;
+
+    // table offsets, 0 when the font has none
+    int cmap;                   // the Unicode subtable
+    int cmap_format;
+    int glyf;
+    int loca;
+    int hmtx;
+    int kern;                   // the horizontal format 0 subtable
+};
+
+// in bitmap pixels, y down
+struct TrueTypeSegment {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+};
+
+// a glyph's outline flattened to lines, scratch for render_truetype_sdf
+struct TrueTypeOutline {
+    int count;
+    bool overflow;
+    TrueTypeSegment segments[TRUETYPE_MAX_SEGMENTS];
+};
+
+bool open_truetype(TrueTypeFont *font, const Uint8 *data, int size);
+
+// 0, the missing glyph box, for codepoints the font doesn't have
+int find_truetype_glyph(TrueTypeFont *font, int codepoint);
+
+// in font units, as are the font's ascent, descent and line gap
+void get_truetype_hmetrics(TrueTypeFont *font, int glyph, int *advance, int *left_side_bearing);
+int get_truetype_kerning(TrueTypeFont *font, int first, int second);
+
+// font units to pixels, for ascent to descent to span pixel_height
+float get_truetype_scale(TrueTypeFont *font, float pixel_height);
+
+// Signed distance field of a glyph at scale, onedge on the outline and rising
+// by pixel_dist_scale for every pixel further inside. The bitmap is padding
+// pixels bigger than the glyph on every side, offset is from the pen to its
+// top left, y down. False for glyphs without an outline and ones that don't
+// fit capacity bytes.
+bool render_truetype_sdf(TrueTypeFont *font, TrueTypeOutline *outline, int glyph, float scale, int padding,
+                         Uint8 onedge, float pixel_dist_scale, Uint8 *bitmap, int capacity,
+                         int *width, int *height, int *x_offset, int *y_offset);
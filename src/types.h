@@ -15,13 +15,57 @@
 
 #include <glm/glm.hpp>
 
-#define MALLOC(T) ((T*)malloc(sizeof(T)))
+void *tracked_malloc(size_t size);
+void *tracked_realloc(void *memory, size_t size);
+#define MALLOC(T) ((T*)tracked_malloc(sizeof(T)))
 
 #define KILOBYTES(n) ((n)*1024)
 #define MEGABYTES(n) (KILOBYTES(n)*1024)
 #define GIGABYTES(n) (MEGABYTES(n)*1024)
 #define TERABYTES(n) (GIGABYTES(n)*1024)
 
+#define ENTITY_NAME_LENGTH 32
+#define MAX_ENTITY_GROUPS 16
+#define MAX_TAGGED_ENTITIES 32
+
+// A pointer kept as the distance from itself to its target, so a block that
+// holds both ends can be copied anywhere and every link still holds. Only
+// for links that stay inside one arena. 0 is null, nothing points at itself.
+template <typename T>
+struct ArenaPtr {
+    Sint32 offset;
+
+    ArenaPtr() : offset(0) {}
+    ArenaPtr(T *target) { set(target); }
+    ArenaPtr(const ArenaPtr &other) { set(other.get()); }
+
+    ArenaPtr &operator=(T *target) { set(target); return *this; }
+    ArenaPtr &operator=(const ArenaPtr &other) { set(other.get()); return *this; }
+
+    T *get() const { return offset ? (T *)((char *)this + offset) : nullptr; }
+    void set(T *target) { offset = target ? (Sint32)((char *)target - (char *)this) : 0; }
+
+    operator T*() const { return get(); }
+    T *operator->() const { return get(); }
+};
+
+// Names a slot in a resource registry, see resources.hpp. The low 16 bits
+// are the index, the high 16 the slot's generation. 0 is no resource.
+template <typename T>
+struct ResourceHandle {
+    Uint32 value;
+
+    bool operator==(ResourceHandle other) const { return value == other.value; }
+    bool operator!=(ResourceHandle other) const { return value != other.value; }
+};
+
+struct Shader;
+struct Texture;
+typedef ResourceHandle<Shader> ShaderHandle;
+typedef ResourceHandle<Texture> TextureHandle;
+
+typedef int SoundId;
+
 
 struct GamePadController {
     bool btn_up;
@@ -44,26 +88,34 @@ struct Window {
     int height;
 };
 
+// lives in the shader registry, the handle is what the render queue keys on
 struct Shader {
-    int id;
     GLuint glid;
+    const char *name;       // for messages, only debug builds can look a shader up by it
 
-    std::string vertex_shader_filename;
-    std::string fragment_shader_filename;
-    std::string name;
-
-    std::map<std::string, GLint> *uniform_locations;
+    // transparent compare so lookups by const char * don't build a std::string
+    std::map<std::string, GLint, std::less<>> *uniform_locations;
 
     bool bound;
 };
 
+struct CollisionMask;
+#define TEXTURE_PATH_LENGTH 256
+
+// owned by the texture cache, the struct stays put while the image behind it
+// comes and goes, so holding a pointer is fine as long as it is acquired
 struct Texture {
-    int id;
-    GLuint glid;
+    GLuint glid;            // 0 while evicted
 
-    std::string name;
-    std::string image_path;
+    char image_path[TEXTURE_PATH_LENGTH];
     glm::vec2 image_size;
+
+    // opaque texels, built from the alpha when the image loads
+    CollisionMask *collision_mask;
+
+    int references;
+    int bytes;              // on the GPU while resident
+    Uint32 released_frame;  // eviction goes oldest first
 };
 
 struct Frame {
@@ -79,25 +131,46 @@ struct Entity;
 struct Sprite {
     int id;
 
-    Entity *parent;
+    ArenaPtr<Entity> parent;
     Texture *texture;
 
     glm::vec2 texture_frame_offset;
     glm::vec2 texture_frame_size;
+
+    // RENDER_LAYER and RENDER_BLEND, both go into the render queue sort key
+    int layer;
+    int blend;
+
+    // a clip replaces the static frame, the GPU works out which frame to show
+    int animation_clip;
+    float animation_start_s;
+    float animation_speed;
 };
 
 
 struct Scene;
+struct Background;
+struct ProjectileSystem;
+struct RenderQueue;
 struct Entity {
     int id;
-    std::string tag;
-    std::string group_tag;
-    std::string name;
-    Scene *scene;
-    Sprite *sprite;
-    Entity *parent;
-
-    std::list<Entity *> *children;
+    char tag[ENTITY_NAME_LENGTH];
+    char group_tag[ENTITY_NAME_LENGTH];
+    char name[ENTITY_NAME_LENGTH];
+    bool in_scene;
+    ArenaPtr<Sprite> sprite;
+    ArenaPtr<Entity> parent;
+
+    // intrusive links so adding and removing entities never touches the heap.
+    // siblings link either the scene's root entities or a parent's children.
+    // all of them stay inside the scene arena, which is what lets a snapshot copy it.
+    ArenaPtr<Entity> first_child;
+    ArenaPtr<Entity> last_child;
+    ArenaPtr<Entity> prev_sibling;
+    ArenaPtr<Entity> next_sibling;
+
+    ArenaPtr<Entity> prev_in_group;
+    ArenaPtr<Entity> next_in_group;
 
     glm::vec3 acceleration;
     glm::vec3 velocity;
@@ -120,32 +193,128 @@ struct MemoryArena {
     unsigned char *current_memory_pointer;
 };
 
+#define ARENA_NULL_OFFSET 0xffffffffu
+
+// fixed size blocks carved out of an arena, freed blocks are reused. the free
+// list is chained through the blocks as arena offsets, so it survives a snapshot
+struct MemoryPool {
+    MemoryArena *arena;
+    int element_size;
+
+    Uint32 free_list;
+};
+
+struct EntityGroup {
+    char tag[ENTITY_NAME_LENGTH];
+    int count;
+
+    Entity *first;
+    Entity *last;
+};
+
+struct EntityTag {
+    char tag[ENTITY_NAME_LENGTH];
+    Entity *entity;
+};
+
 typedef void (*SceneStartupFunc)(Scene*);
 typedef void (*SceneUpdateFunc)(Scene*, float elapsed_time_s);
+typedef void (*SceneDrawFunc)(Scene*, RenderQueue *queue);
 typedef void (*SceneShutdownFunc)(Scene*);
 
+#define SCENE_MAX_TEXTURES 32
+
+// a texture the scene needs before its startup runs, skipped if it is already loaded
+struct SceneTexture {
+    const char *name;
+    const char *image_path;
+};
+
 struct Scene {
     int id;
 
     MemoryArena memory_arena;
 
-    GLuint vao;
-    Frame frame;
-
+    // the arena and textures are ready, the startup can run
+    bool loaded;
     bool initialized;
     bool should_end;
 
-    std::list <Entity *> *entities;
-    std::map <std::string, Entity *> *tagged_entities;
-    std::map <std::string, std::list<Entity *>> *tagged_groups;
+    // set before the startup, a second ship driven by gamepadcontroller_two
+    bool coop;
+
+    // Simulation state from here on, down to the callbacks and again after
+    // them. These pointers all point into the arena, snapshots keep them as offsets.
+
+    // simulated seconds, animation start times are on this clock
+    float time_s;
+
+    MemoryPool entity_pool;
+    MemoryPool sprite_pool;
+
+    Entity *first_entity;
+    Entity *last_entity;
+
+    int tag_count;
+    EntityTag tags[MAX_TAGGED_ENTITIES];
+
+    int group_count;
+    EntityGroup groups[MAX_ENTITY_GROUPS];
 
     SceneStartupFunc startup;
     SceneUpdateFunc update;
     SceneShutdownFunc shutdown;
+    SceneDrawFunc draw_overlay;     // optional, sprites that aren't entities, like HUD panels
+
+    const SceneTexture *textures;
+    int texture_count;
+
+    // resolved when the scene loads, in the order of the texture list
+    TextureHandle texture_handles[SCENE_MAX_TEXTURES];
 
     Entity *player;
+    void *data;
+
+    // parallax layers drawn behind everything, lives in the scene arena
+    Background *background;
+
+    // in the scene arena, pools and all
+    ProjectileSystem *projectiles;
+
+    // streamed, crossfaded in when the scene becomes the top of the stack
+    const char *music_path;
 
     GamePadController gamepadcontroller;
+    GamePadController gamepadcontroller_two;
+};
+
+// per scene simulation state, lives in the scene arena so a replay starts
+// from exactly the same values every run
+#define MAIN_SCENE_METEOR_COUNT 4
+
+struct MainSceneData {
+    float option_angle;
+    float shoot_interval_s;
+    float shoot_timer_s;
+
+    // the option fires rotating rings while the secondary button is held
+    float pattern_interval_s;
+    float pattern_timer_s;
+    float pattern_angle;
+
+    ArenaPtr<Entity> option;
+    SoundId shoot_sound;
+
+    // co-op only, lasers and no option
+    ArenaPtr<Entity> player_two;
+    float player_two_shoot_timer_s;
+
+    // targets for the lasers, a destroyed one comes back in from the top
+    ArenaPtr<Entity> meteors[MAIN_SCENE_METEOR_COUNT];
+    float meteor_health[MAIN_SCENE_METEOR_COUNT];
+    float meteor_max_health[MAIN_SCENE_METEOR_COUNT];
+    float meteor_spin[MAIN_SCENE_METEOR_COUNT];
+    int meteors_destroyed;
 };
 
 
@@ -154,17 +323,17 @@ enum PROJECTILE_TYPE {
     LASER,
     BULLET,
     MISSILE,
-    ORB
+    ORB,
+
+    PROJECTILE_TYPE_COUNT
 };
 
+// One shot to spawn. Live projectiles don't keep this layout, the
+// projectile pools store every field in its own array.
 struct Projectile {
-    Entity *entity;
-    
-    Entity *from;
-
-    float Projectile_velocity;
-    float Projectile_damage;
-    PROJECTILE_TYPE projectile_type;
+    glm::vec2 position;
+    glm::vec2 velocity;
+    float damage;
 };
 
 struct Player {
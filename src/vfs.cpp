@@ -0,0 +1,519 @@
+#include "vfs.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+// empty files can't be mapped, their views point here instead
+static const unsigned char VFS_EMPTY_FILE[1] = { 0 };
+
+
+static bool map_file(const char *path, MappedFile *file)
+{
+    file->base = nullptr;
+    file->size = 0;
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+        CloseHandle(handle);
+        return false;
+    }
+    file->size = (size_t)size.QuadPart;
+
+    if (file->size > 0) {
+        HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        file->base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+
+        if (file->base == nullptr) {
+            CloseHandle(handle);
+            return false;
+        }
+    }
+
+    CloseHandle(handle);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return false;
+    }
+    file->size = (size_t)info.st_size;
+
+    if (file->size > 0) {
+        void *base = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        file->base = base;
+    }
+
+    // the mapping keeps the file alive on its own
+    close(fd);
+#endif
+
+    return true;
+}
+
+
+static void unmap_file(MappedFile *file)
+{
+    if (file->base) {
+#ifdef _WIN32
+        UnmapViewOfFile(file->base);
+#else
+        munmap(file->base, file->size);
+#endif
+    }
+
+    file->base = nullptr;
+    file->size = 0;
+}
+
+
+bool normalize_path(const char *path, char *normalized, int size)
+{
+    int length = 0;
+    const char *c = path;
+
+    while (*c) {
+        while (*c == '/' || *c == '\\') {
+            ++c;
+        }
+
+        const char *start = c;
+        while (*c && *c != '/' && *c != '\\') {
+            ++c;
+        }
+
+        int segment = (int)(c - start);
+        if (segment == 0 || (segment == 1 && start[0] == '.')) {
+            continue;
+        }
+
+        if (segment == 2 && start[0] == '.' && start[1] == '.') {
+            // a path can't climb out of the mount it resolves in
+            if (length == 0) {
+                return false;
+            }
+
+            while (length > 0 && normalized[length - 1] != '/') {
+                --length;
+            }
+            if (length > 0) {
+                --length;
+            }
+            continue;
+        }
+
+        if (length + (length > 0 ? 1 : 0) + segment + 1 > size) {
+            return false;
+        }
+
+        if (length > 0) {
+            normalized[length++] = '/';
+        }
+        memcpy(normalized + length, start, segment);
+        length += segment;
+    }
+
+    normalized[length] = '\0';
+    return length > 0;
+}
+
+
+Uint64 hash_path(const char *normalized)
+{
+    // FNV-1a, 64 bit so a pack never has to worry about two paths colliding
+    Uint64 hash = 14695981039346656037ull;
+    for (const char *c = normalized; *c; ++c) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+static bool init_mount(Vfs *vfs, VfsMount *mount, VFS_MOUNT_TYPE type, const char *mount_point)
+{
+    if (vfs->mount_count >= VFS_MAX_MOUNTS) {
+        LOG_ERROR(LOG_FILE, "Too many mounts, cannot mount %s", mount_point);
+        return false;
+    }
+
+    memset(mount, 0, sizeof(VfsMount));
+    mount->type = type;
+
+    // an empty mount point puts the mount at the root
+    if (mount_point[0] && !normalize_path(mount_point, mount->prefix, VFS_PATH_LENGTH)) {
+        LOG_ERROR(LOG_FILE, "Bad mount point: %s", mount_point);
+        return false;
+    }
+    mount->prefix_length = (int)SDL_strlen(mount->prefix);
+
+    return true;
+}
+
+
+static const char *strip_mount_prefix(VfsMount *mount, const char *normalized)
+{
+    if (mount->prefix_length == 0) {
+        return normalized;
+    }
+
+    if (SDL_strncmp(normalized, mount->prefix, mount->prefix_length) != 0 || normalized[mount->prefix_length] != '/') {
+        return nullptr;
+    }
+
+    return normalized + mount->prefix_length + 1;
+}
+
+
+static const PackEntry *find_pack_entry(VfsMount *mount, const char *relative)
+{
+    Uint64 hash = hash_path(relative);
+    int length = (int)SDL_strlen(relative);
+
+    // entries are sorted by hash
+    Uint32 low = 0;
+    Uint32 high = mount->entry_count;
+    while (low < high) {
+        Uint32 middle = low + (high - low)/2;
+        if (mount->entries[middle].hash < hash) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    for (Uint32 i = low; i < mount->entry_count && mount->entries[i].hash == hash; ++i) {
+        const PackEntry *entry = &mount->entries[i];
+        if ((int)entry->name_length == length && memcmp(mount->names + entry->name_offset, relative, length) == 0) {
+            return entry;
+        }
+    }
+
+    return nullptr;
+}
+
+
+void init_vfs(Vfs *vfs)
+{
+    if (vfs == nullptr) {
+        LOG_ERROR(LOG_FILE, "vfs is null");
+        exit(1);
+    }
+
+    memset(vfs, 0, sizeof(Vfs));
+}
+
+
+void shutdown_vfs(Vfs *vfs)
+{
+    int views_open = SDL_AtomicGet(&vfs->stats.views_open);
+    if (views_open > 0) {
+        LOG_WARN(LOG_FILE, "%d file views still open at shutdown", views_open);
+    }
+
+    for (int i = 0; i < vfs->mount_count; ++i) {
+        if (vfs->mounts[i].type == VFS_MOUNT_PACK) {
+            unmap_file(&vfs->mounts[i].pack);
+        }
+    }
+    vfs->mount_count = 0;
+}
+
+
+bool mount_directory(Vfs *vfs, const char *directory, const char *mount_point)
+{
+    VfsMount *mount = &vfs->mounts[vfs->mount_count];
+    if (!init_mount(vfs, mount, VFS_MOUNT_DIRECTORY, mount_point)) {
+        return false;
+    }
+
+    SDL_strlcpy(mount->root, directory, VFS_PATH_LENGTH);
+    vfs->mount_count += 1;
+
+    LOG_INFO(LOG_FILE, "Mounted directory %s at /%s", directory, mount->prefix);
+    return true;
+}
+
+
+bool mount_pack(Vfs *vfs, const char *pack_path, const char *mount_point)
+{
+    VfsMount *mount = &vfs->mounts[vfs->mount_count];
+    if (!init_mount(vfs, mount, VFS_MOUNT_PACK, mount_point)) {
+        return false;
+    }
+
+    if (!map_file(pack_path, &mount->pack)) {
+        LOG_DEBUG(LOG_FILE, "No pack at %s", pack_path);
+        return false;
+    }
+
+    const PackHeader *header = (const PackHeader *)mount->pack.base;
+    size_t size = mount->pack.size;
+
+    bool valid = header && size >= sizeof(PackHeader) &&
+                 header->magic == PACK_FILE_MAGIC && header->version == PACK_FILE_VERSION &&
+                 header->entries_offset <= size &&
+                 header->entry_count <= (size - header->entries_offset)/sizeof(PackEntry) &&
+                 header->names_offset <= size;
+
+    if (valid) {
+        mount->entries = (const PackEntry *)((const unsigned char *)mount->pack.base + header->entries_offset);
+        mount->names = (const char *)mount->pack.base + header->names_offset;
+        mount->entry_count = header->entry_count;
+
+        for (Uint32 i = 0; valid && i < mount->entry_count; ++i) {
+            const PackEntry *entry = &mount->entries[i];
+            valid = entry->offset <= size && entry->size <= size - entry->offset &&
+                    header->names_offset + entry->name_offset + entry->name_length <= size;
+        }
+    }
+
+    if (!valid) {
+        LOG_ERROR(LOG_FILE, "Bad pack file: %s", pack_path);
+        unmap_file(&mount->pack);
+        return false;
+    }
+
+    vfs->mount_count += 1;
+
+    LOG_INFO(LOG_FILE, "Mounted pack %s at /%s, %u files", pack_path, mount->prefix, mount->entry_count);
+    return true;
+}
+
+
+bool open_file_view(Vfs *vfs, const char *path, FileView *view)
+{
+    memset(view, 0, sizeof(FileView));
+
+    char normalized[VFS_PATH_LENGTH];
+    if (!normalize_path(path, normalized, VFS_PATH_LENGTH)) {
+        LOG_ERROR(LOG_FILE, "Bad path: %s", path);
+        return false;
+    }
+
+    bool from_pack = false;
+
+    // newest mount first, so a pack mounted over a directory patches it
+    for (int i = vfs->mount_count - 1; i >= 0; --i) {
+        VfsMount *mount = &vfs->mounts[i];
+
+        const char *relative = strip_mount_prefix(mount, normalized);
+        if (relative == nullptr) {
+            continue;
+        }
+
+        if (mount->type == VFS_MOUNT_PACK) {
+            const PackEntry *entry = find_pack_entry(mount, relative);
+            if (entry) {
+                view->data = (const unsigned char *)mount->pack.base + entry->offset;
+                view->size = (size_t)entry->size;
+                from_pack = true;
+                break;
+            }
+        }
+        else {
+            char disk_path[VFS_PATH_LENGTH*2];
+            SDL_snprintf(disk_path, sizeof(disk_path), "%s/%s", mount->root, relative);
+
+            if (map_file(disk_path, &view->mapping)) {
+                view->data = view->mapping.base ? (const unsigned char *)view->mapping.base : VFS_EMPTY_FILE;
+                view->size = view->mapping.size;
+                break;
+            }
+        }
+    }
+
+    // not under any mount, a path from the command line can still name a file directly
+    if (view->data == nullptr && map_file(path, &view->mapping)) {
+        view->data = view->mapping.base ? (const unsigned char *)view->mapping.base : VFS_EMPTY_FILE;
+        view->size = view->mapping.size;
+    }
+
+    if (view->data == nullptr) {
+        SDL_AtomicAdd(&vfs->stats.misses, 1);
+        return false;
+    }
+
+    SDL_AtomicAdd(&vfs->stats.views_opened, 1);
+    SDL_AtomicAdd(&vfs->stats.views_open, 1);
+
+    LOG_DEBUG(LOG_FILE, "Opened %s @ %d bytes%s", normalized, (int)view->size, from_pack ? " from pack" : "");
+    return true;
+}
+
+
+void close_file_view(Vfs *vfs, FileView *view)
+{
+    if (view->data == nullptr) {
+        return;
+    }
+
+    unmap_file(&view->mapping);
+    memset(view, 0, sizeof(FileView));
+    SDL_AtomicAdd(&vfs->stats.views_open, -1);
+}
+
+
+void collect_directory_files(const std::string &directory, const std::string &relative, std::vector<std::string> &files)
+{
+    std::string path = relative.empty() ? directory : directory + "/" + relative;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((path + "\\*").c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    do {
+        std::string name = found.cFileName;
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        std::string child = relative.empty() ? name : relative + "/" + name;
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            collect_directory_files(directory, child, files);
+        }
+        else {
+            files.push_back(child);
+        }
+    } while (FindNextFileA(search, &found));
+
+    FindClose(search);
+#else
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+
+    while (dirent *found = readdir(dir)) {
+        std::string name = found->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        std::string child = relative.empty() ? name : relative + "/" + name;
+        struct stat info;
+        if (stat((directory + "/" + child).c_str(), &info) != 0) {
+            continue;
+        }
+
+        if (S_ISDIR(info.st_mode)) {
+            collect_directory_files(directory, child, files);
+        }
+        else if (S_ISREG(info.st_mode)) {
+            files.push_back(child);
+        }
+    }
+
+    closedir(dir);
+#endif
+}
+
+
+bool write_pack(const char *directory, const char *pack_path)
+{
+    std::vector<std::string> files;
+    collect_directory_files(directory, "", files);
+
+    if (files.empty()) {
+        LOG_ERROR(LOG_FILE, "Nothing to pack in %s", directory);
+        return false;
+    }
+
+    // the entry table is looked up by binary search on the path hash
+    std::sort(files.begin(), files.end(), [](const std::string &a, const std::string &b) {
+        return hash_path(a.c_str()) < hash_path(b.c_str());
+    });
+
+    std::fstream file;
+    file.open(pack_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_ERROR(LOG_FILE, "Could not create pack: %s", pack_path);
+        return false;
+    }
+
+    PackHeader header;
+    memset(&header, 0, sizeof(PackHeader));
+    file.write((char *)&header, sizeof(PackHeader));
+
+    std::vector<PackEntry> entries(files.size());
+    std::string names;
+    Uint64 offset = sizeof(PackHeader);
+    static const char padding[PACK_DATA_ALIGNMENT] = {};
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        MappedFile source;
+        std::string source_path = std::string(directory) + "/" + files[i];
+        if (!map_file(source_path.c_str(), &source)) {
+            LOG_ERROR(LOG_FILE, "Could not read %s", source_path.c_str());
+            return false;
+        }
+
+        Uint64 aligned = (offset + PACK_DATA_ALIGNMENT - 1) & ~(Uint64)(PACK_DATA_ALIGNMENT - 1);
+        file.write(padding, (std::streamsize)(aligned - offset));
+        file.write((const char *)source.base, (std::streamsize)source.size);
+
+        PackEntry *entry = &entries[i];
+        entry->hash = hash_path(files[i].c_str());
+        entry->offset = aligned;
+        entry->size = source.size;
+        entry->name_offset = (Uint32)names.size();
+        entry->name_length = (Uint32)files[i].size();
+        names += files[i];
+
+        offset = aligned + source.size;
+        unmap_file(&source);
+    }
+
+    header.magic = PACK_FILE_MAGIC;
+    header.version = PACK_FILE_VERSION;
+    header.entry_count = (Uint32)entries.size();
+    header.entries_offset = (offset + 7) & ~(Uint64)7;
+    header.names_offset = header.entries_offset + entries.size()*sizeof(PackEntry);
+
+    file.write(padding, (std::streamsize)(header.entries_offset - offset));
+    file.write((const char *)entries.data(), (std::streamsize)(entries.size()*sizeof(PackEntry)));
+    file.write(names.data(), (std::streamsize)names.size());
+
+    file.seekp(0, std::ios::beg);
+    file.write((const char *)&header, sizeof(PackHeader));
+
+    if (!file.good()) {
+        LOG_ERROR(LOG_FILE, "Could not write pack: %s", pack_path);
+        return false;
+    }
+
+    LOG_INFO(LOG_FILE, "Wrote pack %s: %d files, %d bytes", pack_path, (int)entries.size(), (int)(header.names_offset + names.size()));
+    return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "types.h"
+
+// Every asset is addressed by a virtual path like "shaders/sprite.vs.glsl",
+// resolved against the mounts newest first. Files come back as read-only
+// memory mapped views, so loading hands the OS pages straight to the
+// decoder without a copy.
+#define VFS_MAX_MOUNTS 8
+#define VFS_PATH_LENGTH 256
+
+#define PACK_FILE_MAGIC 0x4b50444c // "LDPK"
+#define PACK_FILE_VERSION 1
+#define PACK_DATA_ALIGNMENT 16
+
+enum VFS_MOUNT_TYPE {
+    VFS_MOUNT_DIRECTORY,
+    VFS_MOUNT_PACK
+};
+
+struct MappedFile {
+    void *base;
+    size_t size;
+};
+
+// Pack layout: header, file data each aligned to PACK_DATA_ALIGNMENT, then
+// the entry table sorted by path hash, then the normalized path strings.
+struct PackHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 entry_count;
+    Uint32 reserved;
+    Uint64 entries_offset;
+    Uint64 names_offset;
+};
+
+struct PackEntry {
+    Uint64 hash;
+    Uint64 offset;
+    Uint64 size;
+    Uint32 name_offset;
+    Uint32 name_length;
+};
+
+struct VfsMount {
+    VFS_MOUNT_TYPE type;
+    char prefix[VFS_PATH_LENGTH]; // virtual directory the mount appears under, normalized
+    int prefix_length;
+
+    char root[VFS_PATH_LENGTH];   // directory mounts
+
+    MappedFile pack;              // pack mounts stay mapped while mounted
+    const PackEntry *entries;
+    const char *names;
+    Uint32 entry_count;
+};
+
+// A span over file contents. Views into a pack borrow the pack's mapping,
+// loose files get a mapping of their own which close_file_view releases.
+struct FileView {
+    const unsigned char *data;
+    size_t size;
+    MappedFile mapping;
+};
+
+struct VfsStats {
+    SDL_atomic_t views_opened;
+    SDL_atomic_t views_open;
+    SDL_atomic_t misses;
+};
+
+struct Vfs {
+    int mount_count;
+    VfsMount mounts[VFS_MAX_MOUNTS];
+    VfsStats stats;
+};
+
+// Mounts are set up before any loading starts, lookups may then come from any thread.
+void init_vfs(Vfs *vfs);
+void shutdown_vfs(Vfs *vfs);
+
+bool mount_directory(Vfs *vfs, const char *directory, const char *mount_point = "");
+bool mount_pack(Vfs *vfs, const char *pack_path, const char *mount_point = "");
+
+// forward slashes, no "." segments, ".." resolved, no leading or doubled separators
+bool normalize_path(const char *path, char *normalized, int size);
+Uint64 hash_path(const char *normalized);
+
+bool open_file_view(Vfs *vfs, const char *path, FileView *view);
+void close_file_view(Vfs *vfs, FileView *view);
+
+bool write_pack(const char *directory, const char *pack_path);
+
+// every regular file below the directory, as paths relative to it
+void collect_directory_files(const std::string &directory, const std::string &relative, std::vector<std::string> &files);
@@ -0,0 +1,1565 @@
+#include "vorbis.hpp"
+
+#include <math.h>
+
+#define VORBIS_PI 3.14159265358979323846
+
+static void *vorbis_alloc(VorbisDecoder *decoder, int size)
+{
+    int offset = (decoder->memory_used + 15) & ~15;
+    if (size < 0 || offset + size > decoder->memory_size) {
+        return nullptr;
+    }
+
+    decoder->memory_used = offset + size;
+    void *result = decoder->memory + offset;
+    memset(result, 0, size);
+    return result;
+}
+
+
+static int ilog(Uint32 value)
+{
+    int bits = 0;
+    while (value) {
+        bits += 1;
+        value >>= 1;
+    }
+    return bits;
+}
+
+
+static Uint32 reverse_bits(Uint32 value)
+{
+    value = ((value & 0xaaaaaaaa) >> 1) | ((value & 0x55555555) << 1);
+    value = ((value & 0xcccccccc) >> 2) | ((value & 0x33333333) << 2);
+    value = ((value & 0xf0f0f0f0) >> 4) | ((value & 0x0f0f0f0f) << 4);
+    value = ((value & 0xff00ff00) >> 8) | ((value & 0x00ff00ff) << 8);
+    return (value >> 16) | (value << 16);
+}
+
+
+static float unpack_vorbis_float(Uint32 value)
+{
+    double mantissa = (double)(value & 0x1fffff);
+    int exponent = (int)((value & 0x7fe00000) >> 21);
+    if (value & 0x80000000) {
+        mantissa = -mantissa;
+    }
+    return (float)ldexp(mantissa, exponent - 788);
+}
+
+
+/*********************************************************************
+ OGG PAGES AND PACKETS
+ *********************************************************************/
+static Uint32 read_le32(const Uint8 *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((Uint32)data[3] << 24);
+}
+
+
+static bool is_ogg_page(const Uint8 *data, int size, int offset)
+{
+    return offset + 27 <= size && data[offset] == 'O' && data[offset + 1] == 'g' &&
+           data[offset + 2] == 'g' && data[offset + 3] == 'S' && data[offset + 4] == 0;
+}
+
+
+// the page's length, 0 when there isn't a whole page at offset
+static int get_ogg_page_size(const Uint8 *data, int size, int offset)
+{
+    if (!is_ogg_page(data, size, offset)) {
+        return 0;
+    }
+
+    int segment_count = data[offset + 26];
+    if (offset + 27 + segment_count > size) {
+        return 0;
+    }
+
+    int page_size = 27 + segment_count;
+    for (int i = 0; i < segment_count; ++i) {
+        page_size += data[offset + 27 + i];
+    }
+    return offset + page_size <= size ? page_size : 0;
+}
+
+
+static Uint64 get_ogg_page_granule(const Uint8 *data, int offset)
+{
+    return read_le32(data + offset + 6) | ((Uint64)read_le32(data + offset + 10) << 32);
+}
+
+
+static bool load_ogg_page(VorbisReader *reader, int offset)
+{
+    int page_size = get_ogg_page_size(reader->data, reader->size, offset);
+    if (page_size == 0) {
+        reader->next_page = reader->size;
+        return false;
+    }
+
+    reader->page = offset;
+    reader->next_page = offset + page_size;
+    reader->granule = get_ogg_page_granule(reader->data, offset);
+    reader->segment_count = reader->data[offset + 26];
+    reader->lacing = reader->data + offset + 27;
+    reader->segment = -1;
+    reader->offset = offset + 27 + reader->segment_count;
+    reader->segment_end = reader->offset;
+    return true;
+}
+
+
+// the start of the reader, nothing read yet
+static void reset_vorbis_reader(VorbisReader *reader, int page)
+{
+    reader->page = page;
+    reader->next_page = page;
+    reader->segment_count = 0;
+    reader->segment = 0;
+    reader->lacing = nullptr;
+    reader->offset = 0;
+    reader->segment_end = 0;
+    reader->packet_done = true;
+    reader->bits = 0;
+    reader->bit_count = 0;
+    reader->padding = 0;
+    reader->overrun = false;
+}
+
+
+static bool next_ogg_segment(VorbisReader *reader)
+{
+    if (reader->segment + 1 >= reader->segment_count) {
+        bool continued = !reader->packet_done;
+
+        // empty pages only carry a granule, they are stepped over
+        do {
+            if (!load_ogg_page(reader, reader->next_page)) {
+                return false;
+            }
+        } while (reader->segment_count == 0);
+
+        // a page that starts a packet while one is still open, the open one ends here
+        bool page_continues = (reader->data[reader->page + 5] & 0x1) != 0;
+        if (continued != page_continues && continued) {
+            return false;
+        }
+    }
+
+    reader->segment += 1;
+    reader->offset = reader->segment_end;
+    int length = reader->lacing[reader->segment];
+    reader->segment_end = reader->offset + length;
+    reader->packet_done = length < 255;
+    return true;
+}
+
+
+static int next_packet_byte(VorbisReader *reader)
+{
+    while (reader->offset == reader->segment_end) {
+        if (reader->packet_done || !next_ogg_segment(reader)) {
+            reader->packet_done = true;
+            return -1;
+        }
+    }
+    return reader->data[reader->offset++];
+}
+
+
+// steps past whatever is left of the packet being read
+static bool finish_packet(VorbisReader *reader)
+{
+    while (!reader->packet_done) {
+        reader->offset = reader->segment_end;
+        if (!next_ogg_segment(reader)) {
+            reader->packet_done = true;
+            return false;
+        }
+    }
+    reader->offset = reader->segment_end;
+    return true;
+}
+
+
+static bool begin_packet(VorbisReader *reader)
+{
+    if (!finish_packet(reader) || !next_ogg_segment(reader)) {
+        return false;
+    }
+
+    // after a seek the page can start with the end of a packet begun before it
+    if (reader->segment == 0 && (reader->data[reader->page + 5] & 0x1)) {
+        if (!finish_packet(reader) || !next_ogg_segment(reader)) {
+            return false;
+        }
+    }
+
+    reader->bits = 0;
+    reader->bit_count = 0;
+    reader->padding = 0;
+    reader->overrun = false;
+    return true;
+}
+
+
+// whether the packet just finished is the last one to end on its page, the
+// one the page's granule is the position after
+static bool ends_ogg_page(VorbisReader *reader)
+{
+    for (int i = reader->segment + 1; i < reader->segment_count; ++i) {
+        if (reader->lacing[i] < 255) {
+            return false;
+        }
+    }
+    return reader->granule != ~(Uint64)0;
+}
+
+
+static void fill_bits(VorbisReader *reader)
+{
+    while (reader->bit_count <= 56) {
+        int byte = next_packet_byte(reader);
+        if (byte < 0) {
+            reader->padding += 8;
+            byte = 0;
+        }
+        reader->bits |= (Uint64)byte << reader->bit_count;
+        reader->bit_count += 8;
+    }
+}
+
+
+static Uint32 peek_bits(VorbisReader *reader, int count)
+{
+    if (reader->bit_count < count) {
+        fill_bits(reader);
+    }
+    return (Uint32)(reader->bits & (((Uint64)1 << count) - 1));
+}
+
+
+static void skip_bits(VorbisReader *reader, int count)
+{
+    if (reader->bit_count < count) {
+        fill_bits(reader);
+    }
+    if (count > reader->bit_count - reader->padding) {
+        reader->overrun = true;
+    }
+
+    reader->bits >>= count;
+    reader->bit_count -= count;
+    if (reader->padding > reader->bit_count) {
+        reader->padding = reader->bit_count;
+    }
+}
+
+
+static Uint32 read_bits(VorbisReader *reader, int count)
+{
+    if (count == 0) {
+        return 0;
+    }
+    Uint32 value = peek_bits(reader, count);
+    skip_bits(reader, count);
+    return value;
+}
+
+
+/*********************************************************************
+ CODEBOOKS
+ *********************************************************************/
+// the codeword's position in the sorted list, which the vectors are kept in
+static int decode_codebook_index(VorbisReader *reader, VorbisCodebook *book)
+{
+    int index = 0;
+    if (book->single_entry < 0) {
+        index = book->fast ? book->fast[peek_bits(reader, book->fast_bits)] : -1;
+    }
+
+    if (index < 0) {
+        // the last code that starts at or below the next 32 bits, read msb first
+        Uint32 code = reverse_bits(peek_bits(reader, 32));
+        int low = 0;
+        int high = book->sorted_count;
+        while (high - low > 1) {
+            int middle = (low + high)/2;
+            if (book->sorted_codes[middle] <= code) {
+                low = middle;
+            }
+            else {
+                high = middle;
+            }
+        }
+
+        int length = book->lengths[book->sorted_entries[low]];
+        if (length < 32 && code - book->sorted_codes[low] >= (1u << (32 - length))) {
+            reader->overrun = true;
+            return -1;
+        }
+        index = low;
+    }
+
+    skip_bits(reader, book->lengths[book->sorted_entries[index]]);
+    return reader->overrun ? -1 : index;
+}
+
+
+static int decode_codebook_entry(VorbisReader *reader, VorbisCodebook *book)
+{
+    int index = decode_codebook_index(reader, book);
+    return index < 0 ? -1 : book->sorted_entries[index];
+}
+
+
+// the canonical codewords, in entry order, each taking the lowest code still free
+static int build_codebook_codes(VorbisDecoder *decoder, VorbisCodebook *book, int used)
+{
+    book->sorted_codes = (Uint32 *)vorbis_alloc(decoder, used*sizeof(Uint32));
+    book->sorted_entries = (int *)vorbis_alloc(decoder, used*sizeof(int));
+    if (!book->sorted_codes || !book->sorted_entries) {
+        return VORBIS_ERROR_MEMORY;
+    }
+
+    Uint32 available[33] = {};
+    int count = 0;
+    for (int entry = 0; entry < book->entries; ++entry) {
+        int length = book->lengths[entry];
+        if (length == 0) {
+            continue;
+        }
+
+        Uint32 code = 0;
+        if (count == 0) {
+            for (int i = 1; i <= length; ++i) {
+                available[i] = 1u << (32 - i);
+            }
+        }
+        else {
+            int z = length;
+            while (z > 0 && !available[z]) {
+                z -= 1;
+            }
+            if (z == 0) {
+                return VORBIS_ERROR_CORRUPT;    // more codes than the lengths leave room for
+            }
+            code = available[z];
+            available[z] = 0;
+            for (int y = length; y > z; --y) {
+                available[y] = code + (1u << (32 - y));
+            }
+        }
+
+        // insertion keeps the list sorted, codes mostly come in order already
+        int i = count;
+        while (i > 0 && book->sorted_codes[i - 1] > code) {
+            book->sorted_codes[i] = book->sorted_codes[i - 1];
+            book->sorted_entries[i] = book->sorted_entries[i - 1];
+            i -= 1;
+        }
+        book->sorted_codes[i] = code;
+        book->sorted_entries[i] = entry;
+        count += 1;
+    }
+    book->sorted_count = count;
+
+    // a single code of any length is the whole book, it's read without a lookup
+    if (count == 1) {
+        book->single_entry = book->sorted_entries[0];
+        return VORBIS_OK;
+    }
+
+    // no wider than the longest code, a book of short codes gets a small table
+    int longest = 0;
+    for (int entry = 0; entry < book->entries; ++entry) {
+        if (book->lengths[entry] > longest) {
+            longest = book->lengths[entry];
+        }
+    }
+    book->fast_bits = longest < VORBIS_FAST_BITS ? longest : VORBIS_FAST_BITS;
+    book->fast = (Sint16 *)vorbis_alloc(decoder, (1 << book->fast_bits)*sizeof(Sint16));
+    if (!book->fast) {
+        return VORBIS_ERROR_MEMORY;
+    }
+
+    for (int i = 0; i < (1 << book->fast_bits); ++i) {
+        book->fast[i] = -1;
+    }
+    for (int i = 0; i < count && i <= 0x7fff; ++i) {
+        int length = book->lengths[book->sorted_entries[i]];
+        if (length > book->fast_bits) {
+            continue;
+        }
+        Uint32 stream_code = reverse_bits(book->sorted_codes[i]);
+        for (Uint32 fill = 0; fill < (1u << (book->fast_bits - length)); ++fill) {
+            book->fast[stream_code | (fill << length)] = (Sint16)i;
+        }
+    }
+
+    return VORBIS_OK;
+}
+
+
+static int get_lookup1_values(int entries, int dimensions)
+{
+    int values = (int)floor(pow((double)entries, 1.0/dimensions));
+    for (;;) {
+        double power = pow((double)values + 1, (double)dimensions);
+        if (power <= entries) {
+            values += 1;
+            continue;
+        }
+        if (pow((double)values, (double)dimensions) > entries) {
+            values -= 1;
+            continue;
+        }
+        return values;
+    }
+}
+
+
+static int read_codebook(VorbisDecoder *decoder, VorbisCodebook *book)
+{
+    VorbisReader *reader = &decoder->reader;
+
+    if (read_bits(reader, 24) != 0x564342) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+    book->dimensions = read_bits(reader, 16);
+    book->entries = read_bits(reader, 24);
+    book->single_entry = -1;
+    if (book->dimensions == 0 || book->entries == 0) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+
+    book->lengths = (Uint8 *)vorbis_alloc(decoder, book->entries);
+    if (!book->lengths) {
+        return VORBIS_ERROR_MEMORY;
+    }
+
+    int used = 0;
+    if (read_bits(reader, 1)) {
+        // ordered: runs of entries with the same length, each run one longer
+        int entry = 0;
+        int length = read_bits(reader, 5) + 1;
+        while (entry < book->entries) {
+            int run = read_bits(reader, ilog(book->entries - entry));
+            if (length > 32 || entry + run > book->entries) {
+                return VORBIS_ERROR_CORRUPT;
+            }
+            memset(book->lengths + entry, length, run);
+            entry += run;
+            length += 1;
+        }
+        used = book->entries;
+    }
+    else {
+        bool sparse = read_bits(reader, 1) != 0;
+        for (int entry = 0; entry < book->entries; ++entry) {
+            if (!sparse || read_bits(reader, 1)) {
+                book->lengths[entry] = (Uint8)(read_bits(reader, 5) + 1);
+                used += 1;
+            }
+        }
+    }
+    if (reader->overrun) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+
+    if (used == 0) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+    int error = build_codebook_codes(decoder, book, used);
+    if (error != VORBIS_OK) {
+        return error;
+    }
+
+    int lookup_type = read_bits(reader, 4);
+    if (lookup_type == 0) {
+        return VORBIS_OK;
+    }
+    if (lookup_type > 2) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+
+    float minimum = unpack_vorbis_float(read_bits(reader, 32));
+    float delta = unpack_vorbis_float(read_bits(reader, 32));
+    int value_bits = read_bits(reader, 4) + 1;
+    bool sequence = read_bits(reader, 1) != 0;
+    int lookup_values = lookup_type == 1 ? get_lookup1_values(book->entries, book->dimensions)
+                                         : book->entries*book->dimensions;
+    if (lookup_values <= 0) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+
+    // only the entries that have a codeword, in the order of the sorted codes
+    book->vectors = (float *)vorbis_alloc(decoder, book->sorted_count*book->dimensions*sizeof(float));
+    if (!book->vectors) {
+        return VORBIS_ERROR_MEMORY;
+    }
+
+    // the multiplicands are only needed to expand the vectors, their memory is given back
+    int memory_mark = decoder->memory_used;
+    Uint16 *multiplicands = (Uint16 *)vorbis_alloc(decoder, lookup_values*sizeof(Uint16));
+    if (!multiplicands) {
+        return VORBIS_ERROR_MEMORY;
+    }
+    for (int i = 0; i < lookup_values; ++i) {
+        multiplicands[i] = (Uint16)read_bits(reader, value_bits);
+    }
+    if (reader->overrun) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+
+    for (int index = 0; index < book->sorted_count; ++index) {
+        int entry = book->sorted_entries[index];
+        float *vector = book->vectors + index*book->dimensions;
+        float last = 0.f;
+        int divisor = 1;
+        for (int i = 0; i < book->dimensions; ++i) {
+            int offset = lookup_type == 1 ? (entry/divisor) % lookup_values : entry*book->dimensions + i;
+            float value = multiplicands[offset]*delta + minimum + last;
+            if (sequence) {
+                last = value;
+            }
+            vector[i] = value;
+            divisor *= lookup_values;
+        }
+    }
+
+    decoder->memory_used = memory_mark;
+    return VORBIS_OK;
+}
+
+
+/*********************************************************************
+ SETUP
+ *********************************************************************/
+static int read_floor(VorbisDecoder *decoder, VorbisFloor *floor)
+{
+    VorbisReader *reader = &decoder->reader;
+
+    if (read_bits(reader, 16) != 1) {
+        return VORBIS_ERROR_UNSUPPORTED;
+    }
+
+    floor->partitions = read_bits(reader, 5);
+    int max_class = -1;
+    for (int p = 0; p < floor->partitions; ++p) {
+        floor->partition_class[p] = (Uint8)read_bits(reader, 4);
+        if (floor->partition_class[p] > max_class) {
+            max_class = floor->partition_class[p];
+        }
+    }
+
+    for (int c = 0; c <= max_class; ++c) {
+        floor->class_dimensions[c] = (Uint8)(read_bits(reader, 3) + 1);
+        floor->class_subclasses[c] = (Uint8)read_bits(reader, 2);
+        floor->class_masterbook[c] = -1;
+        if (floor->class_subclasses[c]) {
+            floor->class_masterbook[c] = (Sint16)read_bits(reader, 8);
+            if (floor->class_masterbook[c] >= decoder->codebook_count) {
+                return VORBIS_ERROR_CORRUPT;
+            }
+        }
+        for (int j = 0; j < (1 << floor->class_subclasses[c]); ++j) {
+            floor->subclass_books[c][j] = (Sint16)((int)read_bits(reader, 8) - 1);
+            if (floor->subclass_books[c][j] >= decoder->codebook_count) {
+                return VORBIS_ERROR_CORRUPT;
+            }
+        }
+    }
+
+    static const int ranges[4] = {256, 128, 86, 64};
+    floor->multiplier = read_bits(reader, 2) + 1;
+    floor->range = ranges[floor->multiplier - 1];
+    floor->y_bits = ilog(floor->range - 1);
+
+    int range_bits = read_bits(reader, 4);
+    floor->x[0] = 0;
+    floor->x[1] = (Uint16)(1 << range_bits);
+    floor->values = 2;
+    for (int p = 0; p < floor->partitions; ++p) {
+        int c = floor->partition_class[p];
+        for (int j = 0; j < floor->class_dimensions[c]; ++j) {
+            if (floor->values >= VORBIS_FLOOR1_MAX_VALUES) {
+                return VORBIS_ERROR_CORRUPT;
+            }
+            floor->x[floor->values++] = (Uint16)read_bits(reader, range_bits);
+        }
+    }
+
+    for (int i = 0; i < floor->values; ++i) {
+        floor->sorted[i] = (Uint8)i;
+    }
+    for (int i = 1; i < floor->values; ++i) {
+        for (int j = i; j > 0 && floor->x[floor->sorted[j - 1]] > floor->x[floor->sorted[j]]; --j) {
+            Uint8 swap = floor->sorted[j];
+            floor->sorted[j] = floor->sorted[j - 1];
+            floor->sorted[j - 1] = swap;
+        }
+    }
+
+    // the closest value on each side among the ones before it
+    for (int i = 2; i < floor->values; ++i) {
+        int low = 0;
+        int high = 1;
+        for (int j = 0; j < i; ++j) {
+            if (floor->x[j] < floor->x[i] && floor->x[j] > floor->x[low]) {
+                low = j;
+            }
+            if (floor->x[j] > floor->x[i] && floor->x[j] < floor->x[high]) {
+                high = j;
+            }
+        }
+        floor->low[i] = (Uint8)low;
+        floor->high[i] = (Uint8)high;
+    }
+
+    return VORBIS_OK;
+}
+
+
+static int read_residue(VorbisDecoder *decoder, VorbisResidue *residue)
+{
+    VorbisReader *reader = &decoder->reader;
+
+    residue->type = read_bits(reader, 16);
+    if (residue->type > 2) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+    residue->begin = read_bits(reader, 24);
+    residue->end = read_bits(reader, 24);
+    residue->partition_size = read_bits(reader, 24) + 1;
+    residue->classifications = read_bits(reader, 6) + 1;
+    residue->classbook = read_bits(reader, 8);
+    if (residue->classbook >= decoder->codebook_count || residue->end < residue->begin) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+
+    Uint8 cascade[64];
+    for (int c = 0; c < residue->classifications; ++c) {
+        int low = read_bits(reader, 3);
+        int high = read_bits(reader, 1) ? read_bits(reader, 5) : 0;
+        cascade[c] = (Uint8)(high*8 + low);
+    }
+    for (int c = 0; c < residue->classifications; ++c) {
+        for (int pass = 0; pass < 8; ++pass) {
+            residue->books[c][pass] = -1;
+            if (cascade[c] & (1 << pass)) {
+                int book = read_bits(reader, 8);
+                if (book >= decoder->codebook_count || !decoder->codebooks[book].vectors) {
+                    return VORBIS_ERROR_CORRUPT;
+                }
+                residue->books[c][pass] = (Sint16)book;
+            }
+        }
+    }
+
+    // classifications of every partition one pass decodes, per channel or interleaved
+    VorbisCodebook *classbook = &decoder->codebooks[residue->classbook];
+    Uint32 size = (Uint32)decoder->blocksizes[1]/2*(residue->type == 2 ? decoder->channels : 1);
+    Uint32 end = residue->end < size ? residue->end : size;
+    int partitions = end > residue->begin ? (int)((end - residue->begin)/residue->partition_size) : 0;
+    partitions += classbook->dimensions;
+    if (partitions > decoder->max_partitions) {
+        decoder->max_partitions = partitions;
+    }
+
+    return VORBIS_OK;
+}
+
+
+static int read_mapping(VorbisDecoder *decoder, VorbisMapping *mapping)
+{
+    VorbisReader *reader = &decoder->reader;
+
+    if (read_bits(reader, 16) != 0) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+
+    mapping->submaps = read_bits(reader, 1) ? read_bits(reader, 4) + 1 : 1;
+    if (read_bits(reader, 1)) {
+        mapping->coupling_steps = read_bits(reader, 8) + 1;
+        int bits = ilog(decoder->channels - 1);
+        for (int i = 0; i < mapping->coupling_steps; ++i) {
+            mapping->magnitude[i] = (Uint8)read_bits(reader, bits);
+            mapping->angle[i] = (Uint8)read_bits(reader, bits);
+            if (mapping->magnitude[i] >= decoder->channels || mapping->angle[i] >= decoder->channels ||
+                mapping->magnitude[i] == mapping->angle[i])
+            {
+                return VORBIS_ERROR_CORRUPT;
+            }
+        }
+    }
+
+    if (read_bits(reader, 2) != 0) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+
+    for (int c = 0; c < decoder->channels; ++c) {
+        mapping->mux[c] = mapping->submaps > 1 ? (Uint8)read_bits(reader, 4) : 0;
+        if (mapping->mux[c] >= mapping->submaps) {
+            return VORBIS_ERROR_CORRUPT;
+        }
+    }
+    for (int s = 0; s < mapping->submaps; ++s) {
+        read_bits(reader, 8);
+        mapping->submap_floor[s] = (Uint8)read_bits(reader, 8);
+        mapping->submap_residue[s] = (Uint8)read_bits(reader, 8);
+        if (mapping->submap_floor[s] >= decoder->floor_count || mapping->submap_residue[s] >= decoder->residue_count) {
+            return VORBIS_ERROR_CORRUPT;
+        }
+    }
+
+    return VORBIS_OK;
+}
+
+
+static bool begin_header_packet(VorbisReader *reader, int type)
+{
+    if (!begin_packet(reader) || read_bits(reader, 8) != (Uint32)type) {
+        return false;
+    }
+
+    static const char signature[] = "vorbis";
+    for (int i = 0; i < 6; ++i) {
+        if (read_bits(reader, 8) != (Uint32)signature[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static int read_setup_header(VorbisDecoder *decoder)
+{
+    VorbisReader *reader = &decoder->reader;
+    int error = VORBIS_OK;
+
+    decoder->codebook_count = read_bits(reader, 8) + 1;
+    decoder->codebooks = (VorbisCodebook *)vorbis_alloc(decoder, decoder->codebook_count*sizeof(VorbisCodebook));
+    if (!decoder->codebooks) {
+        return VORBIS_ERROR_MEMORY;
+    }
+    for (int i = 0; i < decoder->codebook_count; ++i) {
+        if ((error = read_codebook(decoder, &decoder->codebooks[i])) != VORBIS_OK) {
+            return error;
+        }
+    }
+
+    // time domain transforms, placeholders that are always 0
+    int time_count = read_bits(reader, 6) + 1;
+    for (int i = 0; i < time_count; ++i) {
+        if (read_bits(reader, 16) != 0) {
+            return VORBIS_ERROR_CORRUPT;
+        }
+    }
+
+    decoder->floor_count = read_bits(reader, 6) + 1;
+    decoder->floors = (VorbisFloor *)vorbis_alloc(decoder, decoder->floor_count*sizeof(VorbisFloor));
+    if (!decoder->floors) {
+        return VORBIS_ERROR_MEMORY;
+    }
+    for (int i = 0; i < decoder->floor_count; ++i) {
+        if ((error = read_floor(decoder, &decoder->floors[i])) != VORBIS_OK) {
+            return error;
+        }
+    }
+
+    decoder->residue_count = read_bits(reader, 6) + 1;
+    decoder->residues = (VorbisResidue *)vorbis_alloc(decoder, decoder->residue_count*sizeof(VorbisResidue));
+    if (!decoder->residues) {
+        return VORBIS_ERROR_MEMORY;
+    }
+    for (int i = 0; i < decoder->residue_count; ++i) {
+        if ((error = read_residue(decoder, &decoder->residues[i])) != VORBIS_OK) {
+            return error;
+        }
+    }
+
+    decoder->mapping_count = read_bits(reader, 6) + 1;
+    decoder->mappings = (VorbisMapping *)vorbis_alloc(decoder, decoder->mapping_count*sizeof(VorbisMapping));
+    if (!decoder->mappings) {
+        return VORBIS_ERROR_MEMORY;
+    }
+    for (int i = 0; i < decoder->mapping_count; ++i) {
+        if ((error = read_mapping(decoder, &decoder->mappings[i])) != VORBIS_OK) {
+            return error;
+        }
+    }
+
+    decoder->mode_count = read_bits(reader, 6) + 1;
+    decoder->mode_bits = ilog(decoder->mode_count - 1);
+    decoder->modes = (VorbisMode *)vorbis_alloc(decoder, decoder->mode_count*sizeof(VorbisMode));
+    if (!decoder->modes) {
+        return VORBIS_ERROR_MEMORY;
+    }
+    for (int i = 0; i < decoder->mode_count; ++i) {
+        VorbisMode *mode = &decoder->modes[i];
+        mode->blockflag = read_bits(reader, 1);
+        int window_type = read_bits(reader, 16);
+        int transform_type = read_bits(reader, 16);
+        mode->mapping = read_bits(reader, 8);
+        if (window_type != 0 || transform_type != 0 || mode->mapping >= decoder->mapping_count) {
+            return VORBIS_ERROR_CORRUPT;
+        }
+    }
+
+    if (!read_bits(reader, 1) || reader->overrun) {
+        return VORBIS_ERROR_CORRUPT;
+    }
+    return VORBIS_OK;
+}
+
+
+static bool init_vorbis_transform(VorbisDecoder *decoder, VorbisTransform *transform, int n)
+{
+    int half = n/2;
+    int quarter = n/4;
+
+    transform->n = n;
+    transform->pre_twiddle = (float *)vorbis_alloc(decoder, quarter*2*sizeof(float));
+    transform->post_twiddle = (float *)vorbis_alloc(decoder, quarter*2*sizeof(float));
+    transform->fft_twiddle = (float *)vorbis_alloc(decoder, (quarter/2)*2*sizeof(float));
+    transform->bit_reverse = (int *)vorbis_alloc(decoder, quarter*sizeof(int));
+    transform->slope = (float *)vorbis_alloc(decoder, half*sizeof(float));
+    if (!transform->pre_twiddle || !transform->post_twiddle || !transform->fft_twiddle ||
+        !transform->bit_reverse || !transform->slope)
+    {
+        return false;
+    }
+
+    for (int k = 0; k < quarter; ++k) {
+        double pre = -VORBIS_PI*(4*k + 1)/(4.0*half);
+        double post = -VORBIS_PI*k/half;
+        transform->pre_twiddle[2*k] = (float)cos(pre);
+        transform->pre_twiddle[2*k + 1] = (float)sin(pre);
+        transform->post_twiddle[2*k] = (float)cos(post);
+        transform->post_twiddle[2*k + 1] = (float)sin(post);
+    }
+    for (int k = 0; k < quarter/2; ++k) {
+        double angle = -2.0*VORBIS_PI*k/quarter;
+        transform->fft_twiddle[2*k] = (float)cos(angle);
+        transform->fft_twiddle[2*k + 1] = (float)sin(angle);
+    }
+
+    int bits = ilog(quarter) - 1;
+    for (int k = 0; k < quarter; ++k) {
+        transform->bit_reverse[k] = bits > 0 ? (int)(reverse_bits(k) >> (32 - bits)) : 0;
+    }
+
+    for (int i = 0; i < half; ++i) {
+        double s = sin((i + 0.5)/half*VORBIS_PI*0.5);
+        transform->slope[i] = (float)sin(VORBIS_PI*0.5*s*s);
+    }
+
+    return true;
+}
+
+
+// the frame count is the last page's granule, that is where the encoder says it ends
+static Uint32 find_vorbis_length(const Uint8 *data, int size)
+{
+    for (int offset = size - 27; offset >= 0; --offset) {
+        if (data[offset] == 'O' && get_ogg_page_size(data, size, offset) > 0) {
+            Uint64 granule = get_ogg_page_granule(data, offset);
+            if (granule != ~(Uint64)0) {
+                return granule > 0xffffffff ? 0xffffffff : (Uint32)granule;
+            }
+        }
+    }
+    return 0;
+}
+
+
+VorbisDecoder *open_vorbis(const Uint8 *data, int size, void *memory, int memory_size, int *error)
+{
+    *error = VORBIS_ERROR_MEMORY;
+    if (memory_size < (int)sizeof(VorbisDecoder)) {
+        return nullptr;
+    }
+
+    VorbisDecoder *decoder = (VorbisDecoder *)memory;
+    memset(decoder, 0, sizeof(VorbisDecoder));
+    decoder->memory = (Uint8 *)memory;
+    decoder->memory_size = memory_size;
+    decoder->memory_used = sizeof(VorbisDecoder);
+
+    VorbisReader *reader = &decoder->reader;
+    reader->data = data;
+    reader->size = size;
+    reset_vorbis_reader(reader, 0);
+
+    *error = VORBIS_ERROR_NOT_VORBIS;
+    if (!is_ogg_page(data, size, 0) || !begin_header_packet(reader, 1) || read_bits(reader, 32) != 0) {
+        return nullptr;
+    }
+
+    decoder->channels = read_bits(reader, 8);
+    decoder->sample_rate = read_bits(reader, 32);
+    read_bits(reader, 32);
+    read_bits(reader, 32);
+    read_bits(reader, 32);
+    decoder->blocksizes[0] = 1 << read_bits(reader, 4);
+    decoder->blocksizes[1] = 1 << read_bits(reader, 4);
+    if (!read_bits(reader, 1) || reader->overrun || decoder->channels == 0 || decoder->sample_rate == 0 ||
+        decoder->blocksizes[0] < 64 || decoder->blocksizes[0] > decoder->blocksizes[1])
+    {
+        *error = VORBIS_ERROR_CORRUPT;
+        return nullptr;
+    }
+    if (decoder->channels > VORBIS_MAX_CHANNELS || decoder->blocksizes[1] > VORBIS_MAX_BLOCKSIZE) {
+        *error = VORBIS_ERROR_UNSUPPORTED;
+        return nullptr;
+    }
+
+    // the comments aren't used
+    if (!begin_header_packet(reader, 3) || !begin_header_packet(reader, 5)) {
+        return nullptr;
+    }
+    if ((*error = read_setup_header(decoder)) != VORBIS_OK) {
+        return nullptr;
+    }
+
+    *error = VORBIS_ERROR_MEMORY;
+    int half = decoder->blocksizes[1]/2;
+    decoder->floor_db = (float *)vorbis_alloc(decoder, 256*sizeof(float));
+    decoder->scratch = (float *)vorbis_alloc(decoder, decoder->blocksizes[1]*sizeof(float));
+    if (!decoder->floor_db || !decoder->scratch ||
+        !init_vorbis_transform(decoder, &decoder->transforms[0], decoder->blocksizes[0]) ||
+        !init_vorbis_transform(decoder, &decoder->transforms[1], decoder->blocksizes[1]))
+    {
+        return nullptr;
+    }
+    for (int c = 0; c < decoder->channels; ++c) {
+        decoder->spectrum[c] = (float *)vorbis_alloc(decoder, half*sizeof(float));
+        decoder->previous[c] = (float *)vorbis_alloc(decoder, half*sizeof(float));
+        decoder->output[c] = (float *)vorbis_alloc(decoder, half*sizeof(float));
+        decoder->classifications[c] = (Uint8 *)vorbis_alloc(decoder, decoder->max_partitions);
+        if (!decoder->spectrum[c] || !decoder->previous[c] || !decoder->output[c] || !decoder->classifications[c]) {
+            return nullptr;
+        }
+    }
+
+    // floor1 amplitudes run from -140 dB to 0 in 256 even steps
+    for (int i = 0; i < 256; ++i) {
+        decoder->floor_db[i] = (float)exp((255 - i)*log(1.0649863e-07)/255.0);
+    }
+
+    // audio always starts on the page after the setup packet's last one
+    finish_packet(reader);
+    decoder->audio_page = reader->next_page;
+    reset_vorbis_reader(reader, decoder->audio_page);
+
+    decoder->total_frames = find_vorbis_length(data, size);
+
+    *error = VORBIS_OK;
+    return decoder;
+}
+
+
+const char *get_vorbis_error_name(int error)
+{
+    switch (error) {
+        case VORBIS_OK: return "ok";
+        case VORBIS_ERROR_NOT_VORBIS: return "not an Ogg Vorbis file";
+        case VORBIS_ERROR_CORRUPT: return "corrupt headers";
+        case VORBIS_ERROR_UNSUPPORTED: return "unsupported stream";
+        case VORBIS_ERROR_MEMORY: return "out of decoder memory";
+    }
+    return "unknown error";
+}
+
+
+/*********************************************************************
+ AUDIO PACKETS
+ *********************************************************************/
+static bool read_floor_values(VorbisDecoder *decoder, VorbisFloor *floor, Sint16 *y)
+{
+    VorbisReader *reader = &decoder->reader;
+
+    if (!read_bits(reader, 1)) {
+        return false;
+    }
+
+    y[0] = (Sint16)read_bits(reader, floor->y_bits);
+    y[1] = (Sint16)read_bits(reader, floor->y_bits);
+
+    int offset = 2;
+    for (int p = 0; p < floor->partitions; ++p) {
+        int c = floor->partition_class[p];
+        int dimensions = floor->class_dimensions[c];
+        int bits = floor->class_subclasses[c];
+        int mask = (1 << bits) - 1;
+        int value = 0;
+        if (bits) {
+            value = decode_codebook_entry(reader, &decoder->codebooks[floor->class_masterbook[c]]);
+        }
+        for (int j = 0; j < dimensions; ++j) {
+            int book = floor->subclass_books[c][value & mask];
+            value >>= bits;
+            y[offset++] = book >= 0 ? (Sint16)decode_codebook_entry(reader, &decoder->codebooks[book]) : 0;
+        }
+    }
+
+    return !reader->overrun;
+}
+
+
+static int predict_floor_point(int x0, int y0, int x1, int y1, int x)
+{
+    int dy = y1 - y0;
+    int adx = x1 - x0;
+    int offset = (dy < 0 ? -dy : dy)*(x - x0)/adx;
+    return dy < 0 ? y0 - offset : y0 + offset;
+}
+
+
+// multiplies the spectrum along the line, the same integer steps as the encoder took
+static void apply_floor_line(float *spectrum, const float *floor_db, int x0, int y0, int x1, int y1, int n)
+{
+    int dy = y1 - y0;
+    int adx = x1 - x0;
+    int ady = dy < 0 ? -dy : dy;
+    int base = dy/adx;
+    int step = dy < 0 ? base - 1 : base + 1;
+    ady -= (base < 0 ? -base : base)*adx;
+
+    int y = y0;
+    int error = 0;
+    if (x1 > n) {
+        x1 = n;
+    }
+    for (int x = x0; x < x1; ++x) {
+        spectrum[x] *= floor_db[y & 0xff];
+        error += ady;
+        if (error >= adx) {
+            error -= adx;
+            y += step;
+        }
+        else {
+            y += base;
+        }
+    }
+}
+
+
+static void apply_floor(VorbisDecoder *decoder, VorbisFloor *floor, Sint16 *y, float *spectrum, int n)
+{
+    Sint16 final_y[VORBIS_FLOOR1_MAX_VALUES];
+    bool step2[VORBIS_FLOOR1_MAX_VALUES];
+
+    final_y[0] = y[0];
+    final_y[1] = y[1];
+    step2[0] = true;
+    step2[1] = true;
+
+    for (int i = 2; i < floor->values; ++i) {
+        int low = floor->low[i];
+        int high = floor->high[i];
+        int predicted = predict_floor_point(floor->x[low], final_y[low], floor->x[high], final_y[high], floor->x[i]);
+        int value = y[i];
+        int high_room = floor->range - predicted;
+        int low_room = predicted;
+        int room = (high_room < low_room ? high_room : low_room)*2;
+
+        if (value) {
+            step2[low] = true;
+            step2[high] = true;
+            step2[i] = true;
+            if (value >= room) {
+                final_y[i] = (Sint16)(high_room > low_room ? value - low_room + predicted : predicted - value + high_room - 1);
+            }
+            else {
+                final_y[i] = (Sint16)((value & 1) ? predicted - (value + 1)/2 : predicted + value/2);
+            }
+        }
+        else {
+            step2[i] = false;
+            final_y[i] = (Sint16)predicted;
+        }
+    }
+
+    int lx = 0;
+    int ly = final_y[0]*floor->multiplier;
+    for (int i = 1; i < floor->values; ++i) {
+        int j = floor->sorted[i];
+        if (!step2[j]) {
+            continue;
+        }
+        int hx = floor->x[j];
+        int hy = final_y[j]*floor->multiplier;
+        if (hx > lx) {
+            apply_floor_line(spectrum, decoder->floor_db, lx, ly, hx, hy, n);
+        }
+        lx = hx;
+        ly = hy;
+    }
+    if (lx < n) {
+        float amplitude = decoder->floor_db[ly & 0xff];
+        for (int x = lx; x < n; ++x) {
+            spectrum[x] *= amplitude;
+        }
+    }
+}
+
+
+static void decode_residue(VorbisDecoder *decoder, VorbisResidue *residue, float **vectors, bool *skip, int channels, int n)
+{
+    VorbisReader *reader = &decoder->reader;
+    VorbisCodebook *classbook = &decoder->codebooks[residue->classbook];
+    int classwords = classbook->dimensions;
+    int partition_size = residue->partition_size;
+
+    // type 2 is type 1 over the channels interleaved into one vector
+    int vector_count = channels;
+    int size = n;
+    if (residue->type == 2) {
+        bool any = false;
+        for (int c = 0; c < channels; ++c) {
+            any |= !skip[c];
+        }
+        if (!any) {
+            return;
+        }
+        vector_count = 1;
+        size = n*channels;
+    }
+
+    Uint32 begin = residue->begin < (Uint32)size ? residue->begin : (Uint32)size;
+    Uint32 end = residue->end < (Uint32)size ? residue->end : (Uint32)size;
+    int partitions = (int)((end - begin)/partition_size);
+    if (partitions == 0) {
+        return;
+    }
+
+    for (int pass = 0; pass < 8; ++pass) {
+        int partition = 0;
+        while (partition < partitions) {
+            if (pass == 0) {
+                for (int v = 0; v < vector_count; ++v) {
+                    if (residue->type != 2 && skip[v]) {
+                        continue;
+                    }
+                    int value = decode_codebook_entry(reader, classbook);
+                    if (value < 0) {
+                        return;
+                    }
+                    Uint8 *classifications = decoder->classifications[v];
+                    for (int i = classwords - 1; i >= 0; --i) {
+                        classifications[partition + i] = (Uint8)(value % residue->classifications);
+                        value /= residue->classifications;
+                    }
+                }
+            }
+
+            for (int i = 0; i < classwords && partition < partitions; ++i, ++partition) {
+                for (int v = 0; v < vector_count; ++v) {
+                    if (residue->type != 2 && skip[v]) {
+                        continue;
+                    }
+                    int book_index = residue->books[decoder->classifications[v][partition]][pass];
+                    if (book_index < 0) {
+                        continue;
+                    }
+
+                    VorbisCodebook *book = &decoder->codebooks[book_index];
+                    int dimensions = book->dimensions;
+                    int offset = begin + partition*partition_size;
+
+                    if (residue->type == 0) {
+                        float *vector = vectors[v];
+                        int step = partition_size/dimensions;
+                        for (int k = 0; k < step; ++k) {
+                            int index = decode_codebook_index(reader, book);
+                            if (index < 0) {
+                                return;
+                            }
+                            const float *values = book->vectors + index*dimensions;
+                            for (int d = 0; d < dimensions; ++d) {
+                                vector[offset + k + d*step] += values[d];
+                            }
+                        }
+                    }
+                    else if (residue->type == 1) {
+                        float *vector = vectors[v];
+                        for (int k = 0; k < partition_size;) {
+                            int index = decode_codebook_index(reader, book);
+                            if (index < 0) {
+                                return;
+                            }
+                            const float *values = book->vectors + index*dimensions;
+                            for (int d = 0; d < dimensions && k < partition_size; ++d, ++k) {
+                                vector[offset + k] += values[d];
+                            }
+                        }
+                    }
+                    else {
+                        int channel = offset % channels;
+                        int position = offset/channels;
+                        for (int k = 0; k < partition_size;) {
+                            int index = decode_codebook_index(reader, book);
+                            if (index < 0) {
+                                return;
+                            }
+                            const float *values = book->vectors + index*dimensions;
+                            for (int d = 0; d < dimensions && k < partition_size; ++d, ++k) {
+                                vectors[channel][position] += values[d];
+                                if (++channel == channels) {
+                                    channel = 0;
+                                    position += 1;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+// n/2 coefficients in spectrum, n samples out. spectrum is used as scratch
+static void inverse_mdct(VorbisDecoder *decoder, VorbisTransform *transform, float *spectrum, float *output)
+{
+    int half = transform->n/2;
+    int quarter = transform->n/4;
+    float *buffer = decoder->scratch;
+
+    // the DCT-IV at its core, folded into a quarter size complex FFT
+    for (int k = 0; k < quarter; ++k) {
+        float re = spectrum[2*k];
+        float im = spectrum[half - 1 - 2*k];
+        float wr = transform->pre_twiddle[2*k];
+        float wi = transform->pre_twiddle[2*k + 1];
+        int j = transform->bit_reverse[k];
+        buffer[2*j] = re*wr - im*wi;
+        buffer[2*j + 1] = re*wi + im*wr;
+    }
+
+    for (int size = 2; size <= quarter; size *= 2) {
+        int span = size/2;
+        int stride = quarter/size;
+        for (int start = 0; start < quarter; start += size) {
+            for (int j = 0; j < span; ++j) {
+                float wr = transform->fft_twiddle[2*j*stride];
+                float wi = transform->fft_twiddle[2*j*stride + 1];
+                float *a = buffer + 2*(start + j);
+                float *b = buffer + 2*(start + j + span);
+                float br = b[0]*wr - b[1]*wi;
+                float bi = b[0]*wi + b[1]*wr;
+                b[0] = a[0] - br;
+                b[1] = a[1] - bi;
+                a[0] += br;
+                a[1] += bi;
+            }
+        }
+    }
+
+    for (int k = 0; k < quarter; ++k) {
+        float re = buffer[2*k];
+        float im = buffer[2*k + 1];
+        float wr = transform->post_twiddle[2*k];
+        float wi = transform->post_twiddle[2*k + 1];
+        spectrum[2*k] = re*wr - im*wi;
+        spectrum[half - 1 - 2*k] = -(re*wi + im*wr);
+    }
+
+    // unfolded, the DCT-IV's symmetries give all n samples
+    for (int i = 0; i < half/2; ++i) {
+        output[i] = spectrum[i + half/2];
+    }
+    for (int i = half/2; i < half + half/2; ++i) {
+        output[i] = -spectrum[half + half/2 - 1 - i];
+    }
+    for (int i = half + half/2; i < transform->n; ++i) {
+        output[i] = -spectrum[i - half - half/2];
+    }
+}
+
+
+// one packet's worth of frames into output, false at the end of the stream
+static bool decode_vorbis_packet(VorbisDecoder *decoder)
+{
+    VorbisReader *reader = &decoder->reader;
+
+    if (!begin_packet(reader)) {
+        return false;
+    }
+
+    // anything that isn't an audio packet is skipped
+    if (read_bits(reader, 1) != 0 || reader->overrun) {
+        return true;
+    }
+
+    int mode_index = read_bits(reader, decoder->mode_bits);
+    if (mode_index >= decoder->mode_count) {
+        return true;
+    }
+    VorbisMode *mode = &decoder->modes[mode_index];
+    VorbisMapping *mapping = &decoder->mappings[mode->mapping];
+    VorbisTransform *transform = &decoder->transforms[mode->blockflag];
+    int n = decoder->blocksizes[mode->blockflag];
+    int half = n/2;
+    int short_quarter = decoder->blocksizes[0]/4;
+
+    int left_start = 0;
+    int left_end = half;
+    int right_start = half;
+    int right_end = n;
+    if (mode->blockflag) {
+        bool previous_long = read_bits(reader, 1) != 0;
+        bool next_long = read_bits(reader, 1) != 0;
+        if (!previous_long) {
+            left_start = n/4 - short_quarter;
+            left_end = n/4 + short_quarter;
+        }
+        if (!next_long) {
+            right_start = n*3/4 - short_quarter;
+            right_end = n*3/4 + short_quarter;
+        }
+    }
+    if (reader->overrun) {
+        return true;
+    }
+
+    int channels = decoder->channels;
+    bool no_residue[VORBIS_MAX_CHANNELS];
+    for (int c = 0; c < channels; ++c) {
+        VorbisFloor *floor = &decoder->floors[mapping->submap_floor[mapping->mux[c]]];
+        decoder->floor_used[c] = read_floor_values(decoder, floor, decoder->floor_y[c]);
+        no_residue[c] = !decoder->floor_used[c];
+        memset(decoder->spectrum[c], 0, half*sizeof(float));
+    }
+    reader->overrun = false;
+
+    for (int i = 0; i < mapping->coupling_steps; ++i) {
+        int magnitude = mapping->magnitude[i];
+        int angle = mapping->angle[i];
+        if (!no_residue[magnitude] || !no_residue[angle]) {
+            no_residue[magnitude] = false;
+            no_residue[angle] = false;
+        }
+    }
+
+    for (int s = 0; s < mapping->submaps; ++s) {
+        float *vectors[VORBIS_MAX_CHANNELS];
+        bool skip[VORBIS_MAX_CHANNELS];
+        int count = 0;
+        for (int c = 0; c < channels; ++c) {
+            if (mapping->mux[c] == s) {
+                vectors[count] = decoder->spectrum[c];
+                skip[count] = no_residue[c];
+                count += 1;
+            }
+        }
+        if (count > 0) {
+            decode_residue(decoder, &decoder->residues[mapping->submap_residue[s]], vectors, skip, count, half);
+        }
+    }
+
+    for (int i = mapping->coupling_steps - 1; i >= 0; --i) {
+        float *magnitudes = decoder->spectrum[mapping->magnitude[i]];
+        float *angles = decoder->spectrum[mapping->angle[i]];
+        for (int j = 0; j < half; ++j) {
+            float m = magnitudes[j];
+            float a = angles[j];
+            if (m > 0.f) {
+                if (a > 0.f) {
+                    angles[j] = m - a;
+                }
+                else {
+                    angles[j] = m;
+                    magnitudes[j] = m + a;
+                }
+            }
+            else {
+                if (a > 0.f) {
+                    angles[j] = m + a;
+                }
+                else {
+                    angles[j] = m;
+                    magnitudes[j] = m - a;
+                }
+            }
+        }
+    }
+
+    // how much of the last block and this one overlap into finished frames
+    int previous_size = decoder->previous_size;
+    int count = previous_size ? previous_size/4 + n/4 : 0;
+    int shift = n/4 - previous_size/4;
+
+    float *block = decoder->scratch;
+    for (int c = 0; c < channels; ++c) {
+        float *spectrum = decoder->spectrum[c];
+        if (decoder->floor_used[c]) {
+            VorbisFloor *floor = &decoder->floors[mapping->submap_floor[mapping->mux[c]]];
+            apply_floor(decoder, floor, decoder->floor_y[c], spectrum, half);
+        }
+        else {
+            memset(spectrum, 0, half*sizeof(float));
+        }
+
+        // the block comes back in the scratch buffer, windowed there and overlapped
+        // with the last block's right half into the finished frames
+        float *samples = decoder->output[c];
+        inverse_mdct(decoder, transform, spectrum, block);
+
+        for (int i = 0; i < left_start; ++i) {
+            block[i] = 0.f;
+        }
+        for (int i = left_start; i < left_end; ++i) {
+            block[i] *= decoder->transforms[left_end - left_start == half ? mode->blockflag : 0].slope[i - left_start];
+        }
+        int right_length = right_end - right_start;
+        const float *right_slope = decoder->transforms[right_length == half ? mode->blockflag : 0].slope;
+        for (int i = right_start; i < right_end; ++i) {
+            block[i] *= right_slope[right_length - 1 - (i - right_start)];
+        }
+        for (int i = right_end; i < n; ++i) {
+            block[i] = 0.f;
+        }
+
+        float *previous = decoder->previous[c];
+        for (int k = 0; k < count; ++k) {
+            float value = k < previous_size/2 ? previous[k] : 0.f;
+            int i = k + shift;
+            if (i >= 0 && i < n) {
+                value += block[i];
+            }
+            samples[k] = value;
+        }
+        memcpy(previous, block + half, half*sizeof(float));
+    }
+
+    decoder->previous_size = n;
+    decoder->output_offset = 0;
+    decoder->output_count = 0;
+
+    Uint32 end = decoder->decoded + count;
+    if (decoder->position_lost) {
+        if (!finish_packet(reader) || !ends_ogg_page(reader)) {
+            return true;
+        }
+        end = (Uint32)reader->granule;
+        if ((Uint32)count > end) {
+            count = (int)end;
+        }
+        decoder->decoded = end - count;
+        decoder->position_lost = false;
+    }
+
+    // the last page says where the stream really ends, inside the last block
+    if (decoder->total_frames && end > decoder->total_frames) {
+        count = decoder->decoded < decoder->total_frames ? (int)(decoder->total_frames - decoder->decoded) : 0;
+    }
+    decoder->decoded += count;
+    decoder->output_count = count;
+    return true;
+}
+
+
+int decode_vorbis_frames(VorbisDecoder *decoder, float *output, int channels, int frame_count)
+{
+    int written = 0;
+    while (written < frame_count) {
+        if (decoder->output_count == 0) {
+            if (decoder->finished || (decoder->total_frames && decoder->decoded >= decoder->total_frames)) {
+                decoder->finished = true;
+                break;
+            }
+            if (!decode_vorbis_packet(decoder)) {
+                decoder->finished = true;
+                break;
+            }
+            continue;
+        }
+
+        int count = frame_count - written < decoder->output_count ? frame_count - written : decoder->output_count;
+        for (int c = 0; c < channels; ++c) {
+            float *target = output + written*channels + c;
+            if (c >= decoder->channels) {
+                for (int i = 0; i < count; ++i) {
+                    target[i*channels] = 0.f;
+                }
+                continue;
+            }
+            const float *source = decoder->output[c] + decoder->output_offset;
+            for (int i = 0; i < count; ++i) {
+                target[i*channels] = source[i];
+            }
+        }
+
+        written += count;
+        decoder->output_offset += count;
+        decoder->output_count -= count;
+    }
+
+    return written;
+}
+
+
+static bool decode_to_frame(VorbisDecoder *decoder, int page, Uint32 frame)
+{
+    reset_vorbis_reader(&decoder->reader, page);
+    decoder->previous_size = 0;
+    decoder->output_offset = 0;
+    decoder->output_count = 0;
+    decoder->decoded = 0;
+    decoder->finished = false;
+    decoder->position_lost = page != decoder->audio_page;
+
+    while (decoder->position_lost || decoder->decoded < frame) {
+        if (!decode_vorbis_packet(decoder)) {
+            decoder->finished = true;
+            return false;
+        }
+    }
+    if (decoder->decoded - decoder->output_count > frame) {
+        return false;
+    }
+
+    // the frames before it in the last packet are dropped
+    int skipped = decoder->output_count - (int)(decoder->decoded - frame);
+    decoder->output_offset = skipped;
+    decoder->output_count -= skipped;
+    return true;
+}
+
+
+bool seek_vorbis(VorbisDecoder *decoder, Uint32 frame)
+{
+    if (decoder->total_frames && frame > decoder->total_frames) {
+        return false;
+    }
+
+    // two pages with a granule back from the frame, the first packets read
+    // from there only fill the overlap and find the position again
+    const Uint8 *data = decoder->reader.data;
+    int size = decoder->reader.size;
+    int pages[2] = { decoder->audio_page, decoder->audio_page };
+    int page = decoder->audio_page;
+    for (int page_size; (page_size = get_ogg_page_size(data, size, page)) != 0; page += page_size) {
+        Uint64 granule = get_ogg_page_granule(data, page);
+        if (granule == ~(Uint64)0) {
+            continue;
+        }
+        if (granule > frame) {
+            break;
+        }
+        pages[0] = pages[1];
+        pages[1] = page;
+    }
+
+    // a page can't always be decoded from, one long packet can span past the frame
+    if (pages[0] != decoder->audio_page && decode_to_frame(decoder, pages[0], frame)) {
+        return true;
+    }
+    return decode_to_frame(decoder, decoder->audio_page, frame);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "types.h"
+
+// Ogg Vorbis, decoded straight out of memory, usually a FileView of the pack.
+// The decoder, its tables and its block buffers are all carved out of the
+// memory handed to open_vorbis, so opening and decoding never touch the heap.
+// Floor 0, which no current encoder writes, and chained streams aren't
+// supported, the first logical stream in the file is the one played.
+#define VORBIS_MAX_CHANNELS 8
+#define VORBIS_MAX_BLOCKSIZE 8192
+#define VORBIS_FLOOR1_MAX_VALUES 256
+#define VORBIS_MAX_SUBMAPS 16
+
+// codes up to this long are looked up in one go, longer ones are searched for
+#define VORBIS_FAST_BITS 10
+
+enum VORBIS_ERROR {
+    VORBIS_OK,
+    VORBIS_ERROR_NOT_VORBIS,    // no Ogg pages, or no Vorbis headers in them
+    VORBIS_ERROR_CORRUPT,       // headers that don't add up
+    VORBIS_ERROR_UNSUPPORTED,   // floor 0, too many channels, blocks too large
+    VORBIS_ERROR_MEMORY,        // the tables didn't fit in the memory given
+};
+
+// Ogg pages and the packets laced across them, read a few bits at a time.
+// Vorbis packs its fields least significant bit first.
+struct VorbisReader {
+    const Uint8 *data;
+    int size;
+
+    int page;                   // offset of the page being read
+    int next_page;              // offset of the one after it, size once there is none
+    Uint64 granule;             // of the page being read
+    int segment_count;
+    int segment;                // index of the segment being read
+    const Uint8 *lacing;
+    int offset;                 // next byte
+    int segment_end;            // one past the segment's last byte
+    bool packet_done;           // the segment being read closes its packet
+
+    Uint64 bits;
+    int bit_count;
+    int padding;                // zero bits at the top of bits, read past the packet's end
+    bool overrun;               // a read that went into the padding
+};
+
+struct VorbisCodebook {
+    int dimensions;
+    int entries;
+    Uint8 *lengths;             // of each entry's codeword, 0 when it isn't used
+    int single_entry;           // the only entry used, -1 otherwise
+
+    // every used codeword msb first and left aligned, sorted, searched for codes
+    // longer than the fast table. the fast table is indexed by the next bits of
+    // the packet in stream order and holds positions in the sorted list, -1
+    // where the code is longer
+    int sorted_count;
+    Uint32 *sorted_codes;
+    int *sorted_entries;
+    int fast_bits;
+    Sint16 *fast;
+
+    float *vectors;             // dimensions floats per used entry, in sorted order, null without a lookup
+};
+
+struct VorbisFloor {
+    int partitions;
+    Uint8 partition_class[32];
+    Uint8 class_dimensions[16];
+    Uint8 class_subclasses[16];
+    Sint16 class_masterbook[16];
+    Sint16 subclass_books[16][8];
+    int multiplier;
+    int range;
+    int y_bits;
+
+    int values;
+    Uint16 x[VORBIS_FLOOR1_MAX_VALUES];
+    Uint8 sorted[VORBIS_FLOOR1_MAX_VALUES];     // indices in order of x
+    Uint8 low[VORBIS_FLOOR1_MAX_VALUES];        // the neighbours each value is predicted from
+    Uint8 high[VORBIS_FLOOR1_MAX_VALUES];
+};
+
+struct VorbisResidue {
+    int type;
+    Uint32 begin;
+    Uint32 end;
+    int partition_size;
+    int classifications;
+    int classbook;
+    Sint16 books[64][8];        // per classification and pass, -1 where there is none
+};
+
+struct VorbisMapping {
+    int submaps;
+    int coupling_steps;
+    Uint8 magnitude[256];
+    Uint8 angle[256];
+    Uint8 mux[VORBIS_MAX_CHANNELS];
+    Uint8 submap_floor[VORBIS_MAX_SUBMAPS];
+    Uint8 submap_residue[VORBIS_MAX_SUBMAPS];
+};
+
+struct VorbisMode {
+    int blockflag;
+    int mapping;
+};
+
+// the inverse MDCT of one block size, as a quarter size complex FFT
+struct VorbisTransform {
+    int n;
+    float *pre_twiddle;         // complex, n/4 each
+    float *post_twiddle;
+    float *fft_twiddle;         // complex, n/8
+    int *bit_reverse;           // n/4
+    float *slope;               // the rising half of the window over n/2 samples
+};
+
+struct VorbisDecoder {
+    VorbisReader reader;
+    int channels;
+    int sample_rate;
+    int blocksizes[2];
+    Uint32 total_frames;        // from the last page, 0 when the file doesn't say
+
+    int codebook_count;
+    VorbisCodebook *codebooks;
+    int floor_count;
+    VorbisFloor *floors;
+    int residue_count;
+    VorbisResidue *residues;
+    int mapping_count;
+    VorbisMapping *mappings;
+    int mode_count;
+    int mode_bits;
+    VorbisMode *modes;
+
+    VorbisTransform transforms[2];
+    float *floor_db;            // floor1 amplitudes, 256 of them
+    float *scratch;             // the transform's complex buffer, then the windowed block
+
+    // where the first audio packet starts, a seek to 0 starts over from there
+    int audio_page;
+
+    // per channel
+    float *spectrum[VORBIS_MAX_CHANNELS];
+    float *previous[VORBIS_MAX_CHANNELS];       // the right half of the last block, windowed
+    float *output[VORBIS_MAX_CHANNELS];
+    bool floor_used[VORBIS_MAX_CHANNELS];
+    Sint16 floor_y[VORBIS_MAX_CHANNELS][VORBIS_FLOOR1_MAX_VALUES];
+    Uint8 *classifications[VORBIS_MAX_CHANNELS];
+    int max_partitions;
+    int previous_size;          // 0 before the first block
+
+    // frames decoded and not handed out yet are output[offset, offset + count)
+    int output_offset;
+    int output_count;
+    Uint32 decoded;             // frames decoded so far, handed out or not
+    bool finished;
+
+    // after a seek into the middle of the stream, until a page's granule says
+    // where the decoder is. what's decoded before then is thrown away
+    bool position_lost;
+
+    Uint8 *memory;
+    int memory_size;
+    int memory_used;
+};
+
+// Null when it can't be decoded, error says why. memory has to outlive the decoder.
+VorbisDecoder *open_vorbis(const Uint8 *data, int size, void *memory, int memory_size, int *error);
+const char *get_vorbis_error_name(int error);
+
+// Fills up to frame_count interleaved frames of channels each, extra channels
+// are silent. Fewer at the end of the stream, 0 past it.
+int decode_vorbis_frames(VorbisDecoder *decoder, float *output, int channels, int frame_count);
+
+// Frame accurate. Starts a couple of pages ahead of the frame and decodes up
+// to it, from the start of the stream when the pages don't say where they are.
+bool seek_vorbis(VorbisDecoder *decoder, Uint32 frame);
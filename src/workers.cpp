@@ -0,0 +1,136 @@
+#include "workers.hpp"
+
+// the game and render threads keep a core each, loader, audio and log mostly sleep
+#define WORKER_RESERVED_CPUS 2
+
+static void run_chunks(WorkerPool *pool)
+{
+    for (;;) {
+        int chunk = SDL_AtomicAdd(&pool->next_chunk, 1);
+        if (chunk >= pool->chunk_count) {
+            break;
+        }
+
+        int first = chunk*pool->chunk_size;
+        int count = pool->count - first < pool->chunk_size ? pool->count - first : pool->chunk_size;
+        pool->run(pool->data, first, count);
+    }
+}
+
+
+static int SDLCALL worker_thread_main(void *data)
+{
+    WorkerPool *pool = (WorkerPool *)data;
+
+    for (;;) {
+        SDL_SemWait(pool->start);
+
+        if (SDL_AtomicGet(&pool->quit)) {
+            break;
+        }
+
+        run_chunks(pool);
+        SDL_SemPost(pool->finished);
+    }
+
+    return 0;
+}
+
+
+void init_worker_pool(WorkerPool *pool, int thread_count)
+{
+    if (pool == nullptr) {
+        LOG_ERROR(LOG_CORE, "worker pool is null");
+        exit(1);
+    }
+
+    memset(pool, 0, sizeof(WorkerPool));
+
+    if (thread_count < 0) {
+        thread_count = SDL_GetCPUCount() - WORKER_RESERVED_CPUS;
+    }
+    thread_count = thread_count < WORKER_MAX_THREADS ? thread_count : WORKER_MAX_THREADS;
+
+    if (thread_count > 0) {
+        pool->start = SDL_CreateSemaphore(0);
+        pool->finished = SDL_CreateSemaphore(0);
+
+        if (pool->start == nullptr || pool->finished == nullptr) {
+            LOG_ERROR(LOG_CORE, "Could not create the worker semaphores: %s", SDL_GetError());
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < thread_count; ++i) {
+        pool->threads[pool->thread_count] = SDL_CreateThread(worker_thread_main, "worker", pool);
+
+        if (pool->threads[pool->thread_count] == nullptr) {
+            LOG_WARN(LOG_CORE, "Could not start worker thread %d: %s", i, SDL_GetError());
+            break;
+        }
+        pool->thread_count += 1;
+    }
+
+    LOG_INFO(LOG_CORE, "Worker pool: %d threads", pool->thread_count);
+}
+
+
+void shutdown_worker_pool(WorkerPool *pool)
+{
+    SDL_AtomicSet(&pool->quit, 1);
+    for (int i = 0; i < pool->thread_count; ++i) {
+        SDL_SemPost(pool->start);
+    }
+    for (int i = 0; i < pool->thread_count; ++i) {
+        SDL_WaitThread(pool->threads[i], nullptr);
+    }
+
+    if (pool->start) {
+        SDL_DestroySemaphore(pool->start);
+        SDL_DestroySemaphore(pool->finished);
+    }
+
+    WorkerPoolStats *stats = &pool->stats;
+    LOG_INFO(LOG_CORE, "Worker pool: %d jobs, %d of them spread over threads, %d chunks",
+             stats->jobs, stats->parallel_jobs, stats->chunks);
+
+    memset(pool, 0, sizeof(WorkerPool));
+}
+
+
+void run_parallel(WorkerPool *pool, int count, int chunk_size, WorkerChunkFunc run, void *data)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    int chunk_count = (count + chunk_size - 1)/chunk_size;
+    pool->stats.jobs += 1;
+    pool->stats.chunks += chunk_count;
+
+    // waking a thread costs more than a chunk it would take
+    int helpers = chunk_count - 1 < pool->thread_count ? chunk_count - 1 : pool->thread_count;
+    if (helpers == 0) {
+        run(data, 0, count);
+        return;
+    }
+
+    pool->run = run;
+    pool->data = data;
+    pool->count = count;
+    pool->chunk_size = chunk_size;
+    pool->chunk_count = chunk_count;
+    SDL_AtomicSet(&pool->next_chunk, 0);
+
+    for (int i = 0; i < helpers; ++i) {
+        SDL_SemPost(pool->start);
+    }
+
+    run_chunks(pool);
+
+    for (int i = 0; i < helpers; ++i) {
+        SDL_SemWait(pool->finished);
+    }
+
+    pool->stats.parallel_jobs += 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "types.h"
+
+// A few threads kept around for work that splits into chunks inside a
+// frame, like filling instance data. run_parallel hands out the chunks, the
+// calling thread takes them too, and returns once every chunk is done, so to
+// the caller it is a plain loop. Chunks have to be independent, each one only
+// writes its own range. One caller at a time.
+//
+// A job with a single chunk, or a pool without threads, runs in line.
+#define WORKER_MAX_THREADS 8
+
+typedef void (*WorkerChunkFunc)(void *data, int first, int count);
+
+struct WorkerPoolStats {
+    int jobs;
+    int parallel_jobs;          // the ones that woke at least one thread
+    int chunks;
+};
+
+struct WorkerPool {
+    int thread_count;
+    SDL_Thread *threads[WORKER_MAX_THREADS];
+
+    SDL_sem *start;             // a post per thread a job wakes
+    SDL_sem *finished;          // a post back from each of them
+    SDL_atomic_t quit;
+
+    // the job in progress, set before the posts
+    WorkerChunkFunc run;
+    void *data;
+    int count;
+    int chunk_size;
+    int chunk_count;
+    SDL_atomic_t next_chunk;
+
+    WorkerPoolStats stats;
+};
+
+// thread_count below 0 picks one from the CPU count, 0 runs everything in line
+void init_worker_pool(WorkerPool *pool, int thread_count);
+
+// logs what it ran
+void shutdown_worker_pool(WorkerPool *pool);
+
+// run(data, first, count) over [0, count) in chunks of chunk_size
+void run_parallel(WorkerPool *pool, int count, int chunk_size, WorkerChunkFunc run, void *data);